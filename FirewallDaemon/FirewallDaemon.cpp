@@ -4,6 +4,8 @@
 #include <chrono>
 #include <string>
 #include <atomic>
+#include <algorithm>
+#include <ctime>
 #include "rule_manager.h"
 #include "wfp_manager.h"
 
@@ -26,6 +28,7 @@ inline const char* ProtoToString(Protocol proto) {
     case Protocol::TCP: return "TCP";
     case Protocol::UDP: return "UDP";
     case Protocol::ICMP: return "ICMP";
+    case Protocol::ICMPV6: return "ICMPv6";
     default: return "UNKNOWN";
     }
 }
@@ -38,7 +41,16 @@ inline const char* DirToString(RuleDirection dir) {
     }
 }
 
-void PrintActiveRules(const std::vector<Rule>& rules) {
+std::string FormatHitTime(time_t t) {
+    if (t == 0) return "never";
+    struct tm timeinfo;
+    if (localtime_s(&timeinfo, &t) != 0) return "?";
+    char buf[64];
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &timeinfo);
+    return buf;
+}
+
+void PrintActiveRules(const std::vector<Rule>& rules, const std::unordered_map<int, RuleHitStats>& stats) {
     std::cout << "[FirewallDaemon] Active rules on start:" << std::endl;
     int idx = 1;
     for (const auto& rule : rules) {
@@ -57,6 +69,11 @@ void PrintActiveRules(const std::vector<Rule>& rules) {
                 std::cout << ", App: " << rule.appPath;
             if (!rule.description.empty())
                 std::cout << ", Desc: " << rule.description;
+            auto it = stats.find(rule.id);
+            RuleHitStats st = it != stats.end() ? it->second : RuleHitStats();
+            std::cout << ", Hits: " << st.packets
+                << ", Bytes: " << st.bytes
+                << ", Last hit: " << FormatHitTime(st.lastHit);
             std::cout << ", ENABLED" << std::endl;
         }
     }
@@ -64,6 +81,83 @@ void PrintActiveRules(const std::vector<Rule>& rules) {
         std::cout << "No active rules." << std::endl;
 }
 
+//  :     ,     
+void PrintRuleStats(const std::vector<Rule>& rules, const std::unordered_map<int, RuleHitStats>& stats) {
+    std::vector<std::pair<const Rule*, RuleHitStats>> hit;
+    std::vector<const Rule*> neverHit;
+    for (const auto& rule : rules) {
+        if (!rule.enabled) continue;
+        auto it = stats.find(rule.id);
+        if (it != stats.end() && it->second.packets > 0)
+            hit.push_back({ &rule, it->second });
+        else
+            neverHit.push_back(&rule);
+    }
+    std::sort(hit.begin(), hit.end(), [](const auto& a, const auto& b) {
+        return a.second.packets > b.second.packets;
+        });
+
+    std::cout << "[FirewallDaemon] Rule hit stats: " << hit.size() << " matched, "
+        << neverHit.size() << " never matched" << std::endl;
+    for (const auto& entry : hit) {
+        std::cout << "  ID " << entry.first->id << " (" << entry.first->name << "): "
+            << entry.second.packets << " pkts, " << entry.second.bytes << " bytes, last "
+            << FormatHitTime(entry.second.lastHit) << std::endl;
+    }
+    for (const Rule* rule : neverHit) {
+        std::cout << "  ID " << rule->id << " (" << rule->name << "): never matched" << std::endl;
+    }
+}
+
+//   :        
+void PrintRuleAnalysis(const RuleAnalysis& analysis, bool minimized) {
+    std::cout << "[FirewallDaemon] Rule analysis: " << analysis.enabledBefore << " enabled -> "
+        << analysis.enabledAfter << " after minimization ("
+        << analysis.Count(RuleFindingKind::Redundant) << " redundant, "
+        << analysis.Count(RuleFindingKind::Shadowed) << " shadowed, "
+        << analysis.Count(RuleFindingKind::Merged) << " merged)"
+        << (minimized ? ", minimized set applied" : "") << std::endl;
+    for (const auto& finding : analysis.findings) {
+        std::cout << "  ID " << finding.ruleId << ": " << RuleFindingKindToString(finding.kind)
+            << (finding.kind == RuleFindingKind::Merged ? " into ID " : " by ID ")
+            << finding.otherRuleId << std::endl;
+    }
+}
+
+//    :      , 
+//   API (SwitchProfile) ,       .
+//     matcher   WFP   
+void SelectProfile(RuleManager& ruleManager, WfpFilterManager& wfpManager, std::string& detected) {
+    std::string profile = ruleManager.ProfileForAddresses(WfpFilterManager::LocalAddresses());
+    if (profile.empty() || profile == detected) return;
+    detected = profile;
+    if (profile == ruleManager.GetActiveProfile()) return;
+    auto start = std::chrono::steady_clock::now();
+    ruleManager.SwitchProfile(profile);
+    wfpManager.ApplyRules(ruleManager.GetEffectiveRules());
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[FirewallDaemon] Network matches profile " << profile << ", switched in " << ms << " ms" << std::endl;
+}
+
+//    ,    WFP:   ApplyRules  
+//     ,    
+void BuildScheduleWheel(const std::vector<Rule>& rules, ScheduleWheel& wheel) {
+    wheel.Clear();
+    for (const auto& rule : rules) {
+        std::shared_ptr<const WeekSchedule> schedule;
+        if (rule.enabled && WeekSchedule::Parse(rule.schedule, schedule) && schedule) wheel.Add(rule.id, *schedule);
+    }
+    wheel.Start(ScheduleClock::Instance().Minute());
+}
+
+//  ,   GUI,    profiles.json  rules.json: matcher
+//      ,     
+void ReloadRules(RuleManager& ruleManager, WfpFilterManager& wfpManager, std::string& detectedProfile) {
+    if (ruleManager.LoadFilterMode()) wfpManager.SetFilterMode(ruleManager.GetFilterMode());
+    if (ruleManager.LoadProfiles()) SelectProfile(ruleManager, wfpManager, detectedProfile);
+    else ruleManager.LoadRulesFromFile(RULES_FILE);
+}
+
 //     
 std::atomic<bool> g_stopFlag(false);
 
@@ -104,13 +198,33 @@ BOOL WINAPI CtrlHandler(DWORD fdwCtrlType)
     return FALSE; //    
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // --minimize:  WFP       
+    // --whitelist:   ,   ; --blacklist   
+    // .    ,  GUI (filter_mode.json)
+    // --profile <>:    profiles.json   (    )
+    bool minimizeRules = false;
+    FilterMode filterMode = FilterMode::BLACKLIST;
+    bool filterModeSet = false;
+    std::string startProfile;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--minimize") minimizeRules = true;
+        if (std::string(argv[i]) == "--whitelist" || std::string(argv[i]) == "--blacklist") {
+            filterMode = std::string(argv[i]) == "--whitelist" ? FilterMode::WHITELIST : FilterMode::BLACKLIST;
+            filterModeSet = true;
+        }
+        if (std::string(argv[i]) == "--profile" && i + 1 < argc) startProfile = argv[++i];
+    }
+
     HANDLE hMutex = CreateMutexA(NULL, TRUE, "Global\\WindowsFirewallDaemon");
     HANDLE hStopEvent = CreateEventW(NULL, TRUE, FALSE, L"Global\\FirewallDaemonStopEvent");
     if (GetLastError() == ERROR_ALREADY_EXISTS) {
         std::cout << "Daemon already running.\n";
         return 1;
     }
+    // GUI       :      
+    //  filter_mode.json  ,    
+    HANDLE hRulesEvent = CreateEventW(NULL, FALSE, FALSE, L"Global\\FirewallDaemonRulesChangedEvent");
 
     //   
     SetConsoleCtrlHandler(CtrlHandler, TRUE);
@@ -130,7 +244,18 @@ int main() {
     std::cout << "Firewall daemon started, using WFP.\n";
 
     //  
-    ruleManager.LoadRulesFromFile(RULES_FILE);
+    ruleManager.SetMinimizeRules(minimizeRules);
+    if (!filterModeSet) filterMode = ruleManager.GetFilterMode();
+    ruleManager.SetFilterMode(filterMode);
+    wfpManager.SetFilterMode(filterMode);
+    bool profiles = ruleManager.LoadProfiles();
+    if (!profiles) ruleManager.LoadRulesFromFile(RULES_FILE);
+    std::string detectedProfile;
+    if (profiles && !startProfile.empty()) {
+        if (ruleManager.SwitchProfile(startProfile)) detectedProfile = ruleManager.ProfileForAddresses(WfpFilterManager::LocalAddresses());
+        else std::cerr << "Unknown rule profile: " << startProfile << std::endl;
+    }
+    if (profiles) std::cout << "Rule profile: " << ruleManager.GetActiveProfile() << std::endl;
     const auto& rules = ruleManager.GetRules();
 
     //      enabled-
@@ -140,15 +265,54 @@ int main() {
     }
 
     // >>>      
-    PrintActiveRules(rules);
-    wfpManager.ApplyRules(rules);
+    ruleManager.LoadRuleStats();
+    PrintActiveRules(rules, ruleManager.GetRuleStats());
+    PrintRuleAnalysis(ruleManager.AnalyzeRules(), minimizeRules);
+    wfpManager.ApplyRules(ruleManager.GetEffectiveRules());
 
     //      
+    ScheduleWheel scheduleWheel;
+    std::vector<int> dueRules;
     while (!g_stopFlag) {
-        ruleManager.LoadRulesFromFile(RULES_FILE);
-        wfpManager.ApplyRules(ruleManager.GetRules());
+        ReloadRules(ruleManager, wfpManager, detectedProfile);
+        ScheduleClock::Instance().Refresh();
+        std::vector<Rule> effective = ruleManager.GetEffectiveRules();
+        wfpManager.ApplyRules(effective);
+        BuildScheduleWheel(effective, scheduleWheel);
+        //   GUI (  ),    
+        ruleManager.LoadRuleStats();
+        PrintRuleStats(ruleManager.GetRules(), ruleManager.GetRuleStats());
         for (int i = 0; i < CHECK_INTERVAL_SECONDS && !g_stopFlag; ++i) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+            if (WaitForSingleObject(hRulesEvent, 1000) == WAIT_OBJECT_0) {
+                //      GUI    matcher;  
+                //   ,   WFP     
+                auto start = std::chrono::steady_clock::now();
+                bool modeChanged = ruleManager.LoadFilterMode();
+                if (modeChanged) wfpManager.SetFilterMode(ruleManager.GetFilterMode());
+                size_t added = ruleManager.LoadAddedRules();
+                if (added == 0 && !modeChanged) continue;
+                effective = ruleManager.GetEffectiveRules();
+                wfpManager.ApplyRules(effective);
+                BuildScheduleWheel(effective, scheduleWheel);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (modeChanged) std::cout << "[FirewallDaemon] Filter mode changed by GUI" << std::endl;
+                std::cout << "[FirewallDaemon] Rules added by GUI: " << added << ", applied in " << ms << " ms" << std::endl;
+                continue;
+            }
+            //   : WFP    
+            if (size_t expired = ruleManager.ExpireRules()) {
+                std::cout << "[FirewallDaemon] Temporary rules expired: " << expired << std::endl;
+                effective = ruleManager.GetEffectiveRules();
+                wfpManager.ApplyRules(effective);
+                BuildScheduleWheel(effective, scheduleWheel);
+            }
+            //      ; WFP ,   
+            //   
+            if (!ScheduleClock::Instance().Refresh() || scheduleWheel.Empty()) continue;
+            scheduleWheel.Advance(ScheduleClock::Instance().Minute(), dueRules);
+            if (dueRules.empty()) continue;
+            std::cout << "[FirewallDaemon] Schedule boundary for " << dueRules.size() << " rule(s)" << std::endl;
+            wfpManager.ApplyRules(effective);
         }
         DWORD waitResult = WaitForSingleObject(hStopEvent, CHECK_INTERVAL_MILLISECONDS);
         if (waitResult == WAIT_OBJECT_0) {
@@ -162,6 +326,7 @@ int main() {
     if (g_wfpManager) {
         g_wfpManager->RemoveAllRules();
     }
+    CloseHandle(hRulesEvent);
     CloseHandle(hStopEvent);
     ReleaseMutex(hMutex);
     CloseHandle(hMutex);
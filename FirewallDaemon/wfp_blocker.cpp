@@ -88,6 +88,7 @@ bool WfpBlocker::AddNetworkRule(const Rule& rule) {
         case Protocol::TCP: condition.conditionValue.uint8 = IPPROTO_TCP; break;
         case Protocol::UDP: condition.conditionValue.uint8 = IPPROTO_UDP; break;
         case Protocol::ICMP: condition.conditionValue.uint8 = IPPROTO_ICMP; break;
+        case Protocol::ICMPV6: condition.conditionValue.uint8 = IPPROTO_ICMPV6; break;
         default: break;
         }
         conditions.push_back(condition);
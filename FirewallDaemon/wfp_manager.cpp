@@ -4,14 +4,23 @@
 #include <initguid.h>
 #include <fwpmu.h>
 #include <ws2tcpip.h>
+#include <iphlpapi.h>
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <chrono>
 #include "string_utils.h"
 #include "firewall_logger.h"
+#include "rule_matcher.h"
+#include "app_identity.h"
+#include "domain_table.h"
+#include "address_list.h"
+#include "ip_utils.h"
+#include "rule_schedule.h"
 
 #pragma comment(lib, "fwpuclnt.lib")
 #pragma comment(lib, "Ws2_32.lib")
+#pragma comment(lib, "iphlpapi.lib")
 
 WfpFilterManager::WfpFilterManager() : engineHandle(nullptr) {}
 
@@ -41,91 +50,25 @@ bool WfpFilterManager::Initialize() {
     return true;
 }
 
-struct ResolvedIPs {
-    bool success;
-    std::vector<std::string> ipAddresses;
-    std::string error;
-};
-
-ResolvedIPs ResolveDomain(const std::string& domain) {
-    ResolvedIPs result;
-    result.success = false;
-
-    std::cout << "[DNS] Starting resolution for domain: " << domain << std::endl;
-
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        result.error = "Failed to initialize WinSock";
-        std::cerr << "[DNS] " << result.error << std::endl;
-        return result;
-    }
-
-    try {
-        struct addrinfo hints = { 0 };
-        struct addrinfo* addrs = nullptr;
-
-        //    IPv4 
-        hints.ai_family = AF_INET;        //  IPv4
-        hints.ai_socktype = SOCK_STREAM;  // TCP
-        hints.ai_protocol = IPPROTO_TCP;  // TCP 
-        hints.ai_flags = AI_CANONNAME;    //   
-
-        std::cout << "[DNS] Calling getaddrinfo for " << domain << std::endl;
-
-        int status = getaddrinfo(domain.c_str(), nullptr, &hints, &addrs);
-        if (status != 0) {
-            char msgbuf[256];
-            sprintf_s(msgbuf, "Failed to resolve domain. Error code: %d, WSAError: %d", 
-                     status, WSAGetLastError());
-            result.error = msgbuf;
-            std::cerr << "[DNS] " << result.error << std::endl;
-            WSACleanup();
-            return result;
-        }
-
-        //    
-        for (struct addrinfo* addr = addrs; addr != nullptr; addr = addr->ai_next) {
-            char ipstr[INET_ADDRSTRLEN];
-            void* ptr = &((struct sockaddr_in*)addr->ai_addr)->sin_addr;
-            
-            //  IP  
-            if (inet_ntop(AF_INET, ptr, ipstr, sizeof(ipstr))) {
-                std::string ip = ipstr;
-                std::cout << "[DNS] Found IP: " << ip << std::endl;
-                
-                // ,       IP
-                if (std::find(result.ipAddresses.begin(), result.ipAddresses.end(), ip) 
-                    == result.ipAddresses.end()) {
-                    result.ipAddresses.push_back(ip);
-                }
-            }
-            
-            //   ,  
-            if (addr->ai_canonname) {
-                std::cout << "[DNS] Canonical name: " << addr->ai_canonname << std::endl;
-            }
-        }
-
-        freeaddrinfo(addrs);
-        
-        if (result.ipAddresses.empty()) {
-            result.error = "No IPv4 addresses found";
-            result.success = false;
-            std::cerr << "[DNS] " << result.error << std::endl;
-        } else {
-            result.success = true;
-            std::cout << "[DNS] Successfully resolved " << result.ipAddresses.size() 
-                     << " unique IPv4 addresses" << std::endl;
+// ,      ("example.com", "*.example.com"),
+//    IpDomainTable.      ApplyRules,
+//     CDN  .
+static std::vector<std::string> AddressesForDomain(const std::string& pattern) {
+    DomainTrie trie;
+    std::vector<std::string> addresses;
+    if (!trie.Add(pattern)) return addresses;
+
+    std::vector<uint32_t> hits;
+    for (const auto& entry : IpDomainTable::Instance().Snapshot()) {
+        hits.clear();
+        trie.Match(entry.second, hits);
+        if (hits.empty()) continue;
+        std::string ip = FormatIPv4(entry.first);
+        if (std::find(addresses.begin(), addresses.end(), ip) == addresses.end()) {
+            addresses.push_back(ip);
         }
     }
-    catch (const std::exception& e) {
-        result.error = "Exception during DNS resolution: " + std::string(e.what());
-        result.success = false;
-        std::cerr << "[DNS] " << result.error << std::endl;
-    }
-
-    WSACleanup();
-    return result;
+    return addresses;
 }
 
 void WfpFilterManager::RemoveAllRules() {
@@ -143,6 +86,7 @@ void WfpFilterManager::RemoveAllRules() {
         return;
     }
 
+    for (const auto& kv : appliedFilters) addedFilterIds.insert(addedFilterIds.end(), kv.second.filterIds.begin(), kv.second.filterIds.end());
     for (UINT64 id : addedFilterIds) {
         DWORD res = FwpmFilterDeleteById(engineHandle, id);
         if (res == ERROR_SUCCESS) {
@@ -159,6 +103,7 @@ void WfpFilterManager::RemoveAllRules() {
     }
 
     addedFilterIds.clear();
+    appliedFilters.clear();
 }
 
 UINT8 WfpFilterManager::ProtocolToNumber(Protocol proto) {
@@ -166,6 +111,7 @@ UINT8 WfpFilterManager::ProtocolToNumber(Protocol proto) {
     case Protocol::TCP: return 6;
     case Protocol::UDP: return 17;
     case Protocol::ICMP: return 1;
+    case Protocol::ICMPV6: return 58;
     default: return 0; // ANY
     }
 }
@@ -175,6 +121,7 @@ std::string WfpFilterManager::ProtocolToString(Protocol proto) {
     case Protocol::TCP: return "TCP";
     case Protocol::UDP: return "UDP";
     case Protocol::ICMP: return "ICMP";
+    case Protocol::ICMPV6: return "ICMPv6";
     default: return "ANY";
     }
 }
@@ -221,7 +168,159 @@ bool WfpFilterManager::MakeAppIdBlob(const std::string& appPath, std::vector<uin
     return false;
 }
 
-bool WfpFilterManager::AddRule(const Rule& rule, bool isChildRule = false) {
+void WfpFilterManager::AppendProtocolCondition(const Rule& rule, std::vector<FWPM_FILTER_CONDITION0>& conditions) {
+    if (rule.protocol == Protocol::ANY) return;
+    FWPM_FILTER_CONDITION0 condition = { 0 };
+    condition.fieldKey = FWPM_CONDITION_IP_PROTOCOL;
+    condition.matchType = FWP_MATCH_EQUAL;
+    condition.conditionValue.type = FWP_UINT8;
+    condition.conditionValue.uint8 = ProtocolToNumber(rule.protocol);
+    conditions.push_back(condition);
+}
+
+//    IPv4-; nullptr    
+static const IP_ADAPTER_ADDRESSES* ListAdapters(std::vector<uint8_t>& buffer) {
+    ULONG size = 16 * 1024;
+    ULONG result = ERROR_BUFFER_OVERFLOW;
+    while (result == ERROR_BUFFER_OVERFLOW) {
+        buffer.resize(size);
+        result = GetAdaptersAddresses(AF_INET,
+            GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_DNS_SERVER, nullptr,
+            reinterpret_cast<IP_ADAPTER_ADDRESSES*>(buffer.data()), &size);
+    }
+    return result == NO_ERROR ? reinterpret_cast<const IP_ADAPTER_ADDRESSES*>(buffer.data()) : nullptr;
+}
+
+static uint32_t HostOrderAddress(const SOCKET_ADDRESS& address) {
+    return ntohl(reinterpret_cast<const sockaddr_in*>(address.lpSockaddr)->sin_addr.s_addr);
+}
+
+// ,   IPv4-   (  ,  PacketInfo::adapterIp)
+bool WfpFilterManager::InterfaceForAdapter(uint32_t adapterIp, UINT64& luid) {
+    std::vector<uint8_t> buffer;
+    for (auto* adapter = ListAdapters(buffer); adapter; adapter = adapter->Next) {
+        for (auto* unicast = adapter->FirstUnicastAddress; unicast; unicast = unicast->Next) {
+            if (unicast->Address.lpSockaddr->sa_family != AF_INET) continue;
+            if (HostOrderAddress(unicast->Address) != adapterIp) continue;
+            luid = adapter->Luid.Value;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<uint32_t> WfpFilterManager::LocalAddresses() {
+    std::vector<uint8_t> buffer;
+    std::vector<uint32_t> addresses;
+    for (auto* adapter = ListAdapters(buffer); adapter; adapter = adapter->Next) {
+        if (adapter->OperStatus != IfOperStatusUp) continue;
+        for (auto* unicast = adapter->FirstUnicastAddress; unicast; unicast = unicast->Next) {
+            if (unicast->Address.lpSockaddr->sa_family == AF_INET) addresses.push_back(HostOrderAddress(unicast->Address));
+        }
+    }
+    return addresses;
+}
+
+void WfpFilterManager::AppendInterfaceCondition(UINT64* luid, std::vector<FWPM_FILTER_CONDITION0>& conditions) {
+    if (!luid) return;
+    FWPM_FILTER_CONDITION0 condition = { 0 };
+    condition.fieldKey = FWPM_CONDITION_IP_LOCAL_INTERFACE;
+    condition.matchType = FWP_MATCH_EQUAL;
+    condition.conditionValue.type = FWP_UINT64;
+    condition.conditionValue.uint64 = luid;
+    conditions.push_back(condition);
+}
+
+//  ICMP:     ICMP_TYPE  ICMP_CODE   
+//   ,       .   
+//   ,    ,    
+bool WfpFilterManager::IcmpTypesExpressible(const Rule& rule) {
+    if (!rule.appPath.empty() || rule.protocol == Protocol::TCP || rule.protocol == Protocol::UDP) return false;
+    if (!RuleMatcher::ParsePorts(rule.sourcePortStr, rule.sourcePort).empty()
+        || !RuleMatcher::ParsePorts(rule.destPortStr, rule.destPort).empty()) {
+        return false;
+    }
+    std::vector<IcmpTypeMatch> types = RuleMatcher::ParseIcmpTypes(rule.icmpTypes);
+    bool hasCode = std::any_of(types.begin(), types.end(), [](const IcmpTypeMatch& t) { return t.code >= 0; });
+    return !hasCode || types.size() == 1;
+}
+
+//          ALE:   
+//     ,     .
+//         :      ALE
+GUID WfpFilterManager::RuleLayer(const Rule& rule, bool v6) const {
+    bool inbound = rule.direction == RuleDirection::Inbound;
+    bool newOnly = RuleMatcher::ParseConnectionStates(rule.connectionState) == static_cast<uint8_t>(ConnectionState::New);
+    if (newOnly || (filterMode == FilterMode::WHITELIST && rule.action == RuleAction::ALLOW)) {
+        if (v6) return inbound ? FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V6 : FWPM_LAYER_ALE_AUTH_CONNECT_V6;
+        return inbound ? FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4 : FWPM_LAYER_ALE_AUTH_CONNECT_V4;
+    }
+    if (v6) return inbound ? FWPM_LAYER_INBOUND_TRANSPORT_V6 : FWPM_LAYER_OUTBOUND_TRANSPORT_V6;
+    return inbound ? FWPM_LAYER_INBOUND_TRANSPORT_V4 : FWPM_LAYER_OUTBOUND_TRANSPORT_V4;
+}
+
+//     ICMP:  V4   ICMPv6
+void WfpFilterManager::AppendIcmpConditions(const Rule& rule, std::vector<FWPM_FILTER_CONDITION0>& conditions) {
+    std::vector<IcmpTypeMatch> types = RuleMatcher::ParseIcmpTypes(rule.icmpTypes);
+    if (types.empty()) return;
+    if (rule.protocol == Protocol::ANY) {
+        FWPM_FILTER_CONDITION0 condition = { 0 };
+        condition.fieldKey = FWPM_CONDITION_IP_PROTOCOL;
+        condition.matchType = FWP_MATCH_EQUAL;
+        condition.conditionValue.type = FWP_UINT8;
+        condition.conditionValue.uint8 = ProtocolToNumber(Protocol::ICMP);
+        conditions.push_back(condition);
+    }
+    for (const auto& type : types) {
+        FWPM_FILTER_CONDITION0 condition = { 0 };
+        condition.fieldKey = FWPM_CONDITION_ICMP_TYPE;
+        condition.matchType = FWP_MATCH_EQUAL;
+        condition.conditionValue.type = FWP_UINT16;
+        condition.conditionValue.uint16 = type.type;
+        conditions.push_back(condition);
+    }
+    if (types.size() == 1 && types[0].code >= 0) {
+        FWPM_FILTER_CONDITION0 condition = { 0 };
+        condition.fieldKey = FWPM_CONDITION_ICMP_CODE;
+        condition.matchType = FWP_MATCH_EQUAL;
+        condition.conditionValue.type = FWP_UINT16;
+        condition.conditionValue.uint16 = static_cast<UINT16>(types[0].code);
+        conditions.push_back(condition);
+    }
+}
+
+//   "80,443,1000-2000":    fieldKey WFP   .
+// portRanges   ,    
+void WfpFilterManager::AppendPortConditions(const Rule& rule, std::vector<FWPM_FILTER_CONDITION0>& conditions,
+    std::vector<FWP_RANGE0>& portRanges) {
+    std::vector<PortRange> ports = RuleMatcher::ParsePorts(rule.destPortStr, rule.destPort);
+    portRanges.reserve(ports.size());
+    for (const auto& port : ports) {
+        FWPM_FILTER_CONDITION0 condition = { 0 };
+        condition.fieldKey = (rule.direction == RuleDirection::Inbound)
+            ? FWPM_CONDITION_IP_LOCAL_PORT
+            : FWPM_CONDITION_IP_REMOTE_PORT;
+        if (port.low == port.high) {
+            condition.matchType = FWP_MATCH_EQUAL;
+            condition.conditionValue.type = FWP_UINT16;
+            condition.conditionValue.uint16 = port.low;
+        }
+        else {
+            FWP_RANGE0 range = { 0 };
+            range.valueLow.type = FWP_UINT16;
+            range.valueLow.uint16 = port.low;
+            range.valueHigh.type = FWP_UINT16;
+            range.valueHigh.uint16 = port.high;
+            portRanges.push_back(range);
+            condition.matchType = FWP_MATCH_RANGE;
+            condition.conditionValue.type = FWP_RANGE_TYPE;
+            condition.conditionValue.rangeValue = &portRanges.back();
+        }
+        conditions.push_back(condition);
+    }
+}
+
+bool WfpFilterManager::AddRule(const Rule& rule, UINT64 weight, bool isChildRule) {
     FirewallEvent event;
     event.type = FirewallEventType::RULE_ADDED;
     event.ruleName = rule.name;
@@ -246,10 +345,71 @@ bool WfpFilterManager::AddRule(const Rule& rule, bool isChildRule = false) {
         << "Dest IP/Domain: " << rule.destIp << std::endl
         << "Source Port: " << (rule.sourcePortStr.empty() ? std::to_string(rule.sourcePort) : rule.sourcePortStr) << std::endl
         << "Dest Port: " << (rule.destPortStr.empty() ? std::to_string(rule.destPort) : rule.destPortStr) << std::endl
-        << "App Path: " << rule.appPath << std::endl;
+        << "App Path: " << rule.appPath << std::endl
+        << "Adapter: " << (rule.adapter.empty() ? "any" : rule.adapter) << std::endl
+        << "Schedule: " << (rule.schedule.empty() ? "always" : rule.schedule) << std::endl
+        << "Expires: " << (rule.expiresAt == 0 ? "never" : "in " + std::to_string(rule.expiresAt - time(nullptr)) + " s") << std::endl;
+
+    //     ,  WFP   ALE  ;
+    //     
+    if (!rule.service.empty()) {
+        std::cout << "[WFP] Service rule is not expressible in WFP, skipped: " << rule.service << std::endl;
+        return true;
+    }
+
+    //        ;   
+    //    AddressLists
+    if (AddressLists::IsReference(rule.sourceIp) || AddressLists::IsReference(rule.destIp)) {
+        std::cout << "[WFP] Address list rule is not expressible in WFP, skipped: "
+            << rule.sourceIp << " -> " << rule.destIp << std::endl;
+        return true;
+    }
+
+    if (!rule.icmpTypes.empty() && !IcmpTypesExpressible(rule)) {
+        std::cout << "[WFP] ICMP type rule is not expressible in WFP, skipped: " << rule.icmpTypes << std::endl;
+        return true;
+    }
+
+    //  TCP  WFP ,      NEW (. RuleLayer);
+    //      ConnectionTracker
+    if (!rule.tcpFlags.empty()) {
+        std::cout << "[WFP] TCP flags rule is not expressible in WFP, skipped: " << rule.tcpFlags << std::endl;
+        return true;
+    }
+    uint8_t states = RuleMatcher::ParseConnectionStates(rule.connectionState);
+    if (states != 0 && states != static_cast<uint8_t>(ConnectionState::New)) {
+        std::cout << "[WFP] Connection state rule is not expressible in WFP, skipped: "
+            << rule.connectionState << std::endl;
+        return true;
+    }
+
+    //    ;   LUID ,    
+    // :      
+    UINT64 interfaceLuid = 0;
+    UINT64* adapterLuid = nullptr;
+    uint32_t adapterIp = RuleMatcher::CompileRule(rule).adapter;
+    if (!rule.adapter.empty() && adapterIp == 0) {
+        std::cout << "[WFP] Adapter is not an IPv4 address, skipped: " << rule.adapter << std::endl;
+        return true;
+    }
+    if (adapterIp != 0) {
+        if (!InterfaceForAdapter(adapterIp, interfaceLuid)) {
+            std::cout << "[WFP] No interface has address " << rule.adapter
+                << ", rule skipped until the next apply" << std::endl;
+            return true;
+        }
+        adapterLuid = &interfaceLuid;
+    }
 
     //     
     if (!rule.appPath.empty()) {
+        // ALE_APP_ID    ;      
+        //   
+        if (AppIdentityTable::Instance().ParseMatch(rule.appPath).kind != AppMatch::Kind::FullPath) {
+            std::cout << "[WFP] App rule by name or folder is not expressible in WFP, skipped: "
+                << rule.appPath << std::endl;
+            return true;
+        }
         std::vector<uint8_t> appIdBlob;
         if (!MakeAppIdBlob(rule.appPath, appIdBlob)) {
             std::cerr << "[WFP] Failed to create app ID blob" << std::endl;
@@ -276,8 +436,8 @@ bool WfpFilterManager::AddRule(const Rule& rule, bool isChildRule = false) {
             filter.displayData.name = const_cast<wchar_t*>(L"AppRule");
             filter.displayData.description = const_cast<wchar_t*>(L"Application filter rule");
             filter.action.type = (rule.action == RuleAction::BLOCK) ? FWP_ACTION_BLOCK : FWP_ACTION_PERMIT;
-            filter.weight.type = FWP_UINT8;
-            filter.weight.uint8 = 15;
+            filter.weight.type = FWP_UINT64;
+            filter.weight.uint64 = &weight;
             filter.flags = FWPM_FILTER_FLAG_CLEAR_ACTION_RIGHT;
 
             conditions[0].fieldKey = FWPM_CONDITION_ALE_APP_ID;
@@ -288,6 +448,13 @@ bool WfpFilterManager::AddRule(const Rule& rule, bool isChildRule = false) {
             conditions[0].conditionValue.byteBlob->data = appIdBlob.data();
 
             filter.numFilterConditions = 1;
+            if (adapterLuid) {
+                conditions[1].fieldKey = FWPM_CONDITION_IP_LOCAL_INTERFACE;
+                conditions[1].matchType = FWP_MATCH_EQUAL;
+                conditions[1].conditionValue.type = FWP_UINT64;
+                conditions[1].conditionValue.uint64 = adapterLuid;
+                filter.numFilterConditions = 2;
+            }
             filter.filterCondition = conditions;
 
             UINT64 filterId = 0;
@@ -307,55 +474,56 @@ bool WfpFilterManager::AddRule(const Rule& rule, bool isChildRule = false) {
         return true;
     }
 
-    //  IP-  
+    //      
     std::vector<std::string> sourceIPs;
     std::vector<std::string> destIPs;
 
-    if (!rule.sourceIp.empty() && rule.sourceIp != "0.0.0.0") {
-        IN_ADDR addr = { 0 };
-        if (InetPtonA(AF_INET, rule.sourceIp.c_str(), &addr) == 1) {
+    if (!RuleMatcher::ParseAddress(rule.sourceIp).any) {
+        if (!RuleMatcher::ParseAddress(rule.sourceIp).never) {
             sourceIPs.push_back(rule.sourceIp);
         }
         else {
-            auto resolved = ResolveDomain(rule.sourceIp);
-            if (resolved.success) {
-                sourceIPs = resolved.ipAddresses;
-                std::cout << "[WFP] Resolved source domain " << rule.sourceIp
-                    << " to " << resolved.ipAddresses.size() << " IPs" << std::endl;
-            }
-            else {
-                std::cerr << "[WFP] Failed to resolve source domain: " << resolved.error << std::endl;
-                return false;
+            sourceIPs = AddressesForDomain(rule.sourceIp);
+            if (sourceIPs.empty()) {
+                std::cout << "[WFP] No addresses known yet for source domain " << rule.sourceIp
+                    << ", rule skipped until the next apply" << std::endl;
+                return true;
             }
+            std::cout << "[WFP] Source domain " << rule.sourceIp
+                << " maps to " << sourceIPs.size() << " IPs" << std::endl;
         }
     }
 
-    if (!rule.destIp.empty() && rule.destIp != "0.0.0.0") {
-        IN_ADDR addr = { 0 };
-        if (InetPtonA(AF_INET, rule.destIp.c_str(), &addr) == 1) {
+    if (!RuleMatcher::ParseAddress(rule.destIp).any) {
+        if (!RuleMatcher::ParseAddress(rule.destIp).never) {
             destIPs.push_back(rule.destIp);
         }
         else {
-            auto resolved = ResolveDomain(rule.destIp);
-            if (resolved.success) {
-                destIPs = resolved.ipAddresses;
-                std::cout << "[WFP] Resolved destination domain " << rule.destIp
-                    << " to " << resolved.ipAddresses.size() << " IPs" << std::endl;
-            }
-            else {
-                std::cerr << "[WFP] Failed to resolve domain: " << resolved.error << std::endl;
-                return false;
+            destIPs = AddressesForDomain(rule.destIp);
+            if (destIPs.empty()) {
+                std::cout << "[WFP] No addresses known yet for destination domain " << rule.destIp
+                    << ", rule skipped until the next apply" << std::endl;
+                return true;
             }
+            std::cout << "[WFP] Destination domain " << rule.destIp
+                << " maps to " << destIPs.size() << " IPs" << std::endl;
         }
     }
 
+    //    IPv4,  ICMPv6    V6
+    if (rule.protocol == Protocol::ICMPV6 && (!sourceIPs.empty() || !destIPs.empty())) {
+        std::cout << "[WFP] ICMPv6 rule with IPv4 addresses is not expressible in WFP, skipped" << std::endl;
+        return true;
+    }
+
     //      IP-
     bool success = true;
     if (!destIPs.empty()) {
         for (const auto& destIP : destIPs) {
             FWPM_FILTER0 filter = { 0 };
-            FWPM_FILTER_CONDITION0 conditions[3] = { 0 }; //    
-            UINT32 condCount = 0;
+            std::vector<FWPM_FILTER_CONDITION0> conditions;
+            std::vector<FWP_RANGE0> portRanges;
+            FWP_V4_ADDR_AND_MASK addrAndMask = { 0 };
 
             //   GUID  
             GUID filterKey;
@@ -367,68 +535,40 @@ bool WfpFilterManager::AddRule(const Rule& rule, bool isChildRule = false) {
             filter.displayData.name = const_cast<wchar_t*>(L"DomainRule");
             filter.displayData.description = const_cast<wchar_t*>(L"Domain filter rule");
             filter.flags = FWPM_FILTER_FLAG_CLEAR_ACTION_RIGHT;
-            filter.weight.type = FWP_UINT8;
-            filter.weight.uint8 = 15;
+            filter.weight.type = FWP_UINT64;
+            filter.weight.uint64 = &weight;
 
             //  
-            filter.layerKey = (rule.direction == RuleDirection::Inbound)
-                ? FWPM_LAYER_INBOUND_TRANSPORT_V4
-                : FWPM_LAYER_OUTBOUND_TRANSPORT_V4;
-
-            //   
-            if (rule.protocol != Protocol::ANY) {
-                conditions[condCount].fieldKey = FWPM_CONDITION_IP_PROTOCOL;
-                conditions[condCount].matchType = FWP_MATCH_EQUAL;
-                conditions[condCount].conditionValue.type = FWP_UINT8;
-                conditions[condCount].conditionValue.uint8 = ProtocolToNumber(rule.protocol);
-                condCount++;
-            }
+            filter.layerKey = RuleLayer(rule, false);
 
-            //   IP-
-            IN_ADDR addr = { 0 };
-            if (InetPtonA(AF_INET, destIP.c_str(), &addr) == 1) {
-                conditions[condCount].fieldKey = (rule.direction == RuleDirection::Inbound)
+            AppendProtocolCondition(rule, conditions);
+            AppendInterfaceCondition(adapterLuid, conditions);
+
+            //   IP- (   a.b.c.d/n,   )
+            if (ParseIPv4Prefix(destIP, addrAndMask.addr, addrAndMask.mask)) {
+                FWPM_FILTER_CONDITION0 condition = { 0 };
+                condition.fieldKey = (rule.direction == RuleDirection::Inbound)
                     ? FWPM_CONDITION_IP_LOCAL_ADDRESS
                     : FWPM_CONDITION_IP_REMOTE_ADDRESS;
-                conditions[condCount].matchType = FWP_MATCH_EQUAL;
-                conditions[condCount].conditionValue.type = FWP_UINT32;
-                conditions[condCount].conditionValue.uint32 = addr.S_un.S_addr;
-                condCount++;
+                condition.matchType = FWP_MATCH_EQUAL;
+                if (addrAndMask.mask == 0xFFFFFFFFu) {
+                    condition.conditionValue.type = FWP_UINT32;
+                    condition.conditionValue.uint32 = addrAndMask.addr;
+                }
+                else {
+                    condition.conditionValue.type = FWP_V4_ADDR_MASK;
+                    condition.conditionValue.v4AddrMask = &addrAndMask;
+                }
+                conditions.push_back(condition);
             }
 
             //   ,  
-            if (!rule.destPortStr.empty()) {
-                size_t rangePos = rule.destPortStr.find('-');
-                if (rangePos != std::string::npos) {
-                    UINT16 startPort = static_cast<UINT16>(std::stoi(rule.destPortStr.substr(0, rangePos)));
-                    UINT16 endPort = static_cast<UINT16>(std::stoi(rule.destPortStr.substr(rangePos + 1)));
-
-                    conditions[condCount].fieldKey = (rule.direction == RuleDirection::Inbound)
-                        ? FWPM_CONDITION_IP_LOCAL_PORT
-                        : FWPM_CONDITION_IP_REMOTE_PORT;
-                    conditions[condCount].matchType = FWP_MATCH_RANGE;
-                    conditions[condCount].conditionValue.type = FWP_RANGE_TYPE;
-                    conditions[condCount].conditionValue.rangeValue = new FWP_RANGE0;
-                    conditions[condCount].conditionValue.rangeValue->valueLow.type = FWP_UINT16;
-                    conditions[condCount].conditionValue.rangeValue->valueLow.uint16 = startPort;
-                    conditions[condCount].conditionValue.rangeValue->valueHigh.type = FWP_UINT16;
-                    conditions[condCount].conditionValue.rangeValue->valueHigh.uint16 = endPort;
-                    condCount++;
-                }
-            }
-            else if (rule.destPort != 0) {
-                conditions[condCount].fieldKey = (rule.direction == RuleDirection::Inbound)
-                    ? FWPM_CONDITION_IP_LOCAL_PORT
-                    : FWPM_CONDITION_IP_REMOTE_PORT;
-                conditions[condCount].matchType = FWP_MATCH_EQUAL;
-                conditions[condCount].conditionValue.type = FWP_UINT16;
-                conditions[condCount].conditionValue.uint16 = static_cast<UINT16>(rule.destPort);
-                condCount++;
-            }
+            AppendPortConditions(rule, conditions, portRanges);
+            AppendIcmpConditions(rule, conditions);
 
             //    
-            filter.numFilterConditions = condCount;
-            filter.filterCondition = conditions;
+            filter.numFilterConditions = static_cast<UINT32>(conditions.size());
+            filter.filterCondition = conditions.data();
             filter.action.type = (rule.action == RuleAction::BLOCK) ? FWP_ACTION_BLOCK : FWP_ACTION_PERMIT;
             filter.providerKey = NULL;
 
@@ -444,20 +584,13 @@ bool WfpFilterManager::AddRule(const Rule& rule, bool isChildRule = false) {
                 std::cerr << "[WFP] Failed to add filter for IP " << destIP << ", error: " << result << std::endl;
                 success = false;
             }
-
-            //     
-            for (UINT32 i = 0; i < condCount; i++) {
-                if (conditions[i].conditionValue.type == FWP_RANGE_TYPE) {
-                    delete conditions[i].conditionValue.rangeValue;
-                }
-            }
         }
     }
     else {
         //   IP-,   
         FWPM_FILTER0 filter = { 0 };
-        FWPM_FILTER_CONDITION0 conditions[2] = { 0 };
-        UINT32 condCount = 0;
+        std::vector<FWPM_FILTER_CONDITION0> conditions;
+        std::vector<FWP_RANGE0> portRanges;
 
         GUID filterKey;
         if (CoCreateGuid(&filterKey) == S_OK) {
@@ -467,22 +600,17 @@ bool WfpFilterManager::AddRule(const Rule& rule, bool isChildRule = false) {
         filter.displayData.name = const_cast<wchar_t*>(L"GeneralRule");
         filter.displayData.description = const_cast<wchar_t*>(L"General filter rule");
         filter.flags = FWPM_FILTER_FLAG_CLEAR_ACTION_RIGHT;
-        filter.layerKey = (rule.direction == RuleDirection::Inbound)
-            ? FWPM_LAYER_INBOUND_TRANSPORT_V4
-            : FWPM_LAYER_OUTBOUND_TRANSPORT_V4;
-        filter.weight.type = FWP_UINT8;
-        filter.weight.uint8 = 15;
-
-        if (rule.protocol != Protocol::ANY) {
-            conditions[condCount].fieldKey = FWPM_CONDITION_IP_PROTOCOL;
-            conditions[condCount].matchType = FWP_MATCH_EQUAL;
-            conditions[condCount].conditionValue.type = FWP_UINT8;
-            conditions[condCount].conditionValue.uint8 = ProtocolToNumber(rule.protocol);
-            condCount++;
-        }
+        filter.layerKey = RuleLayer(rule, rule.protocol == Protocol::ICMPV6);
+        filter.weight.type = FWP_UINT64;
+        filter.weight.uint64 = &weight;
+
+        AppendProtocolCondition(rule, conditions);
+        AppendInterfaceCondition(adapterLuid, conditions);
+        AppendPortConditions(rule, conditions, portRanges);
+        AppendIcmpConditions(rule, conditions);
 
-        filter.numFilterConditions = condCount;
-        filter.filterCondition = conditions;
+        filter.numFilterConditions = static_cast<UINT32>(conditions.size());
+        filter.filterCondition = conditions.data();
         filter.action.type = (rule.action == RuleAction::BLOCK) ? FWP_ACTION_BLOCK : FWP_ACTION_PERMIT;
 
         UINT64 filterId = 0;
@@ -500,6 +628,137 @@ bool WfpFilterManager::AddRule(const Rule& rule, bool isChildRule = false) {
     return true;
 }
 
+//       ALE      (RULE_WEIGHT_BASE):
+//    FWPM_FILTER_FLAG_CLEAR_ACTION_RIGHT  .   
+bool WfpFilterManager::AddDefaultBlockFilters() {
+    const GUID* layers[] = {
+        &FWPM_LAYER_ALE_AUTH_CONNECT_V4,
+        &FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4,
+        &FWPM_LAYER_ALE_AUTH_CONNECT_V6,
+        &FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V6
+    };
+
+    bool success = true;
+    for (const GUID* layerKey : layers) {
+        FWPM_FILTER0 filter = { 0 };
+        FWPM_FILTER_CONDITION0 condition = { 0 };
+
+        GUID filterKey;
+        if (CoCreateGuid(&filterKey) == S_OK) {
+            filter.filterKey = filterKey;
+        }
+
+        filter.layerKey = *layerKey;
+        filter.displayData.name = const_cast<wchar_t*>(L"DefaultBlock");
+        filter.displayData.description = const_cast<wchar_t*>(L"Whitelist mode default block");
+        filter.action.type = FWP_ACTION_BLOCK;
+        filter.weight.type = FWP_UINT8;
+        filter.weight.uint8 = 1;
+
+        condition.fieldKey = FWPM_CONDITION_FLAGS;
+        condition.matchType = FWP_MATCH_FLAGS_NONE_SET;
+        condition.conditionValue.type = FWP_UINT32;
+        condition.conditionValue.uint32 = FWP_CONDITION_FLAG_IS_LOOPBACK;
+        filter.numFilterConditions = 1;
+        filter.filterCondition = &condition;
+
+        UINT64 filterId = 0;
+        DWORD result = FwpmFilterAdd0(engineHandle, &filter, NULL, &filterId);
+        if (result == ERROR_SUCCESS) {
+            addedFilterIds.push_back(filterId);
+            std::cout << "[WFP] Default block filter added, id: " << filterId << std::endl;
+        }
+        else {
+            std::cerr << "[WFP] Failed to add default block filter, error: " << result << std::endl;
+            success = false;
+        }
+    }
+    return success;
+}
+
+//   : ,   AddRule  ,     
+//  ,  .            
+std::string WfpFilterManager::FilterKey(const Rule& rule) {
+    std::ostringstream key;
+    key << static_cast<int>(rule.protocol) << '|' << static_cast<int>(rule.action) << '|'
+        << static_cast<int>(rule.direction) << '|' << rule.sourceIp << '|' << rule.destIp << '|'
+        << rule.sourcePort << '|' << rule.destPort << '|' << rule.sourcePortStr << '|' << rule.destPortStr << '|'
+        << rule.appPath << '|' << rule.service << '|' << rule.icmpTypes << '|' << rule.tcpFlags << '|'
+        << rule.connectionState << '|' << rule.adapter;
+    for (const std::string* address : { &rule.sourceIp, &rule.destIp }) {
+        AddressMatch match = RuleMatcher::ParseAddress(*address);
+        if (match.any || !match.never) continue;
+        for (const auto& ip : AddressesForDomain(*address)) key << '|' << ip;
+    }
+    uint32_t adapterIp = RuleMatcher::CompileRule(rule).adapter;
+    UINT64 luid = 0;
+    if (adapterIp != 0 && InterfaceForAdapter(adapterIp, luid)) key << "|if" << luid;
+    return key.str();
+}
+
+// WFP   :         ,  
+//     ApplyRules (ScheduleWheel).      
+static bool ScheduledNow(const Rule& rule, uint32_t minute) {
+    if (rule.schedule.empty()) return true;
+    std::shared_ptr<const WeekSchedule> schedule;
+    return WeekSchedule::Parse(rule.schedule, schedule) && (!schedule || schedule->Active(minute));
+}
+
+//         ,     ,   
+//   .      
+// ,    ,        
+// .      
+std::vector<UINT64> WfpFilterManager::AssignWeights(const std::vector<UINT64>& previous) {
+    const size_t n = previous.size();
+    std::vector<bool> kept(n, false);
+    //   : tails[k]     
+    //     k + 1
+    std::vector<size_t> tails;
+    std::vector<size_t> parent(n, SIZE_MAX);
+    for (size_t i = 0; i < n; ++i) {
+        if (previous[i] == 0) continue;
+        auto it = std::lower_bound(tails.begin(), tails.end(), previous[i],
+            [&previous](size_t t, UINT64 weight) { return previous[t] > weight; });
+        if (it != tails.begin()) parent[i] = *(it - 1);
+        if (it == tails.end()) tails.push_back(i);
+        else *it = i;
+    }
+    for (size_t i = tails.empty() ? SIZE_MAX : tails.back(); i != SIZE_MAX; i = parent[i]) kept[i] = true;
+
+    std::vector<UINT64> weights(n, 0);
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        bool fits = true;
+        UINT64 high = UINT64_MAX;
+        for (size_t a = 0; a < n && fits;) {
+            if (kept[a]) {
+                weights[a] = high = previous[a];
+                ++a;
+                continue;
+            }
+            size_t b = a;
+            while (b < n && !kept[b]) ++b;
+            UINT64 low = b < n ? previous[b] : RULE_WEIGHT_BASE;
+            UINT64 count = b - a;
+            UINT64 gap = high - low;
+            UINT64 step = (std::min)(RULE_WEIGHT_STEP, gap / (count + 1));
+            if (step == 0) {
+                fits = false;
+                break;
+            }
+            //       :    .  
+            //    ,      
+            UINT64 top = low + (gap + step * (count - 1)) / 2;
+            if (a == 0 && b < n) top = low + step * count;
+            else if (a > 0 && b == n) top = high - step;
+            for (size_t i = a; i < b; ++i) weights[i] = top - (i - a) * step;
+            a = b;
+        }
+        if (fits) break;
+        std::fill(kept.begin(), kept.end(), false);
+    }
+    return weights;
+}
+
 bool WfpFilterManager::ApplyRules(const std::vector<Rule>& rules) {
     if (!engineHandle) {
         std::cerr << "[WFP] Cannot apply rules - engine not initialized" << std::endl;
@@ -527,29 +786,89 @@ bool WfpFilterManager::ApplyRules(const std::vector<Rule>& rules) {
     }
 
     std::cout << "[WFP] Applying " << rules.size() << " rules..." << std::endl;
+    auto start = std::chrono::steady_clock::now();
+
+    //      RuleMatcher:     
+    // ,       ,    
+    std::vector<Rule> ordered = RuleMatcher::EvaluationOrder(rules);
+    std::vector<std::string> keys;
+    std::vector<UINT64> previousWeights;
+    std::unordered_map<std::string, std::pair<const Rule*, UINT64>> wanted;
+    uint32_t minute = ScheduleClock::Instance().Minute();
+    size_t offSchedule = 0;
+    for (const auto& rule : ordered) {
+        if (!rule.enabled) continue;
+        if (!ScheduledNow(rule, minute)) {
+            ++offSchedule;
+            continue;
+        }
+        std::string key = FilterKey(rule);
+        //         
+        if (!wanted.emplace(key, std::make_pair(&rule, UINT64(0))).second) continue;
+        auto applied = appliedFilters.find(key);
+        previousWeights.push_back(applied != appliedFilters.end() ? applied->second.weight : 0);
+        keys.push_back(std::move(key));
+    }
+    std::vector<UINT64> weights = AssignWeights(previousWeights);
+    for (size_t i = 0; i < keys.size(); ++i) wanted[keys[i]].second = weights[i];
+    if (filterMode == FilterMode::WHITELIST) wanted.emplace(DEFAULT_BLOCK_KEY, std::make_pair(nullptr, UINT64(0)));
 
-    //      
-    RemoveAllRules();
-
+    //      ,   :  
+    //       ,    WFP   
+    if (FwpmTransactionBegin(engineHandle, 0) != ERROR_SUCCESS) {
+        std::cerr << "[WFP] Failed to begin transaction for rules" << std::endl;
+        return false;
+    }
+    auto previous = appliedFilters;
+    size_t removed = 0;
+    size_t added = 0;
     bool success = true;
-    for (const auto& rule : rules) {
-        if (rule.enabled) {
-            if (!AddRule(rule)) {
-                std::cerr << "[WFP] Failed to add rule" << std::endl;
+    size_t reweighted = 0;
+    for (auto it = appliedFilters.begin(); it != appliedFilters.end();) {
+        auto want = wanted.find(it->first);
+        if (want != wanted.end() && want->second.second == it->second.weight) {
+            ++it;
+            continue;
+        }
+        //     :      
+        if (want != wanted.end()) ++reweighted;
+        for (UINT64 id : it->second.filterIds) {
+            DWORD res = FwpmFilterDeleteById(engineHandle, id);
+            if (res != ERROR_SUCCESS && res != FWP_E_FILTER_NOT_FOUND) {
+                std::cerr << "[WFP] Filter remove FAILED, id: " << id << " code: " << res << std::endl;
                 success = false;
-                break;
             }
         }
+        ++removed;
+        it = appliedFilters.erase(it);
     }
-
-    if (success) {
-        std::cout << "[WFP] Rules applied successfully" << std::endl;
+    for (const auto& kv : wanted) {
+        if (!success) break;
+        if (appliedFilters.count(kv.first)) continue;
+        addedFilterIds.clear();
+        const Rule* rule = kv.second.first;
+        if (rule ? !AddRule(*rule, kv.second.second) : !AddDefaultBlockFilters()) {
+            std::cerr << "[WFP] Failed to add rule" << std::endl;
+            success = false;
+            break;
+        }
+        appliedFilters[kv.first] = { kv.second.second, addedFilterIds };
+        ++added;
     }
-    else {
-        std::cerr << "[WFP] Failed to apply all rules" << std::endl;
-        //      
-        RemoveAllRules();
+    addedFilterIds.clear();
+    if (success && FwpmTransactionCommit(engineHandle) != ERROR_SUCCESS) {
+        std::cerr << "[WFP] Failed to commit rules transaction" << std::endl;
+        success = false;
+    }
+    if (!success) {
+        FwpmTransactionAbort(engineHandle);
+        appliedFilters = std::move(previous);
+        std::cerr << "[WFP] Failed to apply all rules, previous filters kept" << std::endl;
+        return false;
     }
 
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[WFP] Rules applied successfully: " << added << " added, " << removed << " removed ("
+        << reweighted << " moved to a new weight), " << (appliedFilters.size() - added) << " kept, " << offSchedule << " off schedule in " << ms << " ms" << std::endl;
     return success;
 }
\ No newline at end of file
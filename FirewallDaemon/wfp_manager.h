@@ -3,6 +3,7 @@
 #include <fwpmu.h>
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include "rule.h"
 
 class WfpFilterManager {
@@ -12,15 +13,46 @@ public:
 
     bool Initialize();
     void RemoveAllRules();
-    bool AddRule(const Rule& rule, bool isChildRule);
+    // weight — вес фильтров правила (FWP_UINT64): больше — проверяется раньше
+    bool AddRule(const Rule& rule, UINT64 weight, bool isChildRule = false);
+    // Веса правил выше запрета по умолчанию (FWP_UINT8 1, то есть диапазон 1 << 60)
+    static constexpr UINT64 RULE_WEIGHT_BASE = 15ull << 60;
+    // Шаг между весами соседних правил при расстановке: в промежуток встают новые правила
+    static constexpr UINT64 RULE_WEIGHT_STEP = 1ull << 32;
+    // Ставит разницу с уже применённым набором одной транзакцией WFP
     bool ApplyRules(const std::vector<Rule>& rules);
+    // IPv4-адреса работающих адаптеров (порядок байтов хоста), по ним выбирается профиль правил
+    static std::vector<uint32_t> LocalAddresses();
+    // WHITELIST: ApplyRules добавляет запрет по умолчанию под разрешающими правилами
+    void SetFilterMode(FilterMode mode) { filterMode = mode; }
     HANDLE GetEngineHandle() const { return engineHandle; }
 private:
     HANDLE engineHandle;
     std::vector<UINT64> addedFilterIds;
+    struct AppliedRule {
+        UINT64 weight = 0;
+        std::vector<UINT64> filterIds;
+    };
+    std::unordered_map<std::string, AppliedRule> appliedFilters;   // FilterKey -> вес и фильтры правила
+    static constexpr const char* DEFAULT_BLOCK_KEY = "#default-block";
+    static std::string FilterKey(const Rule& rule);
+    // Веса правил в порядке вычисления по прежним весам (0 — правила не было): прежние веса,
+    // которые ещё убывают по порядку, сохраняются, остальные встают в промежутки между ними
+    static std::vector<UINT64> AssignWeights(const std::vector<UINT64>& previous);
+    FilterMode filterMode = FilterMode::BLACKLIST;
     static UINT8 ProtocolToNumber(Protocol proto);
     std::string ProtocolToString(Protocol proto);
 
 
     static bool MakeAppIdBlob(const std::string& appPath, std::vector<uint8_t>& appIdBlob);
+    static void AppendProtocolCondition(const Rule& rule, std::vector<FWPM_FILTER_CONDITION0>& conditions);
+    // adapterIp — IPv4 в порядке байтов хоста; false — адрес не назначен ни одному интерфейсу
+    static bool InterfaceForAdapter(uint32_t adapterIp, UINT64& luid);
+    static void AppendInterfaceCondition(UINT64* luid, std::vector<FWPM_FILTER_CONDITION0>& conditions);
+    static void AppendPortConditions(const Rule& rule, std::vector<FWPM_FILTER_CONDITION0>& conditions,
+        std::vector<FWP_RANGE0>& portRanges);
+    static bool IcmpTypesExpressible(const Rule& rule);
+    static void AppendIcmpConditions(const Rule& rule, std::vector<FWPM_FILTER_CONDITION0>& conditions);
+    GUID RuleLayer(const Rule& rule, bool v6) const;
+    bool AddDefaultBlockFilters();
 };
\ No newline at end of file
@@ -0,0 +1,495 @@
+#include "address_list.h"
+#include "ip_utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+static uint64_t HighMask(int length) {
+    if (length <= 0) return 0;
+    return length >= 64 ? ~0ull : ~0ull << (64 - length);
+}
+
+static uint64_t LowMask(int length) {
+    if (length <= 64) return 0;
+    return length >= 128 ? ~0ull : ~0ull << (128 - length);
+}
+
+static uint64_t Load64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v = (v << 8) | p[i];
+    return v;
+}
+
+static int Bit(uint64_t high, uint64_t low, int bit) {
+    return bit < 64 ? static_cast<int>((high >> (63 - bit)) & 1) : static_cast<int>((low >> (127 - bit)) & 1);
+}
+
+static int CountLeadingZeros(uint64_t v) {
+    int n = 0;
+    while (n < 64 && !(v & (0x8000000000000000ull >> n))) ++n;
+    return n;
+}
+
+void BlockedBloomFilter::Init(size_t keyCount, double falsePositiveRate) {
+    falsePositiveRate = std::clamp(falsePositiveRate, 1e-6, 0.5);
+    const double ln2 = std::log(2.0);
+    double bitsPerKey = -std::log(falsePositiveRate) / (ln2 * ln2);
+    hashes = static_cast<uint32_t>(std::clamp(std::lround(bitsPerKey * ln2), 1L, 16L));
+    // Ключи распределяются по блокам неравномерно, поэтому блоков нужно больше, чем
+    // у обычного фильтра; размер растёт, пока оценка не уложится в заданную долю
+    size_t count = std::max<size_t>(1, static_cast<size_t>(std::ceil(keyCount * bitsPerKey / 512)));
+    while (Estimate(keyCount, count, hashes) > falsePositiveRate) count += count / 16 + 1;
+    blocks.assign(count, Block{});
+    blockCount = count;
+    keys = 0;
+}
+
+void BlockedBloomFilter::Add(uint64_t key) {
+    uint64_t h = Hash(key);
+    Block& block = blocks[static_cast<size_t>(((h >> 32) * blockCount) >> 32)];
+    uint64_t bits = Hash(h ^ SALT);
+    for (uint32_t i = 0; i < hashes; ++i) {
+        if (i == 7) bits = Hash(bits ^ SALT);
+        uint32_t bit = static_cast<uint32_t>(bits) & 511;
+        bits >>= 9;
+        block.words[bit >> 6] |= 1ull << (bit & 63);
+    }
+    ++keys;
+}
+
+// Число ключей в блоке распределено по Пуассону; в блоке с l ключами бит занят
+// с вероятностью 1 - (1 - 1/512)^(k*l)
+double BlockedBloomFilter::Estimate(size_t keyCount, size_t count, uint32_t k) {
+    if (count == 0) return 1;
+    double lambda = static_cast<double>(keyCount) / count;
+    double probability = std::exp(-lambda);
+    double rate = 0;
+    size_t limit = static_cast<size_t>(lambda + 12 * std::sqrt(lambda) + 20);
+    for (size_t l = 0; l <= limit; ++l) {
+        if (l > 0) probability *= lambda / l;
+        double occupied = 1 - std::pow(1 - 1.0 / 512, static_cast<double>(k) * l);
+        rate += probability * std::pow(occupied, k);
+    }
+    return rate;
+}
+
+double BlockedBloomFilter::EstimatedFalsePositiveRate() const {
+    return blocks.empty() ? 0 : Estimate(keys, blocks.size(), hashes);
+}
+
+bool AddressSet::ContainsWide(uint32_t addr) const {
+    // Двоичный поиск даже по тысяче диапазонов стоит дороже самого фильтра из-за ошибок
+    // предсказания ветвлений; большинство адресов отсекает карта блоков
+    uint32_t block = addr >> 16;
+    if (wideBlocks.empty() || !(wideBlocks[block >> 6] & (1ull << (block & 63)))) return false;
+    size_t index = static_cast<size_t>(std::upper_bound(wideStarts.begin(), wideStarts.end(), addr) - wideStarts.begin());
+    return index > 0 && wideEnds[index - 1] >= addr;
+}
+
+bool AddressSet::Search(uint32_t addr) const {
+    if (starts.empty()) return false;
+    // Последний диапазон с началом <= addr ищется только среди начинающихся в том же блоке /16;
+    // если таких нет, кандидат — последний диапазон предыдущих блоков
+    uint32_t block = addr >> 16;
+    auto first = starts.begin() + blockFirst[block];
+    auto last = starts.begin() + blockFirst[block + 1];
+    size_t index = static_cast<size_t>(std::upper_bound(first, last, addr) - starts.begin());
+    return index > 0 && ends[index - 1] >= addr;
+}
+
+bool AddressSet::ContainsIPv6(const uint8_t* addr) const {
+    if (leaves6.empty()) return false;
+    uint64_t high = Load64(addr);
+    uint64_t low = Load64(addr + 8);
+    uint32_t current = root6;
+    while (!(current & LEAF)) {
+        const Node6& node = nodes6[current];
+        current = node.child[Bit(high, low, node.bit)];
+    }
+    // Префиксы не пересекаются, поэтому подходящим может быть только лист на пути по битам адреса
+    const Prefix6& prefix = leaves6[current & ~LEAF];
+    return (high & HighMask(prefix.length)) == prefix.high && (low & LowMask(prefix.length)) == prefix.low;
+}
+
+size_t AddressSet::MemoryBytes() const {
+    return sizeof(*this)
+        + starts.capacity() * sizeof(uint32_t)
+        + ends.capacity() * sizeof(uint32_t)
+        + blockFirst.capacity() * sizeof(uint32_t)
+        + prefilter.MemoryBytes()
+        + (wideStarts.capacity() + wideEnds.capacity()) * sizeof(uint32_t)
+        + wideBlocks.capacity() * sizeof(uint64_t)
+        + nodes6.capacity() * sizeof(Node6)
+        + leaves6.capacity() * sizeof(Prefix6);
+}
+
+void AddressSetBuilder::AddIPv4Range(uint32_t first, uint32_t last) {
+    if (first > last) std::swap(first, last);
+    ranges4.push_back({ first, last });
+}
+
+void AddressSetBuilder::AddIPv6Prefix(const uint8_t* network, int prefixLength) {
+    prefixLength = std::clamp(prefixLength, 0, 128);
+    AddressSet::Prefix6 prefix;
+    prefix.length = static_cast<uint8_t>(prefixLength);
+    prefix.high = Load64(network) & HighMask(prefixLength);
+    prefix.low = Load64(network + 8) & LowMask(prefixLength);
+    prefixes6.push_back(prefix);
+}
+
+static std::string_view TrimField(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t' || s.front() == '"' || s.front() == '\'')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '"' || s.back() == '\'' || s.back() == '\r')) s.remove_suffix(1);
+    return s;
+}
+
+// Адрес, префикс или диапазон IPv4 в одном поле
+static bool AddField(AddressSetBuilder& builder, std::string_view field) {
+    field = TrimField(field);
+    if (field.empty()) return false;
+    if (field.find(':') != std::string_view::npos) {
+        uint8_t network[16];
+        int length = 0;
+        if (!ParseIPv6Prefix(field, network, length)) return false;
+        builder.AddIPv6Prefix(network, length);
+        return true;
+    }
+    size_t dash = field.find('-');
+    if (dash != std::string_view::npos) {
+        uint32_t first = 0, last = 0;
+        if (!ParseIPv4(TrimField(field.substr(0, dash)), first) || !ParseIPv4(TrimField(field.substr(dash + 1)), last)) {
+            return false;
+        }
+        builder.AddIPv4Range(first, last);
+        return true;
+    }
+    uint32_t network = 0, mask = 0;
+    if (!ParseIPv4Prefix(field, network, mask)) return false;
+    builder.AddIPv4Range(network, network | ~mask);
+    return true;
+}
+
+bool AddressSetBuilder::AddLine(std::string_view line, int column) {
+    size_t hash = line.find('#');
+    if (hash != std::string_view::npos) line = line.substr(0, hash);
+    if (column >= 0) {
+        for (int index = 0; ; ++index) {
+            size_t end = line.find_first_of(",;\t");
+            if (index == column) return AddField(*this, line.substr(0, end));
+            if (end == std::string_view::npos) return false;
+            line.remove_prefix(end + 1);
+        }
+    }
+    while (!line.empty()) {
+        size_t end = line.find_first_of(",; \t");
+        if (end != 0 && AddField(*this, line.substr(0, end))) return true;
+        if (end == std::string_view::npos) break;
+        line.remove_prefix(end + 1);
+    }
+    return false;
+}
+
+void AddressSetBuilder::Parse(std::istream& in, ParseStats& stats, int column) {
+    auto processLine = [&](std::string_view line) {
+        ++stats.lines;
+        std::string_view trimmed = TrimField(line);
+        if (trimmed.empty() || trimmed.front() == '#' || trimmed.front() == ';') return;
+        if (AddLine(line, column)) ++stats.entries;
+        else ++stats.skipped;
+    };
+
+    constexpr size_t CHUNK = 1 << 20;
+    std::vector<char> buffer(CHUNK);
+    std::string carry;          // начало строки, разрезанной границей блока
+    while (in) {
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        size_t size = static_cast<size_t>(in.gcount());
+        if (size == 0) break;
+        const char* data = buffer.data();
+        size_t start = 0;
+        while (const void* found = std::memchr(data + start, '\n', size - start)) {
+            size_t end = static_cast<size_t>(static_cast<const char*>(found) - data);
+            if (!carry.empty()) {
+                carry.append(data + start, end - start);
+                processLine(carry);
+                carry.clear();
+            }
+            else {
+                processLine(std::string_view(data + start, end - start));
+            }
+            start = end + 1;
+        }
+        carry.append(data + start, size - start);
+    }
+    if (!carry.empty()) processLine(carry);
+}
+
+std::shared_ptr<const AddressSet> AddressSetBuilder::Build() {
+    auto set = std::make_shared<AddressSet>();
+
+    // IPv4: слияние пересекающихся и смежных диапазонов на месте
+    std::sort(ranges4.begin(), ranges4.end());
+    size_t merged = 0;
+    for (size_t i = 0; i < ranges4.size(); ++i) {
+        if (merged > 0 && static_cast<uint64_t>(ranges4[i].first) <= static_cast<uint64_t>(ranges4[merged - 1].second) + 1) {
+            ranges4[merged - 1].second = std::max(ranges4[merged - 1].second, ranges4[i].second);
+        }
+        else {
+            ranges4[merged++] = ranges4[i];
+        }
+    }
+    set->starts.reserve(merged);
+    set->ends.reserve(merged);
+    for (size_t i = 0; i < merged; ++i) {
+        set->starts.push_back(ranges4[i].first);
+        set->ends.push_back(ranges4[i].second);
+    }
+    std::vector<std::pair<uint32_t, uint32_t>>().swap(ranges4);
+
+    // Фильтр окупается, когда широких диапазонов мало: иначе промах фильтра всё равно
+    // ведёт в большой поиск
+    size_t narrow = 0, wide = 0;
+    for (size_t i = 0; i < merged; ++i) {
+        uint64_t size = static_cast<uint64_t>(set->ends[i]) - set->starts[i] + 1;
+        if (size <= AddressSet::NARROW_RANGE) narrow += static_cast<size_t>(size);
+        else ++wide;
+    }
+    if (prefilterRate > 0 && narrow >= PREFILTER_MIN_KEYS && wide <= PREFILTER_MAX_WIDE) {
+        set->prefilter.Init(narrow, prefilterRate);
+        for (size_t i = 0; i < merged; ++i) {
+            uint32_t first = set->starts[i], last = set->ends[i];
+            if (static_cast<uint64_t>(last) - first + 1 > AddressSet::NARROW_RANGE) {
+                set->wideStarts.push_back(first);
+                set->wideEnds.push_back(last);
+                if (set->wideBlocks.empty()) set->wideBlocks.assign(65536 / 64, 0);
+                for (uint32_t block = first >> 16; block <= last >> 16; ++block) {
+                    set->wideBlocks[block >> 6] |= 1ull << (block & 63);
+                }
+                continue;
+            }
+            for (uint64_t addr = first; addr <= last; ++addr) set->prefilter.Add(addr);
+        }
+        set->wideStarts.shrink_to_fit();
+        set->wideEnds.shrink_to_fit();
+    }
+    if (!set->starts.empty()) {
+        set->blockFirst.resize(65537);
+        size_t index = 0;
+        for (uint32_t block = 0; block <= 65536; ++block) {
+            uint64_t blockStart = static_cast<uint64_t>(block) << 16;
+            while (index < merged && set->starts[index] < blockStart) ++index;
+            set->blockFirst[block] = static_cast<uint32_t>(index);
+        }
+    }
+
+    // IPv6: префиксы, покрытые другими, не нужны; остальные не пересекаются
+    std::sort(prefixes6.begin(), prefixes6.end(), [](const AddressSet::Prefix6& a, const AddressSet::Prefix6& b) {
+        if (a.high != b.high) return a.high < b.high;
+        if (a.low != b.low) return a.low < b.low;
+        return a.length < b.length;
+    });
+    std::vector<AddressSet::Prefix6>& leaves = set->leaves6;
+    for (const auto& prefix : prefixes6) {
+        if (!leaves.empty()) {
+            const AddressSet::Prefix6& last = leaves.back();
+            if ((prefix.high & HighMask(last.length)) == last.high && (prefix.low & LowMask(last.length)) == last.low) continue;
+        }
+        leaves.push_back(prefix);
+    }
+    leaves.shrink_to_fit();
+    std::vector<AddressSet::Prefix6>().swap(prefixes6);
+    if (!leaves.empty()) {
+        set->nodes6.reserve(leaves.size() - 1);
+        // Узел делит отсортированный отрезок листьев по первому биту, в котором расходятся
+        // крайние: у всех листьев отрезка общие биты до него одинаковы
+        auto build = [&](auto& self, size_t first, size_t last) -> uint32_t {
+            if (last - first == 1) return AddressSet::LEAF | static_cast<uint32_t>(first);
+            const AddressSet::Prefix6& a = leaves[first];
+            const AddressSet::Prefix6& b = leaves[last - 1];
+            int bit = a.high != b.high ? CountLeadingZeros(a.high ^ b.high) : 64 + CountLeadingZeros(a.low ^ b.low);
+            size_t split = static_cast<size_t>(std::partition_point(leaves.begin() + first, leaves.begin() + last,
+                [bit](const AddressSet::Prefix6& p) { return Bit(p.high, p.low, bit) == 0; }) - leaves.begin());
+            uint32_t index = static_cast<uint32_t>(set->nodes6.size());
+            set->nodes6.emplace_back();
+            set->nodes6[index].bit = static_cast<uint8_t>(bit);
+            uint32_t zero = self(self, first, split);
+            uint32_t one = self(self, split, last);
+            set->nodes6[index].child[0] = zero;
+            set->nodes6[index].child[1] = one;
+            return index;
+        };
+        set->root6 = build(build, 0, leaves.size());
+    }
+    return set;
+}
+
+AddressList::AddressList(std::string name)
+    : name(std::move(name))
+    , set(std::make_shared<AddressSet>())
+{
+}
+
+bool AddressList::ContainsIPv4(uint32_t addr) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return set->ContainsIPv4(addr);
+}
+
+bool AddressList::ContainsIPv6(const uint8_t* addr) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return set->ContainsIPv6(addr);
+}
+
+std::shared_ptr<const AddressSet> AddressList::Current() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return set;
+}
+
+void AddressList::Replace(std::shared_ptr<const AddressSet> replacement) {
+    if (!replacement) replacement = std::make_shared<AddressSet>();
+    // Прежнее множество освобождается вне блокировки: это десятки мегабайт
+    std::shared_ptr<const AddressSet> previous;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        previous = std::move(set);
+        set = std::move(replacement);
+    }
+    version.fetch_add(1, std::memory_order_relaxed);
+}
+
+AddressLists& AddressLists::Instance() {
+    static AddressLists instance;
+    return instance;
+}
+
+AddressLists::~AddressLists() {
+    WaitForReload();
+}
+
+AddressList* AddressLists::Get(std::string_view name) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto it = lists.find(std::string(name));
+    if (it == lists.end()) {
+        it = lists.emplace(std::string(name), std::make_unique<AddressList>(std::string(name))).first;
+    }
+    return it->second.get();
+}
+
+const AddressList* AddressLists::Find(std::string_view name) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = lists.find(std::string(name));
+    return it == lists.end() ? nullptr : it->second.get();
+}
+
+std::vector<std::string> AddressLists::Names() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    std::vector<std::string> names;
+    for (const auto& kv : lists) names.push_back(kv.first);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+void AddressLists::SetSources(const std::unordered_map<std::string, AddressListSource>& newSources) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    for (const auto& kv : newSources) {
+        auto it = sources.find(kv.first);
+        // Другой файл, поле или фильтр — перечитать даже при той же отметке времени
+        if (it == sources.end() || it->second.path != kv.second.path || it->second.column != kv.second.column
+            || it->second.falsePositiveRate != kv.second.falsePositiveRate) {
+            loaded.erase(kv.first);
+        }
+    }
+    sources = newSources;
+}
+
+AddressLists::LoadResult AddressLists::Load(const std::string& name, const AddressListSource& source) {
+    LoadResult result;
+    result.name = name;
+    auto started = std::chrono::steady_clock::now();
+    std::ifstream in(source.path, std::ios::binary);
+    if (!in) {
+        result.error = "cannot open " + source.path;
+        return result;
+    }
+    AddressSetBuilder builder;
+    builder.SetPrefilter(source.falsePositiveRate);
+    builder.Parse(in, result.stats, source.column);
+    if (in.bad()) {
+        result.error = "read error in " + source.path;
+        return result;
+    }
+    // Файл из одних нераспознанных строк — скорее всего не тот формат; пустой список допустим
+    if (result.stats.entries == 0 && result.stats.skipped > 0) {
+        result.error = "no addresses in " + source.path;
+        return result;
+    }
+    std::shared_ptr<const AddressSet> set = builder.Build();
+    result.memoryBytes = set->MemoryBytes();
+    result.prefilterFalsePositiveRate = set->Prefilter().EstimatedFalsePositiveRate();
+    Get(name)->Replace(std::move(set));
+    result.ok = true;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return result;
+}
+
+std::vector<AddressLists::LoadResult> AddressLists::ReloadChanged() {
+    std::unordered_map<std::string, AddressListSource> current;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        current = sources;
+    }
+    std::vector<LoadResult> results;
+    for (const auto& kv : current) {
+        std::error_code ec;
+        FileStamp stamp;
+        stamp.writeTime = static_cast<int64_t>(std::filesystem::last_write_time(kv.second.path, ec).time_since_epoch().count());
+        if (!ec) stamp.size = static_cast<uint64_t>(std::filesystem::file_size(kv.second.path, ec));
+        if (!ec) {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = loaded.find(kv.first);
+            if (it != loaded.end() && it->second == stamp) continue;
+        }
+        LoadResult result = Load(kv.first, kv.second);
+        if (result.ok && !ec) {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            loaded[kv.first] = stamp;
+        }
+        results.push_back(std::move(result));
+    }
+    return results;
+}
+
+void AddressLists::ReloadChangedAsync(std::function<void(const std::vector<LoadResult>&)> done) {
+    std::lock_guard<std::mutex> lock(workerMutex);
+    if (reloading.exchange(true)) return;
+    if (worker.joinable()) worker.join();
+    worker = std::thread([this, done]() {
+        std::vector<LoadResult> results = ReloadChanged();
+        if (done) done(results);
+        reloading = false;
+    });
+}
+
+void AddressLists::WaitForReload() {
+    std::lock_guard<std::mutex> lock(workerMutex);
+    if (worker.joinable()) worker.join();
+}
+
+bool AddressLists::IsReference(std::string_view address) {
+    std::string_view name = ReferenceName(address);
+    if (name.empty()) return false;
+    for (char c : name) {
+        bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' || c == '_' || c == '-';
+        if (!ok) return false;
+    }
+    return true;
+}
+
+std::string_view AddressLists::ReferenceName(std::string_view address) {
+    while (!address.empty() && (address.front() == ' ' || address.front() == '\t')) address.remove_prefix(1);
+    while (!address.empty() && (address.back() == ' ' || address.back() == '\t')) address.remove_suffix(1);
+    if (address.empty() || address.front() != '@') return std::string_view();
+    return address.substr(1);
+}
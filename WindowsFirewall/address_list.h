@@ -0,0 +1,247 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Блочный фильтр Блума: все k битов ключа лежат в одной строке кэша (512 бит), поэтому
+// ответ "точно нет" стоит одного обращения к памяти вместо поиска по большому множеству
+class BlockedBloomFilter {
+public:
+    // Размер подбирается по числу ключей так, чтобы ожидаемая доля ложных срабатываний
+    // не превышала falsePositiveRate
+    void Init(size_t keys, double falsePositiveRate);
+    void Add(uint64_t key);
+    bool MayContain(uint64_t key) const {
+        uint64_t h = Hash(key);
+        const Block& block = blocks[static_cast<size_t>(((h >> 32) * blockCount) >> 32)];
+        uint64_t bits = Hash(h ^ SALT);
+        for (uint32_t i = 0; i < hashes; ++i) {
+            // 9 бит на позицию, 7 позиций из одного хэша
+            if (i == 7) bits = Hash(bits ^ SALT);
+            uint32_t bit = static_cast<uint32_t>(bits) & 511;
+            bits >>= 9;
+            if (!(block.words[bit >> 6] & (1ull << (bit & 63)))) return false;
+        }
+        return true;
+    }
+
+    bool Empty() const { return blocks.empty(); }
+    uint32_t HashCount() const { return hashes; }
+    // Ожидаемая доля ложных срабатываний при фактическом числе ключей
+    double EstimatedFalsePositiveRate() const;
+    size_t MemoryBytes() const { return blocks.capacity() * sizeof(Block); }
+
+private:
+    struct alignas(64) Block {
+        uint64_t words[8];
+    };
+    static constexpr uint64_t SALT = 0x9E3779B97F4A7C15ull;
+    static uint64_t Hash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xFF51AFD7ED558CCDull;
+        key ^= key >> 33;
+        key *= 0xC4CEB9FE1A85EC53ull;
+        return key ^ (key >> 33);
+    }
+    static double Estimate(size_t keys, size_t blockCount, uint32_t hashes);
+
+    std::vector<Block> blocks;
+    uint64_t blockCount = 0;
+    uint32_t hashes = 0;
+    size_t keys = 0;
+};
+
+// Неизменяемое множество адресов списка блокировки (threat feed) на миллионы записей.
+// IPv4 — отсортированные непересекающиеся диапазоны с индексом по старшим 16 битам,
+// IPv6 — сжатое двоичное дерево префиксов (PATRICIA). Около 8 байт на диапазон IPv4
+// и 36 байт на префикс IPv6.
+// Большинство проверяемых адресов в списке нет, поэтому перед поиском IPv4 стоит
+// необязательный фильтр Блума по адресам узких диапазонов (до NARROW_RANGE адресов).
+// Широкие диапазоны (подсети из фидов вроде DROP) обычно немногочисленны и проверяются
+// отдельно по своему короткому массиву.
+class AddressSet {
+public:
+    // Адрес в порядке байтов хоста, как в FlowKey
+    bool ContainsIPv4(uint32_t addr) const {
+        if (!prefilter.Empty() && !prefilter.MayContain(addr)) return ContainsWide(addr);
+        return Search(addr);
+    }
+    // 16 байт в сетевом порядке
+    bool ContainsIPv6(const uint8_t* addr) const;
+
+    size_t IPv4RangeCount() const { return starts.size(); }
+    size_t IPv6PrefixCount() const { return leaves6.size(); }
+    bool Empty() const { return starts.empty() && leaves6.empty(); }
+    size_t MemoryBytes() const;
+
+    bool HasPrefilter() const { return !prefilter.Empty(); }
+    const BlockedBloomFilter& Prefilter() const { return prefilter; }
+    size_t WideRangeCount() const { return wideStarts.size(); }
+
+    static constexpr uint32_t NARROW_RANGE = 16;
+
+private:
+    friend class AddressSetBuilder;
+
+    struct Prefix6 {
+        uint64_t high = 0;
+        uint64_t low = 0;
+        uint8_t length = 0;
+    };
+    // Внутренний узел: номер проверяемого бита и два потомка; потомок с флагом LEAF —
+    // индекс в leaves6. Сам префикс проверяется только в листе.
+    struct Node6 {
+        uint32_t child[2] = {};
+        uint8_t bit = 0;
+    };
+    static constexpr uint32_t LEAF = 0x80000000u;
+
+    bool Search(uint32_t addr) const;
+    bool ContainsWide(uint32_t addr) const;
+
+    std::vector<uint32_t> starts;           // начала диапазонов по возрастанию
+    std::vector<uint32_t> ends;             // включительно
+    std::vector<uint32_t> blockFirst;       // 65537 элементов: первый диапазон с началом >= (b << 16)
+    BlockedBloomFilter prefilter;           // адреса узких диапазонов; пуст — фильтра нет
+    std::vector<uint32_t> wideStarts;       // диапазоны шире NARROW_RANGE
+    std::vector<uint32_t> wideEnds;
+    std::vector<uint64_t> wideBlocks;       // битовая карта блоков /16, задетых широкими диапазонами
+    std::vector<Node6> nodes6;
+    std::vector<Prefix6> leaves6;
+    uint32_t root6 = 0;
+};
+
+// Потоковый разбор списка и сборка AddressSet. Понимает построчный текст и CSV:
+//   1.2.3.4            адрес
+//   10.0.0.0/8         префикс
+//   1.2.3.0-1.2.3.255  диапазон IPv4
+//   2001:db8::/32      префикс IPv6
+// '#' начинает комментарий, ';' — в начале строки; строки без адреса (заголовки CSV)
+// пропускаются. Поля разделяются ',', ';' и табуляцией; берётся поле column (с нуля)
+// или, если column < 0, первое слово строки, похожее на адрес ("1.2.3.0/24 ; SBL123").
+class AddressSetBuilder {
+public:
+    struct ParseStats {
+        size_t lines = 0;
+        size_t entries = 0;
+        size_t skipped = 0;         // непустые строки без адреса
+    };
+
+    // Доля ложных срабатываний фильтра перед поиском IPv4; 0 — без фильтра.
+    // Фильтр строится, только если узких адресов не меньше PREFILTER_MIN_KEYS, а широких
+    // диапазонов не больше PREFILTER_MAX_WIDE (их массив должен помещаться в кэш).
+    void SetPrefilter(double falsePositiveRate) { prefilterRate = falsePositiveRate; }
+    static constexpr size_t PREFILTER_MIN_KEYS = 4096;
+    static constexpr size_t PREFILTER_MAX_WIDE = 16384;
+
+    void AddIPv4Range(uint32_t first, uint32_t last);
+    void AddIPv6Prefix(const uint8_t* network, int prefixLength);
+    // Одна строка файла; false — адреса в ней нет
+    bool AddLine(std::string_view line, int column = -1);
+    // Читает поток блоками, не держа файл в памяти целиком
+    void Parse(std::istream& in, ParseStats& stats, int column = -1);
+
+    size_t PendingEntries() const { return ranges4.size() + prefixes6.size(); }
+    // Собирает множество и освобождает накопленные записи
+    std::shared_ptr<const AddressSet> Build();
+
+private:
+    std::vector<std::pair<uint32_t, uint32_t>> ranges4;
+    std::vector<AddressSet::Prefix6> prefixes6;
+    double prefilterRate = 0;
+};
+
+// Именованный список, на который ссылаются правила ("@имя" в поле адреса).
+// Правило держит указатель на список, а содержимое заменяется целиком: перезагрузка
+// собирает новое множество без блокировок и только подменяет указатель.
+class AddressList {
+public:
+    explicit AddressList(std::string name);
+
+    const std::string& Name() const { return name; }
+    bool ContainsIPv4(uint32_t addr) const;
+    bool ContainsIPv6(const uint8_t* addr) const;
+    std::shared_ptr<const AddressSet> Current() const;
+    void Replace(std::shared_ptr<const AddressSet> set);
+    // Растёт при каждой замене
+    uint64_t Version() const { return version.load(std::memory_order_relaxed); }
+
+private:
+    const std::string name;
+    mutable std::shared_mutex mutex;
+    std::shared_ptr<const AddressSet> set;      // не nullptr
+    std::atomic<uint64_t> version{ 0 };
+};
+
+// Файл, из которого загружается список
+struct AddressListSource {
+    std::string path;
+    int column = -1;            // поле CSV; -1 — первое поле с адресом
+    double falsePositiveRate = 0.01;        // фильтра Блума перед поиском; 0 — без фильтра
+};
+
+// Реестр списков по имени. Списки не удаляются, поэтому указатели из правил
+// остаются действительными при любых перезагрузках.
+class AddressLists {
+public:
+    struct LoadResult {
+        std::string name;
+        bool ok = false;
+        std::string error;
+        AddressSetBuilder::ParseStats stats;
+        double seconds = 0;
+        size_t memoryBytes = 0;
+        double prefilterFalsePositiveRate = 0;  // ожидаемая; 0 — фильтр не построен
+    };
+
+    static AddressLists& Instance();
+    ~AddressLists();
+
+    // Список по имени; создаётся пустым при первом обращении
+    AddressList* Get(std::string_view name);
+    const AddressList* Find(std::string_view name) const;
+    std::vector<std::string> Names() const;
+
+    // Источники заменяются целиком; списки без источника остаются как есть
+    void SetSources(const std::unordered_map<std::string, AddressListSource>& sources);
+    // Загружает файл и подменяет содержимое; при ошибке прежнее содержимое сохраняется
+    LoadResult Load(const std::string& name, const AddressListSource& source);
+    // Перечитывает списки, чьи файлы изменились (время записи или размер)
+    std::vector<LoadResult> ReloadChanged();
+    // То же в фоновом потоке; done получает результаты там же. Если перезагрузка
+    // уже идёт, вызов ничего не делает.
+    void ReloadChangedAsync(std::function<void(const std::vector<LoadResult>&)> done = nullptr);
+    void WaitForReload();
+
+    // "@имя" — ссылка на список; имя из букв, цифр, '.', '_' и '-'
+    static bool IsReference(std::string_view address);
+    static std::string_view ReferenceName(std::string_view address);
+
+private:
+    AddressLists() = default;
+
+    struct FileStamp {
+        int64_t writeTime = 0;
+        uint64_t size = 0;
+        bool operator==(const FileStamp& other) const { return writeTime == other.writeTime && size == other.size; }
+    };
+
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, std::unique_ptr<AddressList>> lists;
+    std::unordered_map<std::string, AddressListSource> sources;
+    std::unordered_map<std::string, FileStamp> loaded;
+
+    std::mutex workerMutex;
+    std::thread worker;
+    std::atomic<bool> reloading{ false };
+};
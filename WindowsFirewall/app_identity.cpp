@@ -0,0 +1,189 @@
+#include "app_identity.h"
+#include <algorithm>
+#include <mutex>
+
+AppIdentityTable& AppIdentityTable::Instance() {
+    static AppIdentityTable instance;
+    return instance;
+}
+
+static bool StartsWith(const std::string& s, const char* prefix) {
+    size_t len = std::char_traits<char>::length(prefix);
+    return s.size() >= len && s.compare(0, len, prefix) == 0;
+}
+
+static std::string LowerSlashes(std::string_view path) {
+    std::string s(path);
+    for (char& c : s) {
+        if (c == '/') c = '\\';
+        else if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+    }
+    return s;
+}
+
+std::string AppIdentityTable::NormalizePath(std::string_view path) const {
+    size_t first = path.find_first_not_of(" \t\"");
+    size_t last = path.find_last_not_of(" \t\"");
+    if (first == std::string_view::npos) return "";
+    // Регистр меняется только у ASCII: полноценное сравнение без учёта регистра требует таблиц Unicode
+    std::string s = LowerSlashes(path.substr(first, last - first + 1));
+
+    if (StartsWith(s, "\\\\?\\unc\\")) s = "\\\\" + s.substr(8);
+    else if (StartsWith(s, "\\\\?\\") || StartsWith(s, "\\??\\") || StartsWith(s, "\\\\.\\")) s = s.substr(4);
+
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        for (const auto& device : deviceMap) {
+            const std::string& prefix = device.first;
+            if (s.size() >= prefix.size() && s.compare(0, prefix.size(), prefix) == 0
+                && (s.size() == prefix.size() || s[prefix.size()] == '\\')) {
+                s = device.second + s.substr(prefix.size());
+                break;
+            }
+        }
+    }
+
+    // Повторные разделители схлопываются; ведущий "\\" UNC-пути сохраняется
+    std::string result;
+    result.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '\\' && !result.empty() && result.back() == '\\' && i > 1) continue;
+        result += s[i];
+    }
+    while (result.size() > 1 && result.back() == '\\') result.pop_back();
+    return result;
+}
+
+AppId AppIdentityTable::AtomLocked(const std::string& normalized) {
+    auto it = atoms.find(normalized);
+    if (it != atoms.end()) return it->second;
+    AppId id = nextId++;
+    atoms.emplace(normalized, id);
+    return id;
+}
+
+AppId AppIdentityTable::InternNormalizedLocked(const std::string& normalized, std::string_view original) {
+    AppId id = AtomLocked(normalized);
+    if (identities.count(id)) return id;
+
+    auto identity = std::make_unique<AppIdentity>();
+    identity->id = id;
+    identity->path = normalized;
+
+    size_t slash = normalized.rfind('\\');
+    identity->baseNameId = AtomLocked(slash == std::string::npos ? normalized : normalized.substr(slash + 1));
+
+    size_t originalSlash = original.find_last_of("\\/");
+    std::string_view display = originalSlash == std::string_view::npos ? original : original.substr(originalSlash + 1);
+    identity->displayName = std::string(display);
+
+    // Родительские каталоги: "c:", "c:\program files", ... (у UNC — начиная с "\\server")
+    size_t pos = normalized.find('\\', StartsWith(normalized, "\\\\") ? 2 : 1);
+    while (pos != std::string::npos) {
+        identity->directoryIds.push_back(AtomLocked(normalized.substr(0, pos)));
+        pos = normalized.find('\\', pos + 1);
+    }
+
+    identities.emplace(id, std::move(identity));
+    return id;
+}
+
+AppId AppIdentityTable::Intern(std::string_view path) {
+    std::string normalized = NormalizePath(path);
+    if (normalized.empty()) return INVALID_APP_ID;
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    return InternNormalizedLocked(normalized, path);
+}
+
+AppId AppIdentityTable::Find(std::string_view path) const {
+    std::string normalized = NormalizePath(path);
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = atoms.find(normalized);
+    return (it != atoms.end() && identities.count(it->second)) ? it->second : INVALID_APP_ID;
+}
+
+const AppIdentity* AppIdentityTable::Get(AppId id) const {
+    if (id == INVALID_APP_ID) return nullptr;
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = identities.find(id);
+    return it != identities.end() ? it->second.get() : nullptr;
+}
+
+AppMatch AppIdentityTable::ParseMatch(std::string_view appPath) {
+    AppMatch match;
+    size_t last = appPath.find_last_not_of(" \t\"");
+    if (last == std::string_view::npos) return match;
+    appPath = appPath.substr(0, last + 1);
+
+    bool directory = false;
+    if (appPath.back() == '*') {
+        appPath.remove_suffix(1);
+        directory = true;
+    }
+    if (!appPath.empty() && (appPath.back() == '\\' || appPath.back() == '/')) directory = true;
+
+    std::string normalized = NormalizePath(appPath);
+    if (normalized.empty()) return match;
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if (directory) {
+        match.kind = AppMatch::Kind::Directory;
+        match.id = AtomLocked(normalized);
+    }
+    else if (normalized.find('\\') != std::string::npos || normalized.find(':') != std::string::npos) {
+        match.kind = AppMatch::Kind::FullPath;
+        match.id = AtomLocked(normalized);
+    }
+    else {
+        match.kind = AppMatch::Kind::BaseName;
+        match.id = AtomLocked(normalized);
+    }
+    return match;
+}
+
+AppId AppIdentityTable::ForProcess(uint32_t pid, const PathResolver& resolver) {
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::shared_lock<std::shared_mutex> lock(processMutex);
+        auto it = processes.find(pid);
+        if (it != processes.end() && now - it->second.resolvedAt < PID_CACHE_TTL) {
+            return it->second.app;
+        }
+    }
+
+    // Неудачный запрос тоже кэшируется, чтобы не открывать процесс на каждый пакет
+    std::string path = resolver ? resolver(pid) : std::string();
+    AppId app = path.empty() ? INVALID_APP_ID : Intern(path);
+
+    std::unique_lock<std::shared_mutex> lock(processMutex);
+    if (processes.size() >= PID_CACHE_MAX) {
+        for (auto it = processes.begin(); it != processes.end();) {
+            if (now - it->second.resolvedAt >= PID_CACHE_TTL) it = processes.erase(it);
+            else ++it;
+        }
+        if (processes.size() >= PID_CACHE_MAX) processes.clear();
+    }
+    processes[pid] = { app, now };
+    return app;
+}
+
+void AppIdentityTable::ForgetProcess(uint32_t pid) {
+    std::unique_lock<std::shared_mutex> lock(processMutex);
+    processes.erase(pid);
+}
+
+void AppIdentityTable::SetDeviceMap(const std::vector<std::pair<std::string, std::string>>& devices) {
+    std::vector<std::pair<std::string, std::string>> normalized;
+    for (const auto& device : devices) {
+        std::string prefix = LowerSlashes(device.first);
+        while (!prefix.empty() && prefix.back() == '\\') prefix.pop_back();
+        if (!prefix.empty()) normalized.push_back({ prefix, LowerSlashes(device.second) });
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    deviceMap = std::move(normalized);
+}
+
+size_t AppIdentityTable::Size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return identities.size();
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using AppId = uint32_t;
+constexpr AppId INVALID_APP_ID = 0;
+
+// Нормализованная идентичность приложения. Адрес записи стабилен, пока жива таблица.
+struct AppIdentity {
+    AppId id = INVALID_APP_ID;
+    std::string path;                   // нормализованный путь (или только имя файла, если путь неизвестен)
+    std::string displayName;            // имя файла в исходном регистре
+    AppId baseNameId = INVALID_APP_ID;  // id нормализованного имени файла
+    std::vector<AppId> directoryIds;    // id всех родительских каталогов, от корня
+};
+
+// Условие правила на приложение, разобранное из Rule::appPath:
+//   "C:\Program Files\App\app.exe" — полный путь,
+//   "app.exe"                      — имя файла,
+//   "C:\Program Files\App\" или "C:\Program Files\App\*" — каталог (с подкаталогами)
+struct AppMatch {
+    enum class Kind : uint8_t { None, FullPath, BaseName, Directory };
+    Kind kind = Kind::None;
+    AppId id = INVALID_APP_ID;
+
+    bool Matches(const AppIdentity* app) const {
+        switch (kind) {
+        case Kind::None: return true;
+        case Kind::FullPath: return app && app->id == id;
+        case Kind::BaseName: return app && app->baseNameId == id;
+        case Kind::Directory:
+            if (!app) return false;
+            for (AppId dir : app->directoryIds) {
+                if (dir == id) return true;
+            }
+            return false;
+        }
+        return false;
+    }
+
+    bool operator==(const AppMatch& other) const { return kind == other.kind && id == other.id; }
+    bool operator!=(const AppMatch& other) const { return !(*this == other); }
+};
+
+// Таблица интернированных путей приложений и кэш PID -> приложение.
+// Пути, имена файлов и каталоги делят одно пространство id, поэтому сопоставление
+// правила с приложением сводится к сравнению целых чисел.
+class AppIdentityTable {
+public:
+    using PathResolver = std::function<std::string(uint32_t pid)>;
+
+    static AppIdentityTable& Instance();
+
+    // Регистр ASCII, разделители, префиксы \\?\ и \??\, устройства \Device\HarddiskVolumeN
+    std::string NormalizePath(std::string_view path) const;
+
+    AppId Intern(std::string_view path);
+    AppId Find(std::string_view path) const;
+    const AppIdentity* Get(AppId id) const;
+    AppMatch ParseMatch(std::string_view appPath);
+
+    // Приложение процесса: путь запрашивается у resolver только при первой встрече PID
+    // (и повторно по истечении PID_CACHE_TTL — PID переиспользуются системой)
+    AppId ForProcess(uint32_t pid, const PathResolver& resolver);
+    void ForgetProcess(uint32_t pid);
+
+    // Соответствие "\Device\HarddiskVolume3" -> "C:" (заполняется из QueryDosDevice)
+    void SetDeviceMap(const std::vector<std::pair<std::string, std::string>>& devices);
+
+    size_t Size() const;
+
+    static constexpr std::chrono::seconds PID_CACHE_TTL{ 30 };
+    static constexpr size_t PID_CACHE_MAX = 4096;
+
+private:
+    AppIdentityTable() = default;
+
+    AppId AtomLocked(const std::string& normalized);
+    AppId InternNormalizedLocked(const std::string& normalized, std::string_view original);
+
+    struct ProcessEntry {
+        AppId app = INVALID_APP_ID;
+        std::chrono::steady_clock::time_point resolvedAt;
+    };
+
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, AppId> atoms;
+    std::unordered_map<AppId, std::unique_ptr<AppIdentity>> identities;
+    AppId nextId = 1;
+    std::vector<std::pair<std::string, std::string>> deviceMap;     // нормализованные префиксы устройств
+
+    mutable std::shared_mutex processMutex;
+    std::unordered_map<uint32_t, ProcessEntry> processes;
+};
@@ -0,0 +1,145 @@
+// Проверка правил пачками (RuleMatcher::FindBlockingRuleBatch, ConnectionTracker::FindBlockingRuleBatch)
+// против вызовов по одному: сверка ответов и пропускная способность в зависимости от размера
+// пачки. Замок берётся на каждую пачку, как в RuleManager::FindBlockingRuleBatch.
+//
+//   batch_bench [--batches 1,2,4,...,256] [--rules N] [--flows N] [--packets N] [--seed N]
+
+#include "bench_common.h"
+#include "rule_generator.h"
+#include "../connection_tracker.h"
+#include <cstring>
+#include <mutex>
+#include <random>
+
+struct BatchBenchOptions {
+    std::vector<size_t> batches = { 1, 2, 4, 8, 16, 32, 64, 128, 256 };
+    size_t rules = 1000;
+    size_t flows = 20000;
+    size_t packets = 400000;
+    uint32_t seed = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, BatchBenchOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* arg = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(arg, "--batches") == 0) opts.batches = ParseSizeList(value);
+        else if (std::strcmp(arg, "--rules") == 0) opts.rules = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--flows") == 0) opts.flows = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--packets") == 0) opts.packets = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        else return false;
+    }
+    return argc % 2 == 1 && !opts.batches.empty() && opts.flows > 0 && opts.packets > 0;
+}
+
+// Поток пакетов: каждый поток повторяется, около половины пакетов — ответы, так что трекер
+// видит и новые, и установленные соединения
+static std::vector<FlowKey> MakeStream(const std::vector<FlowKey>& flows, size_t packets, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<FlowKey> stream;
+    stream.reserve(packets);
+    size_t window = (std::max)(static_cast<size_t>(1), flows.size() / 8);
+    for (size_t i = 0; i < packets; ++i) {
+        size_t base = (i * flows.size()) / packets;
+        FlowKey flow = flows[(base + rng() % window) % flows.size()];
+        if (rng() % 2) {
+            std::swap(flow.sourceIp, flow.destIp);
+            std::swap(flow.sourcePort, flow.destPort);
+            flow.direction = flow.direction == PacketDirection::Incoming ? PacketDirection::Outgoing : PacketDirection::Incoming;
+        }
+        stream.push_back(flow);
+    }
+    return stream;
+}
+
+static int Id(const CompiledRule* rule) {
+    return rule ? rule->id : -1;
+}
+
+static bool Verify(const RuleMatcher& matcher, const std::vector<FlowKey>& stream, size_t batch) {
+    std::vector<const CompiledRule*> verdicts(batch);
+    for (size_t start = 0; start < stream.size(); start += batch) {
+        size_t n = (std::min)(batch, stream.size() - start);
+        matcher.FindBlockingRuleBatch(stream.data() + start, n, verdicts.data());
+        for (size_t i = 0; i < n; ++i) {
+            if (Id(verdicts[i]) != Id(matcher.FindBlockingRule(stream[start + i]))) {
+                std::fprintf(stderr, "stateless, batch %zu, packet %zu: batch and single verdicts differ\n", batch, start + i);
+                return false;
+            }
+        }
+    }
+
+    ConnectionTracker single;
+    ConnectionTracker batched;
+    std::vector<FlowKey> a = stream;
+    std::vector<FlowKey> b = stream;
+    for (size_t start = 0; start < stream.size(); start += batch) {
+        size_t n = (std::min)(batch, stream.size() - start);
+        uint64_t nowMs = start;
+        batched.FindBlockingRuleBatch(matcher, b.data() + start, n, verdicts.data(), nowMs);
+        for (size_t i = 0; i < n; ++i) {
+            const CompiledRule* expected = single.FindBlockingRule(matcher, a[start + i], nowMs);
+            if (Id(verdicts[i]) != Id(expected) || a[start + i].state != b[start + i].state) {
+                std::fprintf(stderr, "tracked, batch %zu, packet %zu: batch and single verdicts differ\n", batch, start + i);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BatchBenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: batch_bench [--batches 1,2,4,...] [--rules N] [--flows N] [--packets N] [--seed N]\n");
+        return 1;
+    }
+
+    RuleGenerator generator(opts.seed);
+    std::vector<Rule> rules = generator.GenerateRules(opts.rules);
+    std::vector<FlowKey> flows = generator.GenerateTraffic(rules, opts.flows, 0.3);
+    std::vector<FlowKey> stream = MakeStream(flows, opts.packets, opts.seed);
+    RuleMatcher matcher;
+    matcher.Compile(rules);
+    std::mutex ruleMutex;
+
+    for (size_t batch : { static_cast<size_t>(1), static_cast<size_t>(7), static_cast<size_t>(64) }) {
+        if (!Verify(matcher, stream, batch)) return 2;
+    }
+    std::printf("verify:  batch verdicts and connection states match single calls (%zu rules, %zu packets)\n",
+        matcher.Size(), stream.size());
+
+    std::printf("%8s %16s %16s %16s %16s\n", "batch", "stateless Mpps", "stateless ns", "tracked Mpps", "tracked ns");
+    std::vector<const CompiledRule*> verdicts(RuleMatcher::MAX_BATCH);
+    for (size_t batch : opts.batches) {
+        batch = (std::max)(static_cast<size_t>(1), (std::min)(batch, RuleMatcher::MAX_BATCH));
+        size_t blocked = 0;
+
+        auto start = BenchClock::now();
+        for (size_t first = 0; first < stream.size(); first += batch) {
+            size_t n = (std::min)(batch, stream.size() - first);
+            std::lock_guard<std::mutex> lock(ruleMutex);
+            matcher.FindBlockingRuleBatch(stream.data() + first, n, verdicts.data());
+            for (size_t i = 0; i < n; ++i) blocked += verdicts[i] != nullptr;
+        }
+        double stateless = SecondsSince(start);
+
+        ConnectionTracker tracker;
+        std::vector<FlowKey> packets = stream;
+        start = BenchClock::now();
+        for (size_t first = 0; first < packets.size(); first += batch) {
+            size_t n = (std::min)(batch, packets.size() - first);
+            std::lock_guard<std::mutex> lock(ruleMutex);
+            tracker.FindBlockingRuleBatch(matcher, packets.data() + first, n, verdicts.data(), first);
+            for (size_t i = 0; i < n; ++i) blocked += verdicts[i] != nullptr;
+        }
+        double tracked = SecondsSince(start);
+        DoNotOptimize(blocked);
+
+        double count = static_cast<double>(stream.size());
+        std::printf("%8zu %16.2f %16.1f %16.2f %16.1f\n", batch,
+            count / stateless / 1e6, stateless * 1e9 / count, count / tracked / 1e6, tracked * 1e9 / count);
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Общие вспомогательные функции для бенчмарков
+
+using BenchClock = std::chrono::steady_clock;
+
+inline double SecondsSince(BenchClock::time_point start) {
+    return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+inline uint64_t NanosecondsBetween(BenchClock::time_point a, BenchClock::time_point b) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count());
+}
+
+// Перцентиль по отсортированной выборке, p в [0, 1]
+inline uint64_t Percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[(std::min)(index, sorted.size() - 1)];
+}
+
+struct LatencySummary {
+    uint64_t p50 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+};
+
+inline LatencySummary Summarize(std::vector<uint64_t>& samples) {
+    std::sort(samples.begin(), samples.end());
+    LatencySummary s;
+    s.p50 = Percentile(samples, 0.50);
+    s.p99 = Percentile(samples, 0.99);
+    s.p999 = Percentile(samples, 0.999);
+    return s;
+}
+
+// "10,100,1000" -> {10, 100, 1000}
+inline std::vector<size_t> ParseSizeList(const std::string& str) {
+    std::vector<size_t> sizes;
+    size_t start = 0;
+    while (start <= str.size()) {
+        size_t comma = str.find(',', start);
+        std::string part = str.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        if (!part.empty()) sizes.push_back(static_cast<size_t>(std::strtoull(part.c_str(), nullptr, 10)));
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return sizes;
+}
+
+// Не даёт компилятору выбросить результат измеряемого вызова
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
@@ -0,0 +1,398 @@
+// Списки блокировки на миллионы адресов (AddressSet, AddressLists): сверка с прямым перебором,
+// время загрузки и память списка из N записей, скорость проверки адреса с фильтром Блума
+// и без него, замена списка под нагрузкой читателей.
+//
+//   blocklist_bench [--entries N] [--lookups N] [--seed N] [--file LIST]
+
+#include "bench_common.h"
+#include "../address_list.h"
+#include "../ip_utils.h"
+#include "../rule_matcher.h"
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+struct BlocklistBenchOptions {
+    size_t entries = 5000000;
+    size_t lookups = 4000000;
+    uint32_t seed = 1;
+    std::string file;           // готовый список вместо сгенерированного
+};
+
+static bool ParseOptions(int argc, char** argv, BlocklistBenchOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--entries") == 0) opts.entries = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--lookups") == 0) opts.lookups = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+        else if (std::strcmp(argv[i], "--file") == 0) opts.file = argv[i + 1];
+        else return false;
+    }
+    return argc % 2 == 1 && opts.lookups > 0;
+}
+
+static bool Fail(const char* what) {
+    std::fprintf(stderr, "check failed: %s\n", what);
+    return false;
+}
+
+// Пиковый размер процесса (Linux); 0, если недоступен
+static size_t PeakResidentBytes() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+    }
+    return 0;
+}
+
+static std::string FormatIPv6(const uint8_t* a) {
+    char text[48];
+    std::snprintf(text, sizeof(text), "%x:%x:%x:%x:%x:%x:%x:%x",
+        a[0] << 8 | a[1], a[2] << 8 | a[3], a[4] << 8 | a[5], a[6] << 8 | a[7],
+        a[8] << 8 | a[9], a[10] << 8 | a[11], a[12] << 8 | a[13], a[14] << 8 | a[15]);
+    return text;
+}
+
+static bool CheckParser() {
+    uint8_t a[16];
+    uint8_t expected[16] = { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+    if (!ParseIPv6("2001:db8::1", a) || std::memcmp(a, expected, 16) != 0) return Fail("2001:db8::1");
+    uint8_t mapped[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 1, 2, 3, 4 };
+    if (!ParseIPv6("::ffff:1.2.3.4", a) || std::memcmp(a, mapped, 16) != 0) return Fail("::ffff:1.2.3.4");
+    if (!ParseIPv6("::", a) || !ParseIPv6("1:2:3:4:5:6:7:8", a) || !ParseIPv6("fe80::", a)) return Fail("valid IPv6");
+    const char* bad6[] = { "", ":", "1::2::3", "1:2:3:4:5:6:7:8:9", "12345::", "1:2", "1:", "g::", "::1.2.3", "1:2:3:4:5:6:7:1.2.3.4" };
+    for (const char* text : bad6) {
+        if (ParseIPv6(text, a)) return Fail(text);
+    }
+    int length = 0;
+    if (!ParseIPv6Prefix("2001:db8:ffff::/36", a, length) || length != 36 || a[4] != 0xf0 || a[5] != 0) return Fail("IPv6 prefix");
+
+    AddressSetBuilder builder;
+    std::istringstream text(
+        "# feed header\n"
+        "; Spamhaus-style comment\n"
+        "1.2.3.4\n"
+        "10.0.0.0/8 ; SBL123\r\n"
+        "first_seen,ip,port\n"
+        "\"2024-01-01\",\"192.168.5.0-192.168.5.9\",443\n"
+        "2001:db8::/32 # doc range\n"
+        "garbage line\n"
+        "\n"
+        "5.6.7.8");                 // без перевода строки в конце
+    AddressSetBuilder::ParseStats stats;
+    builder.Parse(text, stats);
+    if (stats.lines != 10 || stats.entries != 5 || stats.skipped != 2) return Fail("parse stats");
+    auto set = builder.Build();
+    uint32_t v4 = 0;
+    ParseIPv4("10.255.0.1", v4);
+    if (!set->ContainsIPv4(v4) || !set->ContainsIPv4(0x01020304) || set->ContainsIPv4(0x01020305)) return Fail("plain list");
+    ParseIPv4("192.168.5.9", v4);
+    if (!set->ContainsIPv4(v4) || set->ContainsIPv4(v4 + 1)) return Fail("CSV range");
+    if (!set->ContainsIPv4(0x05060708)) return Fail("last line");
+    ParseIPv6("2001:db8:1234::5", a);
+    if (!set->ContainsIPv6(a)) return Fail("IPv6 in list");
+    ParseIPv6("2001:db9::", a);
+    if (set->ContainsIPv6(a)) return Fail("IPv6 outside list");
+
+    // Поле CSV по номеру: адрес источника во втором поле не должен попасть в список
+    AddressSetBuilder csv;
+    if (!csv.AddLine("8.8.8.8,9.9.9.9,53", 1) || csv.AddLine("8.8.8.8,,53", 1) || csv.AddLine("8.8.8.8", 1)) return Fail("CSV column");
+    set = csv.Build();
+    if (set->ContainsIPv4(0x08080808) || !set->ContainsIPv4(0x09090909)) return Fail("CSV column contents");
+    return true;
+}
+
+// Множество совпадает с прямым перебором: пересекающиеся и смежные диапазоны, вложенные префиксы
+static bool CheckAgainstNaive(std::mt19937_64& rng) {
+    for (int round = 0; round < 200; ++round) {
+        AddressSetBuilder builder;
+        std::vector<std::pair<uint32_t, uint32_t>> ranges;
+        struct Prefix { uint8_t bytes[16]; int length; };
+        std::vector<Prefix> prefixes;
+        // Узкое пространство адресов, чтобы диапазоны и префиксы часто пересекались
+        uint32_t base = static_cast<uint32_t>(rng());
+        size_t count = rng() % 60;
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t first = base + static_cast<uint32_t>(rng() % 4096);
+            uint32_t last = first + static_cast<uint32_t>(rng() % (rng() % 3 == 0 ? 200 : 3));
+            if (last < first) last = first;
+            ranges.push_back({ first, last });
+            builder.AddIPv4Range(first, last);
+
+            Prefix p;
+            std::memset(p.bytes, 0, sizeof(p.bytes));
+            p.bytes[0] = 0x20;
+            p.bytes[1] = 0x01;
+            for (int k = 2; k < 16; ++k) p.bytes[k] = static_cast<uint8_t>(rng() % 4);
+            p.length = static_cast<int>(rng() % 129);
+            for (int bit = p.length; bit < 128; ++bit) p.bytes[bit / 8] &= static_cast<uint8_t>(~(0x80u >> (bit % 8)));
+            prefixes.push_back(p);
+            builder.AddIPv6Prefix(p.bytes, p.length);
+        }
+        auto set = builder.Build();
+        for (int probe = 0; probe < 2000; ++probe) {
+            uint32_t addr = base + static_cast<uint32_t>(rng() % 4400) - 100;
+            if (probe < static_cast<int>(ranges.size()) * 2) {
+                const auto& r = ranges[probe / 2];
+                addr = probe % 2 ? r.second + 1 : r.first - 1;
+            }
+            bool naive = false;
+            for (const auto& r : ranges) naive |= addr >= r.first && addr <= r.second;
+            if (set->ContainsIPv4(addr) != naive) return Fail("IPv4 set differs from naive check");
+
+            uint8_t a[16] = { 0x20, 0x01 };
+            for (int k = 2; k < 16; ++k) a[k] = static_cast<uint8_t>(rng() % 4);
+            if (!prefixes.empty() && probe % 3 == 0) std::memcpy(a, prefixes[probe % prefixes.size()].bytes, 16);
+            naive = false;
+            for (const auto& p : prefixes) {
+                bool match = true;
+                for (int bit = 0; bit < p.length && match; ++bit) {
+                    uint8_t m = static_cast<uint8_t>(0x80u >> (bit % 8));
+                    match = (a[bit / 8] & m) == (p.bytes[bit / 8] & m);
+                }
+                naive |= match;
+            }
+            if (set->ContainsIPv6(a) != naive) return Fail("IPv6 trie differs from naive check");
+        }
+    }
+    return true;
+}
+
+// Промахи с фильтром Блума и без: типичный фид из одиночных адресов и тысячи подсетей,
+// проверяемые адреса в основном не из списка. Ответы с фильтром и без должны совпасть.
+static bool MeasurePrefilter(size_t entries, size_t lookups, std::mt19937_64& rng) {
+    std::vector<uint32_t> singles(entries);
+    for (auto& a : singles) a = static_cast<uint32_t>(rng());
+    std::vector<std::pair<uint32_t, uint32_t>> subnets(1000);
+    for (auto& r : subnets) {
+        uint32_t mask = PrefixToMask(16 + static_cast<int>(rng() % 9));
+        r.first = static_cast<uint32_t>(rng()) & mask;
+        r.second = r.first | ~mask;
+    }
+    std::vector<uint32_t> probes(1 << 20);
+    for (size_t i = 0; i < probes.size(); ++i) {
+        probes[i] = i % 100 == 0 ? singles[i % singles.size()] : static_cast<uint32_t>(rng());
+    }
+
+    std::shared_ptr<const AddressSet> reference;
+    std::vector<uint8_t> expected(probes.size());
+    const double rates[] = { 0, 0.05, 0.01, 0.001 };
+    std::printf("prefilter: %zu addresses + %zu subnets, 99%% of lookups not listed\n", entries, subnets.size());
+    for (double rate : rates) {
+        AddressSetBuilder builder;
+        builder.SetPrefilter(rate);
+        for (uint32_t a : singles) builder.AddIPv4Range(a, a);
+        for (const auto& r : subnets) builder.AddIPv4Range(r.first, r.second);
+        auto start = BenchClock::now();
+        auto set = builder.Build();
+        double buildSeconds = SecondsSince(start);
+
+        size_t hits = 0;
+        start = BenchClock::now();
+        for (size_t i = 0; i < lookups; ++i) hits += set->ContainsIPv4(probes[i & (probes.size() - 1)]);
+        double seconds = SecondsSince(start);
+        DoNotOptimize(hits);
+
+        if (!reference) {
+            reference = set;
+            for (size_t i = 0; i < probes.size(); ++i) expected[i] = set->ContainsIPv4(probes[i]);
+            std::printf("  %-8s %8.1f M lookups/s %6.1f ns   build %.2f s, %.1f MB\n", "off",
+                lookups / seconds / 1e6, seconds * 1e9 / lookups, buildSeconds, set->MemoryBytes() / 1e6);
+            continue;
+        }
+        // Измеренная доля ложных срабатываний: адреса не из узких диапазонов, прошедшие фильтр
+        size_t negatives = 0, falsePositives = 0;
+        for (size_t i = 0; i < probes.size(); ++i) {
+            if (set->ContainsIPv4(probes[i]) != (expected[i] != 0)) return Fail("prefilter changed an answer");
+            if (expected[i]) continue;
+            ++negatives;
+            falsePositives += set->Prefilter().MayContain(probes[i]);
+        }
+        char label[16];
+        std::snprintf(label, sizeof(label), "fp %g", rate);
+        std::printf("  %-8s %8.1f M lookups/s %6.1f ns   build %.2f s, filter %.1f MB, k=%u, "
+            "false positives %.3f%% expected, %.3f%% measured, %zu wide ranges\n",
+            label, lookups / seconds / 1e6, seconds * 1e9 / lookups, buildSeconds,
+            set->Prefilter().MemoryBytes() / 1e6, set->Prefilter().HashCount(),
+            set->Prefilter().EstimatedFalsePositiveRate() * 100, 100.0 * falsePositives / negatives,
+            set->WideRangeCount());
+    }
+    return true;
+}
+
+// Сгенерированный список: одиночные адреса, подсети, диапазоны и 5% IPv6, с комментариями
+static void WriteList(const std::string& path, size_t entries, std::mt19937_64& rng, std::vector<uint32_t>& present) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << "# synthetic threat feed, " << entries << " entries\n";
+    std::string buffer;
+    buffer.reserve(1 << 20);
+    for (size_t i = 0; i < entries; ++i) {
+        uint32_t addr = static_cast<uint32_t>(rng());
+        unsigned kind = static_cast<unsigned>(rng() % 100);
+        if (kind < 80) {
+            buffer += FormatIPv4(addr);
+            if (present.size() < 65536) present.push_back(addr);
+        }
+        else if (kind < 92) {
+            int length = 16 + static_cast<int>(rng() % 15);
+            buffer += FormatIPv4(addr & PrefixToMask(length)) + "/" + std::to_string(length);
+        }
+        else if (kind < 95) {
+            buffer += FormatIPv4(addr) + "-" + FormatIPv4(addr + static_cast<uint32_t>(rng() % 1024));
+        }
+        else {
+            uint8_t a[16];
+            for (auto& b : a) b = static_cast<uint8_t>(rng());
+            a[0] = 0x20;
+            int length = kind < 98 ? 128 : 32 + static_cast<int>(rng() % 33);
+            for (int bit = length; bit < 128; ++bit) a[bit / 8] &= static_cast<uint8_t>(~(0x80u >> (bit % 8)));
+            buffer += FormatIPv6(a);
+            if (length < 128) buffer += "/" + std::to_string(length);
+        }
+        buffer += i % 1000 == 0 ? " # listed\n" : "\n";
+        if (buffer.size() > (1 << 20) - 128) {
+            out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+    }
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+}
+
+int main(int argc, char** argv) {
+    BlocklistBenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: blocklist_bench [--entries N] [--lookups N] [--seed N] [--file LIST]\n");
+        return 1;
+    }
+    std::mt19937_64 rng(opts.seed);
+    if (!CheckParser() || !CheckAgainstNaive(rng)) return 2;
+
+    std::vector<uint32_t> present;
+    std::string path = opts.file;
+    if (path.empty()) {
+        path = "blocklist_bench.tmp";
+        auto start = BenchClock::now();
+        WriteList(path, opts.entries, rng, present);
+        std::printf("generated %zu entries in %.2f s\n", opts.entries, SecondsSince(start));
+    }
+
+    // Загрузка через реестр, как в RuleManager; пик памяти включает накопленные записи сборки
+    size_t residentBefore = PeakResidentBytes();
+    AddressLists& lists = AddressLists::Instance();
+    AddressListSource source;
+    source.path = path;
+    AddressLists::LoadResult load = lists.Load("bench", source);
+    if (!load.ok) {
+        std::fprintf(stderr, "%s\n", load.error.c_str());
+        return 1;
+    }
+    size_t residentPeak = PeakResidentBytes();
+    const AddressList* list = lists.Find("bench");
+    auto set = list->Current();
+    std::printf("load:     %zu entries (%zu lines, %zu skipped) in %.2f s, %.2f M entries/s\n",
+        load.stats.entries, load.stats.lines, load.stats.skipped, load.seconds, load.stats.entries / load.seconds / 1e6);
+    std::printf("memory:   %.1f MB (%.1f bytes/entry): %zu IPv4 ranges after merge, %zu IPv6 prefixes",
+        set->MemoryBytes() / 1e6, static_cast<double>(set->MemoryBytes()) / load.stats.entries,
+        set->IPv4RangeCount(), set->IPv6PrefixCount());
+    if (residentPeak) std::printf("; peak RSS +%.1f MB while loading", (residentPeak - residentBefore) / 1e6);
+    std::printf("\n");
+    for (uint32_t addr : present) {
+        if (!set->ContainsIPv4(addr)) {
+            Fail("listed address not found");
+            return 2;
+        }
+    }
+
+    // Проверка адреса: само множество, список под блокировкой чтения, правило "@bench" в сопоставителе
+    std::vector<uint32_t> probes(1 << 16);
+    for (size_t i = 0; i < probes.size(); ++i) {
+        probes[i] = (i % 4 == 0 && !present.empty()) ? present[i % present.size()] : static_cast<uint32_t>(rng());
+    }
+    auto measure = [&](const char* label, auto contains) {
+        size_t hits = 0;
+        auto start = BenchClock::now();
+        for (size_t i = 0; i < opts.lookups; ++i) hits += contains(probes[i & (probes.size() - 1)]);
+        double seconds = SecondsSince(start);
+        DoNotOptimize(hits);
+        std::printf("%-30s %8.1f M lookups/s  %6.1f ns  (%.1f%% listed)\n", label, opts.lookups / seconds / 1e6,
+            seconds * 1e9 / opts.lookups, 100.0 * hits / opts.lookups);
+    };
+    measure("lookup AddressSet::ContainsIPv4", [&](uint32_t a) { return set->ContainsIPv4(a); });
+    measure("lookup AddressList (locked)", [&](uint32_t a) { return list->ContainsIPv4(a); });
+    Rule rule;
+    rule.id = 1;
+    rule.action = RuleAction::BLOCK;
+    rule.destIp = "@bench";
+    RuleMatcher matcher;
+    matcher.Compile({ rule });
+    measure("RuleMatcher, dest @bench", [&](uint32_t a) {
+        FlowKey flow;
+        flow.destIp = a;
+        flow.ipProtocol = 6;
+        return matcher.FindBlockingRule(flow) != nullptr;
+    });
+    std::vector<std::array<uint8_t, 16>> probes6(4096);
+    for (auto& a : probes6) {
+        for (auto& b : a) b = static_cast<uint8_t>(rng());
+        a[0] = 0x20;
+    }
+    {
+        size_t hits = 0;
+        auto start = BenchClock::now();
+        for (size_t i = 0; i < opts.lookups; ++i) hits += set->ContainsIPv6(probes6[i & (probes6.size() - 1)].data());
+        double seconds = SecondsSince(start);
+        DoNotOptimize(hits);
+        std::printf("%-30s %8.1f M lookups/s  %6.1f ns\n", "lookup AddressSet::ContainsIPv6",
+            opts.lookups / seconds / 1e6, seconds * 1e9 / opts.lookups);
+    }
+    set.reset();
+
+    if (!MeasurePrefilter(opts.entries, opts.lookups, rng)) return 2;
+
+    // Замена под нагрузкой: читатель непрерывно проверяет адреса, которые есть в обеих версиях,
+    // пока список трижды перечитывается; ни один не должен пропасть, задержки — только на подмену
+    std::atomic<bool> stop{ false };
+    std::atomic<size_t> missing{ 0 };
+    std::vector<uint64_t> batchNs;
+    std::thread reader([&]() {
+        size_t i = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            auto t = BenchClock::now();
+            for (int k = 0; k < 256; ++k, ++i) {
+                uint32_t addr = present.empty() ? probes[i & (probes.size() - 1)] : present[i % present.size()];
+                if (!list->ContainsIPv4(addr) && !present.empty()) missing.fetch_add(1, std::memory_order_relaxed);
+            }
+            batchNs.push_back(NanosecondsBetween(t, BenchClock::now()));
+        }
+    });
+    double reloadSeconds = 0;
+    uint64_t versionBefore = list->Version();
+    for (int r = 0; r < 3; ++r) {
+        AddressLists::LoadResult again = lists.Load("bench", source);
+        if (!again.ok) missing.fetch_add(1);
+        reloadSeconds += again.seconds;
+    }
+    // Сама подмена готового множества (с освобождением прежнего) — всё, что видят читатели
+    AddressSetBuilder builder;
+    std::ifstream in(path, std::ios::binary);
+    AddressSetBuilder::ParseStats stats;
+    builder.Parse(in, stats);
+    auto replacement = builder.Build();
+    auto swapStart = BenchClock::now();
+    lists.Get("bench")->Replace(std::move(replacement));
+    double swapSeconds = SecondsSince(swapStart);
+    stop = true;
+    reader.join();
+    LatencySummary latency = Summarize(batchNs);
+    std::printf("reload:   %.2f s each (parse + build, %u cores), swap %.1f us; reader during reloads: %zu batches of 256,\n"
+        "          p50 %llu ns, p99.9 %llu ns, max %llu ns, %zu listed addresses missed\n",
+        reloadSeconds / 3, std::thread::hardware_concurrency(), swapSeconds * 1e6, batchNs.size(),
+        static_cast<unsigned long long>(latency.p50), static_cast<unsigned long long>(latency.p999),
+        static_cast<unsigned long long>(batchNs.empty() ? 0 : batchNs.back()), missing.load());
+    if (opts.file.empty()) std::remove(path.c_str());
+    return missing.load() == 0 && list->Version() == versionBefore + 4 ? 0 : 2;
+}
@@ -0,0 +1,357 @@
+// Пассивный разбор ответов DNS (DnsSnooper): скорость разбора, скорость наполнения
+// IpDomainTable и проверка устойчивости разбора на искажённых сообщениях.
+// Без --pcap трафик синтетический: ответы UDP/53 и TCP/53 со сжатием имён и цепочками CNAME.
+//
+//   dns_bench [--messages N] [--mutations N] [--seed N] [--pcap dns.pcap]
+
+#include "bench_common.h"
+#include "rule_generator.h"
+#include "../dns_snoop.h"
+#include "../ip_utils.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+struct DnsBenchOptions {
+    size_t messages = 200000;
+    size_t mutations = 200000;
+    uint32_t seed = 1;
+    std::string pcapPath;
+};
+
+static bool ParseOptions(int argc, char** argv, DnsBenchOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--messages") == 0) opts.messages = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--mutations") == 0) opts.mutations = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+        else if (std::strcmp(argv[i], "--pcap") == 0) opts.pcapPath = argv[i + 1];
+        else return false;
+    }
+    return argc % 2 == 1 && opts.messages > 0;
+}
+
+// Сборка ответа DNS с указателями сжатия
+class DnsWriter {
+public:
+    explicit DnsWriter(uint16_t id) {
+        Put16(id);
+        Put16(0x8180);      // ответ, рекурсия
+        Put16(1);
+        Put16(0);           // ANCOUNT заполняется в Finish
+        Put16(0);
+        Put16(0);
+    }
+
+    // Возвращает смещение имени для последующих указателей
+    uint16_t Name(const std::string& name) {
+        uint16_t offset = static_cast<uint16_t>(data.size());
+        size_t start = 0;
+        while (start < name.size()) {
+            size_t dot = name.find('.', start);
+            size_t end = dot == std::string::npos ? name.size() : dot;
+            data.push_back(static_cast<uint8_t>(end - start));
+            data.insert(data.end(), name.begin() + start, name.begin() + end);
+            start = end + 1;
+        }
+        data.push_back(0);
+        return offset;
+    }
+
+    void Pointer(uint16_t offset) { Put16(static_cast<uint16_t>(0xC000 | offset)); }
+
+    void Question(const std::string& name, uint16_t type) {
+        questionOffset = Name(name);
+        Put16(type);
+        Put16(1);
+    }
+    uint16_t QuestionOffset() const { return questionOffset; }
+
+    // CNAME: владелец — указатель, цель пишется полностью; возвращает смещение цели
+    uint16_t Cname(uint16_t owner, const std::string& target, uint32_t ttl) {
+        RecordHeader(owner, 5, ttl);
+        size_t lengthAt = data.size();
+        Put16(0);
+        uint16_t targetOffset = Name(target);
+        SetLength(lengthAt);
+        return targetOffset;
+    }
+
+    void A(uint16_t owner, uint32_t ip, uint32_t ttl) {
+        RecordHeader(owner, 1, ttl);
+        Put16(4);
+        Put32(ip);
+    }
+
+    void Aaaa(uint16_t owner, const uint8_t* ip, uint32_t ttl) {
+        RecordHeader(owner, 28, ttl);
+        Put16(16);
+        data.insert(data.end(), ip, ip + 16);
+    }
+
+    std::vector<uint8_t> Finish() {
+        data[6] = static_cast<uint8_t>(answers >> 8);
+        data[7] = static_cast<uint8_t>(answers);
+        return data;
+    }
+
+private:
+    void RecordHeader(uint16_t owner, uint16_t type, uint32_t ttl) {
+        Pointer(owner);
+        Put16(type);
+        Put16(1);
+        Put32(ttl);
+        ++answers;
+    }
+    void SetLength(size_t at) {
+        size_t length = data.size() - at - 2;
+        data[at] = static_cast<uint8_t>(length >> 8);
+        data[at + 1] = static_cast<uint8_t>(length);
+    }
+    void Put16(uint16_t v) {
+        data.push_back(static_cast<uint8_t>(v >> 8));
+        data.push_back(static_cast<uint8_t>(v));
+    }
+    void Put32(uint32_t v) {
+        Put16(static_cast<uint16_t>(v >> 16));
+        Put16(static_cast<uint16_t>(v));
+    }
+
+    std::vector<uint8_t> data;
+    uint16_t answers = 0;
+    uint16_t questionOffset = 0;
+};
+
+static void PutBE16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v >> 8);
+    p[1] = static_cast<uint8_t>(v);
+}
+
+static void PutBE32(uint8_t* p, uint32_t v) {
+    PutBE16(p, static_cast<uint16_t>(v >> 16));
+    PutBE16(p + 2, static_cast<uint16_t>(v));
+}
+
+// IPv4-пакет с сервера DNS (порт 53); для TCP payload уже содержит префикс длины
+static std::vector<uint8_t> WrapIPv4(bool tcp, uint32_t client, uint16_t clientPort, uint32_t seq,
+    const std::vector<uint8_t>& payload) {
+    size_t l4 = tcp ? 20 : 8;
+    std::vector<uint8_t> packet(20 + l4 + payload.size(), 0);
+    packet[0] = 0x45;
+    PutBE16(&packet[2], static_cast<uint16_t>(packet.size()));
+    packet[8] = 64;
+    packet[9] = tcp ? 6 : 17;
+    PutBE32(&packet[12], 0x08080808);
+    PutBE32(&packet[16], client);
+    uint8_t* h = &packet[20];
+    PutBE16(h, 53);
+    PutBE16(h + 2, clientPort);
+    if (tcp) {
+        PutBE32(h + 4, seq);
+        h[12] = 5 << 4;
+        h[13] = 0x18;   // PSH, ACK
+    }
+    else {
+        PutBE16(h + 4, static_cast<uint16_t>(8 + payload.size()));
+    }
+    std::copy(payload.begin(), payload.end(), packet.begin() + 20 + l4);
+    return packet;
+}
+
+struct SyntheticTraffic {
+    std::vector<std::vector<uint8_t>> messages;     // сообщения DNS без обёртки
+    std::vector<std::vector<uint8_t>> packets;      // IPv4-пакеты (UDP и сегменты TCP)
+    std::vector<std::pair<uint32_t, std::string>> expected;     // адрес -> имя из вопроса
+};
+
+static SyntheticTraffic GenerateTraffic(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    SyntheticTraffic traffic;
+    uint32_t tcpSeq = 1000;
+    for (size_t i = 0; i < count; ++i) {
+        std::string question = "www" + std::to_string(rng() % 5000) + ".site" + std::to_string(rng() % 500) + ".example";
+        DnsWriter writer(static_cast<uint16_t>(i));
+        writer.Question(question, 1);
+
+        // 0-2 звена CNAME, затем 1-4 адреса A и иногда AAAA
+        uint16_t owner = writer.QuestionOffset();
+        for (uint32_t hops = rng() % 3; hops > 0; --hops) {
+            owner = writer.Cname(owner, "edge" + std::to_string(rng() % 100) + ".cdn" + std::to_string(rng() % 20) + ".net", 60 + rng() % 600);
+        }
+        for (uint32_t n = 1 + rng() % 4; n > 0; --n) {
+            uint32_t ip = static_cast<uint32_t>(rng());
+            writer.A(owner, ip, 30 + rng() % 3600);
+            if (n == 1) traffic.expected.push_back({ ip, question });
+        }
+        if (rng() % 4 == 0) {
+            uint8_t v6[16];
+            for (auto& b : v6) b = static_cast<uint8_t>(rng());
+            writer.Aaaa(owner, v6, 300);
+        }
+        std::vector<uint8_t> message = writer.Finish();
+
+        uint32_t client = 0xC0A80000 | (rng() % 65536);
+        uint16_t clientPort = static_cast<uint16_t>(1024 + rng() % 60000);
+        if (i % 10 != 0) {
+            traffic.packets.push_back(WrapIPv4(false, client, clientPort, 0, message));
+        }
+        else {
+            // Каждое десятое сообщение — по TCP, разрезанное на два сегмента
+            std::vector<uint8_t> stream(2);
+            PutBE16(stream.data(), static_cast<uint16_t>(message.size()));
+            stream.insert(stream.end(), message.begin(), message.end());
+            size_t split = 1 + rng() % (stream.size() - 1);
+            traffic.packets.push_back(WrapIPv4(true, client, clientPort, tcpSeq,
+                std::vector<uint8_t>(stream.begin(), stream.begin() + split)));
+            traffic.packets.push_back(WrapIPv4(true, client, clientPort, tcpSeq + static_cast<uint32_t>(split),
+                std::vector<uint8_t>(stream.begin() + split, stream.end())));
+            tcpSeq += 100000;
+        }
+        traffic.messages.push_back(std::move(message));
+    }
+    return traffic;
+}
+
+// Известный ответ: question -> CNAME -> CNAME -> A, все имена сжаты
+static bool CheckKnownAnswer() {
+    DnsWriter writer(7);
+    writer.Question("WWW.Example.com", 1);
+    uint16_t first = writer.Cname(writer.QuestionOffset(), "www.example.com.cdn.net", 300);
+    uint16_t second = writer.Cname(first, "e1.cdn.net", 60);
+    writer.A(second, 0x5DB8D822, 20);
+    std::vector<uint8_t> message = writer.Finish();
+
+    std::vector<DnsAddressRecord> records;
+    if (!ParseDnsResponse(message.data(), message.size(), records) || records.size() != 3) return false;
+    const char* names[] = { "e1.cdn.net", "www.example.com.cdn.net", "www.example.com" };
+    for (size_t i = 0; i < 3; ++i) {
+        if (records[i].name != names[i] || records[i].ipv4 != 0x5DB8D822 || records[i].ttl != 20) return false;
+    }
+
+    // Указатель на самого себя и указатель вперёд отвергаются
+    std::vector<uint8_t> loop = message;
+    loop[12] = 0xC0;
+    loop[13] = 12;
+    if (ParseDnsResponse(loop.data(), loop.size(), records)) return false;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    DnsBenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: dns_bench [--messages N] [--mutations N] [--seed N] [--pcap file]\n");
+        return 1;
+    }
+    if (!CheckKnownAnswer()) {
+        std::fprintf(stderr, "known-answer check failed\n");
+        return 2;
+    }
+
+    std::vector<std::vector<uint8_t>> packets;
+    SyntheticTraffic synthetic;
+    if (!opts.pcapPath.empty()) {
+        std::vector<PcapPacket> loaded;
+        std::string error;
+        if (!LoadPcapPackets(opts.pcapPath, SIZE_MAX, loaded, error)) {
+            std::fprintf(stderr, "pcap: %s\n", error.c_str());
+            return 1;
+        }
+        DnsSnooper probe;
+        for (auto& packet : loaded) {
+            if (probe.OnIPv4Packet(packet.ip.data(), packet.ip.size())) packets.push_back(std::move(packet.ip));
+        }
+        std::printf("%zu DNS responses of %zu IPv4 packets in %s\n", packets.size(), loaded.size(), opts.pcapPath.c_str());
+        if (packets.empty()) return 1;
+    }
+    else {
+        synthetic = GenerateTraffic(opts.messages, opts.seed);
+        packets = synthetic.packets;
+    }
+
+    size_t bytes = 0;
+    for (const auto& packet : packets) bytes += packet.size();
+
+    // Только разбор сообщений (без таблицы)
+    if (!synthetic.messages.empty()) {
+        std::vector<DnsAddressRecord> records;
+        size_t found = 0;
+        auto start = BenchClock::now();
+        for (const auto& message : synthetic.messages) {
+            ParseDnsResponse(message.data(), message.size(), records);
+            found += records.size();
+        }
+        double seconds = SecondsSince(start);
+        DoNotOptimize(found);
+        std::printf("parse:    %12.0f msg/s  (%zu address records)\n", synthetic.messages.size() / seconds, found);
+    }
+
+    // Полный путь захвата: IPv4 -> UDP/TCP -> разбор -> IpDomainTable
+    IpDomainTable table;
+    DnsSnooper* snooper = static_cast<DnsSnooper*>(table.AddFeeder(std::make_unique<DnsSnooper>()));
+    auto start = BenchClock::now();
+    for (const auto& packet : packets) {
+        snooper->OnIPv4Packet(packet.data(), packet.size());
+    }
+    double seconds = SecondsSince(start);
+    DnsSnooper::Stats stats = snooper->GetStats();
+    std::printf("snoop:    %12.0f pkt/s  %8.1f MB/s  %llu messages, %llu malformed, %llu IPv4 / %llu IPv6 addresses, table %zu\n",
+        packets.size() / seconds, bytes / seconds / 1e6,
+        static_cast<unsigned long long>(stats.messages), static_cast<unsigned long long>(stats.malformed),
+        static_cast<unsigned long long>(stats.addresses), static_cast<unsigned long long>(stats.ipv6Addresses),
+        table.Size());
+
+    int exitCode = 0;
+    if (!synthetic.expected.empty()) {
+        // Таблица вытесняет самые старые адреса, а в сообщении их не больше четырёх,
+        // поэтому имена последних MAX_ADDRESSES / 4 ответов обязаны быть на месте.
+        // Случайные адреса могут совпасть — допускается доля промахов на уровне коллизий.
+        size_t recent = (std::min)(synthetic.expected.size(), IpDomainTable::MAX_ADDRESSES / 4);
+        size_t recentStart = synthetic.expected.size() - recent;
+        size_t misses = 0;
+        size_t recentMisses = 0;
+        std::vector<uint64_t> latencies;
+        latencies.reserve(synthetic.expected.size());
+        for (size_t i = 0; i < synthetic.expected.size(); ++i) {
+            auto t0 = BenchClock::now();
+            std::string name = table.LookupName(synthetic.expected[i].first);
+            auto t1 = BenchClock::now();
+            latencies.push_back(NanosecondsBetween(t0, t1));
+            if (name.empty()) {
+                ++misses;
+                if (i >= recentStart) ++recentMisses;
+            }
+        }
+        LatencySummary lookup = Summarize(latencies);
+        std::printf("lookup:   p50 %llu ns, p99 %llu ns, %zu of %zu addresses without a name (%zu of last %zu)\n",
+            static_cast<unsigned long long>(lookup.p50), static_cast<unsigned long long>(lookup.p99),
+            misses, synthetic.expected.size(), recentMisses, recent);
+        if (stats.malformed != 0 || recentMisses > recent / 1000) exitCode = 2;
+    }
+
+    // Искажённые сообщения: перевёрнутые байты, обрезка, вставки. Разбор не должен выходить
+    // за границы буфера (собирать с -fsanitize=address для полной проверки).
+    if (opts.mutations > 0) {
+        std::mt19937 rng(opts.seed + 1);
+        const auto& sources = synthetic.messages.empty() ? packets : synthetic.messages;
+        std::vector<DnsAddressRecord> records;
+        size_t accepted = 0;
+        auto mutateStart = BenchClock::now();
+        for (size_t i = 0; i < opts.mutations; ++i) {
+            std::vector<uint8_t> message = sources[rng() % sources.size()];
+            switch (rng() % 3) {
+            case 0:
+                for (uint32_t flips = 1 + rng() % 4; flips > 0; --flips) message[rng() % message.size()] ^= static_cast<uint8_t>(1 + rng() % 255);
+                break;
+            case 1:
+                message.resize(rng() % message.size());
+                break;
+            default:
+                message.insert(message.begin() + rng() % message.size(), static_cast<uint8_t>(rng()));
+                break;
+            }
+            if (ParseDnsResponse(message.data(), message.size(), records)) ++accepted;
+        }
+        std::printf("mutate:   %zu messages in %.2f s, %zu still parsed\n",
+            opts.mutations, SecondsSince(mutateStart), accepted);
+    }
+    return exitCode;
+}
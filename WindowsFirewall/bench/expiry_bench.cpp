@@ -0,0 +1,285 @@
+// Временные правила (Rule::expiresAt) в иерархическом колесе ExpiryWheel: сверка колеса с
+// перебором сроков при тиках, скачках часов и переходе через оборот верхнего уровня; сверка
+// сопоставителя, в который быстрые блокировки дописываются AppendRule и из которого истёкшие
+// снимаются RemoveRule (как RuleManager), с набором, собранным заново; анализатор не считает
+// постоянное правило лишним из-за временного. Стоимость: быстрая блокировка в большом наборе
+// и истечение одного срока в колесе против перебора всех сроков на каждом тике.
+//
+//   expiry_bench [--rules N] [--blocks N] [--timers N] [--packets N] [--seed N]
+
+#include "bench_common.h"
+#include "rule_generator.h"
+#include "../connection_tracker.h"
+#include "../ip_utils.h"
+#include "../rule_analyzer.h"
+#include "../rule_expiry.h"
+#include <cstring>
+#include <map>
+#include <random>
+
+struct ExpiryBenchOptions {
+    size_t rules = 10000;
+    size_t blocks = 2000;           // быстрых блокировок со сроком до часа
+    size_t timers = 100000;         // сроков в колесе для замера
+    size_t packets = 20000;
+    uint32_t seed = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, ExpiryBenchOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* arg = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(arg, "--rules") == 0) opts.rules = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--blocks") == 0) opts.blocks = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--timers") == 0) opts.timers = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--packets") == 0) opts.packets = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        else return false;
+    }
+    return argc % 2 == 1 && opts.rules > 0 && opts.blocks > 0 && opts.timers > 0 && opts.packets > 0;
+}
+
+// Время Unix незадолго до оборота верхнего уровня колеса (2^24 с): сроки за оборотом
+// попадают в overflow и разбираются, когда часы его пройдут
+static const int64_t kStart = (int64_t(101) << 24) - 5000;
+
+static int Id(const CompiledRule* rule) {
+    return rule ? rule->id : -1;
+}
+
+// Случайные постановки, снятия и переносы сроков; часы идут по секунде, прыгают вперёд дальше
+// шага колеса и назад. Ответ Advance — ровно сроки не позже самой дальней позиции часов
+static bool CheckWheel(uint32_t seed) {
+    std::mt19937 rng(seed);
+    ExpiryWheel wheel;
+    std::map<int, int64_t> reference;
+    int64_t now = kStart;
+    int64_t position = now;
+    std::vector<int> expired;
+    size_t fired = 0;
+    size_t jumps = 0;
+    for (size_t step = 0; step < 200000; ++step) {
+        uint32_t op = rng() % 100;
+        int id = static_cast<int>(rng() % 5000);
+        if (op < 40) {
+            int64_t expiresAt = now + static_cast<int64_t>(rng() % 20000) - 5;
+            if (rng() % 50 == 0) expiresAt = now + (int64_t(1) << 24) + rng() % 100000;
+            wheel.Schedule(id, expiresAt);
+            reference[id] = expiresAt;
+            continue;
+        }
+        if (op < 50) {
+            wheel.Cancel(id);
+            reference.erase(id);
+            continue;
+        }
+        if (op < 85) now += 1;
+        else if (op < 95) now += 1 + rng() % 100;
+        else if (op < 98) {
+            now += 5000 + rng() % 20000;
+            ++jumps;
+        }
+        else now -= 1 + rng() % 100;
+        position = (std::max)(position, now);
+        wheel.Advance(now, expired);
+        std::vector<int> expected;
+        for (auto it = reference.begin(); it != reference.end();) {
+            if (it->second > position) {
+                ++it;
+                continue;
+            }
+            expected.push_back(it->first);
+            it = reference.erase(it);
+        }
+        std::sort(expired.begin(), expired.end());
+        if (expired != expected || wheel.Size() != reference.size()) {
+            std::fprintf(stderr, "wheel, step %zu at %lld: %zu expired, expected %zu (%zu pending, expected %zu)\n",
+                step, static_cast<long long>(now - kStart), expired.size(), expected.size(), wheel.Size(), reference.size());
+            return false;
+        }
+        fired += expired.size();
+    }
+    std::printf("wheel:   %zu expirations match a scan of all deadlines (%zu forward jumps, %lld s simulated)\n",
+        fired, jumps, static_cast<long long>(position - kStart));
+    return true;
+}
+
+// Как RuleManager: правило дописывается в конец набора, срок уходит в колесо; истёкшие снимаются
+// по одному. Перекомпиляция — только если AppendRule отказал
+struct TemporaryRules {
+    std::vector<Rule> rules;
+    RuleMatcher matcher;
+    ExpiryWheel expiry;
+    size_t rebuilds = 0;
+
+    void Add(const Rule& rule) {
+        rules.push_back(rule);
+        if (!matcher.AppendRule(rule)) {
+            matcher.Compile(rules);
+            ++rebuilds;
+        }
+        if (rule.expiresAt != 0) expiry.Schedule(rule.id, rule.expiresAt);
+    }
+
+    size_t Expire(int64_t now) {
+        std::vector<int> expired;
+        expiry.Advance(now, expired);
+        for (int id : expired) {
+            rules.erase(std::find_if(rules.begin(), rules.end(), [id](const Rule& r) { return r.id == id; }));
+            matcher.RemoveRule(id);
+        }
+        return expired.size();
+    }
+};
+
+// Блокировка адреса источника потока из трафика, как "Заблокировать IP" в списке соединений
+static Rule QuickBlock(int id, const FlowKey& flow, int64_t expiresAt) {
+    Rule rule;
+    rule.id = id;
+    rule.name = "Quick block " + FormatIPv4(flow.sourceIp);
+    rule.action = RuleAction::BLOCK;
+    rule.direction = flow.direction == PacketDirection::Incoming ? RuleDirection::Inbound : RuleDirection::Outbound;
+    rule.sourceIp = FormatIPv4(flow.sourceIp);
+    rule.expiresAt = expiresAt;
+    return rule;
+}
+
+static bool Verify(const ExpiryBenchOptions& opts, const std::vector<Rule>& base, const std::vector<FlowKey>& traffic,
+    std::vector<uint64_t>& blockNs) {
+    std::mt19937 rng(opts.seed);
+    TemporaryRules set;
+    set.rules = base;
+    set.matcher.Compile(base);
+    set.expiry.Start(kStart);
+    ConnectionTracker tracked;
+    ConnectionTracker fresh;
+    int nextId = 1;
+    for (const auto& rule : base) nextId = (std::max)(nextId, rule.id + 1);
+    uint64_t tick = 1;
+    size_t checked = 0;
+    size_t expired = 0;
+    size_t blocked = 0;
+    size_t added = 0;
+    // Час по минуте: в каждую минуту — новые блокировки со сроком до часа, истёкшие снимаются
+    for (int64_t minute = 0; minute <= 120; ++minute) {
+        int64_t now = kStart + minute * 60;
+        expired += set.Expire(now);
+        for (size_t b = 0; minute < 60 && b < opts.blocks / 60; ++b) {
+            Rule rule = QuickBlock(nextId++, traffic[rng() % traffic.size()], now + 60 + rng() % 3600);
+            auto start = BenchClock::now();
+            set.Add(rule);
+            blockNs.push_back(NanosecondsBetween(start, BenchClock::now()));
+            ++added;
+        }
+        if (minute % 10 != 0) continue;
+        RuleMatcher reference;
+        reference.Compile(set.rules);
+        for (size_t p = 0; p < traffic.size(); ++p) {
+            FlowKey a = traffic[p];
+            FlowKey b = traffic[p];
+            int expected = Id(reference.FindBlockingRule(b));
+            int actual = Id(set.matcher.FindBlockingRule(a));
+            int expectedTracked = Id(fresh.FindBlockingRule(reference, b, tick));
+            int actualTracked = Id(tracked.FindBlockingRule(set.matcher, a, tick));
+            ++tick;
+            if (expected != actual || expectedTracked != actualTracked) {
+                std::fprintf(stderr, "minute %lld, packet %zu: blocking rule %d (tracked %d), expected %d (tracked %d)\n",
+                    static_cast<long long>(minute), p, actual, actualTracked, expected, expectedTracked);
+                return false;
+            }
+            if (actual != -1) ++blocked;
+            ++checked;
+        }
+    }
+    if (expired != added || set.rules.size() != base.size()) {
+        std::fprintf(stderr, "quick blocks: %zu added, %zu expired, %zu rules left of %zu\n",
+            added, expired, set.rules.size(), base.size());
+        return false;
+    }
+    std::printf("verify:  %zu quick blocks added and expired over 2 h, %zu packets agree with recompiled sets "
+        "(%zu blocked, %zu rebuilds, %llu connections revalidated)\n", added, checked, blocked, set.rebuilds,
+        static_cast<unsigned long long>(tracked.GetStats().revalidated));
+    return true;
+}
+
+// Временное правило не заменяет постоянное: постоянное, покрытое им, не лишнее, а два временных
+// правила не сливаются в одно
+static bool CheckAnalyzer() {
+    Rule temporary;
+    temporary.id = 1;
+    temporary.action = RuleAction::BLOCK;
+    temporary.destPortStr = "80";
+    temporary.expiresAt = kStart + 3600;
+    Rule permanent = temporary;
+    permanent.id = 2;
+    permanent.expiresAt = 0;
+    Rule neighbour = temporary;
+    neighbour.id = 3;
+    neighbour.destPortStr = "81";
+    RuleAnalysis before = RuleAnalyzer::Analyze({ temporary, permanent });
+    RuleAnalysis after = RuleAnalyzer::Analyze({ permanent, temporary });
+    RuleAnalysis merged = RuleAnalyzer::Analyze({ temporary, neighbour });
+    if (before.Count(RuleFindingKind::Redundant) != 0 || after.Count(RuleFindingKind::Redundant) != 1
+        || merged.Count(RuleFindingKind::Merged) != 0) {
+        std::fprintf(stderr, "analyzer: %zu redundant with temporary first, %zu with permanent first, %zu merged\n",
+            before.Count(RuleFindingKind::Redundant), after.Count(RuleFindingKind::Redundant),
+            merged.Count(RuleFindingKind::Merged));
+        return false;
+    }
+    std::printf("analyzer: temporary rules cover only rules that expire no later and are never merged\n");
+    return true;
+}
+
+int main(int argc, char** argv) {
+    ExpiryBenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: expiry_bench [--rules N] [--blocks N] [--timers N] [--packets N] [--seed N]\n");
+        return 1;
+    }
+    if (!CheckWheel(opts.seed) || !CheckAnalyzer()) return 2;
+
+    RuleGenerator generator(opts.seed);
+    std::vector<Rule> base = generator.GenerateRules(opts.rules);
+    std::vector<FlowKey> traffic = generator.GenerateTraffic(base, opts.packets, 0.5);
+    std::vector<FlowKey> sample(traffic.begin(), traffic.begin() + (std::min)(traffic.size(), static_cast<size_t>(2000)));
+    std::vector<uint64_t> blockNs;
+    if (!Verify(opts, base, sample, blockNs)) return 2;
+
+    // Сроки до двух часов, часы идут по секунде
+    std::mt19937 rng(opts.seed);
+    std::vector<int64_t> deadlines(opts.timers);
+    for (auto& deadline : deadlines) deadline = kStart + 1 + rng() % 7200;
+    ExpiryWheel wheel;
+    wheel.Start(kStart);
+    auto start = BenchClock::now();
+    for (size_t i = 0; i < deadlines.size(); ++i) wheel.Schedule(static_cast<int>(i), deadlines[i]);
+    double scheduleNs = SecondsSince(start) * 1e9 / deadlines.size();
+    std::vector<int> expired;
+    size_t fired = 0;
+    start = BenchClock::now();
+    for (int64_t now = kStart + 1; now <= kStart + 7200; ++now) {
+        wheel.Advance(now, expired);
+        fired += expired.size();
+    }
+    double wheelSeconds = SecondsSince(start);
+
+    // Без колеса: каждый тик перебирает все сроки
+    const int64_t scanTicks = 200;
+    size_t scanned = 0;
+    start = BenchClock::now();
+    for (int64_t now = kStart + 1; now <= kStart + scanTicks; ++now) {
+        for (int64_t deadline : deadlines) scanned += deadline == now;
+    }
+    double scanUs = SecondsSince(start) * 1e6 / scanTicks;
+    DoNotOptimize(scanned);
+
+    LatencySummary block = Summarize(blockNs);
+    std::printf("%zu rules, %zu quick blocks, %zu timers over 2 h (%zu fired)\n", opts.rules, blockNs.size(),
+        opts.timers, fired);
+    std::printf("%-34s %10.2f %10.2f us  (p50, p99)\n", "quick block (AppendRule)", block.p50 / 1e3, block.p99 / 1e3);
+    std::printf("%-34s %10.1f ns\n", "wheel schedule", scheduleNs);
+    std::printf("%-34s %10.1f ns\n", "wheel advance, per expiry", wheelSeconds * 1e9 / (std::max)(fired, size_t(1)));
+    std::printf("%-34s %10.2f us\n", "wheel advance, per tick", wheelSeconds * 1e6 / 7200);
+    std::printf("%-34s %10.2f us\n", "scan of all deadlines, per tick", scanUs);
+    return fired == opts.timers ? 0 : 2;
+}
@@ -0,0 +1,112 @@
+// Корзины по маске полей (FieldMaskIndex) против общей проверки всех блокирующих правил
+// подряд: сверка ответов FindBlockingRule и цена на смешанных наборах правил.
+//
+//   fieldmask_bench [--sizes 100,1000,10000] [--packets N] [--hit-ratio R] [--seed N]
+
+#include "bench_common.h"
+#include "rule_generator.h"
+#include "../rule_matcher.h"
+#include <cstring>
+
+struct FieldMaskBenchOptions {
+    std::vector<size_t> sizes = { 100, 1000, 10000 };
+    size_t packets = 50000;
+    double hitRatio = 0.3;
+    uint32_t seed = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, FieldMaskBenchOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* arg = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(arg, "--sizes") == 0) opts.sizes = ParseSizeList(value);
+        else if (std::strcmp(arg, "--packets") == 0) opts.packets = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--hit-ratio") == 0) opts.hitRatio = std::atof(value);
+        else if (std::strcmp(arg, "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        else return false;
+    }
+    return argc % 2 == 1 && !opts.sizes.empty() && opts.packets > 0;
+}
+
+struct NamedMix {
+    const char* name;
+    RuleMix mix;
+};
+
+static std::vector<NamedMix> Mixes() {
+    NamedMix standard = { "default", RuleMix() };
+    NamedMix exact = { "exact", RuleMix() };
+    exact.mix.exactIp = 0.6;
+    exact.mix.prefix = 0.05;
+    exact.mix.sourcePrefix = 0.05;
+    exact.mix.app = 0.15;
+    exact.mix.domain = 0.0;
+    NamedMix prefix = { "prefix", RuleMix() };
+    prefix.mix.exactIp = 0.1;
+    prefix.mix.prefix = 0.45;
+    prefix.mix.sourcePrefix = 0.25;
+    prefix.mix.derived = 0.2;
+    return { standard, exact, prefix };
+}
+
+struct PassResult {
+    double ns = 0;
+    double tests = 0;
+    size_t blocked = 0;
+};
+
+static PassResult Run(const RuleMatcher& matcher, const std::vector<FlowKey>& traffic) {
+    PassResult result;
+    size_t tests = 0;
+    auto start = BenchClock::now();
+    for (const auto& flow : traffic) result.blocked += matcher.FindBlockingRule(flow, &tests) != nullptr;
+    double seconds = SecondsSince(start);
+    result.ns = seconds * 1e9 / traffic.size();
+    result.tests = static_cast<double>(tests) / traffic.size();
+    return result;
+}
+
+int main(int argc, char** argv) {
+    FieldMaskBenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: fieldmask_bench [--sizes 100,1000,...] [--packets N] [--hit-ratio R] [--seed N]\n");
+        return 1;
+    }
+
+    std::printf("%-8s %7s %8s %8s %8s %8s %13s %13s %11s %11s %8s\n", "mix", "rules", "buckets", "hashed", "prefixed",
+        "scanned", "generic tests", "masked tests", "generic ns", "masked ns", "speedup");
+    for (const NamedMix& named : Mixes()) {
+        for (size_t size : opts.sizes) {
+            RuleGenerator generator(opts.seed, named.mix);
+            std::vector<Rule> rules = generator.GenerateRules(size);
+            std::vector<FlowKey> traffic = generator.GenerateTraffic(rules, opts.packets, opts.hitRatio);
+
+            RuleMatcher generic;
+            generic.Compile(rules);
+            generic.SetBlockEngine(RuleMatcher::BlockEngine::Linear);
+            RuleMatcher masked;
+            masked.SetBlockEngine(RuleMatcher::BlockEngine::FieldMask);
+            masked.Compile(rules);
+
+            for (size_t p = 0; p < traffic.size(); ++p) {
+                const CompiledRule* expected = generic.FindBlockingRule(traffic[p]);
+                const CompiledRule* actual = masked.FindBlockingRule(traffic[p]);
+                if ((expected ? expected->id : -1) != (actual ? actual->id : -1)) {
+                    std::fprintf(stderr, "%s, %zu rules, packet %zu: rule %d, expected %d\n", named.name, size, p,
+                        actual ? actual->id : -1, expected ? expected->id : -1);
+                    return 2;
+                }
+            }
+
+            PassResult slow = Run(generic, traffic);
+            PassResult fast = Run(masked, traffic);
+            DoNotOptimize(slow.blocked);
+            DoNotOptimize(fast.blocked);
+            const FieldMaskIndex& index = masked.BlockIndex();
+            std::printf("%-8s %7zu %8zu %8zu %8zu %8zu %13.1f %13.1f %11.1f %11.1f %7.1fx\n", named.name, size,
+                index.BucketCount(), index.HashedRules(), index.PrefixedRules(), index.ScannedRules(),
+                slow.tests, fast.tests, slow.ns, fast.ns, slow.ns / (fast.ns > 0 ? fast.ns : 1e-9));
+        }
+    }
+    return 0;
+}
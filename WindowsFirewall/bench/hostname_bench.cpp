@@ -0,0 +1,579 @@
+// Имя сервера из содержимого потоков TCP и QUIC (FlowHostnameTracker): проверка разбора
+// TLS ClientHello, HTTP Host и Initial QUIC (векторы RFC 9001), доменные правила по SNI и
+// скорость пути захвата в сравнении с разбором каждого пакета.
+//
+//   hostname_bench [--flows N] [--packets N] [--mutations N] [--seed N]
+
+#include "bench_common.h"
+#include "../flow_hostname.h"
+#include "../rule_matcher.h"
+#include <cstring>
+#include <random>
+
+struct HostnameBenchOptions {
+    size_t flows = 20000;
+    size_t packets = 30;            // пакетов данных в каждую сторону после классификации
+    size_t mutations = 200000;
+    uint32_t seed = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, HostnameBenchOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--flows") == 0) opts.flows = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--packets") == 0) opts.packets = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--mutations") == 0) opts.mutations = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+        else return false;
+    }
+    return argc % 2 == 1 && opts.flows > 0;
+}
+
+static void Put16(std::vector<uint8_t>& out, size_t v) {
+    out.push_back(static_cast<uint8_t>(v >> 8));
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+static void Set16(std::vector<uint8_t>& out, size_t at, size_t v) {
+    out[at] = static_cast<uint8_t>(v >> 8);
+    out[at + 1] = static_cast<uint8_t>(v);
+}
+
+// ClientHello с SNI после расширения-заполнителя заданного размера (как у браузеров с
+// большими key_share); recordSplit > 0 — сообщение разбито на две записи TLS
+static std::vector<uint8_t> BuildClientHello(const std::string& sni, size_t padding, size_t recordSplit = 0) {
+    std::vector<uint8_t> body;
+    Put16(body, 0x0303);
+    body.insert(body.end(), 32, 0xAB);          // random
+    body.push_back(32);
+    body.insert(body.end(), 32, 0xCD);          // session id
+    Put16(body, 4);
+    Put16(body, 0x1301);
+    Put16(body, 0x1302);
+    body.push_back(1);
+    body.push_back(0);
+
+    size_t extensionsAt = body.size();
+    Put16(body, 0);
+    Put16(body, 0x0033);                        // key_share-подобный заполнитель
+    Put16(body, padding);
+    body.insert(body.end(), padding, 0x5A);
+    Put16(body, 0x0000);                        // server_name
+    Put16(body, sni.size() + 5);
+    Put16(body, sni.size() + 3);
+    body.push_back(0);
+    Put16(body, sni.size());
+    body.insert(body.end(), sni.begin(), sni.end());
+    Put16(body, 0x002B);                        // supported_versions
+    Put16(body, 3);
+    body.push_back(2);
+    Put16(body, 0x0304);
+    Set16(body, extensionsAt, body.size() - extensionsAt - 2);
+
+    std::vector<uint8_t> handshake = { 1, 0, 0, 0 };
+    handshake[1] = static_cast<uint8_t>(body.size() >> 16);
+    handshake[2] = static_cast<uint8_t>(body.size() >> 8);
+    handshake[3] = static_cast<uint8_t>(body.size());
+    handshake.insert(handshake.end(), body.begin(), body.end());
+
+    std::vector<uint8_t> records;
+    size_t split = recordSplit == 0 || recordSplit >= handshake.size() ? handshake.size() : recordSplit;
+    for (size_t start = 0; start < handshake.size();) {
+        size_t length = start == 0 ? split : handshake.size() - start;
+        records.push_back(0x16);
+        Put16(records, 0x0301);
+        Put16(records, length);
+        records.insert(records.end(), handshake.begin() + start, handshake.begin() + start + length);
+        start += length;
+    }
+    return records;
+}
+
+static std::vector<uint8_t> Bytes(const std::string& s) {
+    return std::vector<uint8_t>(s.begin(), s.end());
+}
+
+static std::vector<uint8_t> TcpPacket(uint32_t src, uint16_t sport, uint32_t dst, uint16_t dport,
+    uint32_t seq, uint8_t flags, const uint8_t* payload, size_t size) {
+    std::vector<uint8_t> packet(40 + size, 0);
+    packet[0] = 0x45;
+    Set16(packet, 2, packet.size());
+    packet[8] = 64;
+    packet[9] = 6;
+    for (int i = 0; i < 4; ++i) {
+        packet[12 + i] = static_cast<uint8_t>(src >> (24 - 8 * i));
+        packet[16 + i] = static_cast<uint8_t>(dst >> (24 - 8 * i));
+    }
+    Set16(packet, 20, sport);
+    Set16(packet, 22, dport);
+    for (int i = 0; i < 4; ++i) packet[24 + i] = static_cast<uint8_t>(seq >> (24 - 8 * i));
+    packet[32] = 5 << 4;
+    packet[33] = flags;
+    if (size) std::memcpy(&packet[40], payload, size);
+    return packet;
+}
+
+constexpr uint8_t SYN = 0x02, ACK = 0x10, PSH_ACK = 0x18, FIN_ACK = 0x11;
+
+static bool Fail(const char* what) {
+    std::fprintf(stderr, "check failed: %s\n", what);
+    return false;
+}
+
+static bool CheckParsers() {
+    std::string name;
+    std::vector<uint8_t> hello = BuildClientHello("WWW.Example.COM", 1200);
+    if (ParseTlsClientHello(hello.data(), hello.size(), name) != HostnameParse::Found || name != "www.example.com") {
+        return Fail("TLS SNI");
+    }
+    // Любой обрезанный ClientHello — "нужно ещё", а не отказ
+    for (size_t n = 0; n < hello.size(); ++n) {
+        HostnameParse r = ParseTlsClientHello(hello.data(), n, name);
+        if (r == HostnameParse::NotFound) return Fail("truncated ClientHello rejected");
+    }
+    std::vector<uint8_t> split = BuildClientHello("split.example.net", 600, 100);
+    if (ParseTlsClientHello(split.data(), split.size(), name) != HostnameParse::Found || name != "split.example.net") {
+        return Fail("ClientHello across TLS records");
+    }
+    std::vector<uint8_t> ipLiteral = BuildClientHello("192.0.2.1", 0);
+    if (ParseTlsClientHello(ipLiteral.data(), ipLiteral.size(), name) != HostnameParse::NotFound) {
+        return Fail("IP literal in SNI");
+    }
+
+    std::vector<uint8_t> request = Bytes("GET /index.html HTTP/1.1\r\nUser-Agent: x\r\nHOST: Example.org:8080\r\n\r\n");
+    if (ParseHttpHost(request.data(), request.size(), name) != HostnameParse::Found || name != "example.org") {
+        return Fail("HTTP Host");
+    }
+    for (size_t n = 0; n + 4 < request.size(); ++n) {
+        if (ParseHttpHost(request.data(), n, name) == HostnameParse::NotFound) return Fail("truncated HTTP request rejected");
+    }
+    std::vector<uint8_t> ssh = Bytes("SSH-2.0-OpenSSH_9.6\r\n");
+    if (ParseHttpHost(ssh.data(), ssh.size(), name) != HostnameParse::NotFound) return Fail("non-HTTP accepted");
+    std::vector<uint8_t> noHost = Bytes("GET / HTTP/1.0\r\nAccept: */*\r\n\r\n");
+    if (ParseHttpHost(noHost.data(), noHost.size(), name) != HostnameParse::NotFound) return Fail("HTTP without Host");
+    return true;
+}
+
+static bool CheckTracker() {
+    FlowHostnameTracker tracker;
+    FlowHostname out;
+    const uint32_t client = 0xC0A80A02, server = 0x5DB8D822;
+    std::vector<uint8_t> hello = BuildClientHello("cdn-site.example", 1500);
+
+    // SYN, ClientHello в трёх сегментах, повтор первого сегмента, ответ сервера, FIN
+    auto syn = TcpPacket(client, 50000, server, 443, 999, SYN, nullptr, 0);
+    if (tracker.OnIPv4Packet(syn.data(), syn.size(), out)) return Fail("named before data");
+    size_t cut1 = 500, cut2 = 1100;
+    auto s1 = TcpPacket(client, 50000, server, 443, 1000, PSH_ACK, hello.data(), cut1);
+    auto s2 = TcpPacket(client, 50000, server, 443, 1000 + static_cast<uint32_t>(cut1), PSH_ACK, hello.data() + cut1, cut2 - cut1);
+    auto s3 = TcpPacket(client, 50000, server, 443, 1000 + static_cast<uint32_t>(cut2), PSH_ACK, hello.data() + cut2, hello.size() - cut2);
+    if (tracker.OnIPv4Packet(s1.data(), s1.size(), out)) return Fail("named after first segment");
+    if (tracker.OnIPv4Packet(s1.data(), s1.size(), out)) return Fail("retransmission");
+    if (tracker.OnIPv4Packet(s2.data(), s2.size(), out)) return Fail("named after second segment");
+    if (!tracker.OnIPv4Packet(s3.data(), s3.size(), out) || out.name != "cdn-site.example" || out.serverIsSource) {
+        return Fail("ClientHello across segments");
+    }
+    std::vector<uint8_t> reply(1200, 0x17);
+    auto r1 = TcpPacket(server, 443, client, 50000, 5000, PSH_ACK, reply.data(), reply.size());
+    if (!tracker.OnIPv4Packet(r1.data(), r1.size(), out) || !out.serverIsSource) return Fail("server-side packet");
+    auto fin = TcpPacket(client, 50000, server, 443, 1000 + static_cast<uint32_t>(hello.size()), FIN_ACK, nullptr, 0);
+    tracker.OnIPv4Packet(fin.data(), fin.size(), out);
+    if (tracker.Size() != 0) return Fail("FIN keeps the flow");
+
+    // Протокол с приветствием сервера и поток с потерянным сегментом остаются без имени
+    std::vector<uint8_t> banner = Bytes("220 mail.example ESMTP\r\n");
+    auto b = TcpPacket(server, 25, client, 50001, 1, PSH_ACK, banner.data(), banner.size());
+    if (tracker.OnIPv4Packet(b.data(), b.size(), out)) return Fail("server banner");
+    auto gap1 = TcpPacket(client, 50002, server, 443, 1, PSH_ACK, hello.data(), 300);
+    auto gap3 = TcpPacket(client, 50002, server, 443, 901, PSH_ACK, hello.data() + 900, hello.size() - 900);
+    tracker.OnIPv4Packet(gap1.data(), gap1.size(), out);
+    if (tracker.OnIPv4Packet(gap3.data(), gap3.size(), out)) return Fail("named across a gap");
+    if (tracker.GetStats().unnamed != 2) return Fail("unnamed count");
+    return true;
+}
+
+// Доменное правило на общем адресе CDN: имя из SNI важнее таблицы DNS
+static bool CheckRules() {
+    IpDomainTable table;
+    const uint32_t shared = 0x5DB8D822;
+    table.Associate(shared, "blocked.example", std::chrono::seconds(300));
+    table.Associate(shared, "allowed.example", std::chrono::seconds(300));
+
+    Rule rule;
+    rule.id = 1;
+    rule.action = RuleAction::BLOCK;
+    rule.direction = RuleDirection::Outbound;
+    rule.destIp = "blocked.example";
+    RuleMatcher matcher;
+    matcher.SetDomainTable(&table);
+    matcher.Compile({ rule });
+
+    FlowKey flow;
+    flow.sourceIp = 0xC0A80A02;
+    flow.destIp = shared;
+    flow.ipProtocol = 6;
+    flow.destPort = 443;
+    flow.direction = PacketDirection::Outgoing;
+    if (!matcher.FindBlockingRule(flow)) return Fail("DNS-only match");
+    flow.serverName = "allowed.example";
+    if (matcher.FindBlockingRule(flow)) return Fail("SNI of another site blocked");
+    flow.serverName = "blocked.example";
+    if (!matcher.FindBlockingRule(flow)) return Fail("SNI match");
+    // Ответ сервера: имя относится к источнику, правило на адрес назначения не срабатывает
+    std::swap(flow.sourceIp, flow.destIp);
+    flow.serverIsSource = true;
+    if (matcher.FindBlockingRule(flow)) return Fail("server side of reply");
+    return true;
+}
+
+static std::vector<uint8_t> Hex(const char* hex) {
+    std::vector<uint8_t> out;
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+        out.push_back(static_cast<uint8_t>(std::strtoul(std::string(hex + i, 2).c_str(), nullptr, 16)));
+    }
+    return out;
+}
+
+static bool Equal(const uint8_t* data, const char* hex) {
+    std::vector<uint8_t> expected = Hex(hex);
+    return std::memcmp(data, expected.data(), expected.size()) == 0;
+}
+
+// Известные векторы: FIPS 180-2, FIPS-197, RFC 5869 (случай 1), тесты GCM McGrew-Viega
+static bool CheckCryptoVectors() {
+    std::vector<uint8_t> abc = Bytes("abc");
+    if (!Equal(Sha256(abc.data(), abc.size()).data(), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad")) {
+        return Fail("SHA-256");
+    }
+    std::vector<uint8_t> key = Hex("000102030405060708090a0b0c0d0e0f");
+    std::vector<uint8_t> plain = Hex("00112233445566778899aabbccddeeff");
+    uint8_t block[16];
+    Aes128(key.data()).EncryptBlock(plain.data(), block);
+    if (!Equal(block, "69c4e0d86a7b0430d8cdb78070b4c55a")) return Fail("AES-128");
+
+    std::vector<uint8_t> ikm(22, 0x0b);
+    std::vector<uint8_t> salt = Hex("000102030405060708090a0b0c");
+    std::vector<uint8_t> info = Hex("f0f1f2f3f4f5f6f7f8f9");
+    Sha256Digest prk = HkdfExtract(salt.data(), salt.size(), ikm.data(), ikm.size());
+    if (!Equal(prk.data(), "077709362c2e32df0ddc3f0dc47bba6390b6c73bb50f9c3122ec844ad7c2b3e5")) return Fail("HKDF-Extract");
+    std::vector<uint8_t> okm = HkdfExpand(prk, info.data(), info.size(), 42);
+    if (!Equal(okm.data(), "3cb25f25faacd57a90434f64d0362f2a2d2d0a90cf1a5a4c5db02d56ecc4c5bf34007208d5b887185865")) {
+        return Fail("HKDF-Expand");
+    }
+
+    uint8_t zeroKey[16] = {}, nonce[12] = {}, zeroBlock[16] = {};
+    Aes128Gcm gcm(zeroKey);
+    std::vector<uint8_t> sealed, opened;
+    gcm.Seal(nonce, nullptr, 0, nullptr, 0, sealed);
+    if (sealed.size() != 16 || !Equal(sealed.data(), "58e2fccefa7e3061367f1d57a4e7455a")) return Fail("GCM empty");
+    gcm.Seal(nonce, nullptr, 0, zeroBlock, 16, sealed);
+    if (sealed.size() != 32 || !Equal(sealed.data(), "0388dace60b6a392f328c2b971b2fe78ab6e47d42cec13bdf53a67b21257bddf")) {
+        return Fail("GCM one block");
+    }
+    if (!gcm.Open(nonce, nullptr, 0, sealed.data(), sealed.size(), opened) || opened != std::vector<uint8_t>(16, 0)) {
+        return Fail("GCM open");
+    }
+    sealed[3] ^= 1;
+    if (gcm.Open(nonce, nullptr, 0, sealed.data(), sealed.size(), opened)) return Fail("GCM forged tag accepted");
+    return true;
+}
+
+static std::vector<uint8_t> UdpPacket(uint32_t src, uint16_t sport, uint32_t dst, uint16_t dport,
+    const uint8_t* payload, size_t size) {
+    std::vector<uint8_t> packet(28 + size, 0);
+    packet[0] = 0x45;
+    Set16(packet, 2, packet.size());
+    packet[8] = 64;
+    packet[9] = 17;
+    for (int i = 0; i < 4; ++i) {
+        packet[12 + i] = static_cast<uint8_t>(src >> (24 - 8 * i));
+        packet[16 + i] = static_cast<uint8_t>(dst >> (24 - 8 * i));
+    }
+    Set16(packet, 20, sport);
+    Set16(packet, 22, dport);
+    Set16(packet, 24, 8 + size);
+    if (size) std::memcpy(&packet[28], payload, size);
+    return packet;
+}
+
+// Кадр CRYPTO с 4-байтовыми смещением и длиной
+static void PutCryptoFrame(std::vector<uint8_t>& frames, size_t offset, const uint8_t* data, size_t size) {
+    frames.push_back(0x06);
+    for (size_t v : { offset, size }) {
+        frames.push_back(static_cast<uint8_t>(0x80 | (v >> 24)));
+        frames.push_back(static_cast<uint8_t>(v >> 16));
+        frames.push_back(static_cast<uint8_t>(v >> 8));
+        frames.push_back(static_cast<uint8_t>(v));
+    }
+    frames.insert(frames.end(), data, data + size);
+}
+
+// Защищённый пакет Initial клиента, дополненный до 1200 байт датаграммы, как требует RFC 9000
+static std::vector<uint8_t> BuildQuicInitial(const std::vector<uint8_t>& dcid, uint32_t packetNumber,
+    std::vector<uint8_t> frames) {
+    std::vector<uint8_t> header = { 0xC3, 0, 0, 0, 1, static_cast<uint8_t>(dcid.size()) };
+    for (uint8_t b : dcid) header.push_back(b);
+    header.push_back(0);                        // SCID пустой
+    header.push_back(0);                        // токена нет
+    size_t headerSize = header.size() + 2 + 4;
+    if (headerSize + frames.size() + 16 < 1200) frames.resize(1200 - headerSize - 16, 0);
+    Put16(header, 0x4000 | (4 + frames.size() + 16));
+    for (int i = 0; i < 4; ++i) header.push_back(static_cast<uint8_t>(packetNumber >> (24 - 8 * i)));
+
+    QuicInitialKeys keys;
+    DeriveQuicInitialKeys(dcid.data(), dcid.size(), true, keys);
+    std::vector<uint8_t> packet;
+    QuicInitialProtection(keys).Seal(header, 4, frames.data(), frames.size(), packet);
+    return packet;
+}
+
+// ClientHello без записи TLS — так он идёт в кадрах CRYPTO
+static std::vector<uint8_t> BuildQuicClientHello(const std::string& sni, size_t padding) {
+    std::vector<uint8_t> records = BuildClientHello(sni, padding);
+    return std::vector<uint8_t>(records.begin() + 5, records.end());
+}
+
+// RFC 9001, приложение A: ключи для DCID 8394c8f03e515708 и защищённый Initial клиента
+static bool CheckQuicVectors() {
+    std::vector<uint8_t> dcid = Hex("8394c8f03e515708");
+    QuicInitialKeys client, server;
+    DeriveQuicInitialKeys(dcid.data(), dcid.size(), true, client);
+    DeriveQuicInitialKeys(dcid.data(), dcid.size(), false, server);
+    if (!Equal(client.key, "1f369613dd76d5467730efcbe3b1a22d") || !Equal(client.iv, "fa044b2f42a3fd3b46fb255c")
+        || !Equal(client.hp, "9f50449e04a0e810283a1e9933adedd2")) {
+        return Fail("QUIC client Initial keys");
+    }
+    if (!Equal(server.key, "cf3a5331653c364c88f0f379b6067e37") || !Equal(server.iv, "0ac1493ca1905853b0bba03e")
+        || !Equal(server.hp, "c206b8d9b9f0f37644430b490eeaa314")) {
+        return Fail("QUIC server Initial keys");
+    }
+
+    std::vector<uint8_t> header = Hex("c300000001088394c8f03e5157080000449e00000002");
+    std::vector<uint8_t> frames = Hex("060040f1010000ed0303ebf8fa56f12939b9584a3896472ec40bb863cfd3e86804fe3a47f06a2b69484c"
+        "00000413011302010000c000000010000e00000b6578616d706c652e636f6dff01000100000a00080006001d0017001800100007000504"
+        "616c706e000500050100000000003300260024001d00209370b2c9caa47fbabaf4559fedba753de171fa71f50f1ce15d43e994ec74d748"
+        "002b0003020304000d0010000e0403050306030203080408050806002d00020101001c00024001003900320408ffffffffffffffff0504"
+        "8000ffff07048000ffff0801100104800075300901100f088394c8f03e51570806048000ffff");
+    frames.resize(1162, 0);
+    QuicInitialProtection protection(client);
+    std::vector<uint8_t> packet;
+    protection.Seal(header, 4, frames.data(), frames.size(), packet);
+    if (packet.size() != 1200 || packet[0] != 0xC0 || !Equal(packet.data() + 18, "7b9aec34")
+        || !Equal(packet.data() + 22, "d1b1c98dd7689fb8ec11d242b123dc9b")) {
+        return Fail("QUIC Initial protection (RFC 9001 A.2)");
+    }
+    QuicInitialHeader parsed;
+    std::vector<uint8_t> opened;
+    uint64_t packetNumber = 0;
+    if (!ParseQuicInitialHeader(packet.data(), packet.size(), parsed) || parsed.packetLength != packet.size()
+        || !protection.Open(packet.data(), parsed, opened, packetNumber) || packetNumber != 2 || opened != frames) {
+        return Fail("QUIC Initial open");
+    }
+    QuicCryptoStream stream;
+    std::string name;
+    if (!stream.AddFrames(opened.data(), opened.size())
+        || ParseTlsHandshakeClientHello(stream.Data(), stream.ContiguousSize(), name) != HostnameParse::Found
+        || name != "example.com") {
+        return Fail("QUIC ClientHello SNI");
+    }
+    packet[100] ^= 0x40;
+    if (protection.Open(packet.data(), parsed, opened, packetNumber)) return Fail("QUIC damaged packet opened");
+
+    // Трекер: датаграмма с A.2, затем ответ сервера
+    FlowHostnameTracker tracker;
+    FlowHostname out;
+    const uint32_t host = 0xC0A80A02, remote = 0x8EFAB80E;
+    packet[100] ^= 0x40;
+    auto datagram = UdpPacket(host, 51000, remote, 443, packet.data(), packet.size());
+    if (!tracker.OnIPv4Packet(datagram.data(), datagram.size(), out) || out.name != "example.com" || out.serverIsSource) {
+        return Fail("QUIC tracker");
+    }
+    std::vector<uint8_t> shortHeader(300, 0x41);
+    auto reply = UdpPacket(remote, 443, host, 51000, shortHeader.data(), shortHeader.size());
+    if (!tracker.OnIPv4Packet(reply.data(), reply.size(), out) || !out.serverIsSource) return Fail("QUIC server datagram");
+
+    // ClientHello больше одного пакета: вторая половина приходит первой, обе — в разных датаграммах
+    std::vector<uint8_t> hello = BuildQuicClientHello("big-hello.example", 1800);
+    std::vector<uint8_t> dcid2 = Hex("0011223344556677");
+    size_t cut = 1000;
+    std::vector<uint8_t> first, second;
+    PutCryptoFrame(second, cut, hello.data() + cut, hello.size() - cut);
+    PutCryptoFrame(first, 0, hello.data(), cut);
+    auto p1 = BuildQuicInitial(dcid2, 1, second);
+    auto p0 = BuildQuicInitial(dcid2, 0, first);
+    auto d1 = UdpPacket(host, 51001, remote, 443, p1.data(), p1.size());
+    auto d0 = UdpPacket(host, 51001, remote, 443, p0.data(), p0.size());
+    if (tracker.OnIPv4Packet(d1.data(), d1.size(), out)) return Fail("QUIC named from a partial ClientHello");
+    if (!tracker.OnIPv4Packet(d0.data(), d0.size(), out) || out.name != "big-hello.example") {
+        return Fail("QUIC ClientHello across packets");
+    }
+
+    // Посторонний UDP на 443 (не Initial) и DNS не заводят потоков
+    auto dns = UdpPacket(host, 53000, remote, 53, shortHeader.data(), shortHeader.size());
+    auto junk = UdpPacket(host, 51002, remote, 443, shortHeader.data(), shortHeader.size());
+    tracker.OnIPv4Packet(dns.data(), dns.size(), out);
+    tracker.OnIPv4Packet(junk.data(), junk.size(), out);
+    if (tracker.Size() != 2 || tracker.GetStats().quic != 2) return Fail("QUIC flow accounting");
+    return true;
+}
+
+int main(int argc, char** argv) {
+    HostnameBenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: hostname_bench [--flows N] [--packets N] [--mutations N] [--seed N]\n");
+        return 1;
+    }
+    if (!CheckParsers() || !CheckTracker() || !CheckRules() || !CheckCryptoVectors() || !CheckQuicVectors()) return 2;
+
+    // Потоки: 60% TLS (ClientHello 1-2 КБ в двух сегментах), 20% QUIC (Initial клиента, затем
+    // пакеты с коротким заголовком), 20% HTTP; пакеты потоков перемешаны, как в реальном захвате
+    std::mt19937 rng(opts.seed);
+    std::vector<std::vector<std::vector<uint8_t>>> perFlow(opts.flows);
+    std::vector<uint8_t> data(1200, 0x17);
+    for (size_t i = 0; i < opts.flows; ++i) {
+        auto& packets = perFlow[i];
+        uint32_t client = 0x0A000000 | static_cast<uint32_t>(rng() & 0xFFFFFF);
+        uint32_t server = 0x68000000 | static_cast<uint32_t>(rng() % 4096);    // немного общих адресов CDN
+        uint16_t port = static_cast<uint16_t>(1024 + rng() % 60000);
+        std::string host = "h" + std::to_string(rng() % 100000) + ".site" + std::to_string(rng() % 3000) + ".example";
+        unsigned kind = rng() % 5;
+        if (kind == 1) {
+            std::vector<uint8_t> dcid(8);
+            for (auto& b : dcid) b = static_cast<uint8_t>(rng());
+            std::vector<uint8_t> hello = BuildQuicClientHello(host, 256 + rng() % 600);
+            std::vector<uint8_t> frames;
+            PutCryptoFrame(frames, 0, hello.data(), hello.size());
+            std::vector<uint8_t> initial = BuildQuicInitial(dcid, 0, frames);
+            packets.push_back(UdpPacket(client, port, server, 443, initial.data(), initial.size()));
+            std::vector<uint8_t> ack(40, 0x43);
+            for (size_t k = 0; k < opts.packets; ++k) {
+                packets.push_back(UdpPacket(server, 443, client, port, data.data(), data.size()));
+                packets.push_back(UdpPacket(client, port, server, 443, ack.data(), ack.size()));
+            }
+            continue;
+        }
+        bool tls = kind != 0;
+        std::vector<uint8_t> first = tls
+            ? BuildClientHello(host, 512 + rng() % 1200)
+            : Bytes("GET / HTTP/1.1\r\nHost: " + host + "\r\nAccept: */*\r\n\r\n");
+        uint16_t serverPort = tls ? 443 : 80;
+        packets.push_back(TcpPacket(client, port, server, serverPort, 100, SYN, nullptr, 0));
+        size_t cut = tls ? first.size() / 2 : first.size();
+        packets.push_back(TcpPacket(client, port, server, serverPort, 101, PSH_ACK, first.data(), cut));
+        if (cut < first.size()) {
+            packets.push_back(TcpPacket(client, port, server, serverPort, 101 + static_cast<uint32_t>(cut), PSH_ACK,
+                first.data() + cut, first.size() - cut));
+        }
+        uint32_t clientSeq = 101 + static_cast<uint32_t>(first.size());
+        for (size_t k = 0; k < opts.packets; ++k) {
+            packets.push_back(TcpPacket(server, serverPort, client, port, 7000 + static_cast<uint32_t>(k * data.size()),
+                PSH_ACK, data.data(), data.size()));
+            packets.push_back(TcpPacket(client, port, server, serverPort, clientSeq, ACK, nullptr, 0));
+        }
+        packets.push_back(TcpPacket(client, port, server, serverPort, clientSeq, FIN_ACK, nullptr, 0));
+    }
+    std::vector<std::vector<uint8_t>> traffic;
+    std::vector<size_t> cursor(opts.flows, 0);
+    const size_t window = 256;      // одновременно активных потоков
+    for (size_t base = 0; base < opts.flows; base += window) {
+        size_t end = (std::min)(opts.flows, base + window);
+        bool any = true;
+        while (any) {
+            any = false;
+            for (size_t i = base; i < end; ++i) {
+                if (cursor[i] < perFlow[i].size()) {
+                    traffic.push_back(std::move(perFlow[i][cursor[i]++]));
+                    any = true;
+                }
+            }
+        }
+    }
+    perFlow.clear();
+    size_t bytes = 0;
+    for (const auto& packet : traffic) bytes += packet.size();
+
+    FlowHostnameTracker tracker;
+    FlowHostname out;
+    size_t named = 0;
+    auto start = BenchClock::now();
+    for (const auto& packet : traffic) {
+        if (tracker.OnIPv4Packet(packet.data(), packet.size(), out)) ++named;
+    }
+    double seconds = SecondsSince(start);
+    FlowHostnameTracker::Stats stats = tracker.GetStats();
+    std::printf("tracker:  %12.0f pkt/s  %8.1f MB/s  %zu packets, %zu with a name\n",
+        traffic.size() / seconds, bytes / seconds / 1e6, traffic.size(), named);
+    std::printf("          %llu flows: %llu SNI, %llu QUIC, %llu Host, %llu unnamed; inspected %llu of %zu bytes (%.2f%%)\n",
+        static_cast<unsigned long long>(stats.flows), static_cast<unsigned long long>(stats.tls),
+        static_cast<unsigned long long>(stats.quic), static_cast<unsigned long long>(stats.http),
+        static_cast<unsigned long long>(stats.unnamed),
+        static_cast<unsigned long long>(stats.inspectedBytes), bytes, 100.0 * stats.inspectedBytes / bytes);
+
+    // Для сравнения: разбор содержимого каждого пакета TCP без состояния потока
+    std::string name;
+    size_t found = 0;
+    start = BenchClock::now();
+    for (const auto& packet : traffic) {
+        if (packet[9] != 6) continue;
+        size_t payloadSize = packet.size() - 40;
+        if (payloadSize == 0) continue;
+        const uint8_t* payload = packet.data() + 40;
+        HostnameParse r = payload[0] == 0x16
+            ? ParseTlsClientHello(payload, payloadSize, name)
+            : ParseHttpHost(payload, payloadSize, name);
+        if (r == HostnameParse::Found) ++found;
+    }
+    double naive = SecondsSince(start);
+    DoNotOptimize(found);
+    std::printf("per-packet parse: %12.0f pkt/s (no reassembly, %zu names)\n", traffic.size() / naive, found);
+
+    // Цена классификации QUIC: вывод ключей и расшифровка одного Initial на поток
+    std::vector<const std::vector<uint8_t>*> initials;
+    for (const auto& packet : traffic) {
+        QuicInitialHeader header;
+        if (packet[9] == 17 && ParseQuicInitialHeader(packet.data() + 28, packet.size() - 28, header)) {
+            initials.push_back(&packet);
+        }
+    }
+    if (!initials.empty()) {
+        std::vector<uint8_t> frames;
+        size_t opened = 0;
+        start = BenchClock::now();
+        for (const auto* packet : initials) {
+            QuicInitialHeader header;
+            ParseQuicInitialHeader(packet->data() + 28, packet->size() - 28, header);
+            QuicInitialKeys keys;
+            DeriveQuicInitialKeys(header.dcid, header.dcidLength, true, keys);
+            uint64_t packetNumber = 0;
+            if (QuicInitialProtection(keys).Open(packet->data() + 28, header, frames, packetNumber)) ++opened;
+        }
+        double quicSeconds = SecondsSince(start);
+        DoNotOptimize(opened);
+        std::printf("QUIC Initial: %12.0f /s (keys + open, %.1f us each)\n",
+            initials.size() / quicSeconds, quicSeconds * 1e6 / initials.size());
+    }
+
+    int exitCode = 0;
+    if (stats.tls + stats.quic + stats.http != opts.flows || stats.unnamed != 0) {
+        std::fprintf(stderr, "expected every flow to be named\n");
+        exitCode = 2;
+    }
+
+    // Искажённые ClientHello: разбор не должен выходить за границы (собирать с -fsanitize=address)
+    if (opts.mutations > 0) {
+        std::mt19937 mutateRng(opts.seed + 1);
+        std::vector<uint8_t> base = BuildClientHello("mutate.example.com", 300, 120);
+        size_t accepted = 0;
+        auto mutateStart = BenchClock::now();
+        for (size_t i = 0; i < opts.mutations; ++i) {
+            std::vector<uint8_t> m = base;
+            for (uint32_t flips = 1 + mutateRng() % 4; flips > 0; --flips) {
+                m[mutateRng() % m.size()] = static_cast<uint8_t>(mutateRng());
+            }
+            if (mutateRng() % 3 == 0) m.resize(mutateRng() % m.size());
+            if (ParseTlsClientHello(m.data(), m.size(), name) == HostnameParse::Found) ++accepted;
+        }
+        std::printf("mutate:   %zu ClientHellos in %.2f s, %zu still named\n",
+            opts.mutations, SecondsSince(mutateStart), accepted);
+    }
+    return exitCode;
+}
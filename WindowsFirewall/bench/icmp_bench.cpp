@@ -0,0 +1,370 @@
+// Разбор ICMP/ICMPv6 и правила по типам: сверка декодера на собранных вручную пакетах,
+// привязка ошибок к исходному потоку, правило против ping sweep, которое не задевает
+// path MTU discovery, и цена разбора и сопоставления.
+//
+//   icmp_bench [--packets N] [--rules N] [--seed N]
+
+#include "bench_common.h"
+#include "rule_generator.h"
+#include "../icmp_decoder.h"
+#include "../rule_matcher.h"
+#include "../rule_analyzer.h"
+#include <cstring>
+#include <random>
+
+struct IcmpBenchOptions {
+    size_t packets = 1000000;
+    size_t rules = 1000;            // синтетических правил перед правилами ICMP
+    uint32_t seed = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, IcmpBenchOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--packets") == 0) opts.packets = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--rules") == 0) opts.rules = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+        else return false;
+    }
+    return argc % 2 == 1 && opts.packets > 0;
+}
+
+static bool Fail(const char* what) {
+    std::fprintf(stderr, "check failed: %s\n", what);
+    return false;
+}
+
+static void Set16(std::vector<uint8_t>& out, size_t at, size_t v) {
+    out[at] = static_cast<uint8_t>(v >> 8);
+    out[at + 1] = static_cast<uint8_t>(v);
+}
+
+static void Set32(std::vector<uint8_t>& out, size_t at, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out[at + i] = static_cast<uint8_t>(v >> (24 - 8 * i));
+}
+
+// Заголовок IPv4 без опций и данные
+static std::vector<uint8_t> IPv4(uint8_t protocol, uint32_t src, uint32_t dst, const std::vector<uint8_t>& payload) {
+    std::vector<uint8_t> packet(20, 0);
+    packet[0] = 0x45;
+    Set16(packet, 2, 20 + payload.size());
+    packet[8] = 64;
+    packet[9] = protocol;
+    Set32(packet, 12, src);
+    Set32(packet, 16, dst);
+    packet.insert(packet.end(), payload.begin(), payload.end());
+    return packet;
+}
+
+// Заголовок IPv6; hopByHop добавляет пустой заголовок расширения перед данными
+static std::vector<uint8_t> IPv6(uint8_t protocol, uint8_t srcLast, uint8_t dstLast, const std::vector<uint8_t>& payload,
+    bool hopByHop = false) {
+    std::vector<uint8_t> packet(40, 0);
+    packet[0] = 0x60;
+    packet[6] = hopByHop ? 0 : protocol;
+    packet[7] = 64;
+    packet[8] = 0x20;
+    packet[9] = 0x01;
+    packet[23] = srcLast;
+    packet[24] = 0x20;
+    packet[25] = 0x01;
+    packet[39] = dstLast;
+    if (hopByHop) {
+        std::vector<uint8_t> extension(8, 0);
+        extension[0] = protocol;
+        packet.insert(packet.end(), extension.begin(), extension.end());
+    }
+    packet.insert(packet.end(), payload.begin(), payload.end());
+    Set16(packet, 4, packet.size() - 40);
+    return packet;
+}
+
+static std::vector<uint8_t> Icmp(uint8_t type, uint8_t code, uint16_t id, uint16_t sequence) {
+    std::vector<uint8_t> icmp(8, 0);
+    icmp[0] = type;
+    icmp[1] = code;
+    Set16(icmp, 4, id);
+    Set16(icmp, 6, sequence);
+    return icmp;
+}
+
+// Ошибка с началом исходного пакета (заголовок IP + 8 байт, как требует RFC 792)
+static std::vector<uint8_t> IcmpError(uint8_t type, uint8_t code, const std::vector<uint8_t>& original, size_t ipHeader) {
+    std::vector<uint8_t> icmp = Icmp(type, code, 0, 0);
+    size_t quoted = (std::min)(original.size(), ipHeader + 8);
+    icmp.insert(icmp.end(), original.begin(), original.begin() + quoted);
+    return icmp;
+}
+
+static std::vector<uint8_t> Ports(uint16_t source, uint16_t dest, size_t size) {
+    std::vector<uint8_t> l4(size, 0);
+    Set16(l4, 0, source);
+    Set16(l4, 2, dest);
+    return l4;
+}
+
+static bool Decode(const std::vector<uint8_t>& packet, IcmpInfo& info) {
+    if ((packet[0] >> 4) == 4) return DecodeIcmp(packet.data() + 20, packet.size() - 20, info);
+    uint8_t protocol = 0;
+    size_t offset = 0;
+    if (!FindIPv6Transport(packet.data(), packet.size(), protocol, offset) || protocol != IP_PROTOCOL_ICMPV6) return false;
+    return DecodeIcmpV6(packet.data() + offset, packet.size() - offset, info);
+}
+
+static bool CheckDecoder() {
+    const uint32_t local = 0xC0A80A02;
+    const uint32_t remote = 0x5DB8D822;
+    const uint32_t router = 0x0A000001;
+    IcmpInfo info;
+
+    // Запрос и ответ одного ping: один идентификатор, то есть один поток
+    if (!Decode(IPv4(1, local, remote, Icmp(8, 0, 0x1234, 1)), info) || !info.isEcho || info.echoId != 0x1234
+        || info.type != 8) {
+        return Fail("echo request");
+    }
+    if (!Decode(IPv4(1, remote, local, Icmp(0, 0, 0x1234, 1)), info) || !info.isEcho || info.echoId != 0x1234) {
+        return Fail("echo reply");
+    }
+
+    // "Нужна фрагментация" на исходящий TCP 51000 -> 443
+    std::vector<uint8_t> tcp = IPv4(6, local, remote, Ports(51000, 443, 20));
+    if (!Decode(IPv4(1, router, local, IcmpError(3, 4, tcp, 20)), info) || !info.isError || !info.hasRelated
+        || info.relatedProtocol != 6 || info.relatedSourceIp != local || info.relatedDestIp != remote
+        || info.relatedSourcePort != 51000 || info.relatedDestPort != 443 || info.code != 4) {
+        return Fail("frag-needed for TCP");
+    }
+    // Превышение TTL на traceroute по UDP
+    std::vector<uint8_t> udp = IPv4(17, local, remote, Ports(40000, 33434, 8));
+    if (!Decode(IPv4(1, router, local, IcmpError(11, 0, udp, 20)), info) || !info.hasRelated
+        || info.relatedProtocol != 17 || info.relatedDestPort != 33434) {
+        return Fail("time-exceeded for UDP");
+    }
+    // Недостижимость в ответ на ping: исходный поток — эхо с тем же идентификатором
+    std::vector<uint8_t> ping = IPv4(1, local, remote, Icmp(8, 0, 77, 5));
+    if (!Decode(IPv4(1, router, local, IcmpError(3, 1, ping, 20)), info) || !info.hasRelated
+        || info.relatedProtocol != 1 || info.relatedSourcePort != 77 || info.relatedDestPort != 77) {
+        return Fail("unreachable for echo");
+    }
+    // Обрезанная ошибка: тип известен, исходного потока нет
+    std::vector<uint8_t> shortError = Icmp(3, 3, 0, 0);
+    shortError.resize(16);
+    if (!DecodeIcmp(shortError.data(), shortError.size(), info) || !info.isError || info.hasRelated) {
+        return Fail("truncated error");
+    }
+    if (DecodeIcmp(shortError.data(), 7, info)) return Fail("header shorter than 8 bytes");
+
+    // ICMPv6: эхо за заголовком hop-by-hop и "пакет слишком велик" на TCP
+    if (!Decode(IPv6(58, 1, 2, Icmp(128, 0, 9, 1), true), info) || !info.isEcho || info.echoId != 9) {
+        return Fail("ICMPv6 echo after extension header");
+    }
+    std::vector<uint8_t> tcp6 = IPv6(6, 1, 2, Ports(50000, 443, 20));
+    std::vector<uint8_t> tooBig = IPv6(58, 9, 1, IcmpError(2, 0, tcp6, 40));
+    if (!Decode(tooBig, info) || !info.isError || !info.hasRelated || info.relatedProtocol != 6
+        || info.relatedSourcePort != 50000 || info.relatedDestPort != 443 || info.relatedSourceIp6[15] != 1) {
+        return Fail("ICMPv6 packet-too-big for TCP");
+    }
+    // Не первый фрагмент: транспортного заголовка нет
+    std::vector<uint8_t> fragment = IPv6(44, 1, 2, std::vector<uint8_t>(16, 0));
+    fragment[40] = 6;
+    Set16(fragment, 42, 0x0100);
+    uint8_t protocol = 0;
+    size_t offset = 0;
+    if (FindIPv6Transport(fragment.data(), fragment.size(), protocol, offset)) return Fail("IPv6 non-first fragment");
+
+    if (DescribeIcmp(3, 4, false) != "unreachable/frag-needed" || DescribeIcmp(2, 0, true) != "packet-too-big"
+        || DescribeIcmp(42, 1, false) != "type 42/1") {
+        return Fail("ICMP descriptions");
+    }
+    return true;
+}
+
+static Rule IcmpRule(int id, RuleAction action, const std::string& types) {
+    Rule rule;
+    rule.id = id;
+    rule.action = action;
+    rule.protocol = Protocol::ICMP;
+    rule.icmpTypes = types;
+    return rule;
+}
+
+static FlowKey IcmpFlow(uint8_t protocol, uint8_t type, uint8_t code) {
+    FlowKey flow;
+    flow.sourceIp = 0x5DB8D822;
+    flow.destIp = 0xC0A80A02;
+    flow.ipProtocol = protocol;
+    flow.icmpType = type;
+    flow.icmpCode = code;
+    return flow;
+}
+
+static bool CheckRules() {
+    std::vector<IcmpTypeMatch> types = RuleMatcher::ParseIcmpTypes(" 8, 3/4,bad,300,11/ ,0");
+    if (types.size() != 3 || types[0].type != 8 || types[0].code != -1 || types[1].type != 3 || types[1].code != 4
+        || types[2].type != 0) {
+        return Fail("ICMP type list parsing");
+    }
+
+    // Ping sweep запрещён, недостижимость разрешена только как frag-needed
+    RuleMatcher matcher;
+    Rule mtu = IcmpRule(1, RuleAction::ALLOW, "3/4");
+    Rule sweep = IcmpRule(2, RuleAction::BLOCK, "8");
+    Rule unreachable = IcmpRule(3, RuleAction::BLOCK, "3");
+    Rule echo6 = IcmpRule(4, RuleAction::BLOCK, "128");
+    echo6.protocol = Protocol::ICMPV6;
+    matcher.Compile({ mtu, sweep, unreachable, echo6 });
+    int ruleId = 0;
+    if (matcher.IsAllowed(IcmpFlow(1, 8, 0), ruleId) || ruleId != 2) return Fail("echo request blocked");
+    if (!matcher.IsAllowed(IcmpFlow(1, 0, 0), ruleId) || ruleId != -1) return Fail("echo reply passes");
+    if (!matcher.IsAllowed(IcmpFlow(1, 3, 4), ruleId) || ruleId != 1) return Fail("frag-needed allowed");
+    if (matcher.IsAllowed(IcmpFlow(1, 3, 1), ruleId) || ruleId != 3) return Fail("host unreachable blocked");
+    // Типы только у ICMP: TCP с "портом" 8 правилу не подходит
+    FlowKey tcp = IcmpFlow(6, 8, 0);
+    if (!matcher.IsAllowed(tcp, ruleId)) return Fail("TCP flow and ICMP types");
+
+    // IPv6: префикс IPv4 с адресом IPv6 не совпадает, any совпадает
+    FlowKey echo = IcmpFlow(58, 128, 0);
+    echo.ipv6 = true;
+    echo.sourceIp = echo.destIp = 0;
+    echo.destIp6[0] = 0x20;
+    const CompiledRule* hit = matcher.FindBlockingRule(echo);
+    if (!hit || hit->id != 4) return Fail("ICMPv6 echo rule");
+    Rule prefix = IcmpRule(5, RuleAction::BLOCK, "");
+    prefix.protocol = Protocol::ANY;
+    prefix.destIp = "0.0.0.0/1";
+    matcher.Compile({ prefix });
+    if (matcher.FindBlockingRule(echo)) return Fail("IPv4 prefix matched an IPv6 flow");
+
+    // Анализатор: "3" покрывает "3/4", наоборот — нет; "8" и "0" не пересекаются
+    CompiledRule any3 = RuleMatcher::CompileRule(IcmpRule(1, RuleAction::BLOCK, "3"));
+    CompiledRule frag = RuleMatcher::CompileRule(IcmpRule(2, RuleAction::BLOCK, "3/4"));
+    CompiledRule request = RuleMatcher::CompileRule(IcmpRule(3, RuleAction::BLOCK, "8"));
+    CompiledRule reply = RuleMatcher::CompileRule(IcmpRule(4, RuleAction::BLOCK, "0"));
+    CompiledRule all = RuleMatcher::CompileRule(IcmpRule(5, RuleAction::BLOCK, ""));
+    if (!RuleAnalyzer::Covers(any3, frag) || RuleAnalyzer::Covers(frag, any3)) return Fail("ICMP cover");
+    if (RuleAnalyzer::Overlaps(request, reply) || !RuleAnalyzer::Overlaps(all, reply)) return Fail("ICMP overlap");
+    if (!RuleAnalyzer::Covers(all, request) || RuleAnalyzer::Covers(request, all)) return Fail("ICMP cover of any");
+    RuleAnalysis analysis = RuleAnalyzer::Analyze({ IcmpRule(1, RuleAction::BLOCK, "8"), IcmpRule(2, RuleAction::BLOCK, "0") });
+    if (analysis.Count(RuleFindingKind::Redundant) != 0) return Fail("different ICMP types are not redundant");
+    return true;
+}
+
+int main(int argc, char** argv) {
+    IcmpBenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: icmp_bench [--packets N] [--rules N] [--seed N]\n");
+        return 1;
+    }
+    if (!CheckDecoder() || !CheckRules()) return 2;
+
+    // Смесь: ping sweep снаружи, ответы на собственные ping, frag-needed и time-exceeded
+    // на исходящие потоки, эхо ICMPv6
+    std::mt19937 rng(opts.seed);
+    const uint32_t local = 0xC0A80A02;
+    std::vector<std::vector<uint8_t>> packets;
+    const size_t distinct = 4096;
+    size_t sweeps = 0;
+    size_t errors = 0;
+    for (size_t i = 0; i < distinct; ++i) {
+        uint32_t remote = 0x5D000000 | static_cast<uint32_t>(rng() & 0xFFFFFF);
+        uint16_t port = static_cast<uint16_t>(1024 + rng() % 60000);
+        switch (i % 5) {
+        case 0:
+        case 1:
+            packets.push_back(IPv4(1, remote, local, Icmp(8, 0, static_cast<uint16_t>(rng()), static_cast<uint16_t>(i))));
+            ++sweeps;
+            break;
+        case 2:
+            packets.push_back(IPv4(1, remote, local, Icmp(0, 0, 1, static_cast<uint16_t>(i))));
+            break;
+        case 3: {
+            std::vector<uint8_t> tcp = IPv4(6, local, remote, Ports(port, 443, 20));
+            packets.push_back(IPv4(1, 0x0A000001, local, IcmpError(i % 2 ? 3 : 11, i % 2 ? 4 : 0, tcp, 20)));
+            ++errors;
+            break;
+        }
+        default:
+            packets.push_back(IPv6(58, 1, 2, Icmp(128, 0, static_cast<uint16_t>(rng()), 1), rng() % 2 == 0));
+            break;
+        }
+    }
+
+    size_t decoded = 0;
+    size_t related = 0;
+    IcmpInfo info;
+    auto start = BenchClock::now();
+    for (size_t i = 0; i < opts.packets; ++i) {
+        if (Decode(packets[i % distinct], info)) {
+            ++decoded;
+            related += info.hasRelated;
+        }
+    }
+    double decodeSeconds = SecondsSince(start);
+    DoNotOptimize(related);
+    std::printf("decode:  %8.1f ns/packet  (%zu packets, %zu with a related flow)\n",
+        decodeSeconds * 1e9 / opts.packets, decoded, related);
+
+    // Правила ICMP после синтетического набора: пакет ICMP проходит все правила TCP/UDP
+    RuleGenerator generator(opts.seed);
+    std::vector<Rule> rules = generator.GenerateRules(opts.rules);
+    int nextId = static_cast<int>(rules.size()) + 1;
+    Rule mtu = IcmpRule(nextId++, RuleAction::ALLOW, "3/4");
+    Rule sweep = IcmpRule(nextId++, RuleAction::BLOCK, "8");
+    sweep.direction = RuleDirection::Inbound;
+    rules.push_back(mtu);
+    rules.push_back(sweep);
+    RuleMatcher matcher;
+    matcher.Compile(rules);
+
+    std::vector<FlowKey> flows;
+    flows.reserve(distinct);
+    for (const auto& packet : packets) {
+        FlowKey flow;
+        bool v6 = (packet[0] >> 4) == 6;
+        if (!Decode(packet, info)) continue;
+        flow.ipProtocol = v6 ? IP_PROTOCOL_ICMPV6 : IP_PROTOCOL_ICMP;
+        flow.ipv6 = v6;
+        if (v6) {
+            std::memcpy(flow.sourceIp6, packet.data() + 8, 16);
+            std::memcpy(flow.destIp6, packet.data() + 24, 16);
+        }
+        else {
+            flow.sourceIp = (uint32_t(packet[12]) << 24) | (uint32_t(packet[13]) << 16) | (uint32_t(packet[14]) << 8) | packet[15];
+            flow.destIp = local;
+        }
+        flow.icmpType = info.type;
+        flow.icmpCode = info.code;
+        if (info.isEcho) flow.sourcePort = flow.destPort = info.echoId;
+        if (info.hasRelated) {
+            flow.relatedProtocol = info.relatedProtocol;
+            flow.sourcePort = info.relatedDestPort;
+            flow.destPort = info.relatedSourcePort;
+        }
+        flows.push_back(flow);
+    }
+
+    size_t blockedSweeps = 0;
+    size_t blockedErrors = 0;
+    for (const auto& flow : flows) {
+        const CompiledRule* hit = matcher.FindBlockingRule(flow);
+        if (!hit) continue;
+        if (flow.icmpType == 8) ++blockedSweeps;
+        if (flow.relatedProtocol && hit->id == sweep.id) ++blockedErrors;
+    }
+    std::printf("rules:   %zu rules; %zu of %zu sweep probes blocked, %zu of %zu ICMP errors blocked by it\n",
+        matcher.Size(), blockedSweeps, sweeps, blockedErrors, errors);
+    int exitCode = 0;
+    if (blockedSweeps != sweeps || blockedErrors != 0) {
+        std::fprintf(stderr, "sweep rule must block every echo request and no ICMP error\n");
+        exitCode = 2;
+    }
+
+    size_t blocked = 0;
+    size_t rounds = (std::max)(static_cast<size_t>(1), opts.packets / 20 / flows.size());
+    start = BenchClock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (const auto& flow : flows) blocked += matcher.FindBlockingRule(flow) != nullptr;
+    }
+    double matchSeconds = SecondsSince(start);
+    DoNotOptimize(blocked);
+    std::printf("match:   %8.1f ns/packet over %zu rules\n", matchSeconds * 1e9 / (rounds * flows.size()), matcher.Size());
+    return exitCode;
+}
@@ -0,0 +1,195 @@
+// Разбор заголовков IPv4 пачками (DecodeIPv4Batch) против разбора по одному (DecodeIPv4):
+// сверка всех полей и время на пакет. Пакеты лежат подряд в одном буфере, как копии пачки
+// pcap_dispatch в PacketInterceptor. Без --pcap поток собирается из сгенерированного трафика
+// с долей неудобных пакетов: опции IP, фрагменты, обрезанные, с неверной суммой, IPv6.
+//
+//   ipv4_bench [--pcap file] [--packets N] [--batch N] [--rounds N] [--seed N]
+
+#include "bench_common.h"
+#include "rule_generator.h"
+#include "../ipv4_decoder.h"
+#include <cstring>
+#include <random>
+
+struct Ipv4BenchOptions {
+    std::string pcap;
+    size_t packets = 100000;
+    size_t batch = 256;
+    size_t rounds = 20;
+    uint32_t seed = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, Ipv4BenchOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* arg = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(arg, "--pcap") == 0) opts.pcap = value;
+        else if (std::strcmp(arg, "--packets") == 0) opts.packets = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--batch") == 0) opts.batch = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--rounds") == 0) opts.rounds = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        else return false;
+    }
+    return argc % 2 == 1 && opts.packets > 0 && opts.batch > 0 && opts.rounds > 0;
+}
+
+// Пакеты подряд в одном буфере
+struct PacketStream {
+    std::vector<uint8_t> bytes;
+    std::vector<size_t> offsets;
+    std::vector<size_t> sizes;
+
+    void Add(const std::vector<uint8_t>& packet) {
+        offsets.push_back(bytes.size());
+        sizes.push_back(packet.size());
+        bytes.insert(bytes.end(), packet.begin(), packet.end());
+    }
+};
+
+static void WriteBE16(uint8_t* p, uint16_t value) {
+    p[0] = static_cast<uint8_t>(value >> 8);
+    p[1] = static_cast<uint8_t>(value);
+}
+
+static void WriteBE32(uint8_t* p, uint32_t value) {
+    WriteBE16(p, static_cast<uint16_t>(value >> 16));
+    WriteBE16(p + 2, static_cast<uint16_t>(value));
+}
+
+static void SetChecksum(uint8_t* ip, size_t headerLength) {
+    ip[10] = ip[11] = 0;
+    uint32_t sum = 0;
+    for (size_t i = 0; i < headerLength; i += 2) sum += static_cast<uint32_t>((ip[i] << 8) | ip[i + 1]);
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    WriteBE16(ip + 10, static_cast<uint16_t>(~sum));
+}
+
+static std::vector<uint8_t> BuildPacket(const FlowKey& flow, std::mt19937& rng) {
+    unsigned kind = rng() % 100;
+    if (kind < 3) {
+        // IPv6: векторный разбор должен отдать его DecodeIPv4, а та — отказаться
+        std::vector<uint8_t> packet(60, 0);
+        packet[0] = 0x60;
+        packet[6] = 6;
+        return packet;
+    }
+    size_t options = kind < 8 ? 4 * (1 + rng() % 3) : 0;
+    size_t headerLength = 20 + options;
+    size_t transportLength = flow.ipProtocol == 6 ? 20 : 8;
+    std::vector<uint8_t> packet(headerLength + transportLength + rng() % 64, 0);
+    uint8_t* ip = packet.data();
+    ip[0] = static_cast<uint8_t>(0x40 | (headerLength / 4));
+    WriteBE16(ip + 2, static_cast<uint16_t>(packet.size()));
+    WriteBE16(ip + 4, static_cast<uint16_t>(rng()));
+    uint16_t fragment = 0x4000;     // DF
+    if (kind >= 8 && kind < 11) fragment = static_cast<uint16_t>(0x2000 | (1 + rng() % 100));
+    else if (kind >= 11 && kind < 13) fragment = 0x2000;
+    WriteBE16(ip + 6, fragment);
+    ip[8] = 64;
+    ip[9] = flow.ipProtocol;
+    WriteBE32(ip + 12, flow.sourceIp);
+    WriteBE32(ip + 16, flow.destIp);
+    for (size_t i = 20; i < headerLength; ++i) ip[i] = 1;      // NOP
+    uint8_t* l4 = ip + headerLength;
+    WriteBE16(l4, flow.sourcePort);
+    WriteBE16(l4 + 2, flow.destPort);
+    if (flow.ipProtocol == 6) l4[13] = static_cast<uint8_t>(rng() % 2 ? 0x02 : 0x10);
+    SetChecksum(ip, headerLength);
+    if (kind >= 13 && kind < 15) ip[10] ^= 0x5A;              // неверная сумма
+    if (kind >= 15 && kind < 17) packet.resize(rng() % 40);    // обрезан захватом
+    return packet;
+}
+
+static bool LoadStream(const Ipv4BenchOptions& opts, PacketStream& stream) {
+    if (!opts.pcap.empty()) {
+        std::vector<PcapPacket> packets;
+        std::string error;
+        if (!LoadPcapPackets(opts.pcap, opts.packets, packets, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return false;
+        }
+        for (const auto& packet : packets) stream.Add(packet.ip);
+        return true;
+    }
+    RuleGenerator generator(opts.seed);
+    std::vector<Rule> rules = generator.GenerateRules(1000);
+    std::vector<FlowKey> traffic = generator.GenerateTraffic(rules, opts.packets, 0.3);
+    std::mt19937 rng(opts.seed);
+    for (const auto& flow : traffic) stream.Add(BuildPacket(flow, rng));
+    return true;
+}
+
+static bool Same(const IPv4Summary& a, const IPv4Summary& b) {
+    return a.valid == b.valid && a.checksumValid == b.checksumValid && a.hasPorts == b.hasPorts
+        && a.headerLength == b.headerLength && a.protocol == b.protocol && a.tcpFlags == b.tcpFlags
+        && a.totalLength == b.totalLength && a.fragment == b.fragment
+        && a.sourceIp == b.sourceIp && a.destIp == b.destIp
+        && a.sourcePort == b.sourcePort && a.destPort == b.destPort;
+}
+
+int main(int argc, char** argv) {
+    Ipv4BenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: ipv4_bench [--pcap file] [--packets N] [--batch N] [--rounds N] [--seed N]\n");
+        return 1;
+    }
+    PacketStream stream;
+    if (!LoadStream(opts, stream)) return 1;
+    size_t count = stream.offsets.size();
+    std::vector<const uint8_t*> starts(count);
+    for (size_t i = 0; i < count; ++i) starts[i] = stream.bytes.data() + stream.offsets[i];
+
+    std::vector<IPv4Summary> scalar(count);
+    std::vector<IPv4Summary> batched(count);
+    size_t valid = 0;
+    size_t badChecksum = 0;
+    size_t withPorts = 0;
+    for (size_t i = 0; i < count; ++i) {
+        DecodeIPv4(starts[i], stream.sizes[i], scalar[i]);
+        valid += scalar[i].valid;
+        badChecksum += scalar[i].valid && !scalar[i].checksumValid;
+        withPorts += scalar[i].hasPorts;
+    }
+    size_t vectorised = 0;
+    for (size_t first = 0; first < count; first += opts.batch) {
+        size_t n = (std::min)(opts.batch, count - first);
+        vectorised += DecodeIPv4Batch(starts.data() + first, stream.sizes.data() + first, n, batched.data() + first);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (!Same(scalar[i], batched[i])) {
+            std::fprintf(stderr, "packet %zu (%zu bytes): batch and scalar decoders differ\n", i, stream.sizes[i]);
+            return 2;
+        }
+    }
+    std::printf("verify:  batch matches scalar on %zu packets (%zu IPv4, %zu with ports, %zu bad checksums)\n",
+        count, valid, withPorts, badChecksum);
+    std::printf("vector:  %zu of %zu packets (%.1f%%)%s\n", vectorised, count, 100.0 * vectorised / count,
+        vectorised ? "" : " — no AVX2, batch path is scalar");
+
+    size_t checksum = 0;
+    auto start = BenchClock::now();
+    for (size_t round = 0; round < opts.rounds; ++round) {
+        for (size_t i = 0; i < count; ++i) {
+            DecodeIPv4(starts[i], stream.sizes[i], scalar[i]);
+            checksum += scalar[i].sourcePort;
+        }
+    }
+    double scalarSeconds = SecondsSince(start);
+
+    start = BenchClock::now();
+    for (size_t round = 0; round < opts.rounds; ++round) {
+        for (size_t first = 0; first < count; first += opts.batch) {
+            size_t n = (std::min)(opts.batch, count - first);
+            DecodeIPv4Batch(starts.data() + first, stream.sizes.data() + first, n, batched.data() + first);
+            checksum += batched[first].sourcePort;
+        }
+    }
+    double batchSeconds = SecondsSince(start);
+    DoNotOptimize(checksum);
+
+    double total = static_cast<double>(count * opts.rounds);
+    std::printf("%10s %12s %12s\n", "decoder", "ns/packet", "Mpps");
+    std::printf("%10s %12.2f %12.1f\n", "scalar", scalarSeconds * 1e9 / total, total / scalarSeconds / 1e6);
+    std::printf("%10s %12.2f %12.1f\n", "batch", batchSeconds * 1e9 / total, total / batchSeconds / 1e6);
+    return 0;
+}
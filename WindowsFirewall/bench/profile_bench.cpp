@@ -0,0 +1,178 @@
+// Профили правил (RuleManager::SwitchProfile): наборы скомпилированы заранее, переключение —
+// обмен указателей на matcher под замком правил. Сверка: соединения, решённые под прежним
+// профилем, после переключения получают ответ нового, как с заново скомпилированным набором.
+// Задержка переключения меряется под потоком пакетов, который берёт тот же замок на каждую
+// пачку, и сравнивается с компиляцией профиля (столько стоила смена rules.json).
+//
+//   profile_bench [--rules N] [--profiles N] [--switches N] [--packets N] [--seed N]
+
+#include "bench_common.h"
+#include "rule_generator.h"
+#include "../connection_tracker.h"
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+struct ProfileBenchOptions {
+    size_t rules = 10000;
+    size_t profiles = 3;
+    size_t switches = 2000;
+    size_t packets = 20000;
+    uint32_t seed = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, ProfileBenchOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* arg = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(arg, "--rules") == 0) opts.rules = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--profiles") == 0) opts.profiles = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--switches") == 0) opts.switches = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--packets") == 0) opts.packets = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        else return false;
+    }
+    return argc % 2 == 1 && opts.rules > 0 && opts.profiles > 1 && opts.switches > 0 && opts.packets > 0;
+}
+
+static int Id(const CompiledRule* rule) {
+    return rule ? rule->id : -1;
+}
+
+// Как в RuleManager: matcher активного профиля — в active, остальные — в слотах профилей
+struct Profiles {
+    std::vector<std::vector<Rule>> rules;
+    std::vector<std::unique_ptr<RuleMatcher>> slots;
+    std::unique_ptr<RuleMatcher> active = std::make_unique<RuleMatcher>();
+    size_t current = 0;
+
+    void Switch(size_t index) {
+        std::swap(active, slots[current]);      // ParkActiveProfile
+        std::swap(active, slots[index]);        // ActivateProfile
+        current = index;
+    }
+};
+
+static std::unique_ptr<RuleMatcher> Compile(const std::vector<Rule>& rules) {
+    auto matcher = std::make_unique<RuleMatcher>();
+    matcher->Compile(rules);
+    return matcher;
+}
+
+// Профили — разные наборы одного генератора, чтобы трафик задевал правила каждого
+static Profiles MakeProfiles(const ProfileBenchOptions& opts, RuleGenerator& generator, double& compileMs) {
+    Profiles profiles;
+    auto start = BenchClock::now();
+    for (size_t p = 0; p < opts.profiles; ++p) {
+        profiles.rules.push_back(generator.GenerateRules(opts.rules));
+        profiles.slots.push_back(Compile(profiles.rules.back()));
+    }
+    compileMs = SecondsSince(start) * 1e3 / opts.profiles;
+    std::swap(profiles.active, profiles.slots[0]);     // первая загрузка: парковать нечего
+    return profiles;
+}
+
+// Два трекера видят одни и те же пакеты: один — с переключаемыми профилями, другой — с заново
+// скомпилированным набором после каждого переключения
+static bool Verify(const ProfileBenchOptions& opts, Profiles& profiles, const std::vector<FlowKey>& traffic) {
+    ConnectionTracker switched;
+    ConnectionTracker fresh;
+    std::vector<std::unique_ptr<RuleMatcher>> compiled;
+    compiled.push_back(Compile(profiles.rules[profiles.current]));
+    uint64_t now = 1;
+    size_t steps = (std::min)(opts.switches, static_cast<size_t>(3 * opts.profiles + 1));
+    size_t checked = 0;
+    for (size_t step = 0; step <= steps; ++step) {
+        if (step > 0) {
+            // Профили по кругу, половины трафика через шаг: при двух профилях соединение
+            // застаёт свой прежний matcher (поколение совпало), при трёх — чужой (перепроверка)
+            size_t target = step % opts.profiles;
+            if (target == profiles.current) target = (target + 1) % opts.profiles;
+            profiles.Switch(target);
+            compiled.push_back(Compile(profiles.rules[target]));
+        }
+        for (size_t p = step % 2; p < traffic.size(); p += 2) {
+            FlowKey a = traffic[p];
+            FlowKey b = traffic[p];
+            int expected = Id(fresh.FindBlockingRule(*compiled.back(), b, now));
+            int actual = Id(switched.FindBlockingRule(*profiles.active, a, now));
+            if (expected != actual) {
+                std::fprintf(stderr, "switch %zu to profile %zu, packet %zu: blocking rule %d, expected %d\n",
+                    step, profiles.current, p, actual, expected);
+                return false;
+            }
+            ++checked;
+            ++now;
+        }
+    }
+    std::printf("verify:  %zu switches across %zu profiles, %zu packets agree with recompiled profiles "
+        "(%llu connections revalidated, %llu kept their profile's answer)\n", steps, opts.profiles, checked,
+        static_cast<unsigned long long>(switched.GetStats().revalidated),
+        static_cast<unsigned long long>(switched.GetStats().fastPath));
+    return true;
+}
+
+int main(int argc, char** argv) {
+    ProfileBenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: profile_bench [--rules N] [--profiles N] [--switches N] [--packets N] [--seed N]\n");
+        return 1;
+    }
+
+    RuleGenerator generator(opts.seed);
+    double compileMs = 0;
+    Profiles profiles = MakeProfiles(opts, generator, compileMs);
+    std::vector<Rule> all;
+    for (const auto& rules : profiles.rules) all.insert(all.end(), rules.begin(), rules.end());
+    std::vector<FlowKey> traffic = generator.GenerateTraffic(all, opts.packets, 0.5);
+    if (!Verify(opts, profiles, traffic)) return 2;
+
+    // Поток пакетов пачками по 64 под замком, как RuleManager::FindBlockingRuleBatch
+    std::mutex ruleMutex;
+    std::atomic<bool> stop{ false };
+    std::atomic<uint64_t> processed{ 0 };
+    std::thread packets([&]() {
+        ConnectionTracker tracker;
+        const size_t batch = 64;
+        std::vector<FlowKey> flows(batch);
+        std::vector<const CompiledRule*> verdicts(batch);
+        uint64_t now = 1;
+        size_t at = 0;
+        while (!stop) {
+            for (size_t i = 0; i < batch; ++i) flows[i] = traffic[(at + i) % traffic.size()];
+            at += batch;
+            std::lock_guard<std::mutex> lock(ruleMutex);
+            tracker.FindBlockingRuleBatch(*profiles.active, flows.data(), batch, verdicts.data(), now++);
+            processed += batch;
+        }
+    });
+
+    std::vector<uint64_t> switchNs;     // от запроса до подмены, с ожиданием замка
+    std::vector<uint64_t> swapNs;       // сама подмена под замком
+    auto start = BenchClock::now();
+    for (size_t s = 0; s < opts.switches; ++s) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        size_t target = (profiles.current + 1) % opts.profiles;
+        auto t0 = BenchClock::now();
+        std::lock_guard<std::mutex> lock(ruleMutex);
+        auto t1 = BenchClock::now();
+        profiles.Switch(target);
+        auto t2 = BenchClock::now();
+        switchNs.push_back(NanosecondsBetween(t0, t2));
+        swapNs.push_back(NanosecondsBetween(t1, t2));
+    }
+    double seconds = SecondsSince(start);
+    stop = true;
+    packets.join();
+
+    LatencySummary total = Summarize(switchNs);
+    LatencySummary swap = Summarize(swapNs);
+    std::printf("%zu profiles x %zu rules, compile %.1f ms per profile, %.0f packets/s during switches\n",
+        opts.profiles, opts.rules, compileMs, processed / seconds);
+    std::printf("%-26s %10s %10s %10s\n", "switch", "p50 us", "p99 us", "p99.9 us");
+    std::printf("%-26s %10.2f %10.2f %10.2f\n", "request -> active", total.p50 / 1e3, total.p99 / 1e3, total.p999 / 1e3);
+    std::printf("%-26s %10.2f %10.2f %10.2f\n", "pointer swap", swap.p50 / 1e3, swap.p99 / 1e3, swap.p999 / 1e3);
+    return 0;
+}
@@ -0,0 +1,100 @@
+// Анализ затенённых/избыточных/объединяемых правил на синтетическом наборе:
+// число правил до и после минимизации, время анализа и пропускная способность
+// RuleMatcher на исходном и минимизированном наборе. Вердикты обоих наборов сверяются.
+//
+//   rule_analyze [--sizes 100,1000,10000] [--derived 0.3] [--adapters 0] [--packets N] [--seed N]
+
+#include "bench_common.h"
+#include "rule_generator.h"
+#include "../rule_analyzer.h"
+#include <cstring>
+
+struct AnalyzeOptions {
+    std::vector<size_t> sizes = { 100, 1000, 10000 };
+    double derived = 0.3;
+    double adapters = 0.0;          // доля правил, привязанных к адаптеру (RuleMix::adapter)
+    size_t packets = 200000;
+    uint32_t seed = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, AnalyzeOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--sizes") == 0) opts.sizes = ParseSizeList(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--derived") == 0) opts.derived = std::atof(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--adapters") == 0) opts.adapters = std::atof(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--packets") == 0) opts.packets = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+        else return false;
+    }
+    return argc % 2 == 1 && !opts.sizes.empty() && opts.packets > 0;
+}
+
+static double Throughput(const RuleMatcher& matcher, const std::vector<FlowKey>& traffic) {
+    size_t blocked = 0;
+    auto start = BenchClock::now();
+    for (const auto& flow : traffic) {
+        blocked += matcher.FindBlockingRule(flow) ? 1 : 0;
+    }
+    double seconds = SecondsSince(start);
+    DoNotOptimize(blocked);
+    return traffic.size() / (seconds > 0 ? seconds : 1e-9);
+}
+
+int main(int argc, char** argv) {
+    AnalyzeOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: rule_analyze [--sizes 100,1000,...] [--derived R] [--adapters R] [--packets N] [--seed N]\n");
+        return 1;
+    }
+
+    std::printf("%8s %8s %9s %9s %8s %11s %14s %14s %9s\n",
+        "rules", "after", "redundant", "shadowed", "merged", "analyze ms", "before pkt/s", "after pkt/s", "verdicts");
+
+    int exitCode = 0;
+    for (size_t size : opts.sizes) {
+        RuleMix mix;
+        mix.derived = opts.derived;
+        mix.adapter = opts.adapters;
+        RuleGenerator generator(opts.seed, mix);
+        std::vector<Rule> rules = generator.GenerateRules(size);
+
+        auto start = BenchClock::now();
+        RuleAnalysis analysis = RuleAnalyzer::Analyze(rules);
+        double analyzeMs = SecondsSince(start) * 1000.0;
+
+        RuleMatcher original;
+        original.Compile(rules);
+        RuleMatcher minimized;
+        minimized.Compile(analysis.minimized);
+
+        // Половина пакетов нацелена на правила — иначе сверка почти ничего не проверяет
+        size_t packets = (std::min)(opts.packets, (std::max)(static_cast<size_t>(2000),
+            static_cast<size_t>(100000000) / (std::max)(size, static_cast<size_t>(1))));
+        std::vector<FlowKey> traffic = generator.GenerateTraffic(rules, packets, 0.5);
+
+        size_t mismatches = 0;
+        for (const auto& flow : traffic) {
+            int idA, idB;
+            bool blockedA = original.FindBlockingRule(flow) != nullptr;
+            bool blockedB = minimized.FindBlockingRule(flow) != nullptr;
+            if (blockedA != blockedB || original.IsAllowed(flow, idA) != minimized.IsAllowed(flow, idB)) {
+                ++mismatches;
+            }
+        }
+
+        double before = Throughput(original, traffic);
+        double after = Throughput(minimized, traffic);
+
+        std::printf("%8zu %8zu %9zu %9zu %8zu %11.2f %14.0f %14.0f %9s\n",
+            analysis.enabledBefore, analysis.enabledAfter,
+            analysis.Count(RuleFindingKind::Redundant),
+            analysis.Count(RuleFindingKind::Shadowed),
+            analysis.Count(RuleFindingKind::Merged),
+            analyzeMs, before, after, mismatches == 0 ? "equal" : "DIFFER");
+        if (mismatches != 0) {
+            std::fprintf(stderr, "%zu of %zu packets got a different verdict\n", mismatches, traffic.size());
+            exitCode = 2;
+        }
+    }
+    return exitCode;
+}
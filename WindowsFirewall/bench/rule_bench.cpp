@@ -0,0 +1,200 @@
+// Бенчмарк сопоставления пакетов с правилами (RuleMatcher — то же ядро, что в RuleManager).
+// Собирается и запускается на Linux без окна и без WinPcap, см. GNUmakefile.
+//
+//   rule_bench [--sizes 10,100,1000,10000,100000] [--packets N] [--hit-ratio 0.2]
+//              [--seed N] [--pcap file.pcap]
+
+#include "bench_common.h"
+#include "rule_generator.h"
+#include "../rule_matcher.h"
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+struct BenchOptions {
+    std::vector<size_t> sizes = { 10, 100, 1000, 10000, 100000 };
+    size_t packets = 1000000;
+    double hitRatio = 0.2;
+    uint32_t seed = 1;
+    std::string pcapPath;
+};
+
+static void PrintUsage() {
+    std::printf("usage: rule_bench [--sizes 10,100,...] [--packets N] [--hit-ratio R] [--seed N] [--pcap file]\n");
+}
+
+static bool ParseOptions(int argc, char** argv, BenchOptions& opts) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (std::strcmp(arg, "--help") == 0 || std::strcmp(arg, "-h") == 0) return false;
+        if (!value) {
+            std::fprintf(stderr, "missing value for %s\n", arg);
+            return false;
+        }
+        if (std::strcmp(arg, "--sizes") == 0) opts.sizes = ParseSizeList(value);
+        else if (std::strcmp(arg, "--packets") == 0) opts.packets = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--hit-ratio") == 0) opts.hitRatio = std::atof(value);
+        else if (std::strcmp(arg, "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        else if (std::strcmp(arg, "--pcap") == 0) opts.pcapPath = value;
+        else {
+            std::fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+        ++i;
+    }
+    return !opts.sizes.empty() && opts.packets > 0;
+}
+
+struct OpResult {
+    double matchesPerSecond = 0;
+    LatencySummary latency;
+    size_t matched = 0;
+    size_t evaluated = 0;
+};
+
+// Пропускная способность — сплошной цикл; задержка — отдельная выборка с таймером на каждый вызов
+template <typename Fn>
+static OpResult Measure(const std::vector<FlowKey>& traffic, size_t iterations, Fn&& evaluate) {
+    OpResult result;
+    size_t matched = 0;
+
+    auto start = BenchClock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        matched += evaluate(traffic[i % traffic.size()]) ? 1 : 0;
+    }
+    double seconds = SecondsSince(start);
+    result.matchesPerSecond = iterations / (seconds > 0 ? seconds : 1e-9);
+    result.matched = matched;
+    result.evaluated = iterations;
+
+    size_t samples = (std::min)(iterations, static_cast<size_t>(200000));
+    std::vector<uint64_t> latencies;
+    latencies.reserve(samples);
+    for (size_t i = 0; i < samples; ++i) {
+        const FlowKey& flow = traffic[(i * 7919) % traffic.size()];
+        auto t0 = BenchClock::now();
+        bool hit = evaluate(flow);
+        auto t1 = BenchClock::now();
+        DoNotOptimize(hit);
+        latencies.push_back(NanosecondsBetween(t0, t1));
+    }
+    result.latency = Summarize(latencies);
+    return result;
+}
+
+// Доменные правила на подставленных соответствиях и часах: шаблон, вершина домена, истечение TTL
+static bool CheckDomainRules() {
+    IpDomainTable table;
+    IpDomainTable::Clock::time_point now = IpDomainTable::Clock::now();
+    table.SetClock([&now]() { return now; });
+    auto feeder = std::make_unique<StaticDomainFeeder>();
+    feeder->Add(0x0A000001, "a.cdn.example", std::chrono::seconds(60));
+    feeder->Add(0x0A000002, "CDN.example.", std::chrono::seconds(60));
+    table.AddFeeder(std::move(feeder));
+
+    Rule rule;
+    rule.id = 1;
+    rule.action = RuleAction::BLOCK;
+    rule.destIp = "*.cdn.example";
+    RuleMatcher matcher;
+    matcher.SetDomainTable(&table);
+    matcher.Compile({ rule });
+
+    FlowKey flow;
+    flow.ipProtocol = 6;
+    flow.destIp = 0x0A000001;
+    bool subdomain = matcher.FindBlockingRule(flow) != nullptr;
+    flow.destIp = 0x0A000002;
+    bool apex = matcher.FindBlockingRule(flow) != nullptr;
+    now += std::chrono::seconds(61);
+    flow.destIp = 0x0A000001;
+    bool expired = matcher.FindBlockingRule(flow) != nullptr;
+    return subdomain && !apex && !expired;
+}
+
+static void PrintRow(size_t rules, const char* op, const OpResult& r) {
+    std::printf("%8zu  %-16s %14.0f %10llu %10llu %10llu %8.2f%%\n",
+        rules, op, r.matchesPerSecond,
+        static_cast<unsigned long long>(r.latency.p50),
+        static_cast<unsigned long long>(r.latency.p99),
+        static_cast<unsigned long long>(r.latency.p999),
+        r.evaluated ? 100.0 * r.matched / r.evaluated : 0.0);
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        PrintUsage();
+        return 1;
+    }
+
+    if (!CheckDomainRules()) {
+        std::fprintf(stderr, "domain rule check failed\n");
+        return 2;
+    }
+
+    std::vector<FlowKey> replay;
+    if (!opts.pcapPath.empty()) {
+        std::string error;
+        if (!LoadPcapTraffic(opts.pcapPath, opts.packets, replay, error)) {
+            std::fprintf(stderr, "pcap: %s\n", error.c_str());
+            return 1;
+        }
+        std::printf("replaying %zu packets from %s\n", replay.size(), opts.pcapPath.c_str());
+    }
+
+    // Накладные расходы самого таймера входят в каждую выборку задержки
+    std::vector<uint64_t> overhead;
+    for (int i = 0; i < 100000; ++i) {
+        auto t0 = BenchClock::now();
+        auto t1 = BenchClock::now();
+        overhead.push_back(NanosecondsBetween(t0, t1));
+    }
+    std::printf("timer overhead p50 %llu ns\n", static_cast<unsigned long long>(Summarize(overhead).p50));
+
+    std::printf("%8s  %-16s %14s %10s %10s %10s %9s\n",
+        "rules", "operation", "matches/s", "p50 ns", "p99 ns", "p999 ns", "matched");
+
+    for (size_t size : opts.sizes) {
+        RuleGenerator generator(opts.seed);
+        std::vector<Rule> rules = generator.GenerateRules(size);
+
+        auto compileStart = BenchClock::now();
+        RuleMatcher matcher;
+        matcher.Compile(rules);
+        double compileSeconds = SecondsSince(compileStart);
+
+        std::vector<FlowKey> traffic = replay.empty()
+            ? generator.GenerateTraffic(rules, (std::min)(opts.packets, static_cast<size_t>(1000000)), opts.hitRatio)
+            : replay;
+
+        // Линейный проход по 100k правил медленный — ограничиваем общий объём работы
+        size_t iterations = (std::min)(opts.packets, (std::max)(static_cast<size_t>(2000),
+            static_cast<size_t>(200000000) / (std::max)(size, static_cast<size_t>(1))));
+
+        OpResult blocking = Measure(traffic, iterations, [&](const FlowKey& flow) {
+            return matcher.FindBlockingRule(flow) != nullptr;
+        });
+        OpResult allowed = Measure(traffic, iterations, [&](const FlowKey& flow) {
+            int ruleId;
+            return !matcher.IsAllowed(flow, ruleId);
+        });
+
+        size_t tested = 0;
+        for (size_t i = 0; i < iterations; ++i) matcher.FindBlockingRule(traffic[i % traffic.size()], &tested);
+        double testedPerPacket = static_cast<double>(tested) / iterations;
+
+        PrintRow(size, "FindBlockingRule", blocking);
+        PrintRow(size, "IsAllowed(deny)", allowed);
+        std::printf("%8s  compile %.3f ms, %zu packets, %.1f rules tested per packet\n", "",
+            compileSeconds * 1000.0, iterations, testedPerPacket);
+        // Адресные правила и порты разложены по индексам; доменные правила (и списки, ICMP, флаги,
+        // состояния) проверяются по порядку и на больших наборах дают почти все проверки
+        if (size >= 100000) {
+            std::printf("%8s  note: domain rules are scanned in order outside the block index; at this size\n"
+                "%8s  they account for most rules tested per packet\n", "", "");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,376 @@
+#include "rule_generator.h"
+#include "../rule_matcher.h"
+#include "../ip_utils.h"
+#include "../icmp_decoder.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+static const uint16_t kCommonPorts[] = { 22, 25, 53, 80, 110, 143, 443, 445, 993, 3306, 3389, 5432, 8080, 8443 };
+
+RuleGenerator::RuleGenerator(uint32_t seed, RuleMix mix)
+    : rng(seed)
+    , mix(mix)
+{
+    for (int i = 0; i < 1024; ++i) {
+        std::string path = "C:\\Program Files\\App" + std::to_string(i) + "\\app" + std::to_string(i) + ".exe";
+        apps.push_back(AppIdentityTable::Instance().Get(AppIdentityTable::Instance().Intern(path)));
+    }
+
+    // 64 сайта по 16 хостов, у каждого хоста один-два адреса (как у CDN)
+    auto feeder = std::make_unique<StaticDomainFeeder>();
+    for (int site = 0; site < 64; ++site) {
+        std::string suffix = "site" + std::to_string(site) + ".example";
+        for (int host = 0; host < 16; ++host) {
+            std::string name = "host" + std::to_string(host) + "." + suffix;
+            for (uint32_t n = 1 + rng() % 2; n > 0; --n) {
+                uint32_t ip = RandomAddress();
+                domainAddresses.push_back({ ip, name });
+                addressesByPattern[name].push_back(ip);
+                addressesByPattern["*." + suffix].push_back(ip);
+                feeder->Add(ip, name);
+            }
+        }
+    }
+    IpDomainTable::Instance().AddFeeder(std::move(feeder));
+}
+
+const std::vector<uint32_t>& RuleGenerator::Adapters() {
+    static const std::vector<uint32_t> adapters = { 0x0AFF0001u, 0x0AFF0002u, 0x0AFF0003u, 0x0AFF0004u };
+    return adapters;
+}
+
+// Пакет правила с адаптером приходит с него же; без адаптеров в смеси адаптер неизвестен
+uint32_t RuleGenerator::AdapterForFlow(const CompiledRule& rule) {
+    if (rule.adapter != 0) return rule.adapter;
+    if (mix.adapter <= 0.0) return 0;
+    return Adapters()[rng() % Adapters().size()];
+}
+
+uint32_t RuleGenerator::RandomAddress() {
+    return static_cast<uint32_t>(rng());
+}
+
+uint16_t RuleGenerator::RandomPort() {
+    if (rng() % 2 == 0) {
+        return kCommonPorts[rng() % (sizeof(kCommonPorts) / sizeof(kCommonPorts[0]))];
+    }
+    return static_cast<uint16_t>(1024 + rng() % (65536 - 1024));
+}
+
+std::vector<Rule> RuleGenerator::GenerateRules(size_t count) {
+    const double weights[] = { mix.exactIp, mix.prefix, mix.sourcePrefix, mix.app, mix.anyProtocol, mix.domain };
+    std::discrete_distribution<int> kind(std::begin(weights), std::end(weights));
+    std::bernoulli_distribution allow(mix.allow);
+    std::bernoulli_distribution derived(mix.derived);
+    std::bernoulli_distribution onAdapter(mix.adapter);
+
+    std::vector<Rule> rules;
+    rules.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (!rules.empty() && derived(rng)) {
+            Rule r = DeriveRule(rules[rng() % rules.size()]);
+            r.id = static_cast<int>(i + 1);
+            r.name = "rule" + std::to_string(r.id);
+            rules.push_back(r);
+            continue;
+        }
+
+        Rule r;
+        r.id = static_cast<int>(i + 1);
+        r.name = "rule" + std::to_string(r.id);
+        r.action = allow(rng) ? RuleAction::ALLOW : RuleAction::BLOCK;
+        r.direction = (rng() % 2) ? RuleDirection::Inbound : RuleDirection::Outbound;
+        r.protocol = (rng() % 3 == 0) ? Protocol::UDP : Protocol::TCP;
+
+        switch (kind(rng)) {
+        case 0:
+            r.destIp = FormatIPv4(RandomAddress());
+            r.destPort = RandomPort();
+            break;
+        case 1: {
+            int prefixLength = 16 + static_cast<int>(rng() % 13);
+            r.destIp = FormatIPv4(RandomAddress() & PrefixToMask(prefixLength)) + "/" + std::to_string(prefixLength);
+            uint16_t low = RandomPort();
+            uint16_t high = static_cast<uint16_t>((std::min)(65535, low + static_cast<int>(rng() % 1000)));
+            r.destPortStr = std::to_string(RandomPort()) + "," + std::to_string(low) + "-" + std::to_string(high);
+            r.destPort = 0;
+            break;
+        }
+        case 2: {
+            int prefixLength = 12 + static_cast<int>(rng() % 13);
+            r.sourceIp = FormatIPv4(RandomAddress() & PrefixToMask(prefixLength)) + "/" + std::to_string(prefixLength);
+            uint16_t low = static_cast<uint16_t>(1024 + rng() % 60000);
+            r.sourcePortStr = std::to_string(low) + "-" + std::to_string(low + 500);
+            break;
+        }
+        case 3: {
+            // Полный путь, имя файла или каталог приложения
+            std::string index = std::to_string(rng() % apps.size());
+            switch (rng() % 3) {
+            case 0: r.appPath = "C:\\Program Files\\App" + index + "\\app" + index + ".exe"; break;
+            case 1: r.appPath = "app" + index + ".exe"; break;
+            default: r.appPath = "C:\\Program Files\\App" + index + "\\"; break;
+            }
+            r.destPort = RandomPort();
+            break;
+        }
+        case 4:
+            r.protocol = Protocol::ANY;
+            r.destIp = FormatIPv4(RandomAddress());
+            break;
+        default: {
+            std::string site = "site" + std::to_string(rng() % 64) + ".example";
+            r.destIp = (rng() % 2) ? "*." + site : "host" + std::to_string(rng() % 16) + "." + site;
+            r.destPort = RandomPort();
+            break;
+        }
+        }
+        if (mix.adapter > 0.0 && onAdapter(rng)) r.adapter = FormatIPv4(Adapters()[rng() % Adapters().size()]);
+        rules.push_back(r);
+    }
+    return rules;
+}
+
+Rule RuleGenerator::DeriveRule(const Rule& base) {
+    Rule r = base;
+    CompiledRule c = RuleMatcher::CompileRule(base);
+    switch (rng() % 4) {
+    case 0:
+        // Суженная копия: адрес внутри подсети, один порт из диапазона
+        if (!c.dest.any && !c.dest.never) r.destIp = FormatIPv4(c.dest.network | (RandomAddress() & ~c.dest.mask));
+        if (!c.destPorts.empty()) {
+            r.destPort = c.destPorts.front().low;
+            r.destPortStr.clear();
+        }
+        break;
+    case 1:
+        // Тот же кортеж с другим действием
+        r.action = (base.action == RuleAction::BLOCK) ? RuleAction::ALLOW : RuleAction::BLOCK;
+        break;
+    case 2:
+        // Соседний диапазон портов
+        if (!c.destPorts.empty() && c.destPorts.back().high < 65000) {
+            uint16_t low = static_cast<uint16_t>(c.destPorts.back().high + 1);
+            r.destPortStr = std::to_string(low) + "-" + std::to_string(low + rng() % 100);
+        }
+        else {
+            r.destPort = RandomPort();
+            r.destPortStr.clear();
+        }
+        break;
+    default:
+        // Соседняя подсеть той же длины
+        if (!c.dest.any && !c.dest.never && c.dest.mask != 0) {
+            int length = 0;
+            while (length < 32 && (c.dest.mask & (0x80000000u >> length))) ++length;
+            uint32_t sibling = c.dest.network ^ (1u << (32 - length));
+            r.destIp = FormatIPv4(sibling) + (length < 32 ? "/" + std::to_string(length) : "");
+        }
+        break;
+    }
+    return r;
+}
+
+const AppIdentity* RuleGenerator::AppForRule(const Rule& rule) {
+    if (rule.appPath.empty()) return apps[rng() % apps.size()];
+    // Номер приложения — цифры после последнего "app" (без учёта регистра)
+    std::string lower = rule.appPath;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    size_t pos = lower.rfind("app");
+    size_t index = (pos == std::string::npos) ? 0 : std::strtoul(lower.c_str() + pos + 3, nullptr, 10);
+    return apps[index % apps.size()];
+}
+
+static uint32_t AddressIn(const AddressMatch& m, uint32_t random) {
+    if (m.any) return random;
+    return m.network | (random & ~m.mask);
+}
+
+static uint16_t PortIn(const std::vector<PortRange>& ranges, uint16_t random, uint32_t pick) {
+    if (ranges.empty()) return random;
+    const PortRange& r = ranges[pick % ranges.size()];
+    return static_cast<uint16_t>(r.low + pick % (static_cast<uint32_t>(r.high - r.low) + 1));
+}
+
+FlowKey RuleGenerator::FlowForRule(const Rule& rule) {
+    CompiledRule c = RuleMatcher::CompileRule(rule);
+    FlowKey flow;
+    flow.ipProtocol = c.ipProtocol ? c.ipProtocol : ((rng() % 2) ? 6 : 17);
+    flow.sourceIp = AddressIn(c.source, RandomAddress());
+    flow.destIp = AddressIn(c.dest, RandomAddress());
+    auto domain = addressesByPattern.find(rule.destIp);
+    if (domain != addressesByPattern.end()) flow.destIp = domain->second[rng() % domain->second.size()];
+    flow.sourcePort = PortIn(c.sourcePorts, RandomPort(), rng());
+    flow.destPort = PortIn(c.destPorts, RandomPort(), rng());
+    flow.direction = c.direction == RuleDirection::Inbound ? PacketDirection::Incoming : PacketDirection::Outgoing;
+    flow.adapter = AdapterForFlow(c);
+    flow.size = 64 + rng() % 1400;
+    flow.app = AppForRule(rule);
+    return flow;
+}
+
+std::vector<FlowKey> RuleGenerator::GenerateTraffic(const std::vector<Rule>& rules, size_t count, double hitRatio) {
+    std::bernoulli_distribution targeted(hitRatio);
+    std::vector<FlowKey> flows;
+    flows.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (!rules.empty() && targeted(rng)) {
+            flows.push_back(FlowForRule(rules[rng() % rules.size()]));
+            continue;
+        }
+        FlowKey flow;
+        flow.ipProtocol = (rng() % 3 == 0) ? 17 : 6;
+        flow.sourceIp = RandomAddress();
+        flow.destIp = RandomAddress();
+        flow.sourcePort = RandomPort();
+        flow.destPort = RandomPort();
+        flow.direction = (rng() % 2) ? PacketDirection::Incoming : PacketDirection::Outgoing;
+        if (mix.adapter > 0.0) flow.adapter = Adapters()[rng() % Adapters().size()];
+        flow.size = 64 + rng() % 1400;
+        flow.app = apps[rng() % apps.size()];
+        flows.push_back(flow);
+    }
+    return flows;
+}
+
+// --- pcap ---
+
+static uint32_t ReadU32(const unsigned char* p, bool swap) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    if (swap) v = (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+    return v;
+}
+
+static uint16_t ReadBE16(const unsigned char* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static uint32_t ReadBE32(const unsigned char* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+static bool DecodeIPv4(const unsigned char* ip, size_t len, uint32_t wireLength, FlowKey& flow) {
+    if (len < 20 || (ip[0] >> 4) != 4) return false;
+    size_t ihl = (ip[0] & 0x0F) * 4u;
+    if (ihl < 20 || len < ihl) return false;
+
+    flow = FlowKey();
+    flow.ipProtocol = ip[9];
+    flow.sourceIp = ReadBE32(ip + 12);
+    flow.destIp = ReadBE32(ip + 16);
+    flow.size = wireLength;
+
+    const unsigned char* l4 = ip + ihl;
+    size_t l4len = len - ihl;
+    if ((flow.ipProtocol == 6 || flow.ipProtocol == 17) && l4len >= 4) {
+        flow.sourcePort = ReadBE16(l4);
+        flow.destPort = ReadBE16(l4 + 2);
+        if (flow.ipProtocol == 6 && l4len >= 14) flow.tcpFlags = l4[13];
+    }
+    else if (flow.ipProtocol == IP_PROTOCOL_ICMP) {
+        // Как в PacketInterceptor: эхо — идентификатор в портах, ошибка — порты исходного потока
+        IcmpInfo icmp;
+        if (DecodeIcmp(l4, l4len, icmp)) {
+            flow.icmpType = icmp.type;
+            flow.icmpCode = icmp.code;
+            if (icmp.isEcho) {
+                flow.sourcePort = flow.destPort = icmp.echoId;
+            }
+            else if (icmp.hasRelated) {
+                flow.relatedProtocol = icmp.relatedProtocol;
+                flow.relatedSourceIp = icmp.relatedSourceIp;
+                flow.relatedDestIp = icmp.relatedDestIp;
+                flow.sourcePort = icmp.relatedDestPort;
+                flow.destPort = icmp.relatedSourcePort;
+            }
+        }
+    }
+    return true;
+}
+
+bool LoadPcapPackets(const std::string& path, size_t limit, std::vector<PcapPacket>& out, std::string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    unsigned char header[24];
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header))) {
+        error = "truncated pcap header";
+        return false;
+    }
+    uint32_t magic;
+    std::memcpy(&magic, header, 4);
+    bool swap;
+    if (magic == 0xA1B2C3D4 || magic == 0xA1B23C4D) swap = false;
+    else if (magic == 0xD4C3B2A1 || magic == 0x4D3CB2A1) swap = true;
+    else {
+        error = "not a classic pcap file (pcapng is not supported)";
+        return false;
+    }
+
+    const uint32_t linkType = ReadU32(header + 20, swap);
+    size_t linkHeader;
+    switch (linkType) {
+    case 1: linkHeader = 14; break;     // Ethernet
+    case 101:                           // raw IP
+    case 228: linkHeader = 0; break;    // raw IPv4
+    default:
+        error = "unsupported link type " + std::to_string(linkType);
+        return false;
+    }
+
+    std::vector<unsigned char> packet;
+    unsigned char record[16];
+    while (out.size() < limit && file.read(reinterpret_cast<char*>(record), sizeof(record))) {
+        uint32_t capLen = ReadU32(record + 8, swap);
+        uint32_t wireLen = ReadU32(record + 12, swap);
+        if (capLen > 262144) {
+            error = "corrupt record length";
+            return !out.empty();
+        }
+        packet.resize(capLen);
+        if (!file.read(reinterpret_cast<char*>(packet.data()), capLen)) break;
+
+        size_t offset = linkHeader;
+        if (linkType == 1) {
+            if (capLen < 14) continue;
+            uint16_t etherType = ReadBE16(&packet[12]);
+            if (etherType == 0x8100 && capLen >= 18) {  // VLAN
+                etherType = ReadBE16(&packet[16]);
+                offset += 4;
+            }
+            if (etherType != 0x0800) continue;
+        }
+        if (capLen <= offset) continue;
+
+        if ((packet[offset] >> 4) != 4) continue;
+        out.push_back({ std::vector<unsigned char>(packet.begin() + offset, packet.end()), wireLen });
+    }
+    if (out.empty()) {
+        error = "no IPv4 packets in " + path;
+        return false;
+    }
+    return true;
+}
+
+bool LoadPcapTraffic(const std::string& path, size_t limit, std::vector<FlowKey>& out, std::string& error) {
+    std::vector<PcapPacket> packets;
+    if (!LoadPcapPackets(path, limit, packets, error)) return false;
+    for (const auto& packet : packets) {
+        FlowKey flow;
+        if (DecodeIPv4(packet.ip.data(), packet.ip.size(), packet.wireLength, flow)) {
+            out.push_back(flow);
+        }
+    }
+    if (out.empty()) {
+        error = "no IPv4 packets in " + path;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../rule.h"
+#include "../flow_key.h"
+
+struct CompiledRule;
+
+// Доли типов правил в синтетическом наборе (в сумме не обязаны давать 1, нормализуются)
+struct RuleMix {
+    double exactIp = 0.35;      // точный адрес назначения + порт
+    double prefix = 0.20;       // подсеть назначения + список/диапазон портов
+    double sourcePrefix = 0.10; // подсеть источника + диапазон портов источника
+    double app = 0.15;          // правило приложения
+    double anyProtocol = 0.15;  // протокол ANY, только адрес
+    double domain = 0.05;       // домен назначения ("hostN.siteM.example" или "*.siteM.example")
+    double allow = 0.05;        // разрешающие правила поверх блокирующих
+    double derived = 0.0;       // доля правил, производных от более ранних: суженные копии,
+                                // соседние диапазоны портов и подсети, копии с другим действием
+    double adapter = 0.0;       // доля правил, привязанных к одному из адаптеров Adapters();
+                                // если не 0, трафик тоже приходит с этих адаптеров
+};
+
+class RuleGenerator {
+public:
+    explicit RuleGenerator(uint32_t seed = 1, RuleMix mix = RuleMix());
+
+    std::vector<Rule> GenerateRules(size_t count);
+
+    // hitRatio — доля пакетов, специально построенных под случайное правило;
+    // остальные случайные (в основном проходят все правила насквозь)
+    std::vector<FlowKey> GenerateTraffic(const std::vector<Rule>& rules, size_t count, double hitRatio);
+
+    // Приложения "C:\Program Files\AppN\appN.exe", на которые ссылаются FlowKey::app
+    const std::vector<const AppIdentity*>& Apps() const { return apps; }
+
+    // IPv4 адаптеров многоадресного хоста "10.255.0.1".."10.255.0.4" (FlowKey::adapter)
+    static const std::vector<uint32_t>& Adapters();
+
+    // Соответствия адрес -> имя для доменных правил; конструктор загружает их
+    // в IpDomainTable::Instance() через StaticDomainFeeder
+    const std::vector<std::pair<uint32_t, std::string>>& DomainAddresses() const { return domainAddresses; }
+
+private:
+    uint32_t RandomAddress();
+    uint16_t RandomPort();
+    uint32_t AdapterForFlow(const CompiledRule& rule);
+    FlowKey FlowForRule(const Rule& rule);
+    Rule DeriveRule(const Rule& base);
+    const AppIdentity* AppForRule(const Rule& rule);
+
+    std::mt19937 rng;
+    RuleMix mix;
+    std::vector<const AppIdentity*> apps;
+    std::vector<std::pair<uint32_t, std::string>> domainAddresses;
+    std::unordered_map<std::string, std::vector<uint32_t>> addressesByPattern;   // шаблон -> адреса
+};
+
+// IPv4-пакет из pcap без канального заголовка
+struct PcapPacket {
+    std::vector<unsigned char> ip;
+    uint32_t wireLength = 0;
+};
+
+// Чтение классического pcap (Ethernet, raw IPv4) без libpcap: только IPv4.
+// Возвращает false, если файл не открылся или формат не поддерживается.
+bool LoadPcapPackets(const std::string& path, size_t limit, std::vector<PcapPacket>& out, std::string& error);
+// То же, разобранное в FlowKey (TCP/UDP/ICMP)
+bool LoadPcapTraffic(const std::string& path, size_t limit, std::vector<FlowKey>& out, std::string& error);
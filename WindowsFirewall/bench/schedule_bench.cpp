@@ -0,0 +1,298 @@
+// Правила с расписанием (Rule::schedule): разбор строк в недельные битовые карты, часы
+// ScheduleClock на подставленном времени, сверка сопоставителя (и ConnectionTracker) в минуты
+// вокруг границ против набора, собранного заново только из правил, действующих в эту минуту.
+// Стоимость: пакет с расписаниями против того же набора без них, RefreshSchedule на каждой
+// минуте недели и колесо границ, по которому демон трогает WFP.
+//
+//   schedule_bench [--rules N] [--scheduled F] [--packets N] [--seed N]
+
+#include "bench_common.h"
+#include "rule_generator.h"
+#include "../connection_tracker.h"
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <set>
+
+struct ScheduleBenchOptions {
+    size_t rules = 5000;
+    double scheduled = 0.2;         // доля правил с расписанием
+    size_t packets = 20000;
+    uint32_t seed = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, ScheduleBenchOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* arg = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(arg, "--rules") == 0) opts.rules = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--scheduled") == 0) opts.scheduled = std::strtod(value, nullptr);
+        else if (std::strcmp(arg, "--packets") == 0) opts.packets = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        else return false;
+    }
+    return argc % 2 == 1 && opts.rules > 0 && opts.packets > 0 && opts.scheduled >= 0 && opts.scheduled <= 1;
+}
+
+static const char* const kSchedules[] = {
+    "Mon-Fri 09:00-18:00",
+    "Sat,Sun",
+    "Fri 22:00-02:00",
+    "08:00-12:00,13:00-17:00",
+    "Mon-Fri 12:00-13:00; Sat 10:00-14:00",
+    "Sun 23:00-01:00",
+};
+
+static uint32_t At(uint32_t day, uint32_t hour, uint32_t minute) {
+    return day * WeekSchedule::MINUTES_PER_DAY + hour * 60 + minute;
+}
+
+static int Id(const CompiledRule* rule) {
+    return rule ? rule->id : -1;
+}
+
+static bool CheckParse() {
+    struct Case {
+        const char* text;
+        uint32_t minute;
+        bool active;
+    };
+    static const Case cases[] = {
+        { "Mon-Fri 09:00-18:00", At(0, 9, 0), true }, { "Mon-Fri 09:00-18:00", At(0, 8, 59), false },
+        { "Mon-Fri 09:00-18:00", At(4, 17, 59), true }, { "Mon-Fri 09:00-18:00", At(4, 18, 0), false },
+        { "Mon-Fri 09:00-18:00", At(5, 10, 0), false },
+        { "Fri 22:00-02:00", At(4, 23, 0), true }, { "Fri 22:00-02:00", At(5, 1, 59), true },
+        { "Fri 22:00-02:00", At(5, 2, 0), false }, { "Fri 22:00-02:00", At(4, 21, 59), false },
+        { "Sun 23:00-01:00", At(6, 23, 30), true }, { "Sun 23:00-01:00", At(0, 0, 30), true },
+        { "Sat,Sun", At(5, 0, 0), true }, { "Sat,Sun", At(6, 23, 59), true }, { "Sat,Sun", At(4, 23, 59), false },
+        { "08:00-12:00,13:00-17:00", At(2, 12, 30), false }, { "08:00-12:00,13:00-17:00", At(2, 13, 0), true },
+        { "sat-monday 10:00-11:00", At(0, 10, 30), true }, { "sat-monday 10:00-11:00", At(1, 10, 30), false },
+        { "Mon 00:00-24:00", At(0, 23, 59), true }, { "Mon 00:00-24:00", At(1, 0, 0), false },
+    };
+    for (const auto& c : cases) {
+        std::shared_ptr<const WeekSchedule> schedule;
+        if (!WeekSchedule::Parse(c.text, schedule) || !schedule || schedule->Active(c.minute) != c.active) {
+            std::fprintf(stderr, "schedule \"%s\" at minute %u: expected %s\n", c.text, c.minute,
+                c.active ? "active" : "inactive");
+            return false;
+        }
+    }
+    static const char* const invalid[] = { "Mon-Fry 09:00-18:00", "25:00-26:00", "09:00-09:00", "Mon 9-18", "Mon 09:00", "Mon 09:60-10:00" };
+    for (const char* text : invalid) {
+        std::shared_ptr<const WeekSchedule> schedule;
+        if (WeekSchedule::Parse(text, schedule)) {
+            std::fprintf(stderr, "schedule \"%s\" should be rejected\n", text);
+            return false;
+        }
+    }
+    std::shared_ptr<const WeekSchedule> always;
+    std::shared_ptr<const WeekSchedule> workdays;
+    if (!WeekSchedule::Parse("  ", always) || always || !WeekSchedule::Parse(kSchedules[0], workdays)
+        || workdays->Changes().size() != 10) {
+        std::fprintf(stderr, "empty schedule or boundaries of \"%s\" are wrong\n", kSchedules[0]);
+        return false;
+    }
+    std::printf("parse:   %zu minute checks, %zu invalid schedules rejected\n",
+        sizeof(cases) / sizeof(cases[0]), sizeof(invalid) / sizeof(invalid[0]));
+    return true;
+}
+
+// Местное время как у ScheduleClock (1 января 2024 года — понедельник)
+static ScheduleClock::Clock::time_point LocalTime(int day, int hour, int minute, int second) {
+    std::tm tm = {};
+    tm.tm_year = 2024 - 1900;
+    tm.tm_mon = 0;
+    tm.tm_mday = 1 + day;
+    tm.tm_hour = hour;
+    tm.tm_min = minute;
+    tm.tm_sec = second;
+    tm.tm_isdst = -1;
+    return ScheduleClock::Clock::from_time_t(std::mktime(&tm));
+}
+
+static bool CheckClock() {
+    ScheduleClock clock;
+    ScheduleClock::Clock::time_point now = LocalTime(0, 8, 59, 30);
+    clock.SetClock([&now]() { return now; });
+    bool ok = clock.Refresh() && clock.Minute() == At(0, 8, 59);
+    now += std::chrono::seconds(20);
+    ok = ok && !clock.Refresh() && clock.Minute() == At(0, 8, 59);
+    now += std::chrono::seconds(10);
+    ok = ok && clock.Refresh() && clock.Minute() == At(0, 9, 0);
+    now = LocalTime(6, 23, 59, 59);
+    ok = ok && clock.Refresh() && clock.Minute() == At(6, 23, 59);
+    now += std::chrono::seconds(1);
+    ok = ok && clock.Refresh() && clock.Minute() == 0;
+    // Часы переставили назад в пределах той же минуты недели — минута та же
+    now = LocalTime(7, 0, 0, 30) - std::chrono::hours(24 * 7);
+    ok = ok && !clock.Refresh() && clock.Minute() == 0;
+    if (!ok) {
+        std::fprintf(stderr, "injected clock: wrong minute of week %u\n", clock.Minute());
+        return false;
+    }
+    std::printf("clock:   minute of week follows the injected clock across minute, week and backward jumps\n");
+    return true;
+}
+
+// Правила, действующие в минуту minute, без расписаний: так выглядел бы набор, если бы
+// правила включали и выключали вручную
+static std::vector<Rule> ActiveAt(const std::vector<Rule>& rules, uint32_t minute) {
+    std::vector<Rule> active;
+    for (const auto& rule : rules) {
+        std::shared_ptr<const WeekSchedule> schedule;
+        WeekSchedule::Parse(rule.schedule, schedule);
+        if (schedule && !schedule->Active(minute)) continue;
+        active.push_back(rule);
+        active.back().schedule.clear();
+    }
+    return active;
+}
+
+// Минуты проверки: каждая граница расписаний и минута перед ней, по порядку недели
+static std::vector<uint32_t> CheckMinutes() {
+    std::set<uint32_t> minutes;
+    for (const char* text : kSchedules) {
+        std::shared_ptr<const WeekSchedule> schedule;
+        WeekSchedule::Parse(text, schedule);
+        for (uint32_t change : schedule->Changes()) {
+            minutes.insert(change);
+            minutes.insert((change + WeekSchedule::MINUTES_PER_WEEK - 1) % WeekSchedule::MINUTES_PER_WEEK);
+        }
+    }
+    return std::vector<uint32_t>(minutes.begin(), minutes.end());
+}
+
+// Один matcher на всю неделю (часы двигает ScheduleClock, правила на границах вносятся в наборы
+// и убираются из них) против заново собранного на каждую минуту; трекеры видят одни и те же
+// пакеты, соединения переживают границы расписаний
+static bool Verify(const std::vector<Rule>& rules, const std::vector<FlowKey>& traffic,
+    RuleMatcher::BlockEngine engine, const char* engineName) {
+    ScheduleClock clock;
+    ScheduleClock::Clock::time_point now = LocalTime(0, 0, 0, 0);
+    clock.SetClock([&now]() { return now; });
+    clock.Refresh();
+    RuleMatcher matcher;
+    matcher.SetScheduleClock(&clock);
+    matcher.SetBlockEngine(engine);
+    matcher.Compile(rules);
+    ConnectionTracker scheduled;
+    ConnectionTracker fresh;
+    std::vector<uint32_t> minutes = CheckMinutes();
+    uint64_t tick = 1;
+    size_t checked = 0;
+    size_t flips = 0;
+    for (uint32_t minute : minutes) {
+        now = LocalTime(0, 0, 0, 0) + std::chrono::minutes(minute) + std::chrono::seconds(15);
+        clock.Refresh();
+        if (matcher.RefreshSchedule()) ++flips;
+        RuleMatcher reference;
+        reference.Compile(ActiveAt(rules, minute));
+        for (size_t p = 0; p < traffic.size(); ++p) {
+            FlowKey a = traffic[p];
+            FlowKey b = traffic[p];
+            int expected = Id(reference.Evaluate(b).rule);
+            int actual = Id(matcher.Evaluate(a).rule);
+            int expectedTracked = Id(fresh.FindBlockingRule(reference, b, tick));
+            int actualTracked = Id(scheduled.FindBlockingRule(matcher, a, tick));
+            ++tick;
+            if (expected != actual || expectedTracked != actualTracked) {
+                std::fprintf(stderr, "%s, minute %u, packet %zu: rule %d (tracked %d), expected %d (tracked %d)\n",
+                    engineName, minute, p, actual, actualTracked, expected, expectedTracked);
+                return false;
+            }
+            ++checked;
+        }
+    }
+    std::printf("verify %-9s %zu minutes around boundaries, %zu packets agree with sets rebuilt per minute "
+        "(%zu generation changes, %llu connections revalidated)\n", engineName, minutes.size(), checked, flips,
+        static_cast<unsigned long long>(scheduled.GetStats().revalidated));
+    return true;
+}
+
+static double NsPerPacket(const RuleMatcher& matcher, const std::vector<FlowKey>& traffic) {
+    size_t rounds = (std::max)(static_cast<size_t>(1), static_cast<size_t>(200000) / traffic.size());
+    auto start = BenchClock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (const auto& flow : traffic) DoNotOptimize(matcher.Evaluate(flow).ruleId);
+    }
+    return SecondsSince(start) * 1e9 / (rounds * traffic.size());
+}
+
+int main(int argc, char** argv) {
+    ScheduleBenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: schedule_bench [--rules N] [--scheduled F] [--packets N] [--seed N]\n");
+        return 1;
+    }
+    if (!CheckParse() || !CheckClock()) return 2;
+
+    RuleGenerator generator(opts.seed);
+    std::vector<Rule> plain = generator.GenerateRules(opts.rules);
+    std::vector<Rule> rules = plain;
+    std::mt19937 rng(opts.seed);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    size_t scheduledCount = 0;
+    for (auto& rule : rules) {
+        if (chance(rng) >= opts.scheduled) continue;
+        rule.schedule = kSchedules[rng() % (sizeof(kSchedules) / sizeof(kSchedules[0]))];
+        ++scheduledCount;
+    }
+    std::vector<FlowKey> traffic = generator.GenerateTraffic(rules, opts.packets, 0.5);
+    std::vector<FlowKey> sample(traffic.begin(), traffic.begin() + (std::min)(traffic.size(), static_cast<size_t>(2000)));
+    if (!Verify(rules, sample, RuleMatcher::BlockEngine::Linear, "linear:")
+        || !Verify(rules, sample, RuleMatcher::BlockEngine::FieldMask, "fieldmask:")
+        || !Verify(rules, sample, RuleMatcher::BlockEngine::Simd, "simd:")) {
+        return 2;
+    }
+
+    // Пакет: тот же набор с расписаниями и без них (в рабочее время, чтобы правила действовали)
+    ScheduleClock clock;
+    ScheduleClock::Clock::time_point now = LocalTime(2, 10, 0, 0);
+    clock.SetClock([&now]() { return now; });
+    clock.Refresh();
+    RuleMatcher withSchedules;
+    withSchedules.SetScheduleClock(&clock);
+    withSchedules.Compile(rules);
+    RuleMatcher withoutSchedules;
+    withoutSchedules.Compile(plain);
+    double plainNs = NsPerPacket(withoutSchedules, traffic);
+    double scheduledNs = NsPerPacket(withSchedules, traffic);
+
+    // Неделя по минутам: календарь — раз в минуту, правила перебираются только на смене минуты
+    size_t flips = 0;
+    auto start = BenchClock::now();
+    for (uint32_t minute = 1; minute <= WeekSchedule::MINUTES_PER_WEEK; ++minute) {
+        now += std::chrono::minutes(1);
+        clock.Refresh();
+        if (withSchedules.RefreshSchedule()) ++flips;
+    }
+    double refreshUs = SecondsSince(start) * 1e6 / WeekSchedule::MINUTES_PER_WEEK;
+
+    // Колесо демона: сколько раз за неделю WFP получает ApplyRules
+    start = BenchClock::now();
+    ScheduleWheel wheel;
+    for (const auto& rule : rules) {
+        std::shared_ptr<const WeekSchedule> schedule;
+        if (WeekSchedule::Parse(rule.schedule, schedule) && schedule) wheel.Add(rule.id, *schedule);
+    }
+    double wheelMs = SecondsSince(start) * 1e3;
+    wheel.Start(0);
+    std::vector<int> due;
+    size_t applies = 0;
+    size_t dueRules = 0;
+    for (uint32_t minute = 1; minute <= WeekSchedule::MINUTES_PER_WEEK; ++minute) {
+        wheel.Advance(minute % WeekSchedule::MINUTES_PER_WEEK, due);
+        if (due.empty()) continue;
+        ++applies;
+        dueRules += due.size();
+    }
+
+    std::printf("%zu rules, %zu with schedules\n", opts.rules, scheduledCount);
+    std::printf("%-34s %10.1f ns\n", "packet, no schedules", plainNs);
+    std::printf("%-34s %10.1f ns\n", "packet, with schedules", scheduledNs);
+    std::printf("%-34s %10.2f us  (%zu of %u minutes changed verdicts)\n", "clock + RefreshSchedule per minute",
+        refreshUs, flips, WeekSchedule::MINUTES_PER_WEEK);
+    std::printf("%-34s %10.1f ms  (%zu WFP applies a week, %zu rule boundaries)\n", "schedule wheel build",
+        wheelMs, applies, dueRules);
+    return 0;
+}
@@ -0,0 +1,423 @@
+// Службы потоков по сигнатурам содержимого (SignatureSet, ServiceClassifier): сверка автомата
+// Ахо-Корасик с прямым поиском, опознание потоков на нестандартных портах, условие правила
+// на службу и скорость пути захвата.
+//
+//   service_bench [--signatures FILE] [--flows N] [--packets N] [--extra N] [--seed N]
+
+#include "bench_common.h"
+#include "../service_signatures.h"
+#include "../rule_matcher.h"
+#include <cstring>
+#include <random>
+#include <set>
+#include <sstream>
+
+struct ServiceBenchOptions {
+    std::string signatures = "../service_signatures.txt";
+    size_t flows = 20000;
+    size_t packets = 30;            // пакетов данных в каждую сторону после первых
+    size_t extra = 2000;            // случайных сигнатур для проверки зависимости от размера набора
+    uint32_t seed = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, ServiceBenchOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--signatures") == 0) opts.signatures = argv[i + 1];
+        else if (std::strcmp(argv[i], "--flows") == 0) opts.flows = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--packets") == 0) opts.packets = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--extra") == 0) opts.extra = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+        else return false;
+    }
+    return argc % 2 == 1 && opts.flows > 0;
+}
+
+static bool Fail(const char* what) {
+    std::fprintf(stderr, "check failed: %s\n", what);
+    return false;
+}
+
+static void Set16(std::vector<uint8_t>& out, size_t at, size_t v) {
+    out[at] = static_cast<uint8_t>(v >> 8);
+    out[at + 1] = static_cast<uint8_t>(v);
+}
+
+static std::vector<uint8_t> Bytes(const std::string& s) {
+    return std::vector<uint8_t>(s.begin(), s.end());
+}
+
+static std::vector<uint8_t> IpPacket(uint8_t protocol, uint32_t src, uint16_t sport, uint32_t dst, uint16_t dport,
+    uint32_t seq, uint8_t flags, const uint8_t* payload, size_t size) {
+    size_t l4 = protocol == 6 ? 20 : 8;
+    std::vector<uint8_t> packet(20 + l4 + size, 0);
+    packet[0] = 0x45;
+    Set16(packet, 2, packet.size());
+    packet[8] = 64;
+    packet[9] = protocol;
+    for (int i = 0; i < 4; ++i) {
+        packet[12 + i] = static_cast<uint8_t>(src >> (24 - 8 * i));
+        packet[16 + i] = static_cast<uint8_t>(dst >> (24 - 8 * i));
+    }
+    Set16(packet, 20, sport);
+    Set16(packet, 22, dport);
+    if (protocol == 6) {
+        for (int i = 0; i < 4; ++i) packet[24 + i] = static_cast<uint8_t>(seq >> (24 - 8 * i));
+        packet[32] = 5 << 4;
+        packet[33] = flags;
+    }
+    else {
+        Set16(packet, 24, 8 + size);
+    }
+    if (size) std::memcpy(&packet[20 + l4], payload, size);
+    return packet;
+}
+
+constexpr uint8_t SYN = 0x02, SYN_ACK = 0x12, ACK = 0x10, PSH_ACK = 0x18, FIN_ACK = 0x11;
+
+// Прямой поиск: каждая сигнатура в каждой позиции
+static std::set<std::pair<uint32_t, size_t>> NaiveMatches(const SignatureSet& set, const uint8_t* data, size_t size) {
+    std::set<std::pair<uint32_t, size_t>> found;
+    for (uint32_t s = 0; s < set.Size(); ++s) {
+        const std::string& pattern = set.Signature(s).pattern;
+        for (size_t start = 0; start + pattern.size() <= size; ++start) {
+            if (std::memcmp(data + start, pattern.data(), pattern.size()) == 0) found.insert({ s, start + pattern.size() });
+        }
+    }
+    return found;
+}
+
+// Число совпадений без сбора: то, что делает классификатор на каждом байте окна
+static size_t CountAutomaton(const SignatureSet& set, const uint8_t* data, size_t size) {
+    size_t count = 0;
+    SignatureSet::State state = SignatureSet::START;
+    for (size_t i = 0; i < size; ++i) {
+        state = set.Step(state, data[i]);
+        auto range = set.Matches(state);
+        count += range.second - range.first;
+    }
+    return count;
+}
+
+static size_t CountNaive(const SignatureSet& set, const uint8_t* data, size_t size) {
+    size_t count = 0;
+    for (uint32_t s = 0; s < set.Size(); ++s) {
+        const std::string& pattern = set.Signature(s).pattern;
+        for (size_t start = 0; start + pattern.size() <= size; ++start) {
+            count += std::memcmp(data + start, pattern.data(), pattern.size()) == 0;
+        }
+    }
+    return count;
+}
+
+static std::set<std::pair<uint32_t, size_t>> AutomatonMatches(const SignatureSet& set, const uint8_t* data, size_t size) {
+    std::set<std::pair<uint32_t, size_t>> found;
+    SignatureSet::State state = SignatureSet::START;
+    for (size_t i = 0; i < size; ++i) {
+        state = set.Step(state, data[i]);
+        auto range = set.Matches(state);
+        for (const uint32_t* m = range.first; m != range.second; ++m) found.insert({ *m, i + 1 });
+    }
+    return found;
+}
+
+static bool CheckParser() {
+    SignatureSet set;
+    std::string error;
+    std::istringstream good(
+        "# comment\n"
+        "\n"
+        "Alpha  0  any     \"A\\x00\\r\\n\\\"\\\\\"\n"
+        "beta   *  client  de ad BE ef\n"
+        "gamma  12 server  \"x\"\r\n");
+    if (!set.Parse(good, error) || set.Size() != 3) return Fail("signature file");
+    if (set.Signature(0).pattern != std::string("A\0\r\n\"\\", 6) || set.Signature(0).offset != 0
+        || ServiceNames::Instance().Name(set.Signature(0).service) != "alpha") {
+        return Fail("quoted pattern");
+    }
+    if (set.Signature(1).pattern != "\xde\xad\xbe\xef" || set.Signature(1).offset != -1
+        || set.Signature(1).side != ServiceSignature::Side::Client) {
+        return Fail("hex pattern");
+    }
+    if (set.Signature(2).offset != 12 || set.Signature(2).side != ServiceSignature::Side::Server) return Fail("offset, side");
+    const char* bad[] = {
+        "x 0 any \"unterminated\n", "x -1 any \"a\"\n", "x 0 both \"a\"\n", "x 0 any zz\n",
+        "x 0 any \"\"\n", "x 0 any \"a\" trailing\n", "x 0 any \"\\q\"\n", "x 0 any\n"
+    };
+    for (const char* text : bad) {
+        std::istringstream in(text);
+        if (set.Parse(in, error)) return Fail(text);
+    }
+    if (set.Size() != 3) return Fail("failed parse changed the set");
+    return true;
+}
+
+// Автомат находит ровно то же, что прямой поиск: общие префиксы, вложенные и повторяющиеся шаблоны
+static bool CheckAutomaton(std::mt19937& rng) {
+    for (int round = 0; round < 200; ++round) {
+        SignatureSet set;
+        size_t count = 1 + rng() % 40;
+        for (size_t i = 0; i < count; ++i) {
+            ServiceSignature signature;
+            signature.service = ServiceNames::Instance().Intern("s" + std::to_string(i % 7));
+            size_t length = 1 + rng() % 6;
+            for (size_t k = 0; k < length; ++k) signature.pattern += static_cast<char>('a' + rng() % 3);
+            set.Add(signature);
+        }
+        set.Build();
+        std::vector<uint8_t> text(300);
+        for (auto& b : text) b = static_cast<uint8_t>(rng() % 4 == 0 ? rng() : 'a' + rng() % 3);
+        if (NaiveMatches(set, text.data(), text.size()) != AutomatonMatches(set, text.data(), text.size())) {
+            return Fail("automaton differs from naive search");
+        }
+    }
+    return true;
+}
+
+static bool CheckClassifier(const std::shared_ptr<const SignatureSet>& signatures) {
+    ServiceNames& names = ServiceNames::Instance();
+    ServiceClassifier classifier(signatures);
+    const uint32_t client = 0xC0A80A02, server = 0x5DB8D822;
+
+    // SSH на нестандартном порту: баннер сервера разбит на два сегмента, первый повторён
+    auto syn = IpPacket(6, client, 50000, server, 2222, 99, SYN, nullptr, 0);
+    auto synAck = IpPacket(6, server, 2222, client, 50000, 499, SYN_ACK, nullptr, 0);
+    std::vector<uint8_t> banner = Bytes("SSH-2.0-OpenSSH_9.6\r\n");
+    auto b1 = IpPacket(6, server, 2222, client, 50000, 500, PSH_ACK, banner.data(), 2);
+    auto b2 = IpPacket(6, server, 2222, client, 50000, 502, PSH_ACK, banner.data() + 2, banner.size() - 2);
+    if (classifier.OnIPv4Packet(syn.data(), syn.size()) != UNKNOWN_SERVICE) return Fail("labelled on SYN");
+    classifier.OnIPv4Packet(synAck.data(), synAck.size());
+    if (classifier.OnIPv4Packet(b1.data(), b1.size()) != UNKNOWN_SERVICE) return Fail("labelled on 2 bytes");
+    if (classifier.OnIPv4Packet(b1.data(), b1.size()) != UNKNOWN_SERVICE) return Fail("retransmission");
+    if (classifier.OnIPv4Packet(b2.data(), b2.size()) != names.Find("ssh")) return Fail("SSH across segments");
+    auto later = IpPacket(6, client, 50000, server, 2222, 100, ACK, nullptr, 0);
+    if (classifier.OnIPv4Packet(later.data(), later.size()) != names.Find("ssh")) return Fail("label kept");
+    auto fin = IpPacket(6, client, 50000, server, 2222, 100, FIN_ACK, nullptr, 0);
+    classifier.OnIPv4Packet(fin.data(), fin.size());
+    if (classifier.Size() != 0) return Fail("FIN keeps the flow");
+
+    // Трекер на HTTP: самый длинный шаблон пакета; "GET " в середине потока не привязан к смещению 0
+    std::vector<uint8_t> announce = Bytes("GET /announce?info_hash=abc HTTP/1.1\r\n\r\n");
+    auto a = IpPacket(6, client, 50001, server, 80, 1, PSH_ACK, announce.data(), announce.size());
+    if (classifier.OnIPv4Packet(a.data(), a.size()) != names.Find("bittorrent")) return Fail("longest signature wins");
+    std::vector<uint8_t> shifted = Bytes("xxGET / HTTP/1.1\r\n");
+    auto s = IpPacket(6, client, 50002, server, 80, 1, PSH_ACK, shifted.data(), shifted.size());
+    if (classifier.OnIPv4Packet(s.data(), s.size()) != UNKNOWN_SERVICE) return Fail("anchored signature at wrong offset");
+
+    // SMB2 на порту 4455 (смещение 4 за заголовком NetBIOS), рукопожатие BitTorrent на 51413
+    std::vector<uint8_t> smb = { 0, 0, 0, 0x40, 0xFE, 'S', 'M', 'B', 0x40, 0 };
+    auto m = IpPacket(6, client, 50003, server, 4455, 1, PSH_ACK, smb.data(), smb.size());
+    if (classifier.OnIPv4Packet(m.data(), m.size()) != names.Find("smb")) return Fail("SMB2");
+    std::vector<uint8_t> handshake = Bytes("\x13" "BitTorrent protocol");
+    handshake.resize(68, 0);
+    auto h = IpPacket(6, client, 50004, server, 51413, 1, PSH_ACK, handshake.data(), handshake.size());
+    if (classifier.OnIPv4Packet(h.data(), h.size()) != names.Find("bittorrent")) return Fail("BitTorrent handshake");
+
+    // Сигнатура клиента в данных сервера не срабатывает
+    std::vector<uint8_t> tlsHello = { 0x16, 0x03, 0x01, 0x02, 0x00, 0x01 };
+    auto c1 = IpPacket(6, client, 50005, server, 9443, 1, SYN, nullptr, 0);
+    auto c2 = IpPacket(6, server, 9443, client, 50005, 1, PSH_ACK, tlsHello.data(), tlsHello.size());
+    auto c3 = IpPacket(6, client, 50005, server, 9443, 2, PSH_ACK, tlsHello.data(), tlsHello.size());
+    classifier.OnIPv4Packet(c1.data(), c1.size());
+    if (classifier.OnIPv4Packet(c2.data(), c2.size()) != UNKNOWN_SERVICE) return Fail("client signature from server");
+    if (classifier.OnIPv4Packet(c3.data(), c3.size()) != names.Find("tls")) return Fail("TLS from client");
+
+    // UDP: DHT на случайном порту, смещение от начала каждой датаграммы
+    std::vector<uint8_t> dht = Bytes("d1:ad2:id20:abcdefghij0123456789e1:q4:pinge");
+    auto d = IpPacket(17, client, 40000, server, 31337, 0, 0, dht.data(), dht.size());
+    if (classifier.OnIPv4Packet(d.data(), d.size()) != names.Find("bittorrent")) return Fail("DHT over UDP");
+
+    // Разрыв в сегментах и неизвестный протокол: поток остаётся без службы и больше не просматривается
+    std::vector<uint8_t> noise(1400, 0x5A);
+    auto g1 = IpPacket(6, client, 50006, server, 7000, 1, PSH_ACK, noise.data(), 100);
+    auto g2 = IpPacket(6, client, 50006, server, 7000, 1001, PSH_ACK, banner.data(), banner.size());
+    auto g3 = IpPacket(6, server, 7000, client, 50006, 1, PSH_ACK, noise.data(), noise.size());
+    classifier.OnIPv4Packet(g1.data(), g1.size());
+    classifier.OnIPv4Packet(g2.data(), g2.size());
+    classifier.OnIPv4Packet(g3.data(), g3.size());
+    if (classifier.GetStats().unlabelled != 1) return Fail("gap and exhausted window");
+    uint64_t inspected = classifier.GetStats().inspectedBytes;
+    classifier.OnIPv4Packet(g3.data(), g3.size());
+    if (classifier.GetStats().inspectedBytes != inspected) return Fail("inspection after classification");
+    if (classifier.GetStats().labelled != 6) return Fail("labelled count");
+
+    // Таблица портов — запасной вариант
+    if (ServiceForPorts(6, 51515, 22) != names.Find("ssh") || ServiceForPorts(17, 53, 53) != names.Find("dns")
+        || ServiceForPorts(17, 443, 60000) != names.Find("quic") || ServiceForPorts(6, 40000, 40001) != UNKNOWN_SERVICE) {
+        return Fail("port table");
+    }
+    return true;
+}
+
+// Условие правила на службу
+static bool CheckRules() {
+    Rule block;
+    block.id = 1;
+    block.action = RuleAction::BLOCK;
+    block.direction = RuleDirection::Outbound;
+    block.service = "BitTorrent";
+    Rule web;
+    web.id = 2;
+    web.action = RuleAction::BLOCK;
+    web.direction = RuleDirection::Outbound;
+    web.service = "http";
+    web.destIp = "10.0.0.0/8";
+    RuleMatcher matcher;
+    matcher.Compile({ block, web });
+
+    FlowKey flow;
+    flow.sourceIp = 0xC0A80A02;
+    flow.destIp = 0x5DB8D822;
+    flow.ipProtocol = 6;
+    flow.destPort = 51413;
+    flow.direction = PacketDirection::Outgoing;
+    if (matcher.FindBlockingRule(flow)) return Fail("unlabelled flow blocked");
+    flow.service = ServiceNames::Instance().Find("bittorrent");
+    const CompiledRule* hit = matcher.FindBlockingRule(flow);
+    if (!hit || hit->id != 1) return Fail("service rule");
+    flow.service = ServiceNames::Instance().Find("http");
+    if (matcher.FindBlockingRule(flow)) return Fail("service rule with address");
+    flow.destIp = 0x0A000001;
+    hit = matcher.FindBlockingRule(flow);
+    if (!hit || hit->id != 2) return Fail("service and address");
+    return true;
+}
+
+int main(int argc, char** argv) {
+    ServiceBenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: service_bench [--signatures FILE] [--flows N] [--packets N] [--extra N] [--seed N]\n");
+        return 1;
+    }
+    auto signatures = std::make_shared<SignatureSet>();
+    std::string error;
+    if (!signatures->LoadFile(opts.signatures, error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    signatures->Build();
+    std::printf("signatures: %zu, automaton states: %zu\n", signatures->Size(), signatures->StateCount());
+
+    std::mt19937 rng(opts.seed);
+    if (!CheckParser() || !CheckAutomaton(rng) || !CheckClassifier(signatures) || !CheckRules()) return 2;
+
+    // Потоки на случайных портах с первыми байтами известных протоколов (и 20% неизвестных),
+    // затем данные; пакеты потоков перемешаны окнами по 256
+    const char* firstBytes[] = {
+        "SSH-2.0-OpenSSH_9.6\r\n", "\x16\x03\x01\x02\x00\x01\x00\x01\xfc\x03\x03",
+        "GET /index.html HTTP/1.1\r\nHost: example.com\r\n\r\n", "POST /api HTTP/1.1\r\n",
+        "\x13" "BitTorrent protocol", "GET /announce?info_hash=x HTTP/1.0\r\n", "EHLO mail.example\r\n",
+        "\x03\x00\x00\x2b\x26\xe0\x00\x00\x00\x00\x00" "Cookie: mstshash=user\r\n"
+    };
+    const size_t kinds = sizeof(firstBytes) / sizeof(firstBytes[0]);
+    std::vector<std::vector<std::vector<uint8_t>>> perFlow(opts.flows);
+    std::vector<uint8_t> data(1200);
+    for (auto& b : data) b = static_cast<uint8_t>(rng());
+    size_t expectedLabelled = 0;
+    for (size_t i = 0; i < opts.flows; ++i) {
+        auto& packets = perFlow[i];
+        uint32_t client = 0x0A000000 | static_cast<uint32_t>(rng() & 0xFFFFFF);
+        uint32_t server = 0x68000000 | static_cast<uint32_t>(rng() % 4096);
+        uint16_t port = static_cast<uint16_t>(1024 + rng() % 60000);
+        uint16_t serverPort = static_cast<uint16_t>(10000 + rng() % 50000);
+        std::vector<uint8_t> first;
+        if (rng() % 5 == 0) {
+            first.assign(data.begin(), data.begin() + 600);     // шум: окно исчерпывается
+        }
+        else {
+            const char* text = firstBytes[rng() % kinds];
+            size_t length = text[0] == 0x03 ? 34 : std::strlen(text);
+            if (text[0] == 0x16) length = 11;
+            first.assign(text, text + length);
+            ++expectedLabelled;
+        }
+        packets.push_back(IpPacket(6, client, port, server, serverPort, 100, SYN, nullptr, 0));
+        packets.push_back(IpPacket(6, client, port, server, serverPort, 101, PSH_ACK, first.data(), first.size()));
+        uint32_t clientSeq = 101 + static_cast<uint32_t>(first.size());
+        for (size_t k = 0; k < opts.packets; ++k) {
+            packets.push_back(IpPacket(6, server, serverPort, client, port, 7000 + static_cast<uint32_t>(k * data.size()),
+                PSH_ACK, data.data(), data.size()));
+            packets.push_back(IpPacket(6, client, port, server, serverPort, clientSeq, ACK, nullptr, 0));
+        }
+        packets.push_back(IpPacket(6, client, port, server, serverPort, clientSeq, FIN_ACK, nullptr, 0));
+    }
+    std::vector<std::vector<uint8_t>> traffic;
+    std::vector<size_t> cursor(opts.flows, 0);
+    for (size_t base = 0; base < opts.flows; base += 256) {
+        size_t end = (std::min)(opts.flows, base + 256);
+        for (bool any = true; any;) {
+            any = false;
+            for (size_t i = base; i < end; ++i) {
+                if (cursor[i] < perFlow[i].size()) {
+                    traffic.push_back(std::move(perFlow[i][cursor[i]++]));
+                    any = true;
+                }
+            }
+        }
+    }
+    perFlow.clear();
+    size_t bytes = 0;
+    for (const auto& packet : traffic) bytes += packet.size();
+
+    ServiceClassifier classifier(signatures);
+    size_t withService = 0;
+    auto start = BenchClock::now();
+    for (const auto& packet : traffic) {
+        if (classifier.OnIPv4Packet(packet.data(), packet.size()) != UNKNOWN_SERVICE) ++withService;
+    }
+    double seconds = SecondsSince(start);
+    ServiceClassifier::Stats stats = classifier.GetStats();
+    std::printf("classifier: %12.0f pkt/s  %8.1f MB/s  %zu packets, %zu with a service\n",
+        traffic.size() / seconds, bytes / seconds / 1e6, traffic.size(), withService);
+    std::printf("            %llu flows: %llu labelled, %llu unlabelled; inspected %llu of %zu bytes (%.2f%%)\n",
+        static_cast<unsigned long long>(stats.flows), static_cast<unsigned long long>(stats.labelled),
+        static_cast<unsigned long long>(stats.unlabelled), static_cast<unsigned long long>(stats.inspectedBytes),
+        bytes, 100.0 * stats.inspectedBytes / bytes);
+    std::printf("           ");
+    for (const auto& item : classifier.ServiceCounts()) {
+        std::printf(" %s=%llu", ServiceNames::Instance().Name(item.first).c_str(), static_cast<unsigned long long>(item.second));
+    }
+    std::printf("\n");
+    int exitCode = 0;
+    if (stats.labelled != expectedLabelled || stats.labelled + stats.unlabelled != opts.flows) {
+        std::fprintf(stderr, "expected %zu labelled flows\n", expectedLabelled);
+        exitCode = 2;
+    }
+
+    // Цена просмотра окна: автомат против прямого поиска, с набором из файла и с добавочными
+    // случайными сигнатурами
+    std::vector<uint8_t> window(ServiceClassifier::INSPECT_BYTES);
+    for (auto& b : window) b = static_cast<uint8_t>(rng());
+    auto measure = [&](const SignatureSet& set, const char* label) {
+        const size_t rounds = 2000;
+        size_t found = 0;
+        auto t = BenchClock::now();
+        for (size_t r = 0; r < rounds; ++r) {
+            window[r % window.size()] ^= 1;
+            found += CountAutomaton(set, window.data(), window.size());
+        }
+        double automaton = SecondsSince(t);
+        t = BenchClock::now();
+        size_t naiveRounds = set.Size() > 200 ? 20 : rounds;
+        for (size_t r = 0; r < naiveRounds; ++r) {
+            window[r % window.size()] ^= 1;
+            found += CountNaive(set, window.data(), window.size());
+        }
+        double naive = SecondsSince(t);
+        DoNotOptimize(found);
+        std::printf("%-22s %6zu signatures, %7zu states: automaton %8.1f MB/s, naive %8.2f MB/s\n", label,
+            set.Size(), set.StateCount(), rounds * window.size() / automaton / 1e6,
+            naiveRounds * window.size() / naive / 1e6);
+    };
+    measure(*signatures, "window scan (file):");
+    SignatureSet large = *signatures;
+    for (size_t i = 0; i < opts.extra; ++i) {
+        ServiceSignature signature;
+        signature.service = ServiceNames::Instance().Intern("synthetic" + std::to_string(i % 50));
+        size_t length = 4 + rng() % 12;
+        for (size_t k = 0; k < length; ++k) signature.pattern += static_cast<char>(rng());
+        large.Add(signature);
+    }
+    large.Build();
+    measure(large, "window scan (+extra):");
+    return exitCode;
+}
@@ -0,0 +1,155 @@
+// Просмотр правил по столбцам (SimdRuleTable): сверка всех ядер, доступных процессору, с
+// поштучной проверкой MatchesTuple, сверка движков RuleMatcher между собой и точка, где
+// векторный просмотр перестаёт выигрывать у линейного FindBlockingRule и у корзин FieldMaskIndex.
+//
+//   simd_bench [--sizes 8,16,...,4096] [--packets N] [--seed N]
+
+#include "bench_common.h"
+#include "rule_generator.h"
+#include "../rule_matcher.h"
+#include <climits>
+#include <cstring>
+
+struct SimdBenchOptions {
+    std::vector<size_t> sizes = { 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+    size_t packets = 50000;
+    uint32_t seed = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, SimdBenchOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* arg = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(arg, "--sizes") == 0) opts.sizes = ParseSizeList(value);
+        else if (std::strcmp(arg, "--packets") == 0) opts.packets = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        else return false;
+    }
+    return argc % 2 == 1 && !opts.sizes.empty() && opts.packets > 0;
+}
+
+// Без доменов: все блокирующие правила попадают в таблицу
+static RuleMix TableMix() {
+    RuleMix mix;
+    mix.domain = 0.0;
+    mix.derived = 0.1;
+    return mix;
+}
+
+// Часть пакетов — IPv6 с теми же портами: подсети IPv4 с ними совпадать не должны
+static void AddIPv6(std::vector<FlowKey>& traffic) {
+    for (size_t i = 0; i < traffic.size(); i += 10) {
+        traffic[i].ipv6 = true;
+        traffic[i].sourceIp6[15] = static_cast<uint8_t>(i);
+        traffic[i].destIp6[0] = 0x20;
+    }
+}
+
+static uint32_t Reference(const std::vector<CompiledRule>& rules, const std::vector<uint32_t>& indices,
+    const FlowKey& flow) {
+    for (uint32_t index : indices) {
+        if (RuleMatcher::MatchesTuple(rules[index], flow) && rules[index].app.Matches(flow.app)) return index;
+    }
+    return UINT32_MAX;
+}
+
+static bool VerifyKernels(const RuleMatcher& matcher, const std::vector<FlowKey>& traffic) {
+    const std::vector<CompiledRule>& rules = matcher.Rules();
+    std::vector<uint32_t> indices;
+    for (uint32_t i = 0; i < rules.size(); ++i) {
+        if (rules[i].action == RuleAction::BLOCK && FieldMaskIndex::Supports(rules[i])) indices.push_back(i);
+    }
+    SimdRuleTable table;
+    table.Build(rules, indices);
+    for (SimdRuleTable::Kernel kernel : { SimdRuleTable::Kernel::Scalar, SimdRuleTable::Kernel::Sse2, SimdRuleTable::Kernel::Avx2 }) {
+        if (!table.SetKernel(kernel)) continue;
+        for (size_t p = 0; p < traffic.size(); ++p) {
+            size_t tested = 0;
+            uint32_t expected = Reference(rules, indices, traffic[p]);
+            uint32_t actual = table.Find(rules.data(), traffic[p], true, UINT32_MAX, tested);
+            if (expected != actual) {
+                std::fprintf(stderr, "%s kernel, %zu rules, packet %zu: row %u, expected %u\n",
+                    SimdRuleTable::KernelName(kernel), indices.size(), p, actual, expected);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static int Id(const CompiledRule* rule) {
+    return rule ? rule->id : -1;
+}
+
+static double NsPerPacket(const RuleMatcher& matcher, const std::vector<FlowKey>& traffic) {
+    size_t blocked = 0;
+    auto start = BenchClock::now();
+    for (const auto& flow : traffic) blocked += matcher.FindBlockingRule(flow) != nullptr;
+    double seconds = SecondsSince(start);
+    DoNotOptimize(blocked);
+    return seconds * 1e9 / traffic.size();
+}
+
+int main(int argc, char** argv) {
+    SimdBenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: simd_bench [--sizes 8,16,...] [--packets N] [--seed N]\n");
+        return 1;
+    }
+
+    std::printf("best kernel: %s\n", SimdRuleTable::KernelName(SimdRuleTable::BestKernel()));
+    std::printf("%7s %12s %12s %12s %12s %s\n", "rules", "linear ns", "fieldmask ns", "scalar ns", "simd ns", "fastest");
+    for (size_t size : opts.sizes) {
+        RuleGenerator generator(opts.seed, TableMix());
+        std::vector<Rule> rules = generator.GenerateRules(size);
+        std::vector<FlowKey> traffic = generator.GenerateTraffic(rules, opts.packets, 0.3);
+        AddIPv6(traffic);
+
+        RuleMatcher linear;
+        linear.SetBlockEngine(RuleMatcher::BlockEngine::Linear);
+        linear.Compile(rules);
+        RuleMatcher fieldMask;
+        fieldMask.SetBlockEngine(RuleMatcher::BlockEngine::FieldMask);
+        fieldMask.Compile(rules);
+        RuleMatcher simd;
+        simd.SetBlockEngine(RuleMatcher::BlockEngine::Simd);
+        simd.Compile(rules);
+
+        if (!VerifyKernels(simd, traffic)) return 2;
+        for (size_t p = 0; p < traffic.size(); ++p) {
+            int expected = Id(linear.FindBlockingRule(traffic[p]));
+            if (Id(fieldMask.FindBlockingRule(traffic[p])) != expected || Id(simd.FindBlockingRule(traffic[p])) != expected) {
+                std::fprintf(stderr, "%zu rules, packet %zu: engines disagree\n", size, p);
+                return 2;
+            }
+        }
+
+        double linearNs = NsPerPacket(linear, traffic);
+        double fieldMaskNs = NsPerPacket(fieldMask, traffic);
+        double simdNs = NsPerPacket(simd, traffic);
+        // Тот же движок Simd со скалярным ядром: вклад самих векторных сравнений
+        RuleMatcher scalar;
+        scalar.SetBlockEngine(RuleMatcher::BlockEngine::Simd);
+        scalar.Compile(rules);
+        scalar.SetSimdKernel(SimdRuleTable::Kernel::Scalar);
+        // Правка правила перестраивает таблицу, но не меняет выбранное ядро
+        Rule extra;
+        extra.id = static_cast<int>(size) + 1000000;
+        extra.action = RuleAction::BLOCK;
+        extra.protocol = Protocol::TCP;
+        extra.destPort = 9;
+        extra.priority = INT_MIN;
+        if (!scalar.AppendRule(extra) || !scalar.RemoveRule(extra.id)
+            || scalar.BlockTable().GetKernel() != SimdRuleTable::Kernel::Scalar) {
+            std::fprintf(stderr, "%zu rules: kernel reset by a rule update\n", size);
+            return 2;
+        }
+        double scalarNs = NsPerPacket(scalar, traffic);
+
+        const char* fastest = "simd";
+        if (linearNs < simdNs && linearNs < fieldMaskNs) fastest = "linear";
+        else if (fieldMaskNs < simdNs) fastest = "fieldmask";
+        std::printf("%7zu %12.1f %12.1f %12.1f %12.1f %s\n", size, linearNs, fieldMaskNs, scalarNs, simdNs, fastest);
+    }
+    return 0;
+}
@@ -0,0 +1,286 @@
+// Изменение правил по одному (RuleMatcher::AppendRule, RemoveRule, ReplaceRule) против полной
+// перекомпиляции: сверка ответов с заново скомпилированным набором после случайной серии правок
+// на всех движках и задержка от добавления правила до его применения к пакету на большом наборе.
+//
+//   update_bench [--rules N] [--ops N] [--verify-rules N] [--packets N] [--seed N]
+
+#include "bench_common.h"
+#include "rule_generator.h"
+#include "../rule_matcher.h"
+#include "../ip_utils.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+struct UpdateBenchOptions {
+    size_t rules = 50000;
+    size_t ops = 2000;
+    size_t verifyRules = 2000;
+    size_t packets = 5000;
+    uint32_t seed = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, UpdateBenchOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* arg = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(arg, "--rules") == 0) opts.rules = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--ops") == 0) opts.ops = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--verify-rules") == 0) opts.verifyRules = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--packets") == 0) opts.packets = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        else return false;
+    }
+    return argc % 2 == 1 && opts.rules > 0 && opts.ops > 0 && opts.verifyRules > 0 && opts.packets > 0;
+}
+
+static int Id(const CompiledRule* rule) {
+    return rule ? rule->id : -1;
+}
+
+// Адаптер, которого нет в исходном наборе: первое правило с ним заводит новые наборы
+// сопоставителя на ходу
+static const uint32_t kLateAdapter = 0x0AFF0101u;
+
+static RuleMix AdapterMix() {
+    RuleMix mix;
+    mix.adapter = 0.3;
+    return mix;
+}
+
+// Правки над списком правил и сопоставителем одновременно, как в RuleManager: новое правило —
+// в конец, удаление и замена — по id; включение правила не на своём месте или приоритет, который
+// меняет порядок вычисления, — перекомпиляция
+class Editor {
+public:
+    Editor(RuleMatcher& matcher, std::vector<Rule>& rules, const std::vector<Rule>& pool, uint32_t seed)
+        : matcher(matcher), rules(rules), pool(pool), rng(seed), nextId(static_cast<int>(rules.size() + pool.size() + 1)) {}
+
+    void Append() {
+        Rule rule = pool[rng() % pool.size()];
+        rule.id = nextId++;
+        if (rng() % 8 == 0) rule.priority = static_cast<int>(rng() % 3);
+        if (rng() % 16 == 0) rule.adapter = FormatIPv4(kLateAdapter);
+        rules.push_back(rule);
+        if (!matcher.AppendRule(rule)) matcher.Compile(rules);
+    }
+
+    void Remove() {
+        if (rules.empty()) return;
+        size_t at = rng() % rules.size();
+        matcher.RemoveRule(rules[at].id);
+        rules.erase(rules.begin() + at);
+    }
+
+    void Replace() {
+        if (rules.empty()) return;
+        size_t at = rng() % rules.size();
+        Rule rule = rng() % 4 == 0 ? rules[at] : pool[rng() % pool.size()];
+        rule.id = rules[at].id;
+        if (rng() % 4 == 0) rule.enabled = !rules[at].enabled;
+        if (rng() % 8 == 0) rule.priority = static_cast<int>(rng() % 3);
+        rules[at] = rule;
+        if (!matcher.ReplaceRule(rule)) matcher.Compile(rules);
+    }
+
+    void Random() {
+        unsigned kind = rng() % 3;
+        if (kind == 0) Append();
+        else if (kind == 1) Remove();
+        else Replace();
+    }
+
+private:
+    RuleMatcher& matcher;
+    std::vector<Rule>& rules;
+    const std::vector<Rule>& pool;
+    std::mt19937 rng;
+    int nextId;
+};
+
+static const char* EngineName(RuleMatcher::BlockEngine engine) {
+    switch (engine) {
+    case RuleMatcher::BlockEngine::Linear: return "linear";
+    case RuleMatcher::BlockEngine::FieldMask: return "fieldmask";
+    case RuleMatcher::BlockEngine::Simd: return "simd";
+    default: return "auto";
+    }
+}
+
+static bool Same(const RuleMatcher& patched, const RuleMatcher& fresh, const std::vector<FlowKey>& traffic,
+    const char* engine, size_t step) {
+    for (size_t p = 0; p < traffic.size(); ++p) {
+        const FlowKey& flow = traffic[p];
+        int patchedAllowed = 0;
+        int freshAllowed = 0;
+        bool a = patched.IsAllowed(flow, patchedAllowed);
+        bool b = fresh.IsAllowed(flow, freshAllowed);
+        if (Id(patched.FindBlockingRule(flow)) != Id(fresh.FindBlockingRule(flow))
+            || Id(patched.FindAllowingRule(flow)) != Id(fresh.FindAllowingRule(flow))
+            || Id(patched.FindBlockingPacketRule(flow)) != Id(fresh.FindBlockingPacketRule(flow))
+            || a != b || patchedAllowed != freshAllowed) {
+            std::fprintf(stderr, "%s engine, step %zu, packet %zu: patched and recompiled matchers differ\n",
+                engine, step, p);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool Verify(const UpdateBenchOptions& opts, RuleMatcher::BlockEngine engine, FilterMode mode) {
+    RuleGenerator generator(opts.seed, AdapterMix());
+    std::vector<Rule> pool = generator.GenerateRules(opts.verifyRules * 2);
+    std::vector<Rule> rules(pool.begin(), pool.begin() + opts.verifyRules);
+    std::vector<FlowKey> traffic = generator.GenerateTraffic(pool, opts.packets, 0.5);
+    for (size_t p = 0; p < opts.packets; p += 4) {
+        traffic.push_back(traffic[p]);
+        traffic.back().adapter = kLateAdapter;
+    }
+
+    RuleMatcher patched;
+    patched.SetBlockEngine(engine);
+    patched.SetFilterMode(mode);
+    patched.Compile(rules);
+    Editor editor(patched, rules, pool, opts.seed);
+    size_t ops = (std::min)(opts.ops, static_cast<size_t>(400));
+    for (size_t step = 1; step <= ops; ++step) {
+        editor.Random();
+        if (step % 100 != 0 && step != ops) continue;
+        RuleMatcher fresh;
+        fresh.SetBlockEngine(engine);
+        fresh.SetFilterMode(mode);
+        fresh.Compile(rules);
+        if (!Same(patched, fresh, traffic, EngineName(engine), step)) return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    UpdateBenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: update_bench [--rules N] [--ops N] [--verify-rules N] [--packets N] [--seed N]\n");
+        return 1;
+    }
+
+    for (auto engine : { RuleMatcher::BlockEngine::Auto, RuleMatcher::BlockEngine::Linear,
+        RuleMatcher::BlockEngine::FieldMask, RuleMatcher::BlockEngine::Simd }) {
+        for (FilterMode mode : { FilterMode::BLACKLIST, FilterMode::WHITELIST }) {
+            if (!Verify(opts, engine, mode)) return 2;
+        }
+    }
+    std::printf("verify:  patched matchers agree with recompiled ones on all engines and filter modes "
+        "(%zu rules, %zu adapters)\n", opts.verifyRules, RuleGenerator::Adapters().size() + 1);
+
+    RuleGenerator generator(opts.seed);
+    std::vector<Rule> pool = generator.GenerateRules(opts.rules + opts.ops);
+    std::vector<Rule> rules(pool.begin(), pool.begin() + opts.rules);
+    std::vector<Rule> extra(pool.begin() + opts.rules, pool.end());
+    RuleMatcher matcher;
+    matcher.Compile(rules);
+
+    // Полная перекомпиляция: столько стоило любое изменение до правок по одному
+    const size_t compileRuns = 3;
+    auto start = BenchClock::now();
+    for (size_t i = 0; i < compileRuns; ++i) {
+        RuleMatcher fresh;
+        fresh.Compile(rules);
+        DoNotOptimize(fresh.Size());
+    }
+    double compileMs = SecondsSince(start) * 1e3 / compileRuns;
+
+    // Добавление -> первый пакет, который его видит. Правило не встаёт в конец (приоритет) —
+    // перекомпиляция, как в RuleManager::AddRule
+    std::vector<uint64_t> appendNs;
+    std::vector<uint64_t> enforceNs;
+    std::vector<uint64_t> lookupNs;
+    std::vector<FlowKey> probes;
+    std::vector<int> verdicts;          // решившее правило сразу после добавления
+    std::vector<bool> allowed;
+    size_t recompiled = 0;
+    const int firstAppendedId = static_cast<int>(pool.size() + 1);
+    for (size_t i = 0; i < opts.ops; ++i) {
+        Rule rule = extra[i];
+        rule.id = firstAppendedId + static_cast<int>(i);
+        std::vector<FlowKey> probe = generator.GenerateTraffic({ rule }, 1, 1.0);
+        rules.push_back(rule);
+        auto t0 = BenchClock::now();
+        if (!matcher.AppendRule(rule)) {
+            matcher.Compile(rules);
+            ++recompiled;
+        }
+        auto t1 = BenchClock::now();
+        const CompiledRule* verdict = matcher.FindBlockingRule(probe[0]);
+        auto t2 = BenchClock::now();
+        DoNotOptimize(verdict);
+        appendNs.push_back(NanosecondsBetween(t0, t1));
+        enforceNs.push_back(NanosecondsBetween(t0, t2));
+        lookupNs.push_back(NanosecondsBetween(t1, t2));
+        int ruleId = -1;
+        allowed.push_back(matcher.IsAllowed(probe[0], ruleId));
+        verdicts.push_back(ruleId);
+        probes.push_back(probe[0]);
+    }
+
+    // Сверка каждого пробного пакета с заново скомпилированным набором на момент добавления.
+    // Первое подошедшее правило полного набора, добавленное не позже пробы, решает и в наборе
+    // на момент пробы; иначе набор того момента компилируется отдельно
+    {
+        RuleMatcher fresh;
+        fresh.Compile(rules);
+        size_t baseRules = rules.size() - opts.ops;
+        for (size_t i = 0; i < opts.ops; ++i) {
+            int expectedId = -1;
+            bool expectedAllowed = fresh.IsAllowed(probes[i], expectedId);
+            if (expectedId >= firstAppendedId + static_cast<int>(i) + 1) {
+                RuleMatcher prefix;
+                prefix.Compile(std::vector<Rule>(rules.begin(), rules.begin() + baseRules + i + 1));
+                expectedAllowed = prefix.IsAllowed(probes[i], expectedId);
+            }
+            if (expectedAllowed != allowed[i] || expectedId != verdicts[i]) {
+                std::fprintf(stderr, "append %zu: verdict rule %d, recompiled set gives %d\n", i, verdicts[i], expectedId);
+                return 2;
+            }
+        }
+    }
+
+    std::vector<uint64_t> replaceNs;
+    std::vector<uint64_t> removeNs;
+    std::mt19937 rng(opts.seed);
+    for (size_t i = 0; i < opts.ops; ++i) {
+        size_t at = rng() % rules.size();
+        Rule rule = extra[rng() % extra.size()];
+        rule.id = rules[at].id;
+        rules[at] = rule;
+        auto t0 = BenchClock::now();
+        if (!matcher.ReplaceRule(rule)) {
+            matcher.Compile(rules);
+            ++recompiled;
+        }
+        replaceNs.push_back(NanosecondsBetween(t0, BenchClock::now()));
+    }
+    for (size_t i = 0; i < opts.ops && !rules.empty(); ++i) {
+        size_t at = rng() % rules.size();
+        auto t0 = BenchClock::now();
+        matcher.RemoveRule(rules[at].id);
+        removeNs.push_back(NanosecondsBetween(t0, BenchClock::now()));
+        rules.erase(rules.begin() + at);
+    }
+
+    LatencySummary append = Summarize(appendNs);
+    LatencySummary enforce = Summarize(enforceNs);
+    LatencySummary lookup = Summarize(lookupNs);
+    LatencySummary replace = Summarize(replaceNs);
+    LatencySummary remove = Summarize(removeNs);
+    std::printf("%zu rules, engine %s, full compile %.1f ms\n", opts.rules, EngineName(matcher.GetBlockEngine()), compileMs);
+    std::printf("%-26s %10s %10s %10s\n", "operation", "p50 us", "p99 us", "p99.9 us");
+    std::printf("%-26s %10.1f %10.1f %10.1f\n", "append", append.p50 / 1e3, append.p99 / 1e3, append.p999 / 1e3);
+    std::printf("%-26s %10.1f %10.1f %10.1f\n", "  first lookup", lookup.p50 / 1e3, lookup.p99 / 1e3, lookup.p999 / 1e3);
+    std::printf("%-26s %10.1f %10.1f %10.1f\n", "  append -> enforcement", enforce.p50 / 1e3, enforce.p99 / 1e3, enforce.p999 / 1e3);
+    std::printf("%-26s %10.1f %10.1f %10.1f\n", "replace", replace.p50 / 1e3, replace.p99 / 1e3, replace.p999 / 1e3);
+    std::printf("%-26s %10.1f %10.1f %10.1f\n", "remove", remove.p50 / 1e3, remove.p99 / 1e3, remove.p999 / 1e3);
+    size_t blocked = static_cast<size_t>(std::count(allowed.begin(), allowed.end(), false));
+    std::printf("enforced: all %zu probes match a recompiled set right after append (%zu blocked, %zu allowed); "
+        "%zu full recompiles, holes %zu, fragmented %s\n",
+        opts.ops, blocked, opts.ops - blocked, recompiled, matcher.Holes(), matcher.Fragmented() ? "yes" : "no");
+    return 0;
+}
@@ -0,0 +1,272 @@
+// Режимы BLACKLIST и WHITELIST: сверка FindBlockingRule и IsAllowed с перебором по одному
+// правилу на случайном трафике, IsAllowedEitherDirection для соединения без направления и цена
+// запрета по умолчанию через индекс разрешающих правил против линейного просмотра.
+//
+//   whitelist_bench [--sizes 100,1000,10000] [--packets N] [--allow-share R] [--seed N]
+
+#include "bench_common.h"
+#include "rule_generator.h"
+#include "../rule_matcher.h"
+#include "../ip_utils.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+struct WhitelistBenchOptions {
+    std::vector<size_t> sizes = { 100, 1000, 10000 };
+    size_t packets = 20000;
+    double allowShare = 0.7;        // доля разрешающих правил в наборе
+    uint32_t seed = 1;
+};
+
+static bool ParseOptions(int argc, char** argv, WhitelistBenchOptions& opts) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* arg = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(arg, "--sizes") == 0) opts.sizes = ParseSizeList(value);
+        else if (std::strcmp(arg, "--packets") == 0) opts.packets = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--allow-share") == 0) opts.allowShare = std::atof(value);
+        else if (std::strcmp(arg, "--seed") == 0) opts.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        else return false;
+    }
+    return argc % 2 == 1 && !opts.sizes.empty() && opts.packets > 0;
+}
+
+// Эталон: каждое правило в отдельном сопоставителе как блокирующее. FindBlockingRule такого
+// сопоставителя — совпадение с учётом приложения и направления, адаптер сверяется отдельно;
+// решает первое подошедшее правило любого действия
+class BruteForce {
+public:
+    explicit BruteForce(const std::vector<Rule>& rules) : rules(rules) {
+        for (const auto& rule : rules) {
+            Rule single = rule;
+            single.action = RuleAction::BLOCK;
+            uint32_t adapter = 0;
+            ParseIPv4(single.adapter, adapter);
+            adapters.push_back(adapter);
+            single.adapter.clear();
+            singles.push_back(std::make_unique<RuleMatcher>());
+            singles.back()->Compile({ single });
+        }
+    }
+
+    void Evaluate(const FlowKey& flow) {
+        withApp.assign(rules.size(), false);
+        first = -1;
+        for (size_t i = 0; i < rules.size(); ++i) {
+            withApp[i] = (adapters[i] == 0 || adapters[i] == flow.adapter) && singles[i]->FindBlockingRule(flow) != nullptr;
+            if (first < 0 && withApp[i]) first = static_cast<int>(i);
+        }
+    }
+
+    // Блокирующее правило (id), 0 — запрет по умолчанию, -1 — пакет проходит
+    int Blocking(FilterMode mode) const {
+        if (first < 0) return mode == FilterMode::WHITELIST ? 0 : -1;
+        return rules[first].action == RuleAction::BLOCK ? rules[first].id : -1;
+    }
+
+    bool Allowed(FilterMode mode, int& matchedRuleId) const {
+        matchedRuleId = first < 0 ? -1 : rules[first].id;
+        if (first < 0) return mode == FilterMode::BLACKLIST;
+        return rules[first].action == RuleAction::ALLOW;
+    }
+
+    // Разрешающих правил, которые просмотрел бы линейный поиск до первого подошедшего
+    size_t LinearAllowTests() const {
+        size_t tests = 0;
+        for (size_t i = 0; i < rules.size(); ++i) {
+            if (rules[i].action != RuleAction::ALLOW) continue;
+            ++tests;
+            if (withApp[i]) break;
+        }
+        return tests;
+    }
+
+private:
+    const std::vector<Rule>& rules;
+    std::vector<std::unique_ptr<RuleMatcher>> singles;
+    std::vector<uint32_t> adapters;
+    std::vector<bool> withApp;
+    int first = -1;
+};
+
+static int BlockingId(const RuleMatcher& matcher, const CompiledRule* rule) {
+    if (!rule) return -1;
+    return rule == &matcher.DefaultDenyRule() ? 0 : rule->id;
+}
+
+// Каждое пятое правило с приоритетом выше остальных: перебор идёт в порядке вычисления
+static std::vector<Rule> WithPriorities(std::vector<Rule> rules) {
+    for (size_t i = 0; i < rules.size(); i += 5) rules[i].priority = 1;
+    return rules;
+}
+
+// Сверка обоих режимов; false — расхождение (подробности в stderr)
+static bool Verify(const std::vector<Rule>& rules, const std::vector<FlowKey>& traffic, size_t packets) {
+    bool prioritised = std::any_of(rules.begin(), rules.end(), [](const Rule& r) { return r.priority != 0; });
+    bool adapters = std::any_of(rules.begin(), rules.end(), [](const Rule& r) { return !r.adapter.empty(); });
+    RuleMatcher matcher;
+    matcher.Compile(rules);
+    if (matcher.Size() != rules.size()) {
+        std::fprintf(stderr, "generator produced disabled rules\n");
+        return false;
+    }
+    std::vector<Rule> ordered = RuleMatcher::EvaluationOrder(rules);
+    BruteForce reference(ordered);
+    size_t checked = 0;
+    size_t defaultDenied = 0;
+    for (size_t p = 0; p < packets && p < traffic.size(); ++p) {
+        const FlowKey& flow = traffic[p];
+        reference.Evaluate(flow);
+        for (FilterMode mode : { FilterMode::BLACKLIST, FilterMode::WHITELIST }) {
+            matcher.SetFilterMode(mode);
+            int expectedBlock = reference.Blocking(mode);
+            int actualBlock = BlockingId(matcher, matcher.FindBlockingRule(flow));
+            int expectedId = 0;
+            int actualId = 0;
+            bool expectedAllowed = reference.Allowed(mode, expectedId);
+            bool actualAllowed = matcher.IsAllowed(flow, actualId);
+            if (expectedBlock != actualBlock || expectedAllowed != actualAllowed || expectedId != actualId) {
+                std::fprintf(stderr, "%s mode, packet %zu: blocking rule %d (expected %d), allowed %d by %d (expected %d by %d)\n",
+                    mode == FilterMode::WHITELIST ? "whitelist" : "blacklist", p,
+                    actualBlock, expectedBlock, actualAllowed, actualId, expectedAllowed, expectedId);
+                return false;
+            }
+            defaultDenied += mode == FilterMode::WHITELIST && expectedBlock == 0;
+        }
+        ++checked;
+    }
+    std::printf("verify:  %zu rules%s%s, %zu packets agree with brute force in both modes (%zu default-denied)\n",
+        rules.size(), prioritised ? " with priorities" : "", adapters ? " on adapters" : "", checked, defaultDenied);
+    return true;
+}
+
+static bool CheckFailed(const char* what) {
+    std::fprintf(stderr, "check failed: %s\n", what);
+    return false;
+}
+
+// Соединение без направления: исходящее разрешающее правило пропускает его и в WHITELIST,
+// хотя входящие запрещены; запрещает только блокирующее правило или запрет по умолчанию
+static bool CheckEitherDirection() {
+    Rule allowOut;
+    allowOut.id = 1;
+    allowOut.action = RuleAction::ALLOW;
+    allowOut.direction = RuleDirection::Outbound;
+    allowOut.protocol = Protocol::TCP;
+    allowOut.destIp = "10.0.0.5";
+    allowOut.destPort = 443;
+    Rule blockIn;
+    blockIn.id = 2;
+    blockIn.action = RuleAction::BLOCK;
+    blockIn.direction = RuleDirection::Inbound;
+    Rule blockOut;
+    blockOut.id = 3;
+    blockOut.action = RuleAction::BLOCK;
+    blockOut.direction = RuleDirection::Outbound;
+    blockOut.destIp = "10.0.0.6";
+    RuleMatcher matcher;
+    matcher.Compile({ allowOut, blockOut, blockIn });
+
+    FlowKey flow;
+    ParseIPv4("192.168.1.10", flow.sourceIp);
+    ParseIPv4("10.0.0.5", flow.destIp);
+    flow.ipProtocol = 6;
+    flow.sourcePort = 50000;
+    flow.destPort = 443;
+    FlowKey blocked = flow;
+    ParseIPv4("10.0.0.6", blocked.destIp);
+    int ruleId = 0;
+    for (FilterMode mode : { FilterMode::WHITELIST, FilterMode::BLACKLIST }) {
+        matcher.SetFilterMode(mode);
+        if (!matcher.IsAllowedEitherDirection(flow, ruleId) || ruleId != 1) return CheckFailed("outbound-only allow");
+        // WHITELIST без разрешающего правила — запрет по умолчанию, блокирующие не просматриваются
+        int expectedId = mode == FilterMode::WHITELIST ? -1 : 3;
+        if (matcher.IsAllowedEitherDirection(blocked, ruleId) || ruleId != expectedId) return CheckFailed("outbound block");
+        flow.direction = PacketDirection::Incoming;
+        if (matcher.IsAllowed(flow, ruleId) || ruleId != (mode == FilterMode::WHITELIST ? -1 : 2)) {
+            return CheckFailed("allow rule is outbound only");
+        }
+    }
+    // Ни одно правило не подошло — ответ режима
+    RuleMatcher empty;
+    empty.SetFilterMode(FilterMode::WHITELIST);
+    if (empty.IsAllowedEitherDirection(flow, ruleId) || ruleId != -1) return CheckFailed("whitelist default");
+    empty.SetFilterMode(FilterMode::BLACKLIST);
+    if (!empty.IsAllowedEitherDirection(flow, ruleId) || ruleId != -1) return CheckFailed("blacklist default");
+    return true;
+}
+
+int main(int argc, char** argv) {
+    WhitelistBenchOptions opts;
+    if (!ParseOptions(argc, argv, opts)) {
+        std::printf("usage: whitelist_bench [--sizes 100,1000,...] [--packets N] [--allow-share R] [--seed N]\n");
+        return 1;
+    }
+    if (!CheckEitherDirection()) return 2;
+
+    std::printf("%8s %14s %14s %12s %12s %12s\n",
+        "rules", "linear tests", "index tests", "linear ns", "index ns", "blacklist ns");
+    for (size_t size : opts.sizes) {
+        RuleMix mix;
+        mix.allow = opts.allowShare / (1.0 - opts.allowShare);     // к сумме остальных долей (1.0)
+        RuleGenerator generator(opts.seed, mix);
+        std::vector<Rule> rules = generator.GenerateRules(size);
+        std::vector<FlowKey> traffic = generator.GenerateTraffic(rules, opts.packets, 0.5);
+
+        // Перебор дорог (по сопоставителю на правило), поэтому сверка — на части трафика
+        size_t verifyPackets = (std::max)(static_cast<size_t>(200), 2000000 / (size + 1));
+        if (!Verify(rules, traffic, verifyPackets) || !Verify(WithPriorities(rules), traffic, verifyPackets)) return 2;
+        // Часть правил привязана к адаптерам, пакеты приходят с разных адаптеров
+        mix.adapter = 0.3;
+        RuleGenerator adapterGenerator(opts.seed, mix);
+        std::vector<Rule> adapterRules = adapterGenerator.GenerateRules(size);
+        if (!Verify(adapterRules, adapterGenerator.GenerateTraffic(adapterRules, verifyPackets, 0.5), verifyPackets)) return 2;
+
+        RuleMatcher matcher;
+        matcher.Compile(rules);
+        BruteForce reference(rules);
+
+        // Линейный эталон запрета по умолчанию: просмотр разрешающих правил по порядку
+        size_t linearTests = 0;
+        size_t sample = (std::min)(traffic.size(), verifyPackets);
+        for (size_t p = 0; p < sample; ++p) {
+            reference.Evaluate(traffic[p]);
+            linearTests += reference.LinearAllowTests();
+        }
+
+        matcher.SetFilterMode(FilterMode::WHITELIST);
+        size_t indexTests = 0;
+        size_t blocked = 0;
+        auto start = BenchClock::now();
+        for (const auto& flow : traffic) blocked += matcher.FindAllowingRule(flow, &indexTests) == nullptr;
+        double indexSeconds = SecondsSince(start);
+
+        size_t linearBlocked = 0;
+        start = BenchClock::now();
+        for (const auto& flow : traffic) {
+            bool allowed = false;
+            for (const auto& rule : matcher.Rules()) {
+                if (rule.action == RuleAction::ALLOW && RuleMatcher::MatchesTuple(rule, flow) && rule.app.Matches(flow.app)) {
+                    allowed = true;
+                    break;
+                }
+            }
+            linearBlocked += !allowed;
+        }
+        double linearSeconds = SecondsSince(start);
+
+        matcher.SetFilterMode(FilterMode::BLACKLIST);
+        start = BenchClock::now();
+        for (const auto& flow : traffic) blocked += matcher.FindBlockingRule(flow) != nullptr;
+        double blacklistSeconds = SecondsSince(start);
+        DoNotOptimize(blocked);
+        DoNotOptimize(linearBlocked);
+
+        double packets = static_cast<double>(traffic.size());
+        std::printf("%8zu %14.1f %14.1f %12.1f %12.1f %12.1f\n", size,
+            static_cast<double>(linearTests) / sample, indexTests / packets,
+            linearSeconds * 1e9 / packets, indexSeconds * 1e9 / packets, blacklistSeconds * 1e9 / packets);
+    }
+    return 0;
+}
@@ -9,11 +9,16 @@ struct Connection {
     int sourcePort;
     int destPort;
     std::string appPath;
+    // ,  ;     
+    bool directionKnown;
+    PacketDirection direction;
 
     Connection()
         : protocol(Protocol::ANY)
         , sourcePort(0)
         , destPort(0)
+        , directionKnown(false)
+        , direction(PacketDirection::Outgoing)
     {
     }
 };
\ No newline at end of file
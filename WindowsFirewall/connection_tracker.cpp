@@ -0,0 +1,253 @@
+#include "connection_tracker.h"
+#include <cstring>
+
+static void MapIPv4(uint32_t addr, uint8_t* out) {
+    std::memset(out, 0, 10);
+    out[10] = 0xFF;
+    out[11] = 0xFF;
+    out[12] = static_cast<uint8_t>(addr >> 24);
+    out[13] = static_cast<uint8_t>(addr >> 16);
+    out[14] = static_cast<uint8_t>(addr >> 8);
+    out[15] = static_cast<uint8_t>(addr);
+}
+
+bool ConnectionTracker::Tuple::operator==(const Tuple& o) const {
+    return protocol == o.protocol && lowPort == o.lowPort && highPort == o.highPort
+        && std::memcmp(lowIp, o.lowIp, 16) == 0 && std::memcmp(highIp, o.highIp, 16) == 0;
+}
+
+size_t ConnectionTracker::TupleHash::operator()(const Tuple& t) const {
+    uint64_t words[4];
+    std::memcpy(words, t.lowIp, 16);
+    std::memcpy(words + 2, t.highIp, 16);
+    uint64_t h = (uint64_t(t.lowPort) << 24) ^ (uint64_t(t.highPort) << 8) ^ t.protocol;
+    for (uint64_t w : words) h = (h ^ w) * 0x9E3779B97F4A7C15ull;
+    return std::hash<uint64_t>()(h ^ (h >> 29));
+}
+
+ConnectionTracker::Tuple ConnectionTracker::MakeTuple(uint8_t protocol, bool ipv6, uint32_t sourceIp, uint32_t destIp,
+    const uint8_t* sourceIp6, const uint8_t* destIp6, uint16_t sourcePort, uint16_t destPort, bool& fromLow) {
+    uint8_t source[16];
+    uint8_t dest[16];
+    if (ipv6) {
+        std::memcpy(source, sourceIp6, 16);
+        std::memcpy(dest, destIp6, 16);
+    }
+    else {
+        MapIPv4(sourceIp, source);
+        MapIPv4(destIp, dest);
+    }
+    int order = std::memcmp(source, dest, 16);
+    fromLow = order < 0 || (order == 0 && sourcePort <= destPort);
+
+    Tuple t;
+    t.protocol = protocol;
+    std::memcpy(t.lowIp, fromLow ? source : dest, 16);
+    std::memcpy(t.highIp, fromLow ? dest : source, 16);
+    t.lowPort = fromLow ? sourcePort : destPort;
+    t.highPort = fromLow ? destPort : sourcePort;
+    return t;
+}
+
+bool ConnectionTracker::Expired(const Connection& c, uint64_t nowMs) {
+    uint64_t timeout = OTHER_TIMEOUT_MS;
+    if (c.closing) timeout = CLOSING_TIMEOUT_MS;
+    else if (c.opening.ipProtocol == 6) timeout = TCP_TIMEOUT_MS;
+    else if (c.opening.ipProtocol == 17) timeout = UDP_TIMEOUT_MS;
+    return nowMs - c.lastSeen > timeout;
+}
+
+// Имя сервера (SNI, Host, QUIC) и служба по сигнатуре приходят после первого пакета: решение
+// по нему принималось без них. Имя в первом пакете относится к серверу, поэтому для пакета
+// от принимающей стороны сторона имени переворачивается
+bool ConnectionTracker::Relabel(Connection& c, const FlowKey& flow) {
+    bool changed = false;
+    if (!flow.serverName.empty() && flow.serverName != c.serverName) {
+        c.serverName.assign(flow.serverName.data(), flow.serverName.size());
+        c.opening.serverIsSource = flow.serverIsSource != flow.fromResponder;
+        changed = true;
+    }
+    if (flow.service != UNKNOWN_SERVICE && flow.service != c.opening.service) {
+        c.opening.service = flow.service;
+        changed = true;
+    }
+    return changed;
+}
+
+// Решение по первому пакету (перепроверенное, если сменились правила, имя сервера или служба),
+// затем правила пакета
+const CompiledRule* ConnectionTracker::Decide(const RuleMatcher& matcher, Connection& c, const FlowKey& flow,
+    size_t& tests, bool relabelled) {
+    if (relabelled || c.generation != matcher.Generation()) {
+        FlowKey opening = c.opening;
+        opening.serverName = c.serverName;
+        c.blockingRule = matcher.FindBlockingRule(opening, &tests);
+        c.generation = matcher.Generation();
+        if (relabelled) ++stats.relabelled;
+        else ++stats.revalidated;
+    }
+    else {
+        ++stats.fastPath;
+    }
+    if (c.blockingRule) return c.blockingRule;
+    return matcher.FindBlockingPacketRule(flow, &tests);
+}
+
+const CompiledRule* ConnectionTracker::FindBlockingRule(const RuleMatcher& matcher, FlowKey& flow, uint64_t nowMs) {
+    return Evaluate(matcher, flow, nowMs, nullptr);
+}
+
+const CompiledRule* ConnectionTracker::Evaluate(const RuleMatcher& matcher, FlowKey& flow, uint64_t nowMs,
+    const CompiledRule* const* newVerdict) {
+    ++stats.packets;
+    size_t tests = 0;
+    const CompiledRule* result = nullptr;
+    bool fromLow = false;
+
+    // Ошибка ICMP: порты исходного потока в ней переставлены, см. FlowKey
+    if (flow.relatedProtocol != 0) {
+        Tuple related = MakeTuple(flow.relatedProtocol, flow.ipv6, flow.relatedSourceIp, flow.relatedDestIp,
+            flow.relatedSourceIp6, flow.relatedDestIp6, flow.destPort, flow.sourcePort, fromLow);
+        auto it = connections.find(related);
+        if (it != connections.end() && !Expired(it->second, nowMs)) {
+            Connection& c = it->second;
+            flow.state = ConnectionState::Related;
+            flow.fromResponder = flow.direction != c.opening.direction;
+            ++stats.related;
+            result = Decide(matcher, c, flow, tests, false);
+            c.lastSeen = nowMs;
+            stats.ruleTests += tests;
+            return result;
+        }
+        // Ошибка о неизвестном соединении — обычный новый пакет, соединения не открывает
+        flow.state = ConnectionState::New;
+        flow.fromResponder = false;
+        result = newVerdict ? *newVerdict : matcher.FindBlockingRule(flow, &tests);
+        stats.ruleTests += tests;
+        return result;
+    }
+
+    Tuple tuple = MakeTuple(flow.ipProtocol, flow.ipv6, flow.sourceIp, flow.destIp,
+        flow.sourceIp6, flow.destIp6, flow.sourcePort, flow.destPort, fromLow);
+    auto it = connections.find(tuple);
+    if (it != connections.end()) {
+        bool restart = it->second.closing && flow.ipProtocol == 6
+            && (flow.tcpFlags & (TCP_FLAG_SYN | TCP_FLAG_ACK)) == TCP_FLAG_SYN;
+        if (Expired(it->second, nowMs) || restart) {
+            if (!restart) ++stats.expired;
+            connections.erase(it);
+            it = connections.end();
+        }
+    }
+
+    if (it == connections.end()) {
+        flow.state = ConnectionState::New;
+        flow.fromResponder = false;
+        result = newVerdict ? *newVerdict : matcher.FindBlockingRule(flow, &tests);
+        Insert(tuple, flow, matcher, result, fromLow, nowMs);
+        stats.ruleTests += tests;
+        return result;
+    }
+
+    Connection& c = it->second;
+    bool fromInitiator = fromLow == c.initiatorIsLow;
+    if (!fromInitiator) c.replied = true;
+    flow.fromResponder = !fromInitiator;
+    flow.state = c.replied ? ConnectionState::Established : ConnectionState::New;
+    if (c.replied) ++stats.established;
+    result = Decide(matcher, c, flow, tests, Relabel(c, flow));
+    c.lastSeen = nowMs;
+    if (flow.ipProtocol == 6 && (flow.tcpFlags & (TCP_FLAG_FIN | TCP_FLAG_RST))) c.closing = true;
+    stats.ruleTests += tests;
+    return result;
+}
+
+// Предсказание для пачки: пакет пойдёт путём нового соединения, если таблица не изменится
+bool ConnectionTracker::OpensConnection(const FlowKey& flow, uint64_t nowMs) const {
+    bool fromLow = false;
+    if (flow.relatedProtocol != 0) {
+        Tuple related = MakeTuple(flow.relatedProtocol, flow.ipv6, flow.relatedSourceIp, flow.relatedDestIp,
+            flow.relatedSourceIp6, flow.relatedDestIp6, flow.destPort, flow.sourcePort, fromLow);
+        auto it = connections.find(related);
+        return it == connections.end() || Expired(it->second, nowMs);
+    }
+    Tuple tuple = MakeTuple(flow.ipProtocol, flow.ipv6, flow.sourceIp, flow.destIp,
+        flow.sourceIp6, flow.destIp6, flow.sourcePort, flow.destPort, fromLow);
+    auto it = connections.find(tuple);
+    if (it == connections.end()) return true;
+    bool restart = it->second.closing && flow.ipProtocol == 6
+        && (flow.tcpFlags & (TCP_FLAG_SYN | TCP_FLAG_ACK)) == TCP_FLAG_SYN;
+    return restart || Expired(it->second, nowMs);
+}
+
+// Сначала для всей пачки ищутся соединения (поиски друг от друга не зависят), пакеты новых
+// соединений проверяются вместе; затем пакеты проходят обычный путь по порядку. Если пакет
+// пачки успел открыть соединение для следующего, заготовленный ответ просто не понадобится;
+// ответ сопоставителя для нового соединения зависит только от самого пакета
+void ConnectionTracker::FindBlockingRuleBatch(const RuleMatcher& matcher, FlowKey* flows, size_t count,
+    const CompiledRule** verdicts, uint64_t nowMs) {
+    batchFlows.clear();
+    batchSlots.assign(count, UINT32_MAX);
+    for (size_t i = 0; i < count; ++i) {
+        if (!OpensConnection(flows[i], nowMs)) continue;
+        batchSlots[i] = static_cast<uint32_t>(batchFlows.size());
+        batchFlows.push_back(flows[i]);
+        batchFlows.back().state = ConnectionState::New;
+        batchFlows.back().fromResponder = false;
+    }
+    batchVerdicts.resize(batchFlows.size());
+    size_t tests = 0;
+    matcher.FindBlockingRuleBatch(batchFlows.data(), batchFlows.size(), batchVerdicts.data(), &tests);
+    stats.ruleTests += tests;
+    for (size_t i = 0; i < count; ++i) {
+        const CompiledRule* const* prepared = batchSlots[i] == UINT32_MAX ? nullptr : &batchVerdicts[batchSlots[i]];
+        verdicts[i] = Evaluate(matcher, flows[i], nowMs, prepared);
+    }
+}
+
+void ConnectionTracker::Insert(const Tuple& tuple, const FlowKey& flow, const RuleMatcher& matcher,
+    const CompiledRule* rule, bool initiatorIsLow, uint64_t nowMs) {
+    if (connections.size() >= MAX_CONNECTIONS) EvictLocked();
+    Connection& c = connections[tuple];
+    c.opening = flow;
+    c.serverName.assign(flow.serverName.data(), flow.serverName.size());
+    c.opening.serverName = std::string_view();
+    c.generation = matcher.Generation();
+    c.blockingRule = rule;
+    c.lastSeen = nowMs;
+    c.order = nextOrder++;
+    c.initiatorIsLow = initiatorIsLow;
+    if (flow.ipProtocol == 6 && (flow.tcpFlags & (TCP_FLAG_FIN | TCP_FLAG_RST))) c.closing = true;
+    insertionOrder.emplace_back(c.order, tuple);
+    ++stats.connections;
+    if (insertionOrder.size() > 2 * connections.size() + 1024) CompactOrderLocked();
+}
+
+// Вытесняется самое старое по времени создания соединение
+void ConnectionTracker::EvictLocked() {
+    while (!insertionOrder.empty()) {
+        std::pair<uint64_t, Tuple> oldest = insertionOrder.front();
+        insertionOrder.pop_front();
+        auto it = connections.find(oldest.second);
+        if (it != connections.end() && it->second.order == oldest.first) {
+            connections.erase(it);
+            ++stats.evicted;
+            return;
+        }
+    }
+}
+
+// Закрытые и истёкшие соединения оставляют в очереди устаревшие записи
+void ConnectionTracker::CompactOrderLocked() {
+    std::deque<std::pair<uint64_t, Tuple>> live;
+    for (const auto& item : insertionOrder) {
+        auto it = connections.find(item.second);
+        if (it != connections.end() && it->second.order == item.first) live.push_back(item);
+    }
+    insertionOrder.swap(live);
+}
+
+void ConnectionTracker::Clear() {
+    connections.clear();
+    insertionOrder.clear();
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "flow_key.h"
+#include "rule_matcher.h"
+
+// Состояние соединений для правил с условием NEW/ESTABLISHED/RELATED и быстрого пути.
+// Правила без условия состояния решают судьбу соединения по его первому пакету: решение
+// запоминается вместе с поколением правил (RuleMatcher::Generation). Остальные пакеты
+// разрешённого соединения проверяют только правила, зависящие от самого пакета, — с условием
+// состояния и с флагами TCP; обычно таких нет или единицы. После смены правил, а также когда
+// позже приходит имя сервера или служба по сигнатуре, соединение перепроверяется по своему
+// первому пакету с ними.
+// Соединение — пятёрка без учёта направления; для эха ICMP портом служит идентификатор.
+// Ответ принимающей стороны переводит соединение в ESTABLISHED, ошибка ICMP об известном
+// соединении — RELATED. Потокобезопасности нет: вызывающий держит тот же замок, под которым
+// перекомпилируются правила.
+class ConnectionTracker {
+public:
+    struct Stats {
+        uint64_t packets = 0;
+        uint64_t connections = 0;       // созданных записей
+        uint64_t established = 0;       // пакетов в состоянии ESTABLISHED
+        uint64_t related = 0;           // ошибок ICMP об известных соединениях
+        uint64_t fastPath = 0;          // пакетов без полного прохода по правилам
+        uint64_t revalidated = 0;       // перепроверок после смены правил
+        uint64_t relabelled = 0;        // перепроверок после имени сервера или службы из содержимого
+        uint64_t expired = 0;
+        uint64_t evicted = 0;
+        uint64_t ruleTests = 0;         // проверено правил за все пакеты
+    };
+
+    // Проставляет flow.state и flow.fromResponder. Блокирующее правило или nullptr
+    const CompiledRule* FindBlockingRule(const RuleMatcher& matcher, FlowKey& flow, uint64_t nowMs);
+    // То же для пачки, результат как при вызовах по одному в том же порядке. Пакеты, которые
+    // по таблице откроют новые соединения, проверяются одной пачкой RuleMatcher
+    void FindBlockingRuleBatch(const RuleMatcher& matcher, FlowKey* flows, size_t count,
+        const CompiledRule** verdicts, uint64_t nowMs);
+
+    size_t Size() const { return connections.size(); }
+    const Stats& GetStats() const { return stats; }
+    void Clear();
+
+    static constexpr size_t MAX_CONNECTIONS = 65536;
+    static constexpr uint64_t TCP_TIMEOUT_MS = 600000;
+    static constexpr uint64_t CLOSING_TIMEOUT_MS = 10000;   // после FIN или RST
+    static constexpr uint64_t UDP_TIMEOUT_MS = 60000;
+    static constexpr uint64_t OTHER_TIMEOUT_MS = 30000;
+
+private:
+    // Адреса IPv4 хранятся как ::ffff:a.b.c.d; меньшая пара (адрес, порт) — "low"
+    struct Tuple {
+        uint8_t lowIp[16] = {};
+        uint8_t highIp[16] = {};
+        uint16_t lowPort = 0;
+        uint16_t highPort = 0;
+        uint8_t protocol = 0;
+        bool operator==(const Tuple& o) const;
+    };
+    struct TupleHash {
+        size_t operator()(const Tuple& t) const;
+    };
+
+    struct Connection {
+        FlowKey opening;                // первый пакет со службой из содержимого; serverName — в поле ниже
+        std::string serverName;         // последнее известное имя сервера
+        uint64_t generation = 0;        // поколение правил, по которому принято решение
+        const CompiledRule* blockingRule = nullptr;     // действителен, пока совпадает generation
+        uint64_t lastSeen = 0;
+        uint64_t order = 0;             // номер вставки, см. insertionOrder
+        bool initiatorIsLow = false;
+        bool replied = false;
+        bool closing = false;
+    };
+
+    // fromLow — источник пакета оказался стороной "low"
+    static Tuple MakeTuple(uint8_t protocol, bool ipv6, uint32_t sourceIp, uint32_t destIp,
+        const uint8_t* sourceIp6, const uint8_t* destIp6, uint16_t sourcePort, uint16_t destPort, bool& fromLow);
+    static bool Expired(const Connection& c, uint64_t nowMs);
+    // newVerdict — уже найденный ответ сопоставителя для пакета, если тот откроет соединение
+    const CompiledRule* Evaluate(const RuleMatcher& matcher, FlowKey& flow, uint64_t nowMs,
+        const CompiledRule* const* newVerdict);
+    bool OpensConnection(const FlowKey& flow, uint64_t nowMs) const;
+    static bool Relabel(Connection& c, const FlowKey& flow);
+    const CompiledRule* Decide(const RuleMatcher& matcher, Connection& c, const FlowKey& flow, size_t& tests,
+        bool relabelled);
+    void Insert(const Tuple& tuple, const FlowKey& flow, const RuleMatcher& matcher, const CompiledRule* rule,
+        bool initiatorIsLow, uint64_t nowMs);
+    void EvictLocked();
+    void CompactOrderLocked();
+
+    std::unordered_map<Tuple, Connection, TupleHash> connections;
+    std::deque<std::pair<uint64_t, Tuple>> insertionOrder;         // старые в начале
+    uint64_t nextOrder = 0;
+    Stats stats;
+    std::vector<FlowKey> batchFlows;                // для FindBlockingRuleBatch
+    std::vector<const CompiledRule*> batchVerdicts;
+    std::vector<uint32_t> batchSlots;
+};
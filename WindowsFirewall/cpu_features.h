@@ -0,0 +1,37 @@
+#pragma once
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define FIREWALL_X86 1
+#define TARGET_AVX2
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FIREWALL_X86 1
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#ifdef FIREWALL_X86
+// Процессор поддерживает AVX2, а ОС сохраняет регистры YMM (определяется один раз)
+inline bool CpuHasAvx2() {
+    static const bool supported = [] {
+#if defined(_MSC_VER)
+        int info[4] = {};
+        __cpuid(info, 0);
+        if (info[0] < 7) return false;
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+    }();
+    return supported;
+}
+#else
+inline bool CpuHasAvx2() { return false; }
+#endif
@@ -0,0 +1,96 @@
+#include <winsock2.h>
+#include <windows.h>
+#include <windns.h>
+#include <algorithm>
+#include <iostream>
+#include "dns_resolver_feeder.h"
+
+#pragma comment(lib, "dnsapi.lib")
+#pragma comment(lib, "Ws2_32.lib")
+
+ResolverDomainFeeder::~ResolverDomainFeeder() {
+    Stop();
+}
+
+void ResolverDomainFeeder::SetNames(const std::vector<std::string>& names) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::string, Clock::time_point> updated;
+    for (const auto& name : names) {
+        auto it = refreshAt.find(name);
+        updated[name] = it != refreshAt.end() ? it->second : Clock::time_point();
+    }
+    refreshAt.swap(updated);
+    wake.notify_all();
+}
+
+void ResolverDomainFeeder::Start(IpDomainTable& target) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (worker.joinable()) return;
+    table = &target;
+    stopping = false;
+    worker = std::thread(&ResolverDomainFeeder::Run, this);
+}
+
+void ResolverDomainFeeder::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+std::chrono::seconds ResolverDomainFeeder::Resolve(const std::string& name) {
+    PDNS_RECORD records = nullptr;
+    DNS_STATUS status = DnsQuery_A(name.c_str(), DNS_TYPE_A, DNS_QUERY_STANDARD, nullptr, &records, nullptr);
+    if (status != ERROR_SUCCESS) {
+        std::cerr << "[DNS] Failed to resolve " << name << ", error: " << status << std::endl;
+        return std::chrono::seconds(0);
+    }
+
+    // В ответ входит цепочка CNAME: адреса привязываются к имени из правила
+    std::chrono::seconds minTtl(0);
+    for (PDNS_RECORD record = records; record; record = record->pNext) {
+        if (record->wType != DNS_TYPE_A) continue;
+        std::chrono::seconds ttl(record->dwTtl);
+        table->Associate(ntohl(record->Data.A.IpAddress), name, ttl);
+        if (minTtl.count() == 0 || ttl < minTtl) minTtl = ttl;
+    }
+    DnsRecordListFree(records, DnsFreeRecordList);
+    return minTtl;
+}
+
+void ResolverDomainFeeder::Run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        Clock::time_point now = Clock::now();
+        Clock::time_point next = now + RETRY_INTERVAL;
+        std::vector<std::string> due;
+        for (const auto& entry : refreshAt) {
+            if (entry.second <= now) due.push_back(entry.first);
+            else if (entry.second < next) next = entry.second;
+        }
+
+        if (due.empty()) {
+            wake.wait_until(lock, next);
+            continue;
+        }
+
+        // DnsQuery блокируется на время запроса — без удержания мьютекса
+        lock.unlock();
+        std::vector<std::pair<std::string, Clock::time_point>> refreshed;
+        for (const auto& name : due) {
+            // Перезапрос чуть раньше истечения, чтобы соответствие не пропадало
+            std::chrono::seconds ttl = Resolve(name);
+            std::chrono::seconds delay = ttl.count() > 0
+                ? (std::max)(ttl - std::chrono::seconds(1), IpDomainTable::MIN_TTL) : RETRY_INTERVAL;
+            refreshed.push_back({ name, Clock::now() + delay });
+        }
+        lock.lock();
+
+        for (const auto& entry : refreshed) {
+            auto it = refreshAt.find(entry.first);
+            if (it != refreshAt.end()) it->second = entry.second;
+        }
+    }
+}
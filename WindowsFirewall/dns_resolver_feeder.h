@@ -0,0 +1,39 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "domain_table.h"
+
+// Разрешает точные имена из доменных правил через DnsQuery и держит их
+// соответствия в IpDomainTable, перезапрашивая по истечении TTL записи.
+// Шаблоны "*.example.com" так не разрешить — их адреса приходят из других источников.
+class ResolverDomainFeeder : public DomainFeeder {
+public:
+    ~ResolverDomainFeeder() override;
+
+    // Новые имена разрешаются сразу (в фоновом потоке), исчезнувшие перестают обновляться
+    void SetNames(const std::vector<std::string>& names);
+
+    void Start(IpDomainTable& table) override;
+    void Stop() override;
+
+    static constexpr std::chrono::seconds RETRY_INTERVAL{ 30 };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void Run();
+    // TTL самой короткоживущей A-записи или 0, если имя не разрешилось
+    std::chrono::seconds Resolve(const std::string& name);
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread worker;
+    bool stopping = false;
+    IpDomainTable* table = nullptr;
+    std::map<std::string, Clock::time_point> refreshAt;     // имя -> время следующего запроса
+};
@@ -0,0 +1,278 @@
+#include "dns_snoop.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+constexpr uint16_t DNS_TYPE_A = 1;
+constexpr uint16_t DNS_TYPE_CNAME = 5;
+constexpr uint16_t DNS_TYPE_AAAA = 28;
+constexpr uint16_t DNS_CLASS_IN = 1;
+constexpr size_t DNS_HEADER_SIZE = 12;
+constexpr size_t MAX_NAME_LENGTH = 255;
+constexpr size_t MAX_RECORDS = 64;          // на сообщение; остальное — мусор или атака
+constexpr size_t MAX_CHAIN = 8;
+
+uint16_t ReadBE16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t ReadBE32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+// Имя по смещению offset; next — позиция сразу за именем в исходной записи.
+// Указатель сжатия допускается только назад, поэтому циклы невозможны.
+bool ReadName(const uint8_t* data, size_t size, size_t offset, std::string& name, size_t& next) {
+    name.clear();
+    bool jumped = false;
+    size_t limit = offset;      // указатель должен вести строго до начала текущего имени
+    while (true) {
+        if (offset >= size) return false;
+        uint8_t length = data[offset];
+        if ((length & 0xC0) == 0xC0) {
+            if (offset + 1 >= size) return false;
+            size_t target = ((length & 0x3F) << 8) | data[offset + 1];
+            if (target >= limit) return false;
+            if (!jumped) next = offset + 2;
+            jumped = true;
+            limit = target;
+            offset = target;
+            continue;
+        }
+        if (length & 0xC0) return false;    // расширенные типы меток (RFC 6891) не встречаются
+        if (length == 0) {
+            if (!jumped) next = offset + 1;
+            return true;
+        }
+        if (offset + 1 + length > size) return false;
+        if (name.size() + length + 1 > MAX_NAME_LENGTH) return false;
+        if (!name.empty()) name += '.';
+        for (size_t i = 0; i < length; ++i) {
+            char c = static_cast<char>(data[offset + 1 + i]);
+            if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+            // Точка или управляющий символ внутри метки не дают однозначного имени
+            if (c == '.' || static_cast<unsigned char>(c) <= 0x20 || static_cast<unsigned char>(c) >= 0x7F) return false;
+            name += c;
+        }
+        offset += 1 + length;
+    }
+}
+
+struct CnameRecord {
+    std::string alias;
+    std::string target;
+    uint32_t ttl;
+};
+
+} // namespace
+
+bool ParseDnsResponse(const uint8_t* data, size_t size, std::vector<DnsAddressRecord>& out) {
+    out.clear();
+    if (!data || size < DNS_HEADER_SIZE) return false;
+    uint16_t flags = ReadBE16(data + 2);
+    if (!(flags & 0x8000)) return false;        // запрос, а не ответ
+    if ((flags & 0x000F) != 0) return true;     // NXDOMAIN и прочие ошибки: адресов нет
+    size_t questions = ReadBE16(data + 4);
+    size_t answers = ReadBE16(data + 6);
+    if (questions > MAX_RECORDS || answers > MAX_RECORDS) return false;
+
+    size_t offset = DNS_HEADER_SIZE;
+    std::string name;
+    for (size_t i = 0; i < questions; ++i) {
+        size_t next = 0;
+        if (!ReadName(data, size, offset, name, next)) return false;
+        offset = next + 4;
+        if (offset > size) return false;
+    }
+
+    std::vector<CnameRecord> cnames;
+    std::vector<DnsAddressRecord> addresses;
+    for (size_t i = 0; i < answers; ++i) {
+        size_t next = 0;
+        if (!ReadName(data, size, offset, name, next)) return false;
+        offset = next;
+        if (offset + 10 > size) return false;
+        uint16_t type = ReadBE16(data + offset);
+        uint16_t klass = ReadBE16(data + offset + 2);
+        uint32_t ttl = ReadBE32(data + offset + 4);
+        size_t rdlength = ReadBE16(data + offset + 8);
+        offset += 10;
+        if (offset + rdlength > size) return false;
+        const uint8_t* rdata = data + offset;
+
+        if (klass == DNS_CLASS_IN && !name.empty()) {
+            if (type == DNS_TYPE_A && rdlength == 4) {
+                DnsAddressRecord record;
+                record.name = name;
+                record.ipv4 = ReadBE32(rdata);
+                record.ttl = ttl;
+                addresses.push_back(std::move(record));
+            }
+            else if (type == DNS_TYPE_AAAA && rdlength == 16) {
+                DnsAddressRecord record;
+                record.name = name;
+                record.ipv6 = true;
+                std::copy(rdata, rdata + 16, record.ipv6Address.begin());
+                record.ttl = ttl;
+                addresses.push_back(std::move(record));
+            }
+            else if (type == DNS_TYPE_CNAME) {
+                std::string target;
+                size_t unused = 0;
+                // Имя внутри rdata может ссылаться на любую более раннюю часть сообщения
+                if (ReadName(data, offset + rdlength, offset, target, unused) && !target.empty()) {
+                    cnames.push_back({ name, std::move(target), ttl });
+                }
+            }
+        }
+        offset += rdlength;
+    }
+
+    // Адрес получает и своё имя, и все псевдонимы, цепочка CNAME которых к нему ведёт
+    for (const auto& address : addresses) {
+        out.push_back(address);
+        std::string current = address.name;
+        uint32_t ttl = address.ttl;
+        for (size_t depth = 0; depth < MAX_CHAIN; ++depth) {
+            auto alias = std::find_if(cnames.begin(), cnames.end(),
+                [&current](const CnameRecord& c) { return c.target == current; });
+            if (alias == cnames.end()) break;
+            ttl = (std::min)(ttl, alias->ttl);
+            DnsAddressRecord record = address;
+            record.name = alias->alias;
+            record.ttl = ttl;
+            out.push_back(std::move(record));
+            current = alias->alias;
+        }
+    }
+    return true;
+}
+
+void DnsSnooper::Start(IpDomainTable& target) {
+    table = &target;
+}
+
+void DnsSnooper::Stop() {
+    table = nullptr;
+    std::lock_guard<std::mutex> lock(tcpMutex);
+    tcpStreams.clear();
+}
+
+void DnsSnooper::HandleMessage(const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(parseMutex);
+    if (!ParseDnsResponse(data, size, scratch)) {
+        ++malformed;
+        return;
+    }
+    ++messages;
+    IpDomainTable* target = table;
+    for (const auto& record : scratch) {
+        if (record.ipv6) {
+            ++ipv6Addresses;
+            continue;
+        }
+        if (target) target->Associate(record.ipv4, record.name, std::chrono::seconds(record.ttl));
+        ++addresses;
+    }
+}
+
+void DnsSnooper::OnUdpPayload(const uint8_t* payload, size_t size) {
+    HandleMessage(payload, size);
+}
+
+void DnsSnooper::OnTcpSegment(uint32_t serverIp, uint16_t serverPort, uint32_t clientIp, uint16_t clientPort,
+    uint32_t seq, const uint8_t* payload, size_t size, bool finished) {
+    std::lock_guard<std::mutex> lock(tcpMutex);
+    auto it = std::find_if(tcpStreams.begin(), tcpStreams.end(), [&](const TcpStream& s) {
+        return s.serverIp == serverIp && s.clientIp == clientIp && s.serverPort == serverPort && s.clientPort == clientPort;
+    });
+
+    if (it == tcpStreams.end()) {
+        if (size == 0) return;
+        if (tcpStreams.size() >= MAX_TCP_STREAMS) tcpStreams.pop_back();
+        TcpStream stream;
+        stream.serverIp = serverIp;
+        stream.clientIp = clientIp;
+        stream.serverPort = serverPort;
+        stream.clientPort = clientPort;
+        stream.nextSeq = seq;
+        tcpStreams.push_front(std::move(stream));
+        it = tcpStreams.begin();
+    }
+    else if (it != tcpStreams.begin()) {
+        tcpStreams.splice(tcpStreams.begin(), tcpStreams, it);
+        it = tcpStreams.begin();
+    }
+
+    TcpStream& stream = *it;
+    if (size > 0) {
+        if (seq != stream.nextSeq) {
+            // Потеря или переупорядочивание: без полной сборки TCP собранное не восстановить
+            if (!stream.buffer.empty()) ++malformed;
+            stream.buffer.clear();
+            // Новое начало возможно только на границе сообщения — ждём его со следующего сегмента
+            stream.nextSeq = seq + static_cast<uint32_t>(size);
+            if (finished) tcpStreams.erase(it);
+            return;
+        }
+        stream.buffer.insert(stream.buffer.end(), payload, payload + size);
+        stream.nextSeq += static_cast<uint32_t>(size);
+
+        size_t consumed = 0;
+        while (stream.buffer.size() - consumed >= 2) {
+            size_t length = ReadBE16(stream.buffer.data() + consumed);
+            if (stream.buffer.size() - consumed - 2 < length) break;
+            HandleMessage(stream.buffer.data() + consumed + 2, length);
+            consumed += 2 + length;
+        }
+        stream.buffer.erase(stream.buffer.begin(), stream.buffer.begin() + consumed);
+        if (stream.buffer.size() > MAX_TCP_MESSAGE + 2) {
+            ++malformed;
+            stream.buffer.clear();
+        }
+    }
+    if (finished) tcpStreams.erase(it);
+}
+
+bool DnsSnooper::OnIPv4Packet(const uint8_t* packet, size_t size) {
+    if (size < 20 || (packet[0] >> 4) != 4) return false;
+    size_t ihl = (packet[0] & 0x0F) * 4u;
+    size_t total = ReadBE16(packet + 2);
+    if (ihl < 20 || total < ihl || total > size) return false;
+    // Фрагменты не собираются: ответ DNS больше MTU почти всегда уходит по TCP
+    if (ReadBE16(packet + 6) & 0x3FFF) return false;
+
+    uint8_t protocol = packet[9];
+    const uint8_t* l4 = packet + ihl;
+    size_t l4size = total - ihl;
+
+    if (protocol == 17) {
+        if (l4size < 8 || ReadBE16(l4) != 53) return false;
+        size_t udpLength = ReadBE16(l4 + 4);
+        if (udpLength < 8 || udpLength > l4size) return false;
+        OnUdpPayload(l4 + 8, udpLength - 8);
+        return true;
+    }
+    if (protocol == 6) {
+        if (l4size < 20 || ReadBE16(l4) != 53) return false;
+        size_t dataOffset = (l4[12] >> 4) * 4u;
+        if (dataOffset < 20 || dataOffset > l4size) return false;
+        bool finished = (l4[13] & 0x05) != 0;   // FIN или RST
+        bool syn = (l4[13] & 0x02) != 0;
+        uint32_t seq = ReadBE32(l4 + 4) + (syn ? 1 : 0);
+        OnTcpSegment(ReadBE32(packet + 12), 53, ReadBE32(packet + 16), ReadBE16(l4 + 2),
+            seq, l4 + dataOffset, l4size - dataOffset, finished);
+        return true;
+    }
+    return false;
+}
+
+DnsSnooper::Stats DnsSnooper::GetStats() const {
+    Stats stats;
+    stats.messages = messages;
+    stats.malformed = malformed;
+    stats.addresses = addresses;
+    stats.ipv6Addresses = ipv6Addresses;
+    return stats;
+}
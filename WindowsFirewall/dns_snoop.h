@@ -0,0 +1,75 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "domain_table.h"
+
+// Адрес из DNS-ответа с именем, под которым его запрашивали
+struct DnsAddressRecord {
+    std::string name;                       // нормализованное имя (и каждый псевдоним цепочки CNAME)
+    bool ipv6 = false;
+    uint32_t ipv4 = 0;                      // порядок байтов хоста
+    std::array<uint8_t, 16> ipv6Address{};
+    uint32_t ttl = 0;                       // минимальный TTL по цепочке
+};
+
+// Разбор ответа DNS (сообщение без TCP-префикса длины): A/AAAA и цепочки CNAME, сжатые имена.
+// Входные данные не доверенные: любые выходы за границы и циклы указателей дают false.
+bool ParseDnsResponse(const uint8_t* data, size_t size, std::vector<DnsAddressRecord>& out);
+
+// Пассивный источник соответствий: ответы DNS (UDP/53, TCP/53), увиденные захватом,
+// попадают в IpDomainTable без единого собственного запроса.
+// AAAA разбираются, но в таблицу не попадают: сопоставление пакетов пока только IPv4.
+class DnsSnooper : public DomainFeeder {
+public:
+    struct Stats {
+        uint64_t messages = 0;      // разобранные ответы
+        uint64_t malformed = 0;     // отброшенные сообщения
+        uint64_t addresses = 0;     // IPv4-соответствия, отправленные в таблицу
+        uint64_t ipv6Addresses = 0;
+    };
+
+    void Start(IpDomainTable& table) override;
+    void Stop() override;
+
+    // IPv4-пакет целиком (без канального заголовка); false — не ответ DNS
+    bool OnIPv4Packet(const uint8_t* packet, size_t size);
+    void OnUdpPayload(const uint8_t* payload, size_t size);
+    void OnTcpSegment(uint32_t serverIp, uint16_t serverPort, uint32_t clientIp, uint16_t clientPort,
+        uint32_t seq, const uint8_t* payload, size_t size, bool finished);
+
+    Stats GetStats() const;
+
+    static constexpr size_t MAX_TCP_STREAMS = 64;
+    static constexpr size_t MAX_TCP_MESSAGE = 65535;
+
+private:
+    // Поток DNS по TCP: сообщения с 2-байтовым префиксом длины, собираются по порядку seq
+    struct TcpStream {
+        uint32_t serverIp = 0;
+        uint32_t clientIp = 0;
+        uint16_t serverPort = 0;
+        uint16_t clientPort = 0;
+        uint32_t nextSeq = 0;
+        std::vector<uint8_t> buffer;
+    };
+
+    void HandleMessage(const uint8_t* data, size_t size);
+
+    std::atomic<IpDomainTable*> table{ nullptr };
+    std::atomic<uint64_t> messages{ 0 };
+    std::atomic<uint64_t> malformed{ 0 };
+    std::atomic<uint64_t> addresses{ 0 };
+    std::atomic<uint64_t> ipv6Addresses{ 0 };
+
+    std::mutex tcpMutex;
+    std::list<TcpStream> tcpStreams;        // последний использованный — в начале
+
+    std::mutex parseMutex;
+    std::vector<DnsAddressRecord> scratch;  // переиспользуется между сообщениями
+};
@@ -0,0 +1,302 @@
+#include "domain_table.h"
+#include <algorithm>
+
+std::string DomainTrie::Normalize(std::string_view name) {
+    size_t first = name.find_first_not_of(" \t");
+    if (first == std::string_view::npos) return "";
+    size_t last = name.find_last_not_of(" \t");
+    name = name.substr(first, last - first + 1);
+    if (!name.empty() && name.back() == '.') name.remove_suffix(1);
+
+    std::string s(name);
+    for (char& c : s) {
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+    }
+    return s;
+}
+
+static bool IsLabelChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '_';
+}
+
+bool DomainTrie::IsDomainPattern(std::string_view s) {
+    std::string name = Normalize(s);
+    std::string_view rest = name;
+    if (rest.size() > 2 && rest[0] == '*' && rest[1] == '.') rest.remove_prefix(2);
+    if (rest.empty() || rest.size() > 253) return false;
+
+    size_t labelStart = 0;
+    bool lastLabelNumeric = true;
+    for (size_t i = 0; i <= rest.size(); ++i) {
+        if (i == rest.size() || rest[i] == '.') {
+            size_t length = i - labelStart;
+            if (length == 0 || length > 63) return false;
+            labelStart = i + 1;
+            continue;
+        }
+        if (!IsLabelChar(rest[i])) return false;
+        if (i == labelStart) lastLabelNumeric = true;
+        if (rest[i] < '0' || rest[i] > '9') lastLabelNumeric = false;
+    }
+    // Последняя метка из одних цифр — это адрес (в том числе некорректный), а не имя
+    return !lastLabelNumeric;
+}
+
+const DomainTrie::Node* DomainTrie::Child(const Node& node, std::string_view label) const {
+    auto it = std::lower_bound(node.children.begin(), node.children.end(), label,
+        [](const std::pair<std::string, uint32_t>& child, std::string_view key) { return child.first < key; });
+    if (it == node.children.end() || it->first != label) return nullptr;
+    return &nodes[it->second];
+}
+
+uint32_t DomainTrie::Add(std::string_view pattern) {
+    if (!IsDomainPattern(pattern)) return 0;
+    std::string normalized = Normalize(pattern);
+    std::string_view name = normalized;
+    bool wildcard = name.size() > 2 && name[0] == '*' && name[1] == '.';
+    if (wildcard) name.remove_prefix(2);
+
+    if (nodes.empty()) nodes.emplace_back();
+    uint32_t current = 0;
+    size_t end = name.size();
+    while (true) {
+        size_t dot = name.rfind('.', end - 1);
+        size_t start = dot == std::string_view::npos ? 0 : dot + 1;
+        std::string_view label = name.substr(start, end - start);
+
+        auto& children = nodes[current].children;
+        auto it = std::lower_bound(children.begin(), children.end(), label,
+            [](const std::pair<std::string, uint32_t>& child, std::string_view key) { return child.first < key; });
+        if (it != children.end() && it->first == label) {
+            current = it->second;
+        }
+        else {
+            uint32_t index = static_cast<uint32_t>(nodes.size());
+            children.insert(it, { std::string(label), index });
+            nodes.emplace_back();   // ссылка children выше больше не используется
+            current = index;
+        }
+
+        if (dot == std::string_view::npos) break;
+        end = dot;
+    }
+
+    uint32_t& slot = wildcard ? nodes[current].wildcard : nodes[current].exact;
+    if (slot == 0) {
+        patterns.push_back(normalized);
+        slot = static_cast<uint32_t>(patterns.size());
+    }
+    return slot;
+}
+
+void DomainTrie::Match(std::string_view name, std::vector<uint32_t>& out) const {
+    if (nodes.empty()) return;
+    if (!name.empty() && name.back() == '.') name.remove_suffix(1);
+    if (name.empty()) return;
+
+    // Имена в таблице уже нормализованы (нижний регистр), поэтому сравнение побайтовое
+    const Node* node = &nodes[0];
+    size_t end = name.size();
+    while (true) {
+        size_t dot = end == 0 ? std::string_view::npos : name.rfind('.', end - 1);
+        size_t start = dot == std::string_view::npos ? 0 : dot + 1;
+        node = Child(*node, name.substr(start, end - start));
+        if (!node) return;
+        if (dot == std::string_view::npos) {
+            if (node->exact) out.push_back(node->exact);
+            return;
+        }
+        // Осталась хотя бы одна метка слева — подходит "*." этого узла
+        if (node->wildcard) out.push_back(node->wildcard);
+        end = dot;
+    }
+}
+
+std::vector<std::string> DomainTrie::ExactNames() const {
+    std::vector<std::string> names;
+    for (const auto& pattern : patterns) {
+        if (pattern.compare(0, 2, "*.") != 0) names.push_back(pattern);
+    }
+    return names;
+}
+
+void DomainTrie::Clear() {
+    nodes.clear();
+    patterns.clear();
+}
+
+IpDomainTable::~IpDomainTable() {
+    StopFeeders();
+}
+
+IpDomainTable& IpDomainTable::Instance() {
+    static IpDomainTable instance;
+    return instance;
+}
+
+IpDomainTable::Clock::time_point IpDomainTable::Now() const {
+    return clock ? clock() : Clock::now();
+}
+
+void IpDomainTable::SetClock(std::function<Clock::time_point()> newClock) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    clock = std::move(newClock);
+}
+
+void IpDomainTable::Associate(uint32_t ip, std::string_view name, std::chrono::seconds ttl) {
+    std::string normalized = DomainTrie::Normalize(name);
+    if (normalized.empty()) return;
+    ttl = (std::max)(MIN_TTL, (std::min)(ttl, MAX_TTL));
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    Clock::time_point now = Now();
+    Clock::time_point expires = now + ttl;
+
+    auto it = addresses.find(ip);
+    if (it == addresses.end()) {
+        if (addresses.size() >= MAX_ADDRESSES) EvictLocked();
+        it = addresses.emplace(ip, AddressEntry()).first;
+        it->second.order = nextOrder++;
+        insertionOrder.push_back({ it->second.order, ip });
+    }
+
+    auto& names = it->second.names;
+    for (auto& association : names) {
+        if (association.name == normalized) {
+            association.expires = (std::max)(association.expires, expires);
+            return;
+        }
+    }
+    if (names.size() >= MAX_NAMES_PER_ADDRESS) {
+        names.erase(std::min_element(names.begin(), names.end(),
+            [](const Association& a, const Association& b) { return a.expires < b.expires; }));
+    }
+    names.push_back({ std::move(normalized), expires });
+    ++version;
+}
+
+bool IpDomainTable::ForEachName(uint32_t ip, const std::function<void(std::string_view)>& f) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = addresses.find(ip);
+    if (it == addresses.end()) return false;
+    Clock::time_point now = Now();
+    bool any = false;
+    for (const auto& association : it->second.names) {
+        if (association.expires <= now) continue;
+        f(association.name);
+        any = true;
+    }
+    return any;
+}
+
+std::string IpDomainTable::LookupName(uint32_t ip) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = addresses.find(ip);
+    if (it == addresses.end()) return "";
+    Clock::time_point now = Now();
+    const auto& names = it->second.names;
+    for (auto association = names.rbegin(); association != names.rend(); ++association) {
+        if (association->expires > now) return association->name;
+    }
+    return "";
+}
+
+std::vector<std::pair<uint32_t, std::string>> IpDomainTable::Snapshot() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    Clock::time_point now = Now();
+    std::vector<std::pair<uint32_t, std::string>> result;
+    for (const auto& entry : addresses) {
+        for (const auto& association : entry.second.names) {
+            if (association.expires > now) result.push_back({ entry.first, association.name });
+        }
+    }
+    return result;
+}
+
+void IpDomainTable::PurgeLocked(Clock::time_point now) {
+    for (auto it = addresses.begin(); it != addresses.end();) {
+        auto& names = it->second.names;
+        size_t before = names.size();
+        names.erase(std::remove_if(names.begin(), names.end(),
+            [now](const Association& a) { return a.expires <= now; }), names.end());
+        if (names.size() != before) ++version;
+        if (names.empty()) it = addresses.erase(it);
+        else ++it;
+    }
+
+    // Очередь вставок чистится от удалённых адресов, чтобы не росла при частых Purge
+    if (insertionOrder.size() > 2 * addresses.size() + 1024) {
+        std::deque<std::pair<uint64_t, uint32_t>> live;
+        for (const auto& item : insertionOrder) {
+            auto entry = addresses.find(item.second);
+            if (entry != addresses.end() && entry->second.order == item.first) live.push_back(item);
+        }
+        insertionOrder.swap(live);
+    }
+}
+
+// Таблица полна: вытесняется адрес, добавленный раньше всех (FIFO за O(1) вместо поиска
+// самой ранней записи); записи, удалённые Purge, в очереди пропускаются
+void IpDomainTable::EvictLocked() {
+    while (!insertionOrder.empty()) {
+        std::pair<uint64_t, uint32_t> oldest = insertionOrder.front();
+        insertionOrder.pop_front();
+        auto it = addresses.find(oldest.second);
+        if (it != addresses.end() && it->second.order == oldest.first) {
+            addresses.erase(it);
+            ++version;
+            return;
+        }
+    }
+}
+
+void IpDomainTable::Purge() {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    PurgeLocked(Now());
+}
+
+void IpDomainTable::Clear() {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    addresses.clear();
+    insertionOrder.clear();
+    ++version;
+}
+
+size_t IpDomainTable::Size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return addresses.size();
+}
+
+uint64_t IpDomainTable::Version() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return version;
+}
+
+DomainFeeder* IpDomainTable::AddFeeder(std::unique_ptr<DomainFeeder> feeder) {
+    DomainFeeder* raw = feeder.get();
+    {
+        std::lock_guard<std::mutex> lock(feederMutex);
+        feeders.push_back(std::move(feeder));
+    }
+    raw->Start(*this);
+    return raw;
+}
+
+void IpDomainTable::StopFeeders() {
+    std::vector<std::unique_ptr<DomainFeeder>> stopping;
+    {
+        std::lock_guard<std::mutex> lock(feederMutex);
+        stopping.swap(feeders);
+    }
+    for (auto& feeder : stopping) feeder->Stop();
+}
+
+void StaticDomainFeeder::Add(uint32_t ip, std::string name, std::chrono::seconds ttl) {
+    entries.push_back({ ip, std::move(name), ttl });
+}
+
+void StaticDomainFeeder::Start(IpDomainTable& table) {
+    for (const auto& entry : entries) {
+        table.Associate(entry.ip, entry.name, entry.ttl);
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Шаблоны доменов правил в суффиксном дереве по перевёрнутым меткам:
+// "www.example.com" хранится как com -> example -> www.
+//   "example.com"   — только это имя,
+//   "*.example.com" — любой поддомен (a.example.com, a.b.example.com), но не сам example.com
+class DomainTrie {
+public:
+    // id шаблона (> 0, одинаковые шаблоны получают один id) или 0, если строка не домен
+    uint32_t Add(std::string_view pattern);
+    // Добавляет в out id всех шаблонов, которым соответствует имя
+    void Match(std::string_view name, std::vector<uint32_t>& out) const;
+    bool Empty() const { return patterns.empty(); }
+    size_t Size() const { return patterns.size(); }
+    void Clear();
+
+    // Точные имена (без "*."), которые можно разрешить заранее
+    std::vector<std::string> ExactNames() const;
+
+    // Нижний регистр, без пробелов и завершающей точки
+    static std::string Normalize(std::string_view name);
+    static bool IsDomainPattern(std::string_view s);
+
+private:
+    struct Node {
+        std::vector<std::pair<std::string, uint32_t>> children;  // отсортированы по метке
+        uint32_t exact = 0;
+        uint32_t wildcard = 0;
+    };
+    const Node* Child(const Node& node, std::string_view label) const;
+
+    std::vector<Node> nodes;                // nodes[0] — корень (создаётся при первом Add)
+    std::vector<std::string> patterns;      // patterns[id - 1]
+};
+
+class IpDomainTable;
+
+// Источник соответствий адрес -> имя: резолвер, разбор DNS-ответов, тестовые данные
+class DomainFeeder {
+public:
+    virtual ~DomainFeeder() = default;
+    virtual void Start(IpDomainTable& table) = 0;
+    virtual void Stop() {}
+};
+
+// Живая таблица "IPv4 -> имена" с временем жизни записей (TTL из DNS).
+// Адреса в порядке байтов хоста, как в FlowKey.
+class IpDomainTable {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    IpDomainTable() = default;
+    ~IpDomainTable();
+    IpDomainTable(const IpDomainTable&) = delete;
+    IpDomainTable& operator=(const IpDomainTable&) = delete;
+
+    static IpDomainTable& Instance();
+
+    void Associate(uint32_t ip, std::string_view name, std::chrono::seconds ttl);
+    // Вызывает f для каждого непросроченного имени адреса; false — адрес неизвестен
+    bool ForEachName(uint32_t ip, const std::function<void(std::string_view)>& f) const;
+    // Последнее сопоставленное адресу живое имя или пустая строка (для отображения)
+    std::string LookupName(uint32_t ip) const;
+    // Все живые пары (адрес, имя)
+    std::vector<std::pair<uint32_t, std::string>> Snapshot() const;
+
+    void Purge();
+    void Clear();
+    size_t Size() const;
+    // Растёт при каждом изменении набора соответствий (для пересинхронизации WFP)
+    uint64_t Version() const;
+
+    // Подмена часов для проверок TTL без ожидания
+    void SetClock(std::function<Clock::time_point()> clock);
+
+    // Таблица владеет источниками и останавливает их при уничтожении
+    DomainFeeder* AddFeeder(std::unique_ptr<DomainFeeder> feeder);
+    void StopFeeders();
+
+    static constexpr size_t MAX_ADDRESSES = 65536;
+    static constexpr size_t MAX_NAMES_PER_ADDRESS = 8;
+    static constexpr std::chrono::seconds MIN_TTL{ 5 };
+    static constexpr std::chrono::seconds MAX_TTL{ 24 * 60 * 60 };
+
+private:
+    struct Association {
+        std::string name;
+        Clock::time_point expires;
+    };
+    struct AddressEntry {
+        uint64_t order = 0;                 // номер вставки адреса, см. insertionOrder
+        std::vector<Association> names;
+    };
+
+    Clock::time_point Now() const;
+    void PurgeLocked(Clock::time_point now);
+    void EvictLocked();
+
+    mutable std::shared_mutex mutex;
+    std::unordered_map<uint32_t, AddressEntry> addresses;
+    std::deque<std::pair<uint64_t, uint32_t>> insertionOrder;  // (номер вставки, адрес), старые в начале
+    uint64_t nextOrder = 0;
+    uint64_t version = 0;
+    std::function<Clock::time_point()> clock;
+
+    std::mutex feederMutex;
+    std::vector<std::unique_ptr<DomainFeeder>> feeders;
+};
+
+// Фиксированный набор соответствий: для проверок и бенчмарков без настоящего DNS
+class StaticDomainFeeder : public DomainFeeder {
+public:
+    void Add(uint32_t ip, std::string name, std::chrono::seconds ttl = IpDomainTable::MAX_TTL);
+    void Start(IpDomainTable& table) override;
+
+private:
+    struct Entry {
+        uint32_t ip;
+        std::string name;
+        std::chrono::seconds ttl;
+    };
+    std::vector<Entry> entries;
+};
@@ -0,0 +1,368 @@
+#include "field_mask_index.h"
+#include "rule_matcher.h"
+#include <algorithm>
+#include <array>
+#include <utility>
+
+static bool PortIn(const std::vector<PortRange>& ranges, uint16_t port) {
+    for (const auto& r : ranges) {
+        if (port >= r.low && port <= r.high) return true;
+    }
+    return false;
+}
+
+static bool PlainAddress(const AddressMatch& a) {
+    return a.any || (!a.never && !a.list && a.domain == 0);
+}
+
+bool FieldMaskIndex::Supports(const CompiledRule& rule) {
+    return PlainAddress(rule.source) && PlainAddress(rule.dest)
+        && rule.icmpTypes.empty() && rule.tcpFlagsMask == 0 && rule.states == 0;
+}
+
+uint8_t FieldMaskIndex::FieldMask(const CompiledRule& rule) {
+    uint8_t mask = 0;
+    if (rule.ipProtocol != 0) mask |= FIELD_PROTOCOL;
+    if (rule.service != UNKNOWN_SERVICE) mask |= FIELD_SERVICE;
+    if (!rule.source.any) mask |= FIELD_SOURCE;
+    if (!rule.dest.any) mask |= FIELD_DEST;
+    if (!rule.sourcePorts.empty()) mask |= FIELD_SOURCE_PORT;
+    if (!rule.destPorts.empty()) mask |= FIELD_DEST_PORT;
+    return mask;
+}
+
+// Проверка только полей из Mask; остальные у правил корзины — "любой"
+template <unsigned Mask>
+static inline bool MatchesFields(const CompiledRule& rule, const FlowKey& flow) {
+    if constexpr ((Mask & FieldMaskIndex::FIELD_PROTOCOL) != 0) {
+        if (rule.ipProtocol != flow.ipProtocol) return false;
+    }
+    if constexpr ((Mask & FieldMaskIndex::FIELD_SERVICE) != 0) {
+        if (rule.service != flow.service) return false;
+    }
+    if constexpr ((Mask & FieldMaskIndex::FIELD_SOURCE) != 0) {
+        if ((flow.sourceIp & rule.source.mask) != rule.source.network) return false;
+    }
+    if constexpr ((Mask & FieldMaskIndex::FIELD_DEST) != 0) {
+        if ((flow.destIp & rule.dest.mask) != rule.dest.network) return false;
+    }
+    if constexpr ((Mask & FieldMaskIndex::FIELD_SOURCE_PORT) != 0) {
+        if (!PortIn(rule.sourcePorts, flow.sourcePort)) return false;
+    }
+    if constexpr ((Mask & FieldMaskIndex::FIELD_DEST_PORT) != 0) {
+        if (!PortIn(rule.destPorts, flow.destPort)) return false;
+    }
+    return true;
+}
+
+template <unsigned Mask>
+static uint32_t ScanBucket(const CompiledRule* rules, const std::vector<uint32_t>& indices,
+    const FlowKey& flow, bool checkApp, uint32_t limit, size_t& tested) {
+    for (uint32_t index : indices) {
+        if (index >= limit) break;
+        const CompiledRule& rule = rules[index];
+        ++tested;
+        if (!MatchesFields<Mask>(rule, flow)) continue;
+        if (checkApp && !rule.app.Matches(flow.app)) continue;
+        return index;
+    }
+    return limit;
+}
+
+// Правило за правилом, каждое — против всех пакетов пачки, у которых ещё не нашлось правила раньше
+template <unsigned Mask>
+static void ScanBucketBatch(const CompiledRule* rules, const std::vector<uint32_t>& indices,
+    const FlowKey* flows, size_t count, bool checkApp, uint32_t* limits, size_t& tested) {
+    constexpr bool addressMask = (Mask & (FieldMaskIndex::FIELD_SOURCE | FieldMaskIndex::FIELD_DEST)) != 0;
+    for (uint32_t index : indices) {
+        const CompiledRule& rule = rules[index];
+        bool pending = false;
+        for (size_t i = 0; i < count; ++i) {
+            if (index >= limits[i]) continue;
+            pending = true;
+            const FlowKey& flow = flows[i];
+            if (addressMask && flow.ipv6) continue;
+            ++tested;
+            if (!MatchesFields<Mask>(rule, flow)) continue;
+            if (checkApp && !rule.app.Matches(flow.app)) continue;
+            limits[i] = index;
+        }
+        if (!pending) break;        // у всех пакетов уже есть правило раньше
+    }
+}
+
+using ScanFnPtr = uint32_t (*)(const CompiledRule*, const std::vector<uint32_t>&, const FlowKey&, bool, uint32_t, size_t&);
+using ScanBatchFnPtr = void (*)(const CompiledRule*, const std::vector<uint32_t>&, const FlowKey*, size_t, bool,
+    uint32_t*, size_t&);
+
+template <size_t... Masks>
+static constexpr std::array<ScanFnPtr, sizeof...(Masks)> MakeScanTable(std::index_sequence<Masks...>) {
+    return { { &ScanBucket<static_cast<unsigned>(Masks)>... } };
+}
+
+template <size_t... Masks>
+static constexpr std::array<ScanBatchFnPtr, sizeof...(Masks)> MakeScanBatchTable(std::index_sequence<Masks...>) {
+    return { { &ScanBucketBatch<static_cast<unsigned>(Masks)>... } };
+}
+
+static constexpr auto kScanTable = MakeScanTable(std::make_index_sequence<FieldMaskIndex::MASK_COUNT>());
+static constexpr auto kScanBatchTable = MakeScanBatchTable(std::make_index_sequence<FieldMaskIndex::MASK_COUNT>());
+
+size_t FieldMaskIndex::ExactKeyHash::operator()(const ExactKey& k) const {
+    uint64_t a = (uint64_t(k.source) << 32) | k.dest;
+    uint64_t b = (uint64_t(k.sourcePort) << 40) | (uint64_t(k.destPort) << 24) | (uint64_t(k.service) << 8) | k.protocol;
+    uint64_t h = (a ^ (b * 0x9E3779B97F4A7C15ull)) * 0xC2B2AE3D27D4EB4Full;
+    return static_cast<size_t>(h ^ (h >> 31));
+}
+
+// Все сочетания точных значений полей маски; false — есть подсеть или слишком много портов
+bool FieldMaskIndex::ExactKeys(const CompiledRule& rule, uint8_t mask, std::vector<ExactKey>& keys) {
+    keys.clear();
+    if (mask == 0) return false;
+    if ((mask & FIELD_SOURCE) && rule.source.mask != 0xFFFFFFFFu) return false;
+    if ((mask & FIELD_DEST) && rule.dest.mask != 0xFFFFFFFFu) return false;
+
+    auto countPorts = [](const std::vector<PortRange>& ranges) {
+        size_t n = 0;
+        for (const auto& r : ranges) n += r.high - r.low + 1u;
+        return n;
+    };
+    size_t sourcePorts = (mask & FIELD_SOURCE_PORT) ? countPorts(rule.sourcePorts) : 1;
+    size_t destPorts = (mask & FIELD_DEST_PORT) ? countPorts(rule.destPorts) : 1;
+    if (sourcePorts * destPorts > MAX_EXACT_KEYS) return false;
+
+    ExactKey base;
+    base.protocol = (mask & FIELD_PROTOCOL) ? rule.ipProtocol : 0;
+    base.service = (mask & FIELD_SERVICE) ? rule.service : 0;
+    base.source = (mask & FIELD_SOURCE) ? rule.source.network : 0;
+    base.dest = (mask & FIELD_DEST) ? rule.dest.network : 0;
+    std::vector<PortRange> any = { { 0, 0 } };
+    const std::vector<PortRange>& sources = (mask & FIELD_SOURCE_PORT) ? rule.sourcePorts : any;
+    const std::vector<PortRange>& dests = (mask & FIELD_DEST_PORT) ? rule.destPorts : any;
+    for (const auto& s : sources) {
+        for (uint32_t sp = s.low; sp <= s.high; ++sp) {
+            for (const auto& d : dests) {
+                for (uint32_t dp = d.low; dp <= d.high; ++dp) {
+                    ExactKey key = base;
+                    key.sourcePort = static_cast<uint16_t>(sp);
+                    key.destPort = static_cast<uint16_t>(dp);
+                    // Пересекающиеся диапазоны дают одинаковые ключи
+                    if (std::find(keys.begin(), keys.end(), key) == keys.end()) keys.push_back(key);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+const AddressMatch* FieldMaskIndex::PrefixAddress(const CompiledRule& rule, uint8_t mask) {
+    if (mask & FIELD_DEST) return &rule.dest;
+    if (mask & FIELD_SOURCE) return &rule.source;
+    return nullptr;
+}
+
+uint32_t FieldMaskIndex::PrefixFlowAddress(const FlowKey& flow, uint8_t mask) {
+    return (mask & FIELD_DEST) ? flow.destIp : flow.sourceIp;
+}
+
+std::vector<uint32_t>& FieldMaskIndex::PrefixSlot(Bucket& bucket, const AddressMatch& address) {
+    auto list = std::find_if(bucket.prefixes.begin(), bucket.prefixes.end(),
+        [&address](const PrefixList& p) { return p.netmask == address.mask; });
+    if (list == bucket.prefixes.end()) {
+        bucket.prefixes.emplace_back();
+        list = bucket.prefixes.end() - 1;
+        list->netmask = address.mask;
+    }
+    return list->byNetwork[address.network & address.mask];
+}
+
+FieldMaskIndex::ExactKey FieldMaskIndex::FlowKeyFor(const FlowKey& flow, uint8_t mask) {
+    ExactKey key;
+    if (mask & FIELD_PROTOCOL) key.protocol = flow.ipProtocol;
+    if (mask & FIELD_SERVICE) key.service = flow.service;
+    if (mask & FIELD_SOURCE) key.source = flow.sourceIp;
+    if (mask & FIELD_DEST) key.dest = flow.destIp;
+    if (mask & FIELD_SOURCE_PORT) key.sourcePort = flow.sourcePort;
+    if (mask & FIELD_DEST_PORT) key.destPort = flow.destPort;
+    return key;
+}
+
+void FieldMaskIndex::Build(const std::vector<CompiledRule>& rules, const std::vector<uint32_t>& indices) {
+    Clear();
+    int bucketOf[MASK_COUNT];
+    std::fill(bucketOf, bucketOf + MASK_COUNT, -1);
+    std::vector<ExactKey> keys;
+    for (uint32_t index : indices) {
+        const CompiledRule& rule = rules[index];
+        uint8_t mask = FieldMask(rule);
+        if (bucketOf[mask] < 0) {
+            bucketOf[mask] = static_cast<int>(buckets.size());
+            buckets.emplace_back();
+            buckets.back().mask = mask;
+            buckets.back().first = index;
+            buckets.back().scan = kScanTable[mask];
+            buckets.back().scanBatch = kScanBatchTable[mask];
+        }
+        Bucket& bucket = buckets[bucketOf[mask]];
+        if (ExactKeys(rule, mask, keys)) {
+            for (const auto& key : keys) bucket.exact[key].push_back(index);
+            ++hashedRules;
+        }
+        else if (const AddressMatch* address = PrefixAddress(rule, mask)) {
+            PrefixSlot(bucket, *address).push_back(index);
+            ++prefixedRules;
+        }
+        else {
+            bucket.scanned.push_back(index);
+            ++scannedRules;
+        }
+    }
+    // Корзины создавались в порядке первого правила, так что buckets уже упорядочены по first
+}
+
+// Корзина маски; новая встаёт на своё место по first
+FieldMaskIndex::Bucket& FieldMaskIndex::BucketFor(uint8_t mask, uint32_t index) {
+    for (Bucket& bucket : buckets) {
+        if (bucket.mask != mask) continue;
+        if (index < bucket.first) {
+            // Корзина переезжает ближе к началу, иначе Find остановится раньше неё
+            Bucket moved = std::move(bucket);
+            moved.first = index;
+            buckets.erase(buckets.begin() + (&bucket - buckets.data()));
+            auto at = std::upper_bound(buckets.begin(), buckets.end(), index,
+                [](uint32_t i, const Bucket& b) { return i < b.first; });
+            return *buckets.insert(at, std::move(moved));
+        }
+        return bucket;
+    }
+    Bucket created;
+    created.mask = mask;
+    created.first = index;
+    created.scan = kScanTable[mask];
+    created.scanBatch = kScanBatchTable[mask];
+    auto at = std::upper_bound(buckets.begin(), buckets.end(), index,
+        [](uint32_t i, const Bucket& b) { return i < b.first; });
+    return *buckets.insert(at, std::move(created));
+}
+
+void FieldMaskIndex::Insert(const CompiledRule& rule, uint32_t index) {
+    uint8_t mask = FieldMask(rule);
+    Bucket& bucket = BucketFor(mask, index);
+    std::vector<ExactKey> keys;
+    if (ExactKeys(rule, mask, keys)) {
+        for (const auto& key : keys) InsertSortedIndex(bucket.exact[key], index);
+        ++hashedRules;
+    }
+    else if (const AddressMatch* address = PrefixAddress(rule, mask)) {
+        InsertSortedIndex(PrefixSlot(bucket, *address), index);
+        ++prefixedRules;
+    }
+    else {
+        InsertSortedIndex(bucket.scanned, index);
+        ++scannedRules;
+    }
+}
+
+void FieldMaskIndex::Remove(const CompiledRule& rule, uint32_t index) {
+    uint8_t mask = FieldMask(rule);
+    auto bucket = std::find_if(buckets.begin(), buckets.end(), [mask](const Bucket& b) { return b.mask == mask; });
+    if (bucket == buckets.end()) return;
+    std::vector<ExactKey> keys;
+    if (ExactKeys(rule, mask, keys)) {
+        bool found = false;
+        for (const auto& key : keys) {
+            auto it = bucket->exact.find(key);
+            if (it == bucket->exact.end() || !EraseSortedIndex(it->second, index)) continue;
+            found = true;
+            if (it->second.empty()) bucket->exact.erase(it);
+        }
+        if (found) --hashedRules;
+    }
+    else if (const AddressMatch* address = PrefixAddress(rule, mask)) {
+        auto list = std::find_if(bucket->prefixes.begin(), bucket->prefixes.end(),
+            [address](const PrefixList& p) { return p.netmask == address->mask; });
+        if (list != bucket->prefixes.end()) {
+            auto it = list->byNetwork.find(address->network & address->mask);
+            if (it != list->byNetwork.end() && EraseSortedIndex(it->second, index)) {
+                --prefixedRules;
+                if (it->second.empty()) list->byNetwork.erase(it);
+                if (list->byNetwork.empty()) bucket->prefixes.erase(list);
+            }
+        }
+    }
+    else if (EraseSortedIndex(bucket->scanned, index)) {
+        --scannedRules;
+    }
+    if (bucket->Empty()) buckets.erase(bucket);
+}
+
+void FieldMaskIndex::Clear() {
+    buckets.clear();
+    hashedRules = 0;
+    prefixedRules = 0;
+    scannedRules = 0;
+}
+
+uint32_t FieldMaskIndex::FindExact(const Bucket& bucket, const CompiledRule* rules, const FlowKey& flow,
+    bool checkApp, uint32_t limit, size_t& tested) {
+    auto it = bucket.exact.find(FlowKeyFor(flow, bucket.mask));
+    if (it == bucket.exact.end()) return limit;
+    for (uint32_t index : it->second) {
+        if (index >= limit) break;
+        ++tested;
+        if (checkApp && !rules[index].app.Matches(flow.app)) continue;
+        return index;
+    }
+    return limit;
+}
+
+// По одному поиску на длину префикса; список сети проверяется функцией корзины целиком
+uint32_t FieldMaskIndex::FindPrefixed(const Bucket& bucket, const CompiledRule* rules, const FlowKey& flow,
+    bool checkApp, uint32_t limit, size_t& tested) {
+    uint32_t address = PrefixFlowAddress(flow, bucket.mask);
+    for (const PrefixList& list : bucket.prefixes) {
+        auto it = list.byNetwork.find(address & list.netmask);
+        if (it == list.byNetwork.end() || it->second.front() >= limit) continue;
+        limit = bucket.scan(rules, it->second, flow, checkApp, limit, tested);
+    }
+    return limit;
+}
+
+uint32_t FieldMaskIndex::FindInBucket(const Bucket& bucket, const CompiledRule* rules, const FlowKey& flow,
+    bool checkApp, uint32_t limit, size_t& tested) {
+    // Подсеть IPv4 с адресом IPv6 не совпадает никогда
+    if (flow.ipv6 && (bucket.mask & (FIELD_SOURCE | FIELD_DEST))) return limit;
+    if (!bucket.exact.empty()) limit = FindExact(bucket, rules, flow, checkApp, limit, tested);
+    if (!bucket.prefixes.empty()) limit = FindPrefixed(bucket, rules, flow, checkApp, limit, tested);
+    if (!bucket.scanned.empty()) limit = bucket.scan(rules, bucket.scanned, flow, checkApp, limit, tested);
+    return limit;
+}
+
+uint32_t FieldMaskIndex::Find(const CompiledRule* rules, const FlowKey& flow, bool checkApp, uint32_t limit,
+    size_t& tested) const {
+    for (const Bucket& bucket : buckets) {
+        if (bucket.first >= limit) break;
+        limit = FindInBucket(bucket, rules, flow, checkApp, limit, tested);
+    }
+    return limit;
+}
+
+void FieldMaskIndex::FindBatch(const CompiledRule* rules, const FlowKey* flows, size_t count, bool checkApp,
+    uint32_t* limits, size_t& tested) const {
+    for (const Bucket& bucket : buckets) {
+        bool addressMask = (bucket.mask & (FIELD_SOURCE | FIELD_DEST)) != 0;
+        if (!bucket.exact.empty()) {
+            for (size_t i = 0; i < count; ++i) {
+                if (bucket.first >= limits[i] || (addressMask && flows[i].ipv6)) continue;
+                limits[i] = FindExact(bucket, rules, flows[i], checkApp, limits[i], tested);
+            }
+        }
+        if (!bucket.prefixes.empty()) {
+            for (size_t i = 0; i < count; ++i) {
+                if (bucket.first >= limits[i] || flows[i].ipv6) continue;
+                limits[i] = FindPrefixed(bucket, rules, flows[i], checkApp, limits[i], tested);
+            }
+        }
+        if (!bucket.scanned.empty()) bucket.scanBatch(rules, bucket.scanned, flows, count, checkApp, limits, tested);
+    }
+}
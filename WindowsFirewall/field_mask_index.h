@@ -0,0 +1,139 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct AddressMatch;
+struct CompiledRule;
+struct FlowKey;
+
+// Списки индексов правил по возрастанию: вставка без повторов и удаление
+inline void InsertSortedIndex(std::vector<uint32_t>& list, uint32_t index) {
+    if (list.empty() || list.back() < index) {
+        list.push_back(index);
+        return;
+    }
+    auto it = std::lower_bound(list.begin(), list.end(), index);
+    if (*it != index) list.insert(it, index);
+}
+
+inline bool EraseSortedIndex(std::vector<uint32_t>& list, uint32_t index) {
+    auto it = std::lower_bound(list.begin(), list.end(), index);
+    if (it == list.end() || *it != index) return false;
+    list.erase(it);
+    return true;
+}
+
+// Правила, разложенные по набору полей, которые они ограничивают (протокол, служба, адреса,
+// порты). Каждая корзина проверяется функцией, инстанцированной под свою маску: поля "любой"
+// в ней не проверяются вовсе. Правила корзины с точными значениями всех своих полей (адрес /32,
+// несколько одиночных портов) лежат в хеш-таблице по этим значениям. Остальные правила корзины
+// с адресом (подсети, диапазоны портов) разложены по длине префикса и сети адреса назначения,
+// а без него — источника: пакет просматривает только списки своих сетей, по одному поиску на
+// длину префикса. Правила без адреса просматриваются по порядку.
+// Сюда попадают только правила, для которых FieldMaskIndex::Supports: домены, списки адресов,
+// ICMP, флаги TCP и состояния RuleMatcher проверяет сам.
+class FieldMaskIndex {
+public:
+    enum Field : uint8_t {
+        FIELD_PROTOCOL = 1,
+        FIELD_SERVICE = 2,
+        FIELD_SOURCE = 4,
+        FIELD_DEST = 8,
+        FIELD_SOURCE_PORT = 16,
+        FIELD_DEST_PORT = 32
+    };
+    static constexpr unsigned MASK_COUNT = 64;
+    // Больше сочетаний портов правило в хеш-таблицу не раскладывается
+    static constexpr size_t MAX_EXACT_KEYS = 16;
+
+    static bool Supports(const CompiledRule& rule);
+    static uint8_t FieldMask(const CompiledRule& rule);
+
+    // indices — по возрастанию, только правила, для которых Supports
+    void Build(const std::vector<CompiledRule>& rules, const std::vector<uint32_t>& indices);
+    void Clear();
+    // Одно правило в свою корзину или из неё без перестройки остальных. Remove получает правило
+    // в том виде, в каком оно было добавлено. first корзины после удаления не растёт: он остаётся
+    // нижней границей, и порядок корзин по нему не нарушается
+    void Insert(const CompiledRule& rule, uint32_t index);
+    void Remove(const CompiledRule& rule, uint32_t index);
+
+    // Самый ранний индекс подходящего правила меньше limit, иначе limit; tested += проверено правил.
+    // checkApp — проверять и приложение правила
+    uint32_t Find(const CompiledRule* rules, const FlowKey& flow, bool checkApp, uint32_t limit, size_t& tested) const;
+    // То же для пачки: limits[i] — граница и ответ для flows[i]. Корзины обходятся во внешнем
+    // цикле, просматриваемые правила корзины — тоже: каждое правило читается из памяти один раз
+    // на пачку, а не на пакет
+    void FindBatch(const CompiledRule* rules, const FlowKey* flows, size_t count, bool checkApp,
+        uint32_t* limits, size_t& tested) const;
+
+    size_t BucketCount() const { return buckets.size(); }
+    size_t HashedRules() const { return hashedRules; }
+    size_t PrefixedRules() const { return prefixedRules; }
+    size_t ScannedRules() const { return scannedRules; }
+
+private:
+    struct ExactKey {
+        uint32_t source = 0;
+        uint32_t dest = 0;
+        uint16_t sourcePort = 0;
+        uint16_t destPort = 0;
+        uint16_t service = 0;
+        uint8_t protocol = 0;
+
+        bool operator==(const ExactKey& o) const {
+            return source == o.source && dest == o.dest && sourcePort == o.sourcePort
+                && destPort == o.destPort && service == o.service && protocol == o.protocol;
+        }
+    };
+    struct ExactKeyHash {
+        size_t operator()(const ExactKey& k) const;
+    };
+
+    using ScanFn = uint32_t (*)(const CompiledRule* rules, const std::vector<uint32_t>& indices,
+        const FlowKey& flow, bool checkApp, uint32_t limit, size_t& tested);
+
+    using ScanBatchFn = void (*)(const CompiledRule* rules, const std::vector<uint32_t>& indices,
+        const FlowKey* flows, size_t count, bool checkApp, uint32_t* limits, size_t& tested);
+
+    // Правила одной длины префикса: сеть -> индексы по возрастанию
+    struct PrefixList {
+        uint32_t netmask = 0;
+        std::unordered_map<uint32_t, std::vector<uint32_t>> byNetwork;
+    };
+
+    struct Bucket {
+        uint8_t mask = 0;
+        uint32_t first = 0;                 // наименьший индекс правила в корзине
+        ScanFn scan = nullptr;
+        ScanBatchFn scanBatch = nullptr;
+        std::vector<uint32_t> scanned;      // индексы по возрастанию
+        std::unordered_map<ExactKey, std::vector<uint32_t>, ExactKeyHash> exact;
+        std::vector<PrefixList> prefixes;   // по длине префикса, в порядке появления
+
+        bool Empty() const { return scanned.empty() && exact.empty() && prefixes.empty(); }
+    };
+
+    static uint32_t FindInBucket(const Bucket& bucket, const CompiledRule* rules, const FlowKey& flow, bool checkApp,
+        uint32_t limit, size_t& tested);
+    static uint32_t FindExact(const Bucket& bucket, const CompiledRule* rules, const FlowKey& flow, bool checkApp,
+        uint32_t limit, size_t& tested);
+    static uint32_t FindPrefixed(const Bucket& bucket, const CompiledRule* rules, const FlowKey& flow, bool checkApp,
+        uint32_t limit, size_t& tested);
+    static bool ExactKeys(const CompiledRule& rule, uint8_t mask, std::vector<ExactKey>& keys);
+    static ExactKey FlowKeyFor(const FlowKey& flow, uint8_t mask);
+    // Адрес, по которому правила корзины с маской mask раскладываются по префиксу; nullptr — адреса нет
+    static const AddressMatch* PrefixAddress(const CompiledRule& rule, uint8_t mask);
+    static uint32_t PrefixFlowAddress(const FlowKey& flow, uint8_t mask);
+    static std::vector<uint32_t>& PrefixSlot(Bucket& bucket, const AddressMatch& address);
+
+    Bucket& BucketFor(uint8_t mask, uint32_t index);
+
+    std::vector<Bucket> buckets;            // по возрастанию first
+    size_t hashedRules = 0;
+    size_t prefixedRules = 0;
+    size_t scannedRules = 0;
+};
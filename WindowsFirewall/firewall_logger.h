@@ -203,8 +203,10 @@ public:
                 }
                 logFile << " "
                     << packet.protocol << " "
-                    << packet.sourceIp << ":" << packet.sourcePort << " -> "
-                    << packet.destIp << ":" << packet.destPort << " "
+                    << packet.sourceIp << ":" << packet.sourcePort
+                    << (packet.sourceDomain.empty() ? "" : " (" + packet.sourceDomain + ")") << " -> "
+                    << packet.destIp << ":" << packet.destPort
+                    << (packet.destDomain.empty() ? "" : " (" + packet.destDomain + ")") << " "
                     << "[" << packet.processName << ":" << packet.processId << "] "
                     << FormatSize(packet.size);
 
@@ -249,6 +251,7 @@ private:
         case Protocol::TCP: return "TCP";
         case Protocol::UDP: return "UDP";
         case Protocol::ICMP: return "ICMP";
+        case Protocol::ICMPV6: return "ICMPv6";
         case Protocol::ANY: return "ANY";
         default: return "UNKNOWN";
         }
@@ -5,7 +5,8 @@ enum class Protocol {
     ANY,
     TCP,
     UDP,
-    ICMP
+    ICMP,
+    ICMPV6
 };
 
 enum class RuleAction {
@@ -18,7 +19,19 @@ enum class RuleDirection {
     Outbound
 };
 
+enum class FilterMode {
+    BLACKLIST,  //   
+    WHITELIST   //    
+};
+
 enum class PacketDirection {
     Incoming,
     Outgoing
+};
+
+//    ;      CompiledRule
+enum class ConnectionState : unsigned char {
+    New = 1,            //       
+    Established = 2,    // ,     
+    Related = 4         //  ICMP   
 };
\ No newline at end of file
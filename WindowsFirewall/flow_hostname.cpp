@@ -0,0 +1,430 @@
+#include "flow_hostname.h"
+#include "domain_table.h"
+#include <algorithm>
+#include <string_view>
+
+namespace {
+
+constexpr uint8_t TLS_HANDSHAKE = 0x16;
+constexpr uint8_t TLS_CLIENT_HELLO = 1;
+constexpr uint16_t TLS_EXT_SERVER_NAME = 0;
+constexpr uint8_t TLS_NAME_TYPE_HOST = 0;
+constexpr size_t TLS_RECORD_HEADER = 5;
+constexpr size_t TLS_MAX_RECORD = 16384 + 2048;
+
+uint16_t ReadBE16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t ReadBE32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+// Последовательное чтение с проверкой границ: false — данные кончились
+struct Reader {
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+
+    bool Skip(size_t n) {
+        if (size - pos < n) return false;
+        pos += n;
+        return true;
+    }
+    bool U8(size_t& v) {
+        if (size - pos < 1) return false;
+        v = data[pos++];
+        return true;
+    }
+    bool U16(size_t& v) {
+        if (size - pos < 2) return false;
+        v = ReadBE16(data + pos);
+        pos += 2;
+        return true;
+    }
+    bool U24(size_t& v) {
+        if (size - pos < 3) return false;
+        v = (size_t(data[pos]) << 16) | (size_t(data[pos + 1]) << 8) | data[pos + 2];
+        pos += 3;
+        return true;
+    }
+};
+
+bool AcceptName(std::string_view raw, std::string& name) {
+    if (raw.empty() || raw.size() > 253 || raw[0] == '*') return false;
+    if (!DomainTrie::IsDomainPattern(raw)) return false;
+    name = DomainTrie::Normalize(raw);
+    return true;
+}
+
+bool StartsWithNoCase(std::string_view s, std::string_view prefix) {
+    if (s.size() < prefix.size()) return false;
+    for (size_t i = 0; i < prefix.size(); ++i) {
+        char c = s[i];
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+        if (c != prefix[i]) return false;
+    }
+    return true;
+}
+
+// Сообщение Handshake ClientHello (без записей TLS). endOfInput — за данными ничего нет,
+// и обрезанное сообщение может продолжиться
+HostnameParse ParseClientHelloMessage(const uint8_t* data, size_t size, bool endOfInput, std::string& name) {
+    Reader r{ data, size };
+    size_t type = 0;
+    size_t length = 0;
+    if (!r.U8(type) || !r.U24(length)) {
+        return endOfInput ? HostnameParse::NeedMore : HostnameParse::NotFound;
+    }
+    if (type != TLS_CLIENT_HELLO) return HostnameParse::NotFound;
+    bool complete = size >= 4 + length;
+    if (complete) r.size = 4 + length;      // дальше — уже следующее сообщение
+    // Выход за собранные данные: ждать продолжения, если сообщение ещё не пришло целиком
+    HostnameParse truncatedResult = !complete && endOfInput ? HostnameParse::NeedMore : HostnameParse::NotFound;
+
+    size_t sessionIdLength = 0;
+    size_t cipherSuitesLength = 0;
+    size_t compressionLength = 0;
+    size_t extensionsLength = 0;
+    if (!r.Skip(2 + 32)                                         // версия, random
+        || !r.U8(sessionIdLength) || !r.Skip(sessionIdLength)
+        || !r.U16(cipherSuitesLength) || !r.Skip(cipherSuitesLength)
+        || !r.U8(compressionLength) || !r.Skip(compressionLength)) {
+        return truncatedResult;
+    }
+    if (complete && r.pos == r.size) return HostnameParse::NotFound;   // без расширений
+    if (!r.U16(extensionsLength)) return truncatedResult;
+    if (complete && extensionsLength > r.size - r.pos) return HostnameParse::NotFound;
+
+    while (true) {
+        size_t extensionType = 0;
+        size_t extensionLength = 0;
+        if (complete && r.pos == r.size) return HostnameParse::NotFound;
+        if (!r.U16(extensionType) || !r.U16(extensionLength)) return truncatedResult;
+        if (extensionType != TLS_EXT_SERVER_NAME) {
+            if (!r.Skip(extensionLength)) return truncatedResult;
+            continue;
+        }
+
+        size_t listLength = 0;
+        size_t nameType = 0;
+        size_t nameLength = 0;
+        if (!r.U16(listLength) || !r.U8(nameType) || !r.U16(nameLength)) return truncatedResult;
+        if (nameType != TLS_NAME_TYPE_HOST) return HostnameParse::NotFound;
+        if (r.size - r.pos < nameLength) return truncatedResult;
+        std::string_view raw(reinterpret_cast<const char*>(r.data + r.pos), nameLength);
+        return AcceptName(raw, name) ? HostnameParse::Found : HostnameParse::NotFound;
+    }
+}
+
+} // namespace
+
+HostnameParse ParseTlsClientHello(const uint8_t* data, size_t size, std::string& name) {
+    name.clear();
+    if (size == 0) return HostnameParse::NeedMore;
+    if (data[0] != TLS_HANDSHAKE || (size >= 2 && data[1] != 3)) return HostnameParse::NotFound;
+
+    // ClientHello может быть разбит на несколько записей: собирается тело сообщения Handshake
+    std::vector<uint8_t> handshake;
+    handshake.reserve(size);
+    size_t pos = 0;
+    bool endOfInput = true;     // false — за сообщением идёт запись другого типа
+    while (pos < size) {
+        if (size - pos < TLS_RECORD_HEADER) break;
+        if (data[pos] != TLS_HANDSHAKE || data[pos + 1] != 3) {
+            endOfInput = false;
+            break;
+        }
+        size_t length = ReadBE16(data + pos + 3);
+        if (length == 0 || length > TLS_MAX_RECORD) return HostnameParse::NotFound;
+        size_t available = (std::min)(length, size - pos - TLS_RECORD_HEADER);
+        handshake.insert(handshake.end(), data + pos + TLS_RECORD_HEADER, data + pos + TLS_RECORD_HEADER + available);
+        pos += TLS_RECORD_HEADER + length;
+    }
+
+    return ParseClientHelloMessage(handshake.data(), handshake.size(), endOfInput, name);
+}
+
+HostnameParse ParseTlsHandshakeClientHello(const uint8_t* data, size_t size, std::string& name) {
+    name.clear();
+    return ParseClientHelloMessage(data, size, true, name);
+}
+
+HostnameParse ParseHttpHost(const uint8_t* data, size_t size, std::string& name) {
+    static const std::string_view methods[] = {
+        "GET ", "POST ", "HEAD ", "PUT ", "DELETE ", "OPTIONS ", "PATCH ", "CONNECT ", "TRACE "
+    };
+    name.clear();
+    std::string_view text(reinterpret_cast<const char*>(data), size);
+
+    bool request = false;
+    bool maybeRequest = false;
+    for (const auto& method : methods) {
+        if (text.size() >= method.size()) {
+            if (text.compare(0, method.size(), method) == 0) request = true;
+        }
+        else if (method.compare(0, text.size(), text) == 0) {
+            maybeRequest = true;
+        }
+    }
+    if (!request) return maybeRequest ? HostnameParse::NeedMore : HostnameParse::NotFound;
+
+    size_t headersEnd = text.find("\r\n\r\n");
+    std::string_view headers = headersEnd == std::string_view::npos ? text : text.substr(0, headersEnd + 2);
+    size_t lineStart = headers.find("\r\n");
+    if (lineStart == std::string_view::npos) return HostnameParse::NeedMore;
+    lineStart += 2;
+
+    while (true) {
+        size_t lineEnd = headers.find("\r\n", lineStart);
+        if (lineEnd == std::string_view::npos) break;
+        std::string_view line = headers.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 2;
+        if (!StartsWithNoCase(line, "host:")) continue;
+
+        std::string_view value = line.substr(5);
+        size_t first = value.find_first_not_of(" \t");
+        size_t last = value.find_last_not_of(" \t");
+        if (first == std::string_view::npos) return HostnameParse::NotFound;
+        value = value.substr(first, last - first + 1);
+        if (value[0] == '[') return HostnameParse::NotFound;    // литерал IPv6
+        size_t colon = value.rfind(':');
+        if (colon != std::string_view::npos) value = value.substr(0, colon);
+        return AcceptName(value, name) ? HostnameParse::Found : HostnameParse::NotFound;
+    }
+    return headersEnd == std::string_view::npos ? HostnameParse::NeedMore : HostnameParse::NotFound;
+}
+
+void FlowHostnameTracker::Inspect(FlowState& flow, bool fromLow, uint32_t seq, const uint8_t* payload, size_t size) {
+    if (!flow.clientKnown) {
+        // Первым данные шлёт клиент (ClientHello, запрос); протоколы с приветствием сервера
+        // отсеются разбором
+        flow.clientKnown = true;
+        flow.clientIsLow = fromLow;
+        flow.nextSeq = seq;
+    }
+    if (fromLow != flow.clientIsLow) {
+        // Ответ сервера раньше законченного запроса: ни TLS, ни HTTP так себя не ведут
+        flow.state = State::Unnamed;
+        return;
+    }
+
+    int32_t delta = static_cast<int32_t>(seq - flow.nextSeq);
+    if (delta > 0) {
+        // Пропуск в данных: без пропавшего сегмента начало сообщения не восстановить
+        flow.state = State::Unnamed;
+        return;
+    }
+    size_t overlap = static_cast<size_t>(-static_cast<int64_t>(delta));
+    if (overlap >= size) return;        // повторная передача уже принятых байт
+    payload += overlap;
+    size -= overlap;
+
+    size_t accepted = (std::min)(size, MAX_BUFFER - flow.buffer.size());
+    flow.buffer.insert(flow.buffer.end(), payload, payload + accepted);
+    flow.nextSeq += static_cast<uint32_t>(size);
+    ++flow.segments;
+    stats.inspectedBytes += accepted;
+
+    bool tls = flow.buffer[0] == 0x16;
+    HostnameParse result = tls
+        ? ParseTlsClientHello(flow.buffer.data(), flow.buffer.size(), flow.name)
+        : ParseHttpHost(flow.buffer.data(), flow.buffer.size(), flow.name);
+    if (result == HostnameParse::NeedMore
+        && flow.buffer.size() < MAX_BUFFER && flow.segments < MAX_SEGMENTS) {
+        return;
+    }
+
+    if (result == HostnameParse::Found) {
+        flow.state = State::Named;
+        ++(tls ? stats.tls : stats.http);
+    }
+    else {
+        flow.state = State::Unnamed;
+        flow.name.clear();
+    }
+    std::vector<uint8_t>().swap(flow.buffer);
+}
+
+bool FlowHostnameTracker::OnIPv4Packet(const uint8_t* packet, size_t size, FlowHostname& out) {
+    if (size < 20 || (packet[0] >> 4) != 4) return false;
+    uint8_t protocol = packet[9];
+    if (protocol != 6 && protocol != 17) return false;
+    size_t ihl = (packet[0] & 0x0F) * 4u;
+    size_t total = ReadBE16(packet + 2);
+    if (ihl < 20 || total < ihl) return false;
+    if (ReadBE16(packet + 6) & 0x1FFF) return false;    // не первый фрагмент: заголовка L4 нет
+    bool truncated = total > size;
+    size_t available = (std::min)(total, size);
+    if (available < ihl + 8) return false;
+
+    const uint8_t* l4 = packet + ihl;
+    size_t l4size = available - ihl;
+    uint16_t sourcePort = ReadBE16(l4);
+    uint16_t destPort = ReadBE16(l4 + 2);
+    bool quic = protocol == 17;
+    bool syn = false;
+    bool ack = false;
+    bool finished = false;
+    const uint8_t* payload = nullptr;
+    size_t payloadSize = 0;
+    if (quic) {
+        // Чужой UDP отсеивается до блокировки: новый поток QUIC начинается только пакетом клиента на 443
+        if (destPort != QUIC_PORT && sourcePort != QUIC_PORT) return false;
+        payload = l4 + 8;
+        payloadSize = l4size - 8;
+    }
+    else {
+        if (l4size < 20) return false;
+        size_t dataOffset = (l4[12] >> 4) * 4u;
+        if (dataOffset < 20 || dataOffset > l4size) return false;
+        uint8_t flags = l4[13];
+        syn = (flags & 0x02) != 0;
+        ack = (flags & 0x10) != 0;
+        finished = (flags & 0x05) != 0;     // FIN или RST
+        payload = l4 + dataOffset;
+        payloadSize = l4size - dataOffset;
+    }
+
+    uint32_t sourceIp = ReadBE32(packet + 12);
+    uint32_t destIp = ReadBE32(packet + 16);
+    bool fromLow = sourceIp < destIp || (sourceIp == destIp && sourcePort <= destPort);
+    FlowTuple tuple;
+    tuple.lowIp = fromLow ? sourceIp : destIp;
+    tuple.highIp = fromLow ? destIp : sourceIp;
+    tuple.lowPort = fromLow ? sourcePort : destPort;
+    tuple.highPort = fromLow ? destPort : sourcePort;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = flows.find(tuple);
+    if (it == flows.end()) {
+        if (quic) {
+            QuicInitialHeader header;
+            if (destPort != QUIC_PORT || !ParseQuicInitialHeader(payload, payloadSize, header)) return false;
+        }
+        // Пустые сегменты середины потока не интересны: поток берётся с SYN или с первых данных
+        else if (finished || (payloadSize == 0 && !syn)) {
+            return false;
+        }
+        if (flows.size() >= MAX_FLOWS) EvictLocked();
+        it = flows.emplace(tuple, FlowState()).first;
+        it->second.order = nextOrder++;
+        insertionOrder.push_back({ it->second.order, tuple });
+        if (insertionOrder.size() > 2 * flows.size() + 1024) CompactOrderLocked();
+        ++stats.flows;
+    }
+
+    FlowState& flow = it->second;
+    if (flow.state == State::Pending) {
+        if (syn && !ack) {
+            flow.clientKnown = true;
+            flow.clientIsLow = fromLow;
+            flow.nextSeq = ReadBE32(l4 + 4) + 1;
+        }
+        else if (payloadSize > 0) {
+            if (truncated) ++stats.truncated;
+            if (quic) InspectQuic(flow, fromLow, payload, payloadSize);
+            else Inspect(flow, fromLow, ReadBE32(l4 + 4), payload, payloadSize);
+            if (flow.state == State::Unnamed) ++stats.unnamed;
+        }
+    }
+
+    bool named = flow.state == State::Named;
+    if (named) {
+        out.name = flow.name;
+        out.serverIsSource = fromLow != flow.clientIsLow;
+    }
+    if (finished) flows.erase(it);
+    return named;
+}
+
+void FlowHostnameTracker::InspectQuic(FlowState& flow, bool fromLow, const uint8_t* datagram, size_t size) {
+    if (!flow.clientKnown) {
+        flow.clientKnown = true;
+        flow.clientIsLow = fromLow;
+    }
+    // Initial сервера несёт ServerHello без имени: его датаграммы только пропускаются
+    if (fromLow != flow.clientIsLow) return;
+    ++flow.segments;
+    stats.inspectedBytes += size;
+
+    // Пакеты в датаграмме склеены; за Initial могут идти 0-RTT, их ключами Initial не открыть
+    bool malformed = false;
+    size_t offset = 0;
+    QuicInitialHeader header;
+    while (offset < size && ParseQuicInitialHeader(datagram + offset, size - offset, header)) {
+        if (!flow.quic) {
+            // Ключи — по DCID первого пакета клиента; повторные Initial того же соединения
+            // защищены ими же
+            QuicInitialKeys keys;
+            DeriveQuicInitialKeys(header.dcid, header.dcidLength, true, keys);
+            flow.quic = std::make_unique<QuicFlow>(keys);
+        }
+        uint64_t packetNumber = 0;
+        QuicFlow& quic = *flow.quic;
+        if (quic.protection.Open(datagram + offset, header, quic.frames, packetNumber)
+            && !quic.crypto.AddFrames(quic.frames.data(), quic.frames.size())) {
+            malformed = true;
+            break;
+        }
+        offset += header.packetLength;
+    }
+
+    HostnameParse result = HostnameParse::NeedMore;
+    if (malformed) {
+        result = HostnameParse::NotFound;
+    }
+    else if (flow.quic && flow.quic->crypto.ContiguousSize() > 0) {
+        result = ParseTlsHandshakeClientHello(flow.quic->crypto.Data(), flow.quic->crypto.ContiguousSize(), flow.name);
+    }
+    if (result == HostnameParse::NeedMore && flow.segments < MAX_SEGMENTS) return;
+
+    if (result == HostnameParse::Found) {
+        flow.state = State::Named;
+        ++stats.quic;
+    }
+    else {
+        flow.state = State::Unnamed;
+        flow.name.clear();
+    }
+    flow.quic.reset();
+}
+
+// Таблица полна: вытесняется самый старый поток; записи, удалённые по FIN/RST, пропускаются
+void FlowHostnameTracker::EvictLocked() {
+    while (!insertionOrder.empty()) {
+        std::pair<uint64_t, FlowTuple> oldest = insertionOrder.front();
+        insertionOrder.pop_front();
+        auto it = flows.find(oldest.second);
+        if (it != flows.end() && it->second.order == oldest.first) {
+            flows.erase(it);
+            return;
+        }
+    }
+}
+
+// Закрытые потоки оставляют в очереди устаревшие записи — очередь чистится, чтобы не росла
+void FlowHostnameTracker::CompactOrderLocked() {
+    std::deque<std::pair<uint64_t, FlowTuple>> live;
+    for (const auto& item : insertionOrder) {
+        auto it = flows.find(item.second);
+        if (it != flows.end() && it->second.order == item.first) live.push_back(item);
+    }
+    insertionOrder.swap(live);
+}
+
+size_t FlowHostnameTracker::Size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return flows.size();
+}
+
+FlowHostnameTracker::Stats FlowHostnameTracker::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void FlowHostnameTracker::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    flows.clear();
+    insertionOrder.clear();
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "quic_initial.h"
+
+enum class HostnameParse {
+    Found,          // имя найдено
+    NeedMore,       // начало похоже на ClientHello или запрос, но данных пока не хватает
+    NotFound        // не TLS/HTTP, данные испорчены или имени в сообщении нет
+};
+
+// SNI из TLS ClientHello: данные клиента с начала потока (записи TLS, возможно обрезанные).
+// Имя нормализовано (нижний регистр); IP-адрес вместо имени не считается именем.
+HostnameParse ParseTlsClientHello(const uint8_t* data, size_t size, std::string& name);
+// То же для сообщения Handshake без записей TLS (данные кадров CRYPTO в QUIC)
+HostnameParse ParseTlsHandshakeClientHello(const uint8_t* data, size_t size, std::string& name);
+// Host из запроса HTTP/1.x, без порта
+HostnameParse ParseHttpHost(const uint8_t* data, size_t size, std::string& name);
+
+// Имя сервера, к которому относится поток
+struct FlowHostname {
+    std::string name;
+    bool serverIsSource = false;    // сервер — источник пакета (пакет от сервера к клиенту)
+};
+
+// Имя сервера потока по первым пакетам данных: SNI из TLS ClientHello или Host из HTTP/1.x для TCP,
+// SNI из пакетов Initial для QUIC (UDP/443). Содержимое разбирается один раз на поток: после
+// классификации пакет потока стоит одного поиска в хэш-таблице. Разорванный на сегменты ClientHello
+// собирается по порядку seq в буфере не больше MAX_BUFFER байт; после MAX_SEGMENTS сегментов
+// (датаграмм) без результата поток помечается как безымянный. Ключи Initial выводятся один раз
+// на поток и освобождаются вместе с буфером после классификации.
+class FlowHostnameTracker {
+public:
+    struct Stats {
+        uint64_t flows = 0;             // потоков, взятых на классификацию
+        uint64_t tls = 0;               // имя из SNI
+        uint64_t http = 0;              // имя из Host
+        uint64_t quic = 0;              // имя из SNI пакетов Initial QUIC
+        uint64_t unnamed = 0;           // классифицированы без имени
+        uint64_t inspectedBytes = 0;    // байтов данных, прошедших через разбор
+        uint64_t truncated = 0;         // сегменты ожидающих потоков, обрезанные snaplen
+    };
+
+    // IPv4-пакет целиком (без канального заголовка). true — имя потока известно.
+    bool OnIPv4Packet(const uint8_t* packet, size_t size, FlowHostname& out);
+
+    size_t Size() const;
+    Stats GetStats() const;
+    void Clear();
+
+    static constexpr size_t MAX_FLOWS = 16384;
+    static constexpr size_t MAX_BUFFER = 4096;
+    static constexpr size_t MAX_SEGMENTS = 4;
+    static constexpr uint16_t QUIC_PORT = 443;
+
+private:
+    enum class State : uint8_t { Pending, Named, Unnamed };
+
+    // Поток без учёта направления: меньшая пара (адрес, порт) — "low"
+    struct FlowTuple {
+        uint32_t lowIp = 0;
+        uint32_t highIp = 0;
+        uint16_t lowPort = 0;
+        uint16_t highPort = 0;
+        bool operator==(const FlowTuple& o) const {
+            return lowIp == o.lowIp && highIp == o.highIp && lowPort == o.lowPort && highPort == o.highPort;
+        }
+    };
+    struct FlowTupleHash {
+        size_t operator()(const FlowTuple& t) const {
+            uint64_t a = (uint64_t(t.lowIp) << 32) | t.highIp;
+            uint64_t b = (uint64_t(t.lowPort) << 16) | t.highPort;
+            return std::hash<uint64_t>()(a * 0x9E3779B97F4A7C15ull ^ b);
+        }
+    };
+    // Состояние QUIC до классификации: ключи Initial клиента и собранные кадры CRYPTO
+    struct QuicFlow {
+        explicit QuicFlow(const QuicInitialKeys& keys) : protection(keys) {}
+        QuicInitialProtection protection;
+        QuicCryptoStream crypto;
+        std::vector<uint8_t> frames;    // расшифрованный пакет, переиспользуется
+    };
+
+    struct FlowState {
+        State state = State::Pending;
+        bool clientKnown = false;
+        bool clientIsLow = false;
+        uint8_t segments = 0;
+        uint32_t nextSeq = 0;           // следующий ожидаемый байт клиента
+        uint64_t order = 0;             // номер вставки, см. insertionOrder
+        std::vector<uint8_t> buffer;    // данные клиента TCP до классификации
+        std::unique_ptr<QuicFlow> quic;
+        std::string name;
+    };
+
+    void Inspect(FlowState& flow, bool fromLow, uint32_t seq, const uint8_t* payload, size_t size);
+    void InspectQuic(FlowState& flow, bool fromLow, const uint8_t* datagram, size_t size);
+    void EvictLocked();
+    void CompactOrderLocked();
+
+    mutable std::mutex mutex;
+    std::unordered_map<FlowTuple, FlowState, FlowTupleHash> flows;
+    std::deque<std::pair<uint64_t, FlowTuple>> insertionOrder;     // старые в начале
+    uint64_t nextOrder = 0;
+    Stats stats;
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include "firewall_types.h"
+#include "app_identity.h"
+#include "service_names.h"
+
+// Компактное описание пакета для сопоставления с правилами.
+// В отличие от PacketInfo не содержит строк с адресами и не зависит от Windows.
+struct FlowKey {
+    uint32_t sourceIp = 0;      // IPv4, порядок байтов хоста
+    uint32_t destIp = 0;
+    uint16_t sourcePort = 0;
+    uint16_t destPort = 0;
+    uint8_t ipProtocol = 0;     // номер протокола IP (6 = TCP, 17 = UDP, 1 = ICMP, 58 = ICMPv6)
+    // ICMP и ICMPv6: эхо несёт идентификатор в обоих портах, ошибка — порты исходного потока
+    uint8_t icmpType = 0;
+    uint8_t icmpCode = 0;
+    uint8_t relatedProtocol = 0;        // ошибка ICMP: протокол исходного потока; 0 — не ошибка
+    uint32_t relatedSourceIp = 0;       // ошибка ICMP: адреса исходного пакета (IPv4 или IPv6 по ipv6)
+    uint32_t relatedDestIp = 0;
+    uint8_t relatedSourceIp6[16] = {};
+    uint8_t relatedDestIp6[16] = {};
+    uint8_t tcpFlags = 0;               // TCP_FLAG_*
+    bool ipv6 = false;                  // адреса в sourceIp6/destIp6, sourceIp/destIp не заполнены
+    uint8_t sourceIp6[16] = {};         // сетевой порядок байтов
+    uint8_t destIp6[16] = {};
+    PacketDirection direction = PacketDirection::Incoming;
+    uint32_t adapter = 0;               // IPv4 адаптера захвата (PacketInfo::adapterIp); 0 — неизвестен
+    uint32_t size = 0;
+    const AppIdentity* app = nullptr;   // nullptr — приложение неизвестно
+    // Имя сервера из содержимого потока (SNI, Host); для этой стороны важнее DNS
+    std::string_view serverName;
+    bool serverIsSource = false;        // имя относится к sourceIp, иначе к destIp
+    ServiceId service = UNKNOWN_SERVICE;    // по сигнатуре содержимого, иначе по известному порту
+    // Заполняет ConnectionTracker; без него каждый пакет — новое соединение своего направления
+    ConnectionState state = ConnectionState::New;
+    bool fromResponder = false;         // пакет от принимающей стороны соединения
+
+    // Направление соединения — направление его первого пакета
+    PacketDirection ConnectionDirection() const {
+        if (!fromResponder) return direction;
+        return direction == PacketDirection::Incoming ? PacketDirection::Outgoing : PacketDirection::Incoming;
+    }
+};
+
+constexpr uint8_t TCP_FLAG_FIN = 0x01;
+constexpr uint8_t TCP_FLAG_SYN = 0x02;
+constexpr uint8_t TCP_FLAG_RST = 0x04;
+constexpr uint8_t TCP_FLAG_PSH = 0x08;
+constexpr uint8_t TCP_FLAG_ACK = 0x10;
+constexpr uint8_t TCP_FLAG_URG = 0x20;
+constexpr uint8_t TCP_FLAG_ECE = 0x40;
+constexpr uint8_t TCP_FLAG_CWR = 0x80;
+
+inline uint8_t ProtocolToIpNumber(Protocol proto) {
+    switch (proto) {
+    case Protocol::TCP: return 6;
+    case Protocol::UDP: return 17;
+    case Protocol::ICMP: return 1;
+    case Protocol::ICMPV6: return 58;
+    default: return 0; // ANY
+    }
+}
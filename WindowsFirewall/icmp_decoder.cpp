@@ -0,0 +1,198 @@
+#include "icmp_decoder.h"
+#include <cstring>
+
+static uint16_t ReadBE16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static uint32_t ReadBE32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+// Порты исходного пакета: TCP/UDP — первые 4 байта заголовка, эхо ICMP — идентификатор.
+// RFC 792 гарантирует 8 байт данных исходного пакета, этого достаточно.
+static void ReadRelatedPorts(const uint8_t* l4, size_t size, IcmpInfo& out) {
+    if (out.relatedProtocol == 6 || out.relatedProtocol == 17 || out.relatedProtocol == 132) {
+        if (size < 4) return;
+        out.relatedSourcePort = ReadBE16(l4);
+        out.relatedDestPort = ReadBE16(l4 + 2);
+    }
+    else if (out.relatedProtocol == IP_PROTOCOL_ICMP || out.relatedProtocol == IP_PROTOCOL_ICMPV6) {
+        if (size < 6) return;
+        uint8_t type = l4[0];
+        bool echo = out.relatedProtocol == IP_PROTOCOL_ICMP ? (type == 8 || type == 0) : (type == 128 || type == 129);
+        if (!echo) return;
+        out.relatedSourcePort = out.relatedDestPort = ReadBE16(l4 + 4);
+    }
+}
+
+bool DecodeIcmp(const uint8_t* data, size_t size, IcmpInfo& out) {
+    out = IcmpInfo();
+    if (size < 8) return false;
+    out.type = data[0];
+    out.code = data[1];
+    switch (out.type) {
+    case 0:     // echo-reply
+    case 8:     // echo-request
+        out.isEcho = true;
+        out.echoId = ReadBE16(data + 4);
+        return true;
+    case 3:     // unreachable
+    case 4:     // source-quench
+    case 5:     // redirect
+    case 11:    // time-exceeded
+    case 12:    // param-problem
+        out.isError = true;
+        break;
+    default:
+        return true;
+    }
+
+    const uint8_t* ip = data + 8;
+    size_t ipSize = size - 8;
+    if (ipSize < 20 || (ip[0] >> 4) != 4) return true;
+    size_t ihl = (ip[0] & 0x0F) * 4u;
+    if (ihl < 20 || ihl > ipSize) return true;
+    out.hasRelated = true;
+    out.relatedProtocol = ip[9];
+    out.relatedSourceIp = ReadBE32(ip + 12);
+    out.relatedDestIp = ReadBE32(ip + 16);
+    if ((ReadBE16(ip + 6) & 0x1FFF) == 0) {
+        ReadRelatedPorts(ip + ihl, ipSize - ihl, out);
+    }
+    return true;
+}
+
+bool DecodeIcmpV6(const uint8_t* data, size_t size, IcmpInfo& out) {
+    out = IcmpInfo();
+    if (size < 8) return false;
+    out.type = data[0];
+    out.code = data[1];
+    if (out.type == 128 || out.type == 129) {
+        out.isEcho = true;
+        out.echoId = ReadBE16(data + 4);
+        return true;
+    }
+    // Ошибки ICMPv6 — типы 0..127 (RFC 4443)
+    if (out.type >= 128) return true;
+    out.isError = true;
+
+    const uint8_t* ip = data + 8;
+    size_t ipSize = size - 8;
+    if (ipSize < 40 || (ip[0] >> 4) != 6) return true;
+    out.hasRelated = true;
+    std::memcpy(out.relatedSourceIp6, ip + 8, 16);
+    std::memcpy(out.relatedDestIp6, ip + 24, 16);
+    size_t offset = 0;
+    if (FindIPv6Transport(ip, ipSize, out.relatedProtocol, offset)) {
+        ReadRelatedPorts(ip + offset, ipSize - offset, out);
+    }
+    else {
+        out.relatedProtocol = ip[6];
+    }
+    return true;
+}
+
+bool FindIPv6Transport(const uint8_t* packet, size_t size, uint8_t& protocol, size_t& offset) {
+    if (size < 40) return false;
+    uint8_t next = packet[6];
+    size_t pos = 40;
+    // Больше восьми заголовков расширения в настоящем трафике не бывает
+    for (int i = 0; i < 8; ++i) {
+        switch (next) {
+        case 0:     // hop-by-hop
+        case 43:    // routing
+        case 60:    // destination options
+            if (pos + 8 > size) return false;
+            next = packet[pos];
+            pos += (packet[pos + 1] + 1u) * 8;
+            break;
+        case 44:    // fragment
+            if (pos + 8 > size) return false;
+            if (ReadBE16(packet + pos + 2) & 0xFFF8) return false;
+            next = packet[pos];
+            pos += 8;
+            break;
+        case 51:    // AH
+            if (pos + 8 > size) return false;
+            next = packet[pos];
+            pos += (packet[pos + 1] + 2u) * 4;
+            break;
+        case 59:    // no next header
+            return false;
+        default:
+            if (pos > size) return false;
+            protocol = next;
+            offset = pos;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char* UnreachableCode(uint8_t code, bool v6) {
+    if (v6) {
+        switch (code) {
+        case 0: return "no-route";
+        case 1: return "admin-prohibited";
+        case 3: return "address";
+        case 4: return "port";
+        default: return nullptr;
+        }
+    }
+    switch (code) {
+    case 0: return "net";
+    case 1: return "host";
+    case 2: return "protocol";
+    case 3: return "port";
+    case 4: return "frag-needed";
+    case 13: return "admin-prohibited";
+    default: return nullptr;
+    }
+}
+
+static const char* TypeName(uint8_t type, bool v6) {
+    if (v6) {
+        switch (type) {
+        case 1: return "unreachable";
+        case 2: return "packet-too-big";
+        case 3: return "time-exceeded";
+        case 4: return "param-problem";
+        case 128: return "echo-request";
+        case 129: return "echo-reply";
+        case 133: return "router-solicit";
+        case 134: return "router-advert";
+        case 135: return "neighbor-solicit";
+        case 136: return "neighbor-advert";
+        case 137: return "redirect";
+        default: return nullptr;
+        }
+    }
+    switch (type) {
+    case 0: return "echo-reply";
+    case 3: return "unreachable";
+    case 4: return "source-quench";
+    case 5: return "redirect";
+    case 8: return "echo-request";
+    case 9: return "router-advert";
+    case 10: return "router-solicit";
+    case 11: return "time-exceeded";
+    case 12: return "param-problem";
+    case 13: return "timestamp-request";
+    case 14: return "timestamp-reply";
+    default: return nullptr;
+    }
+}
+
+std::string DescribeIcmp(uint8_t type, uint8_t code, bool v6) {
+    const char* name = TypeName(type, v6);
+    if (!name) return "type " + std::to_string(type) + "/" + std::to_string(code);
+    std::string result = name;
+    bool unreachable = v6 ? type == 1 : type == 3;
+    if (unreachable) {
+        const char* detail = UnreachableCode(code, v6);
+        result += "/";
+        result += detail ? detail : std::to_string(code);
+    }
+    return result;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Разбор заголовков ICMP и ICMPv6 для записи о потоке и правил.
+// Эхо-запрос и ответ несут идентификатор, который служит псевдопортом: запрос и ответ
+// одного ping складываются в один поток, а разные ping — в разные. Сообщение об ошибке
+// (недостижимость, превышение TTL, "пакет слишком велик") несёт начало исходного пакета;
+// по нему ошибка относится к потоку, который её вызвал.
+struct IcmpInfo {
+    uint8_t type = 0;
+    uint8_t code = 0;
+    bool isEcho = false;            // запрос или ответ эха, echoId заполнен
+    bool isError = false;
+    uint16_t echoId = 0;
+
+    // Исходный поток ошибки — в направлении исходного пакета, то есть обратном ошибке
+    bool hasRelated = false;
+    uint8_t relatedProtocol = 0;
+    uint32_t relatedSourceIp = 0;   // IPv4, порядок байтов хоста
+    uint32_t relatedDestIp = 0;
+    uint8_t relatedSourceIp6[16] = {};
+    uint8_t relatedDestIp6[16] = {};
+    uint16_t relatedSourcePort = 0; // порты TCP/UDP или идентификатор эха
+    uint16_t relatedDestPort = 0;
+};
+
+constexpr uint8_t IP_PROTOCOL_ICMP = 1;
+constexpr uint8_t IP_PROTOCOL_ICMPV6 = 58;
+
+// data — заголовок ICMP (после заголовка IP), size — сколько байт захвачено.
+// false — заголовок короче 8 байт
+bool DecodeIcmp(const uint8_t* data, size_t size, IcmpInfo& out);
+bool DecodeIcmpV6(const uint8_t* data, size_t size, IcmpInfo& out);
+
+// Заголовок транспортного уровня IPv6-пакета за цепочкой заголовков расширения.
+// false — цепочка обрезана или пакет — не первый фрагмент (заголовка L4 в нём нет)
+bool FindIPv6Transport(const uint8_t* packet, size_t size, uint8_t& protocol, size_t& offset);
+
+// "echo-request", "unreachable/frag-needed", "time-exceeded"; неизвестные — "type 42/0"
+std::string DescribeIcmp(uint8_t type, uint8_t code, bool v6);
@@ -0,0 +1,150 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Переносимый разбор IPv4 (без winsock), адреса в порядке байтов хоста
+
+inline bool ParseIPv4(std::string_view str, uint32_t& out) {
+    uint32_t result = 0;
+    int octets = 0;
+    size_t i = 0;
+    while (octets < 4) {
+        if (i >= str.size() || str[i] < '0' || str[i] > '9') return false;
+        uint32_t value = 0;
+        size_t digits = 0;
+        while (i < str.size() && str[i] >= '0' && str[i] <= '9') {
+            value = value * 10 + static_cast<uint32_t>(str[i] - '0');
+            if (++digits > 3 || value > 255) return false;
+            ++i;
+        }
+        result = (result << 8) | value;
+        ++octets;
+        if (octets < 4) {
+            if (i >= str.size() || str[i] != '.') return false;
+            ++i;
+        }
+    }
+    if (i != str.size()) return false;
+    out = result;
+    return true;
+}
+
+inline uint32_t PrefixToMask(int prefixLength) {
+    if (prefixLength <= 0) return 0;
+    if (prefixLength >= 32) return 0xFFFFFFFFu;
+    return 0xFFFFFFFFu << (32 - prefixLength);
+}
+
+// "a.b.c.d" или "a.b.c.d/n"
+inline bool ParseIPv4Prefix(std::string_view str, uint32_t& network, uint32_t& mask) {
+    size_t slash = str.find('/');
+    uint32_t addr = 0;
+    if (!ParseIPv4(str.substr(0, slash), addr)) return false;
+    int prefixLength = 32;
+    if (slash != std::string_view::npos) {
+        std::string_view len = str.substr(slash + 1);
+        if (len.empty() || len.size() > 2) return false;
+        prefixLength = 0;
+        for (char c : len) {
+            if (c < '0' || c > '9') return false;
+            prefixLength = prefixLength * 10 + (c - '0');
+        }
+        if (prefixLength > 32) return false;
+    }
+    mask = PrefixToMask(prefixLength);
+    network = addr & mask;
+    return true;
+}
+
+inline std::string FormatIPv4(uint32_t addr) {
+    return std::to_string((addr >> 24) & 0xFF) + "." +
+        std::to_string((addr >> 16) & 0xFF) + "." +
+        std::to_string((addr >> 8) & 0xFF) + "." +
+        std::to_string(addr & 0xFF);
+}
+
+// IPv6 в сетевом порядке байтов: полная форма, сокращение "::" и IPv4 в конце ("::ffff:1.2.3.4")
+inline bool ParseIPv6(std::string_view str, uint8_t out[16]) {
+    uint16_t head[8] = {};
+    uint16_t tail[8] = {};
+    int headCount = 0;
+    int tailCount = 0;
+    bool compressed = false;
+    size_t i = 0;
+    if (str.size() >= 2 && str[0] == ':' && str[1] == ':') {
+        compressed = true;
+        i = 2;
+    }
+    while (i < str.size()) {
+        int count = headCount + tailCount;
+        // IPv4 в последних 32 битах
+        size_t end = str.find(':', i);
+        std::string_view group = str.substr(i, end == std::string_view::npos ? std::string_view::npos : end - i);
+        if (end == std::string_view::npos && group.find('.') != std::string_view::npos) {
+            uint32_t v4 = 0;
+            if (count > 6 || !ParseIPv4(group, v4)) return false;
+            uint16_t* groups = compressed ? tail : head;
+            int& n = compressed ? tailCount : headCount;
+            groups[n++] = static_cast<uint16_t>(v4 >> 16);
+            groups[n++] = static_cast<uint16_t>(v4);
+            i = str.size();
+            break;
+        }
+        if (group.empty() || group.size() > 4 || count >= 8) return false;
+        uint16_t value = 0;
+        for (char c : group) {
+            int digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+            else return false;
+            value = static_cast<uint16_t>((value << 4) | digit);
+        }
+        if (compressed) tail[tailCount++] = value;
+        else head[headCount++] = value;
+        i += group.size();
+        if (i == str.size()) break;
+        // ':' между группами или "::"
+        ++i;
+        if (i < str.size() && str[i] == ':') {
+            if (compressed) return false;
+            compressed = true;
+            ++i;
+        }
+        else if (i == str.size()) {
+            return false;
+        }
+    }
+    int total = headCount + tailCount;
+    if (compressed ? total > 7 : total != 8) return false;
+    uint16_t groups[8] = {};
+    for (int k = 0; k < headCount; ++k) groups[k] = head[k];
+    for (int k = 0; k < tailCount; ++k) groups[8 - tailCount + k] = tail[k];
+    for (int k = 0; k < 8; ++k) {
+        out[2 * k] = static_cast<uint8_t>(groups[k] >> 8);
+        out[2 * k + 1] = static_cast<uint8_t>(groups[k]);
+    }
+    return true;
+}
+
+// "addr" или "addr/n"; биты хоста обнуляются
+inline bool ParseIPv6Prefix(std::string_view str, uint8_t network[16], int& prefixLength) {
+    size_t slash = str.find('/');
+    if (!ParseIPv6(str.substr(0, slash), network)) return false;
+    prefixLength = 128;
+    if (slash != std::string_view::npos) {
+        std::string_view len = str.substr(slash + 1);
+        if (len.empty() || len.size() > 3) return false;
+        prefixLength = 0;
+        for (char c : len) {
+            if (c < '0' || c > '9') return false;
+            prefixLength = prefixLength * 10 + (c - '0');
+        }
+        if (prefixLength > 128) return false;
+    }
+    for (int bit = prefixLength; bit < 128; ++bit) {
+        network[bit / 8] &= static_cast<uint8_t>(~(0x80u >> (bit % 8)));
+    }
+    return true;
+}
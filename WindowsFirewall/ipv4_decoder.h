@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Поля заголовков IPv4 и TCP/UDP, нужные записи о пакете и правилам.
+// Пачка пакетов разбирается по 8 за раз (AVX2): заголовки транспонируются в векторы по словам,
+// поля выделяются сдвигами и масками во всех полосах сразу, контрольная сумма заголовка
+// считается так же. Пакеты с опциями IP, обрезанные и не IPv4 разбираются по одному.
+struct IPv4Summary {
+    bool valid = false;             // false — не IPv4 или заголовок обрезан, остальные поля пусты
+    bool checksumValid = false;     // контрольная сумма заголовка сошлась
+    bool hasPorts = false;          // TCP/UDP, порты захвачены и пакет — первый фрагмент
+    uint8_t headerLength = 0;       // байт
+    uint8_t protocol = 0;
+    uint8_t tcpFlags = 0;
+    uint16_t totalLength = 0;
+    uint16_t fragment = 0;          // флаги и смещение, как в заголовке
+    uint32_t sourceIp = 0;          // порядок байтов хоста
+    uint32_t destIp = 0;
+    uint16_t sourcePort = 0;
+    uint16_t destPort = 0;
+
+    bool MoreFragments() const { return (fragment & 0x2000) != 0; }
+    uint16_t FragmentOffset() const { return static_cast<uint16_t>((fragment & 0x1FFF) * 8u); }
+    bool IsFragment() const { return (fragment & 0x3FFF) != 0; }
+};
+
+// Столько байт пакета нужно векторному разбору: заголовок без опций и флаги TCP
+constexpr size_t IPV4_BATCH_MIN_BYTES = 34;
+
+// ip — начало заголовка IP, size — сколько байт захвачено. Образец для пачек и запасной путь.
+// false — не IPv4 или заголовок обрезан
+bool DecodeIPv4(const uint8_t* ip, size_t size, IPv4Summary& out);
+
+// out[i] — то же, что DecodeIPv4(packets[i], sizes[i], out[i]). Возвращает, сколько пакетов
+// разобрано векторно; без AVX2 все разбираются по одному
+size_t DecodeIPv4Batch(const uint8_t* const* packets, const size_t* sizes, size_t count, IPv4Summary* out);
@@ -14,6 +14,8 @@
 #include <comdef.h>
 #include <tlhelp32.h>
 #include "rule_manager.h"
+#include "domain_table.h"
+#include "ip_utils.h"
 
 
 #pragma comment(lib, "wbemuuid.lib")
@@ -82,13 +84,24 @@ void StartBlockerProcess()
     if (daemonPath.empty()) return; // Не найден
 
     if (IsBlockerRunning()) return;
+    // Режим фильтрации, сохранённый GUI; сменённый позже демон читает из filter_mode.json сам
+    std::wstring commandLine = L"\"" + daemonPath + L"\"";
+    if (RuleManager::Instance().GetFilterMode() == FilterMode::WHITELIST) commandLine += L" --whitelist";
     STARTUPINFOW si = { sizeof(si) };
     PROCESS_INFORMATION pi;
-    if (CreateProcessW(daemonPath.c_str(), NULL, NULL, NULL, FALSE, DETACHED_PROCESS, NULL, NULL, &si, &pi)) {
+    if (CreateProcessW(daemonPath.c_str(), &commandLine[0], NULL, NULL, FALSE, DETACHED_PROCESS, NULL, NULL, &si, &pi)) {
         CloseHandle(pi.hProcess);
         CloseHandle(pi.hThread);
     }
 }
+// Демон сразу ставит правила, дописанные в журнал (RuleManager::AddTemporaryRule), а не через
+// интервал; не запущен — правила прочтёт при старте
+void NotifyBlockerRulesChanged() {
+    HANDLE hRulesEvent = OpenEventW(EVENT_MODIFY_STATE, FALSE, L"Global\\FirewallDaemonRulesChangedEvent");
+    if (!hRulesEvent) return;
+    SetEvent(hRulesEvent);
+    CloseHandle(hRulesEvent);
+}
 // Остановка процесса по имени
 void StopBlockerProcess() {
     // 1. Открываем Event для сигнала остановки
@@ -122,15 +135,11 @@ void StopBlockerProcess() {
     }
 }
 
+// Имя из перехваченных ответов DNS (IpDomainTable), без сетевых запросов
 std::string GetDomainByIp(const std::string& ip) {
-    if (ip.empty() || ip == "Unknown") return "";
-    char host[NI_MAXHOST] = { 0 };
-    sockaddr_in sa = {};
-    sa.sin_family = AF_INET;
-    inet_pton(AF_INET, ip.c_str(), &(sa.sin_addr));
-    sa.sin_port = 0;
-    int res = getnameinfo((sockaddr*)&sa, sizeof(sa), host, NI_MAXHOST, nullptr, 0, NI_NAMEREQD);
-    return (res == 0) ? std::string(host) : "";
+    uint32_t addr = 0;
+    if (!ParseIPv4(ip, addr)) return "";
+    return IpDomainTable::Instance().LookupName(addr);
 }
 
 std::string TimeTToString(const time_t& time) {
@@ -188,6 +197,7 @@ std::wstring MainWindow::StringToWString(const std::string& str) {
 }
 
 MainWindow::MainWindow() : hwnd(nullptr), hInstance(nullptr), adapterInfoLabel(nullptr) {
+    settings.filterMode = RuleManager::Instance().GetFilterMode();
     StartBlockerProcess();
 }
 
@@ -741,7 +751,7 @@ void MainWindow::UpdateGroupedPacketsNoDuplicates() {
             }
 
             std::vector<std::wstring> items;
-            items.reserve(8);
+            items.reserve(11);
             items.push_back(packet.direction == PacketDirection::Incoming ? L"Входящий" : L"Исходящий");
             items.push_back(StringToWString(packet.sourceIp));
             items.push_back(std::to_wstring(packet.sourcePort));
@@ -751,6 +761,8 @@ void MainWindow::UpdateGroupedPacketsNoDuplicates() {
             items.push_back(std::to_wstring(packet.processId));
             items.push_back(StringToWString(packet.processName));
             items.push_back(packet.isBlocked ? L"Заблокирован" : L"Разрешен");
+            items.push_back(StringToWString(packet.serverName));
+            items.push_back(StringToWString(packet.service));
 
             connectionsListView.AddItem(items);
             displayedKeys.insert(key);
@@ -938,6 +950,9 @@ void MainWindow::OnStopCapture() {
         packetInterceptor.StopCapture();
         isCapturing = false;
 
+        // Поток захвата завершён — его счётчики правил уже слиты, сохраняем
+        RuleManager::Instance().SaveRuleStats();
+
         // Получаем количество пакетов из вашей структуры данных
         size_t packetCount = groupedPackets.size();
 
@@ -1206,7 +1221,9 @@ bool MainWindow::InitializeConnectionsList(int yPosition) {
         {L"Протокол", 80},        // 5
 		{L"PID процесса", 80}, // 6
         {L"Процесс", 150},         // 7
-        { L"Статус", 80 }           // 8
+        { L"Статус", 80 },          // 8
+        { L"Хост", 150 },           // 9: SNI или Host потока
+        { L"Служба", 90 }           // 10: по сигнатуре содержимого или порту
     };
 
     for (int i = 0; i < _countof(columns); i++) {
@@ -1245,7 +1262,7 @@ void MainWindow::UpdateGroupedPackets() {
     for (size_t i = start; i < total; ++i) {
         const auto& packet = *lastPackets[i];
         std::vector<std::wstring> items;
-        items.reserve(8);
+        items.reserve(11);
 
         items.push_back(packet.direction == PacketDirection::Incoming ? L"Входящий" : L"Исходящий");
         items.push_back(StringToWString(packet.sourceIp));
@@ -1256,6 +1273,8 @@ void MainWindow::UpdateGroupedPackets() {
         items.push_back(std::to_wstring(packet.processId));
         items.push_back(StringToWString(packet.processName));
         items.push_back(packet.isBlocked ? L"Заблокирован" : L"Разрешен");
+        items.push_back(StringToWString(packet.serverName));
+        items.push_back(StringToWString(packet.service));
 
         connectionsListView.AddItem(items);
     }
@@ -1282,6 +1301,10 @@ bool MainWindow::OnPacketCaptured(const PacketInfo& packet) {
         groupInfo.processName = packet.processName;
         groupInfo.sourcePort = packet.sourcePort;
         groupInfo.destPort = packet.destPort;
+        groupInfo.sourceDomain = packet.sourceDomain;
+        groupInfo.destDomain = packet.destDomain;
+        groupInfo.serverName = packet.serverName;
+        groupInfo.service = packet.service;
         groupInfo.direction = packet.direction;
         groupInfo.processPath = GetProcessPath(packet.processId);
         groupInfo.isBlocked = packet.isBlocked;
@@ -1316,6 +1339,9 @@ bool MainWindow::OnPacketCaptured(const PacketInfo& packet) {
                 groupInfo.processPath = it->second.processPath;
                 groupInfo.totalSize = it->second.totalSize + packet.size;
                 groupInfo.packetCount = it->second.packetCount + 1;
+                // Имя сервера известно не с первого пакета и не во всех пакетах группы
+                if (groupInfo.serverName.empty()) groupInfo.serverName = it->second.serverName;
+                if (groupInfo.service.empty()) groupInfo.service = it->second.service;
             }
 
             groupedPackets[key] = groupInfo;
@@ -1465,12 +1491,21 @@ void MainWindow::CopyToClipboard(const std::string& text) {
     CloseClipboard();
 }
 
+// Временное правило дописывается в matcher без перекомпиляции и действует на следующем пакете;
+// демон по сигналу ставит в WFP только его фильтр. Срок хранится в файле правил и переживает перезапуск
 void MainWindow::AddBlockingRule(const std::string& ip) {
-    // TODO: Реализовать добавление правила блокировки
-    // Например, через Windows Firewall API
-    MessageBox(hwnd, StringToWString(
-        "Блокировка IP " + ip + " (требуется реализация)").c_str(),
-        L"Информация", MB_OK | MB_ICONINFORMATION);
+    Rule rule;
+    rule.name = "Quick block " + ip;
+    rule.description = "Blocked from the connection list";
+    rule.action = RuleAction::BLOCK;
+    rule.direction = RuleDirection::Inbound;
+    rule.sourceIp = ip;
+    if (!RuleManager::Instance().AddTemporaryRule(rule, BLOCK_IP_TTL_SECONDS)) {
+        MessageBox(hwnd, StringToWString("Не удалось заблокировать IP " + ip).c_str(),
+            L"Ошибка", MB_OK | MB_ICONERROR);
+        return;
+    }
+    NotifyBlockerRulesChanged();
 }
 
 void MainWindow::OnPacketCommand(WPARAM wParam) {
@@ -1514,7 +1549,8 @@ void MainWindow::OnPacketCommand(WPARAM wParam) {
         break;
 
     case CMD_BLOCK_IP: {
-        std::wstring msg = L"Заблокировать IP " + StringToWString(srcIp) + L"?";
+        std::wstring msg = L"Заблокировать IP " + StringToWString(srcIp) + L" на "
+            + std::to_wstring(BLOCK_IP_TTL_SECONDS / 60) + L" мин?";
         if (MessageBox(hwnd, msg.c_str(), L"Подтверждение",
             MB_YESNO | MB_ICONQUESTION) == IDYES) {
             AddBlockingRule(srcIp);
@@ -1733,6 +1769,8 @@ LRESULT CALLBACK MainWindow::MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPA
             }
             case WM_TIMER:
                 if (wParam == 1) {
+                    // Истёкшие временные правила записываются в файл здесь, а не в потоке захвата
+                    RuleManager::Instance().ExpireRules();
                     window->ProcessPacketBatch();
                 }
                 break;
@@ -1805,19 +1843,11 @@ INT_PTR CALLBACK MainWindow::PacketPropertiesDialogProc(HWND hwnd, UINT msg, WPA
         SetDlgItemText(hwnd, IDC_PROCESS_NAME,
             StringToWString(packet->processName).c_str());
 
-        std::string sourceIp = packet->sourceIp;
-        std::string destIp = packet->destIp;
-
-        std::thread([hwnd, sourceIp, destIp]() {
-            std::string srcDom = GetDomainByIp(sourceIp);
-            std::string dstDom = GetDomainByIp(destIp);
-            // Обновление GUI из фонового потока: используем SendMessage/PostMessage через кастомное сообщение или простой вызов SetDlgItemText в main thread
-            std::wstring srcW = srcDom.empty() ? L"(нет данных)" : MainWindow::StringToWString(srcDom);
-            std::wstring dstW = dstDom.empty() ? L"(нет данных)" : MainWindow::StringToWString(dstDom);
-            // Лучше через PostMessage + кастомное сообщение, но для простоты (если поток GUI не сильно используется):
-            SendMessage(hwnd, WM_USER + 100, (WPARAM)new std::wstring(srcW), 1);
-            SendMessage(hwnd, WM_USER + 100, (WPARAM)new std::wstring(dstW), 2);
-            }).detach();
+        // Имена уже известны из перехваченных ответов DNS — фоновый поток не нужен
+        std::string srcDom = packet->sourceDomain.empty() ? GetDomainByIp(packet->sourceIp) : packet->sourceDomain;
+        std::string dstDom = packet->destDomain.empty() ? GetDomainByIp(packet->destIp) : packet->destDomain;
+        SetDlgItemText(hwnd, IDC_SOURCE_DOMAIN, srcDom.empty() ? L"(нет данных)" : StringToWString(srcDom).c_str());
+        SetDlgItemText(hwnd, IDC_DEST_DOMAIN, dstDom.empty() ? L"(нет данных)" : StringToWString(dstDom).c_str());
 
         // Путь процесса - если путь пустой, пробуем получить его снова
         std::string processPath = packet->processPath;
@@ -1910,6 +1940,8 @@ INT_PTR CALLBACK MainWindow::SettingsDialogProc(HWND hwndDlg, UINT uMsg, WPARAM
             CheckRadioButton(hwndDlg, IDC_RADIO_ALL, IDC_RADIO_UDP, IDC_RADIO_UDP);
             break;
         }
+        CheckDlgButton(hwndDlg, IDC_CHECK_WHITELIST,
+            window->settings.filterMode == FilterMode::WHITELIST ? BST_CHECKED : BST_UNCHECKED);
         // Обновить статус
         SetDlgItemText(hwndDlg, IDC_BLOCKER_STATUS,
             IsBlockerRunning() ? L"Статус: работает" : L"Статус: остановлен");
@@ -1946,6 +1978,21 @@ INT_PTR CALLBACK MainWindow::SettingsDialogProc(HWND hwndDlg, UINT uMsg, WPARAM
             }
 
             window->settings.protocolFilter = newFilter;
+
+            FilterMode newMode = IsDlgButtonChecked(hwndDlg, IDC_CHECK_WHITELIST) == BST_CHECKED
+                ? FilterMode::WHITELIST : FilterMode::BLACKLIST;
+            if (newMode != window->settings.filterMode) {
+                FirewallLogger::Instance().LogServiceEvent(
+                    FirewallEventType::FILTER_CHANGED,
+                    newMode == FilterMode::WHITELIST
+                        ? "Filter mode changed to whitelist (default deny)"
+                        : "Filter mode changed to blacklist (default allow)"
+                );
+                window->settings.filterMode = newMode;
+                RuleManager::Instance().SetFilterMode(newMode);
+                RuleManager::Instance().SaveFilterMode();
+                NotifyBlockerRulesChanged();
+            }
             EndDialog(hwndDlg, IDOK);
             window->UpdateGroupedPackets();
             return TRUE;
@@ -106,6 +106,8 @@ private:
     static const int CMD_COPY_DEST_IP = 3103;
     static const int CMD_BLOCK_IP = 3104;
     static const int CMD_WHOIS_IP = 3105;
+    // " IP"     
+    static const int BLOCK_IP_TTL_SECONDS = 3600;
 
     //  
     std::string GetPacketKeyFromListView(int index);
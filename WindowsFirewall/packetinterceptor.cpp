@@ -15,6 +15,10 @@
 #include <shlwapi.h>
 #include <map>
 #include "rule_manager.h"
+#include "app_identity.h"
+#include "dns_snoop.h"
+#include "ip_utils.h"
+#include "icmp_decoder.h"
 
 #pragma comment(lib, "Shlwapi.lib")
 #pragma comment(lib, "Psapi.lib")
@@ -52,7 +56,7 @@ bool starts_with(const std::string& str, const std::string& prefix) {
 }
 
 bool PacketInterceptor::IsLocalAddress(const std::string& ip) const {
-    return ip == "127.0.0.1" || starts_with(ip, "127.");
+    return ip == "127.0.0.1" || starts_with(ip, "127.") || ip == "::1";
 }
 
 bool PacketInterceptor::IsPrivateNetworkAddress(const std::string& ip) const {
@@ -62,6 +66,12 @@ bool PacketInterceptor::IsPrivateNetworkAddress(const std::string& ip) const {
         return true;
     }
 
+    // IPv6: локальные для канала fe80::/10 и уникальные локальные fc00::/7
+    if (starts_with(ip, "fe8") || starts_with(ip, "fe9") || starts_with(ip, "fea") || starts_with(ip, "feb") ||
+        starts_with(ip, "fc") || starts_with(ip, "fd")) {
+        return ip.find(':') != std::string::npos;
+    }
+
     // Проверка диапазона 172.16.0.0 - 172.31.255.255
     if (starts_with(ip, "172.")) {
         try {
@@ -88,9 +98,49 @@ PacketDirection PacketInterceptor::DeterminePacketDirection(const std::string& s
     return PacketDirection::Incoming;
 }
 
-bool GetProcessInfoByPortAndProto(uint16_t port, const std::string& proto, uint32_t& pid, std::string& pname) {
+// Полный путь образа процесса (Win32-путь, не \Device\...)
+static std::string QueryProcessImagePath(uint32_t pid) {
+    HANDLE hProc = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+    if (!hProc) return "";
+    wchar_t path[MAX_PATH] = L"";
+    DWORD size = MAX_PATH;
+    std::string result;
+    if (QueryFullProcessImageNameW(hProc, 0, path, &size)) {
+        result = WideToUtf8(std::wstring(path, size));
+    }
+    CloseHandle(hProc);
+    return result;
+}
+
+// Префиксы устройств (\Device\HarddiskVolume3 -> C:) для нормализации путей вида \Device\...
+static void LoadDosDeviceMap() {
+    std::vector<std::pair<std::string, std::string>> devices;
+    for (wchar_t letter = L'A'; letter <= L'Z'; ++letter) {
+        wchar_t drive[3] = { letter, L':', 0 };
+        wchar_t target[MAX_PATH] = L"";
+        if (QueryDosDeviceW(drive, target, MAX_PATH)) {
+            devices.push_back({ WideToUtf8(target), WideToUtf8(drive) });
+        }
+    }
+    AppIdentityTable::Instance().SetDeviceMap(devices);
+}
+
+// Сигнатуры служб читаются один раз при запуске; без файла остаётся только таблица портов
+static std::shared_ptr<const SignatureSet> LoadServiceSignatures() {
+    auto signatures = std::make_shared<SignatureSet>();
+    std::string error;
+    if (!signatures->LoadFile("service_signatures.txt", error)) {
+        OutputDebugStringA(("Service signatures not loaded: " + error + "\n").c_str());
+        return nullptr;
+    }
+    signatures->Build();
+    return signatures;
+}
+
+bool GetProcessInfoByPortAndProto(uint16_t port, const std::string& proto, uint32_t& pid, std::string& pname, AppId& appId) {
     pid = 0;
     pname = "Unknown";
+    appId = INVALID_APP_ID;
 
     if (proto == "TCP") {
         DWORD size = 0;
@@ -122,16 +172,10 @@ bool GetProcessInfoByPortAndProto(uint16_t port, const std::string& proto, uint3
     }
 
     if (pid != 0) {
-        HANDLE hProc = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_VM_READ, FALSE, pid);
-        if (hProc) {
-            wchar_t wname[MAX_PATH] = L"";
-            if (GetModuleFileNameExW(hProc, NULL, wname, MAX_PATH)) {
-                LPCWSTR baseName = PathFindFileNameW(wname);
-                char mbname[MAX_PATH] = "";
-                WideCharToMultiByte(CP_UTF8, 0, baseName, -1, mbname, MAX_PATH, NULL, NULL);
-                pname = std::string(mbname);
-            }
-            CloseHandle(hProc);
+        // Путь процесса запрашивается один раз на PID, дальше — из кэша таблицы приложений
+        appId = AppIdentityTable::Instance().ForProcess(pid, QueryProcessImagePath);
+        if (const AppIdentity* app = AppIdentityTable::Instance().Get(appId)) {
+            pname = app->displayName;
         }
     }
     return pid != 0;
@@ -349,6 +393,11 @@ std::vector<NetworkAdapter> PacketInterceptor::GetNetworkAdapters() const {
 bool PacketInterceptor::Initialize() {
     isCapturing = false;
     handle = nullptr;
+    LoadDosDeviceMap();
+    services.SetSignatures(LoadServiceSignatures());
+    if (!dnsSnooper) {
+        dnsSnooper = static_cast<DnsSnooper*>(IpDomainTable::Instance().AddFeeder(std::make_unique<DnsSnooper>()));
+    }
     return true;
 }
 
@@ -534,8 +583,6 @@ bool PacketInterceptor::StopCapture() {
 void PacketInterceptor::CaptureThread(PacketInterceptor* interceptor) {
     try {
         OutputDebugStringA("Capture thread starting\n");
-        struct pcap_pkthdr* header;
-        const u_char* packet;
         int timeouts = 0;
 
         while (interceptor->isRunning) {
@@ -544,20 +591,24 @@ void PacketInterceptor::CaptureThread(PacketInterceptor* interceptor) {
                 break;
             }
 
-            int result = pcap_next_ex(interceptor->handle, &header, &packet);
+            // Всё, что уже лежит в буфере драйвера (до MAX_CAPTURE_BATCH пакетов), разбирается
+            // в batch и проверяется правилами за один захват их замка
+            int result = pcap_dispatch(interceptor->handle, MAX_CAPTURE_BATCH, DispatchHandler,
+                reinterpret_cast<u_char*>(interceptor));
 
-            // Проверяем флаг остановки после каждого пакета
+            // Проверяем флаг остановки после каждой пачки
             if (!interceptor->isRunning) {
                 OutputDebugStringA("Capture stopped, exiting thread\n");
                 break;
             }
 
-            switch (result) {
-            case 1:  // Пакет успешно захвачен
+            if (result > 0) {
                 timeouts = 0;
-                interceptor->ProcessPacket(header, packet);
-                break;
+                interceptor->ProcessBatch();
+                continue;
+            }
 
+            switch (result) {
             case 0:  // Таймаут
                 timeouts++;
                 if (!interceptor->isRunning) break;
@@ -579,7 +630,7 @@ void PacketInterceptor::CaptureThread(PacketInterceptor* interceptor) {
                 return;
 
             default:
-                OutputDebugStringA(("Unknown result from pcap_next_ex: " + std::to_string(result) + "\n").c_str());
+                OutputDebugStringA(("Unknown result from pcap_dispatch: " + std::to_string(result) + "\n").c_str());
                 if (!interceptor->isRunning) break;
                 std::this_thread::sleep_for(std::chrono::milliseconds(10));
                 continue;
@@ -597,21 +648,12 @@ void PacketInterceptor::CaptureThread(PacketInterceptor* interceptor) {
 }
 
 
+// Имя из перехваченных ответов DNS: без обратного запроса, который блокирует поток
 std::string PacketInterceptor::ResolveDestination(const std::string& ip) const {
-    char host[NI_MAXHOST];
-    struct sockaddr_in sa;
-    sa.sin_family = AF_INET;
-    inet_pton(AF_INET, ip.c_str(), &(sa.sin_addr));
-    sa.sin_port = 0;
-
-    if (getnameinfo((struct sockaddr*)&sa, sizeof(sa),
-        host, NI_MAXHOST,
-        NULL, 0,
-        NI_NAMEREQD) == 0) {
-        return std::string(host);
-    }
-
-    return ip;
+    uint32_t addr = 0;
+    if (!ParseIPv4(ip, addr)) return ip;
+    std::string name = IpDomainTable::Instance().LookupName(addr);
+    return name.empty() ? ip : name;
 }
 
 void PacketInterceptor::UpdateConnection(const PacketInfo& info) {
@@ -622,8 +664,17 @@ void PacketInterceptor::UpdateConnection(const PacketInfo& info) {
 }
 
 std::string PacketInterceptor::GetServiceName(unsigned short port) const {
-    auto it = knownServices.find(port);
-    return it != knownServices.end() ? it->second : "Unknown";
+    ServiceId service = ServiceForPort(IPPROTO_TCP, port);
+    if (service == UNKNOWN_SERVICE) service = ServiceForPort(IPPROTO_UDP, port);
+    return service != UNKNOWN_SERVICE ? ServiceNames::Instance().Name(service) : "Unknown";
+}
+
+std::vector<std::pair<std::string, uint64_t>> PacketInterceptor::GetServiceCounts() const {
+    std::vector<std::pair<std::string, uint64_t>> counts;
+    for (const auto& item : services.ServiceCounts()) {
+        counts.push_back({ ServiceNames::Instance().Name(item.first), item.second });
+    }
+    return counts;
 }
 
 bool PacketInterceptor::IsOutgoingPacket(const std::string& sourceIp) const {
@@ -680,15 +731,91 @@ std::string PacketInterceptor::GetProcessNameByPort(unsigned short port) {
     return "Unknown";
 }
 
-void PacketInterceptor::ProcessPacket(const pcap_pkthdr* header, const u_char* packet) {
+void PacketInterceptor::DispatchHandler(u_char* user, const pcap_pkthdr* header, const u_char* packet) {
+    PacketInterceptor* interceptor = reinterpret_cast<PacketInterceptor*>(user);
+    if (!header || !packet) return;
+    interceptor->captured.push_back({ *header, interceptor->capturedBytes.size() });
+    interceptor->capturedBytes.insert(interceptor->capturedBytes.end(), packet, packet + header->caplen);
+}
+
+// Начало заголовка IP: за Ethernet, если тип кадра — IPv4 или IPv6, иначе с начала
+static size_t IpOffset(const pcap_pkthdr& header, const u_char* packet) {
+    if (header.caplen < 14) return 0;
+    uint16_t etherType = static_cast<uint16_t>((packet[12] << 8) | packet[13]);
+    return etherType == 0x0800 || etherType == 0x86DD ? 14 : 0;
+}
+
+void PacketInterceptor::DecodeCaptured() {
+    size_t count = captured.size();
+    ipStarts.resize(count);
+    ipSizes.resize(count);
+    ipv4Headers.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const pcap_pkthdr& header = captured[i].header;
+        const u_char* packet = capturedBytes.data() + captured[i].offset;
+        size_t offset = IpOffset(header, packet);
+        ipStarts[i] = packet + offset;
+        ipSizes[i] = header.caplen > offset ? header.caplen - offset : 0;
+    }
+    DecodeIPv4Batch(ipStarts.data(), ipSizes.data(), count, ipv4Headers.data());
+    for (size_t i = 0; i < count; ++i) {
+        PacketInfo info = {};
+        const IPv4Summary* ipv4 = ipv4Headers[i].valid ? &ipv4Headers[i] : nullptr;
+        if (DecodePacket(&captured[i].header, capturedBytes.data() + captured[i].offset, ipv4, info)) {
+            batch.push_back(std::move(info));
+        }
+    }
+    captured.clear();
+    capturedBytes.clear();
+}
+
+void PacketInterceptor::ProcessBatch() {
+    DecodeCaptured();
+    if (batch.empty()) return;
+    try {
+        RuleManager::Instance().FindBlockingRuleBatch(batch);
+        for (const auto& info : batch) {
+            try {
+                packetCallback(info);
+            }
+            catch (const std::exception& e) {
+                OutputDebugStringA(("ProcessBatch callback error: " + std::string(e.what()) + "\n").c_str());
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        OutputDebugStringA(("ProcessBatch error: " + std::string(e.what()) + "\n").c_str());
+    }
+    batch.clear();
+}
+
+bool PacketInterceptor::DecodePacket(const pcap_pkthdr* header, const u_char* packet, const IPv4Summary* ipv4,
+    PacketInfo& info) {
     // Проверка входных параметров
     if (!header || !packet || !packetCallback) {
-        OutputDebugStringA("ProcessPacket: Invalid parameters\n");
-        return;
+        OutputDebugStringA("DecodePacket: Invalid parameters\n");
+        return false;
     }
     try {
 
-        size_t len = header->len;
+        size_t ipOffset = IpOffset(*header, packet);
+        if (header->caplen < ipOffset + 20) return false; // слишком короткий для IP
+
+        const u_char* ipStart = packet + ipOffset;
+
+        // Ответы DNS разбираются до ограничения потока, иначе соответствия адрес -> имя теряются
+        if (dnsSnooper && header->caplen > static_cast<bpf_u_int32>(ipOffset)) {
+            dnsSnooper->OnIPv4Packet(ipStart, header->caplen - ipOffset);
+        }
+        // Первые сегменты потока тоже нельзя терять: без них имя сервера не узнать.
+        // Классифицированный поток здесь стоит одного поиска в таблице потоков.
+        FlowHostname flowHostname;
+        bool hasHostname = header->caplen > static_cast<bpf_u_int32>(ipOffset)
+            && flowHostnames.OnIPv4Packet(ipStart, header->caplen - ipOffset, flowHostname);
+        ServiceId service = header->caplen > static_cast<bpf_u_int32>(ipOffset)
+            ? services.OnIPv4Packet(ipStart, header->caplen - ipOffset)
+            : UNKNOWN_SERVICE;
+
         // --- Ограничение на поток пакетов ---
         static std::atomic<size_t> packetCount = 0;
         static std::atomic<time_t> lastTime = 0;
@@ -698,118 +825,186 @@ void PacketInterceptor::ProcessPacket(const pcap_pkthdr* header, const u_char* p
             packetCount = 0;
         }
         if (++packetCount > 500) { // Не более 500 пакетов в секунду
-            return;
-        }
-
-        int ipOffset = 0;
-        bool hasEthernet = false;
-
-        // --- Определяем, есть ли Ethernet header ---
-        if (len >= 14) {
-            uint16_t etherType = ntohs(*(uint16_t*)(packet + 12));
-            if (etherType == 0x0800 || etherType == 0x86DD) {
-                hasEthernet = true;
-                ipOffset = 14;
-            }
-        }
-        if (!hasEthernet) {
-            ipOffset = 0;
-            if (len < 20) return; // слишком короткий для IP
+            return false;
         }
 
-        const u_char* ipStart = packet + ipOffset;
-
         // --- Определяем версию IP ---
         uint8_t version = (ipStart[0] >> 4) & 0x0F;
+        size_t ipSize = header->caplen > static_cast<bpf_u_int32>(ipOffset) ? header->caplen - ipOffset : 0;
+
+        info.processId = 0;
+        info.processName = "Unknown";
+        info.adapterIp = currentAdapter;
+
+        uint8_t ipProtocol = 0;
+        const u_char* transport = nullptr;      // заголовок L4; nullptr — не захвачен
+        size_t transportSize = 0;
+        IPv4Summary decoded;
         if (version == 4) {
-            if (len < ipOffset + 20) return;
-            const IPHeader* ipHeader = reinterpret_cast<const IPHeader*>(ipStart);
-
-            PacketInfo info = {};
-            info.processId = 0;
-            info.processName = "Unknown";
-            info.adapterIp = currentAdapter;
-
-            // Время
-            SYSTEMTIME st = {};
-            GetSystemTime(&st);
-            char timeBuffer[32] = {};
-            sprintf_s(timeBuffer, sizeof(timeBuffer), "%04d-%02d-%02d %02d:%02d:%02d",
-                st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
-            info.time = timeBuffer;
+            if (!ipv4) {
+                if (!DecodeIPv4(ipStart, ipSize, decoded)) return false;
+                ipv4 = &decoded;
+            }
 
             // IP
             char srcIP[INET_ADDRSTRLEN] = {}, dstIP[INET_ADDRSTRLEN] = {};
-            inet_ntop(AF_INET, &(ipHeader->sourceIP), srcIP, INET_ADDRSTRLEN);
-            inet_ntop(AF_INET, &(ipHeader->destIP), dstIP, INET_ADDRSTRLEN);
+            uint32_t sourceIp = htonl(ipv4->sourceIp);
+            uint32_t destIp = htonl(ipv4->destIp);
+            inet_ntop(AF_INET, &sourceIp, srcIP, INET_ADDRSTRLEN);
+            inet_ntop(AF_INET, &destIp, dstIP, INET_ADDRSTRLEN);
+            info.sourceIp = srcIP;
+            info.destIp = dstIP;
+            IpDomainTable& domains = IpDomainTable::Instance();
+            info.sourceDomain = domains.LookupName(ipv4->sourceIp);
+            info.destDomain = domains.LookupName(ipv4->destIp);
+
+            ipProtocol = ipv4->protocol;
+            if (ipSize > ipv4->headerLength) {
+                transport = ipStart + ipv4->headerLength;
+                transportSize = ipSize - ipv4->headerLength;
+            }
+        }
+        else if (version == 6) {
+            if (ipSize < 40) return false;
+
+            char srcIP[INET6_ADDRSTRLEN] = {}, dstIP[INET6_ADDRSTRLEN] = {};
+            inet_ntop(AF_INET6, ipStart + 8, srcIP, INET6_ADDRSTRLEN);
+            inet_ntop(AF_INET6, ipStart + 24, dstIP, INET6_ADDRSTRLEN);
             info.sourceIp = srcIP;
             info.destIp = dstIP;
 
-            // Протокол, размер
-            info.protocol = GetProtocolName(ipHeader->protocol);
-            info.size = header->len;
-
-            info.direction = DeterminePacketDirection(srcIP);
-
-            // Порты
-            int ipHeaderLength = (ipHeader->headerLength & 0x0F) * 4;
-            info.sourcePort = 0;
-            info.destPort = 0;
-            if (ipHeader->protocol == IPPROTO_TCP) {
-                if (len >= ipOffset + ipHeaderLength + sizeof(TCPHeader)) {
-                    const TCPHeader* tcp = reinterpret_cast<const TCPHeader*>(ipStart + ipHeaderLength);
-                    info.sourcePort = ntohs(tcp->sourcePort);
-                    info.destPort = ntohs(tcp->destPort);
-                }
+            // Протокол — за цепочкой заголовков расширения; без неё порты неизвестны
+            size_t offset = 0;
+            if (FindIPv6Transport(ipStart, ipSize, ipProtocol, offset)) {
+                transport = ipStart + offset;
+                transportSize = ipSize - offset;
             }
-            else if (ipHeader->protocol == IPPROTO_UDP) {
-                if (len >= ipOffset + ipHeaderLength + sizeof(UDPHeader)) {
-                    const UDPHeader* udp = reinterpret_cast<const UDPHeader*>(ipStart + ipHeaderLength);
-                    info.sourcePort = ntohs(udp->sourcePort);
-                    info.destPort = ntohs(udp->destPort);
-                }
+            else {
+                ipProtocol = ipStart[6];
             }
+        }
+        else {
+            // Неизвестный протокол
+            return false;
+        }
 
-            // PID и имя процесса
-            uint32_t pid = 0;
-            std::string pname = "Unknown";
-            uint16_t localPort = (info.direction == PacketDirection::Outgoing) ? info.sourcePort : info.destPort;
-            GetProcessInfoByPortAndProto(localPort, info.protocol, pid, pname);
-            info.processId = pid;
-            info.processName = pname;
-
-            if (info.sourceIp.empty()) info.sourceIp = "Unknown";
-            if (info.destIp.empty()) info.destIp = "Unknown";
-            if (info.protocol.empty()) info.protocol = "Unknown";
-            if (info.processName.empty()) info.processName = "Unknown";
-            if (info.time.empty()) info.time = "Unknown";
-
-            std::string blockRuleName;
-            info.isBlocked = RuleManager::Instance().FindBlockingRule(info, blockRuleName);
-            info.blockReason = blockRuleName;
-
-            // Callback
-            try {
-                packetCallback(info);
+        // Время
+        SYSTEMTIME st = {};
+        GetSystemTime(&st);
+        char timeBuffer[32] = {};
+        sprintf_s(timeBuffer, sizeof(timeBuffer), "%04d-%02d-%02d %02d:%02d:%02d",
+            st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+        info.time = timeBuffer;
+
+        if (hasHostname) {
+            info.serverName = std::move(flowHostname.name);
+            info.serverIsSource = flowHostname.serverIsSource;
+        }
+
+        // Протокол, размер
+        info.protocol = GetProtocolName(ipProtocol);
+        info.size = header->len;
+
+        info.direction = DeterminePacketDirection(info.sourceIp);
+        // Входящий заголовок с неверной суммой стек отбросит, но правила и журнал его видят.
+        // У исходящих сумму часто заполняет сетевая карта уже после захвата, их сумма не проверяется
+        info.badChecksum = ipv4 && !ipv4->checksumValid && info.direction == PacketDirection::Incoming;
+
+        // Порты
+        info.sourcePort = 0;
+        info.destPort = 0;
+        std::string icmpText;
+        if (ipv4 && (ipProtocol == IPPROTO_TCP || ipProtocol == IPPROTO_UDP)) {
+            // Разобраны вместе с заголовком IP; у не первого фрагмента портов нет
+            info.sourcePort = ipv4->sourcePort;
+            info.destPort = ipv4->destPort;
+            info.tcpFlags = ipv4->tcpFlags;
+        }
+        else if (ipProtocol == IPPROTO_TCP) {
+            if (transportSize >= sizeof(TCPHeader)) {
+                const TCPHeader* tcp = reinterpret_cast<const TCPHeader*>(transport);
+                info.sourcePort = ntohs(tcp->sourcePort);
+                info.destPort = ntohs(tcp->destPort);
+                info.tcpFlags = tcp->flags;
             }
-            catch (const std::exception& e) {
-                OutputDebugStringA(("ProcessPacket callback error: " + std::string(e.what()) + "\n").c_str());
+        }
+        else if (ipProtocol == IPPROTO_UDP) {
+            if (transportSize >= sizeof(UDPHeader)) {
+                const UDPHeader* udp = reinterpret_cast<const UDPHeader*>(transport);
+                info.sourcePort = ntohs(udp->sourcePort);
+                info.destPort = ntohs(udp->destPort);
             }
         }
-        else if (version == 6) {
-            // Можно реализовать разбор IPv6
-            // Пока просто пропускаем такие пакеты
-            return;
+        else if (ipProtocol == IP_PROTOCOL_ICMP || ipProtocol == IP_PROTOCOL_ICMPV6) {
+            bool v6 = ipProtocol == IP_PROTOCOL_ICMPV6;
+            IcmpInfo icmp;
+            if (transport && (v6 ? DecodeIcmpV6(transport, transportSize, icmp) : DecodeIcmp(transport, transportSize, icmp))) {
+                info.icmpType = icmp.type;
+                info.icmpCode = icmp.code;
+                icmpText = DescribeIcmp(icmp.type, icmp.code, v6);
+                if (icmp.isEcho) {
+                    // Идентификатор эха — псевдопорт: запрос и ответ одного ping попадают в один поток
+                    info.sourcePort = icmp.echoId;
+                    info.destPort = icmp.echoId;
+                }
+                else if (icmp.hasRelated) {
+                    // Ошибка идёт навстречу исходному пакету, поэтому его порты меняются местами:
+                    // для входящей ошибки destPort — локальный порт исходного потока
+                    info.relatedProtocol = icmp.relatedProtocol;
+                    info.sourcePort = icmp.relatedDestPort;
+                    info.destPort = icmp.relatedSourcePort;
+                    char relatedSrc[INET6_ADDRSTRLEN] = {}, relatedDst[INET6_ADDRSTRLEN] = {};
+                    if (v6) {
+                        inet_ntop(AF_INET6, icmp.relatedSourceIp6, relatedSrc, INET6_ADDRSTRLEN);
+                        inet_ntop(AF_INET6, icmp.relatedDestIp6, relatedDst, INET6_ADDRSTRLEN);
+                    }
+                    else {
+                        uint32_t relatedSource = htonl(icmp.relatedSourceIp);
+                        uint32_t relatedDest = htonl(icmp.relatedDestIp);
+                        inet_ntop(AF_INET, &relatedSource, relatedSrc, INET6_ADDRSTRLEN);
+                        inet_ntop(AF_INET, &relatedDest, relatedDst, INET6_ADDRSTRLEN);
+                    }
+                    info.relatedSourceIp = relatedSrc;
+                    info.relatedDestIp = relatedDst;
+                    icmpText += ": " + GetProtocolName(icmp.relatedProtocol) + " "
+                        + relatedSrc + ":" + std::to_string(icmp.relatedSourcePort) + " -> "
+                        + relatedDst + ":" + std::to_string(icmp.relatedDestPort);
+                }
+            }
         }
-        else {
-            // Неизвестный протокол
-            return;
+
+        // Пока содержимое потока не опознано, служба берётся по известному порту;
+        // ошибке ICMP достаётся служба исходного потока
+        uint8_t flowProtocol = info.relatedProtocol ? info.relatedProtocol : ipProtocol;
+        if (service == UNKNOWN_SERVICE) service = ServiceForPorts(flowProtocol, info.sourcePort, info.destPort);
+        info.serviceId = service;
+        info.service = ServiceNames::Instance().Name(service);
+        if (!icmpText.empty()) {
+            info.service = info.service.empty() ? icmpText : icmpText + " (" + info.service + ")";
         }
+
+        // PID и имя процесса; ошибка ICMP относится к процессу исходного потока
+        uint32_t pid = 0;
+        std::string pname = "Unknown";
+        uint16_t localPort = (info.direction == PacketDirection::Outgoing) ? info.sourcePort : info.destPort;
+        AppId appId = INVALID_APP_ID;
+        GetProcessInfoByPortAndProto(localPort, GetProtocolName(flowProtocol), pid, pname, appId);
+        info.processId = pid;
+        info.processName = pname;
+        info.appId = appId;
+
+        if (info.sourceIp.empty()) info.sourceIp = "Unknown";
+        if (info.destIp.empty()) info.destIp = "Unknown";
+        if (info.protocol.empty()) info.protocol = "Unknown";
+        if (info.processName.empty()) info.processName = "Unknown";
+        if (info.time.empty()) info.time = "Unknown";
+        return true;
     }
     catch (const std::exception& e) {
-        OutputDebugStringA(("ProcessPacket error: " + std::string(e.what()) + "\n").c_str());
+        OutputDebugStringA(("DecodePacket error: " + std::string(e.what()) + "\n").c_str());
     }
     catch (...) {
-        OutputDebugStringA("ProcessPacket: Unknown error occurred\n");
+        OutputDebugStringA("DecodePacket: Unknown error occurred\n");
     }
+    return false;
 }
\ No newline at end of file
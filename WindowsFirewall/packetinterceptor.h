@@ -15,6 +15,11 @@
 #include <fwpmtypes.h>
 #include <fwpmu.h>
 #include "string_utils.h"
+#include "flow_hostname.h"
+#include "service_signatures.h"
+#include "ipv4_decoder.h"
+
+class DnsSnooper;
 
 class PacketInterceptor {
 public:
@@ -44,8 +49,18 @@ public:
         packetCallback = callback;
     }
     std::vector<AdapterInfo> GetAdapters();
+    // Потоки, опознанные по содержимому, по службам — по убыванию числа
+    std::vector<std::pair<std::string, uint64_t>> GetServiceCounts() const;
+    ServiceClassifier::Stats GetServiceStats() const { return services.GetStats(); }
 protected:
-    void ProcessPacket(const pcap_pkthdr* header, const u_char* packet);
+    // Разбор пакета до проверки правил; false — пакет отброшен.
+    // ipv4 — заголовок, уже разобранный DecodeIPv4Batch; nullptr — разобрать здесь
+    bool DecodePacket(const pcap_pkthdr* header, const u_char* packet, const IPv4Summary* ipv4, PacketInfo& info);
+    // Разбор скопированных пакетов пачки в batch: заголовки IPv4 — все сразу, остальное — по одному
+    void DecodeCaptured();
+    // Правила для всей накопленной пачки одним вызовом, затем packetCallback по порядку
+    void ProcessBatch();
+    static void DispatchHandler(u_char* user, const pcap_pkthdr* header, const u_char* packet);
     std::string GetProcessNameByPort(unsigned short port);
     std::string GetProtocolName(u_char protocol);
     std::string GetConnectionDescription(const PacketInfo& info) const;
@@ -67,7 +82,22 @@ private:
     SOCKET rawSocket;
     std::thread captureThread;
     std::unordered_map<std::string, std::string> connections;
-    std::unordered_map<unsigned short, std::string> knownServices;
     mutable std::mutex mutex;
     std::function<void(const PacketInfo&)> packetCallback;
+    DnsSnooper* dnsSnooper = nullptr;      // принадлежит IpDomainTable
+    FlowHostnameTracker flowHostnames;      // SNI/Host потоков TCP
+    ServiceClassifier services;             // служба потока по сигнатурам содержимого
+    // Пакеты текущего pcap_dispatch, только поток захвата. Буфер pcap действителен лишь внутри
+    // обработчика, поэтому пакеты копируются в capturedBytes и разбираются после pcap_dispatch
+    struct CapturedPacket {
+        pcap_pkthdr header;
+        size_t offset;                      // начало в capturedBytes
+    };
+    std::vector<CapturedPacket> captured;
+    std::vector<uint8_t> capturedBytes;
+    std::vector<const uint8_t*> ipStarts;   // заголовки IP пачки для DecodeIPv4Batch
+    std::vector<size_t> ipSizes;
+    std::vector<IPv4Summary> ipv4Headers;
+    std::vector<PacketInfo> batch;
+    static constexpr int MAX_CAPTURE_BATCH = 256;
 };
\ No newline at end of file
@@ -0,0 +1,390 @@
+#include "quic_crypto.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+inline uint32_t Rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+class Sha256Context {
+public:
+    void Update(const uint8_t* data, size_t size) {
+        total += size;
+        while (size > 0) {
+            size_t n = (std::min)(size, sizeof(block) - used);
+            std::memcpy(block + used, data, n);
+            used += n;
+            data += n;
+            size -= n;
+            if (used == sizeof(block)) {
+                Compress();
+                used = 0;
+            }
+        }
+    }
+
+    Sha256Digest Finish() {
+        uint64_t bits = total * 8;
+        block[used++] = 0x80;
+        if (used > 56) {
+            std::memset(block + used, 0, sizeof(block) - used);
+            Compress();
+            used = 0;
+        }
+        std::memset(block + used, 0, 56 - used);
+        for (int i = 0; i < 8; ++i) block[56 + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+        Compress();
+        Sha256Digest digest;
+        for (int i = 0; i < 8; ++i) {
+            digest[4 * i] = static_cast<uint8_t>(state[i] >> 24);
+            digest[4 * i + 1] = static_cast<uint8_t>(state[i] >> 16);
+            digest[4 * i + 2] = static_cast<uint8_t>(state[i] >> 8);
+            digest[4 * i + 3] = static_cast<uint8_t>(state[i]);
+        }
+        return digest;
+    }
+
+private:
+    void Compress() {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16)
+                | (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = h + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+            uint32_t t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+
+    uint32_t state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    uint8_t block[64] = {};
+    size_t used = 0;
+    uint64_t total = 0;
+};
+
+const uint8_t AES_SBOX[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+inline uint8_t Xtime(uint8_t x) {
+    return static_cast<uint8_t>((x << 1) ^ ((x & 0x80) ? 0x1b : 0));
+}
+
+uint64_t LoadBE64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v = (v << 8) | p[i];
+    return v;
+}
+
+void StoreBE64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) p[i] = static_cast<uint8_t>(v >> (56 - 8 * i));
+}
+
+inline uint32_t LoadBE32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+inline void StoreBE32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+inline uint32_t RotateRight(uint32_t v, int n) {
+    return (v >> n) | (v << (32 - n));
+}
+
+// SubBytes + MixColumns одним поиском на байт: столбец (2s, s, s, 3s) и его сдвиги
+struct AesTables {
+    uint32_t te[4][256];
+    AesTables() {
+        for (int x = 0; x < 256; ++x) {
+            uint8_t s = AES_SBOX[x];
+            uint8_t s2 = Xtime(s);
+            uint32_t column = (uint32_t(s2) << 24) | (uint32_t(s) << 16) | (uint32_t(s) << 8) | uint8_t(s2 ^ s);
+            for (int i = 0; i < 4; ++i) te[i][x] = i == 0 ? column : RotateRight(column, 8 * i);
+        }
+    }
+};
+
+const AesTables& Tables() {
+    static const AesTables tables;
+    return tables;
+}
+
+} // namespace
+
+Sha256Digest Sha256(const uint8_t* data, size_t size) {
+    Sha256Context ctx;
+    ctx.Update(data, size);
+    return ctx.Finish();
+}
+
+Sha256Digest HmacSha256(const uint8_t* key, size_t keySize, const uint8_t* data, size_t size) {
+    uint8_t block[64] = {};
+    if (keySize > sizeof(block)) {
+        Sha256Digest hashed = Sha256(key, keySize);
+        std::memcpy(block, hashed.data(), hashed.size());
+    }
+    else if (keySize > 0) {
+        std::memcpy(block, key, keySize);
+    }
+
+    uint8_t pad[64];
+    for (int i = 0; i < 64; ++i) pad[i] = block[i] ^ 0x36;
+    Sha256Context inner;
+    inner.Update(pad, sizeof(pad));
+    inner.Update(data, size);
+    Sha256Digest innerDigest = inner.Finish();
+
+    for (int i = 0; i < 64; ++i) pad[i] = block[i] ^ 0x5c;
+    Sha256Context outer;
+    outer.Update(pad, sizeof(pad));
+    outer.Update(innerDigest.data(), innerDigest.size());
+    return outer.Finish();
+}
+
+Sha256Digest HkdfExtract(const uint8_t* salt, size_t saltSize, const uint8_t* ikm, size_t ikmSize) {
+    return HmacSha256(salt, saltSize, ikm, ikmSize);
+}
+
+std::vector<uint8_t> HkdfExpand(const Sha256Digest& prk, const uint8_t* info, size_t infoSize, size_t length) {
+    std::vector<uint8_t> okm;
+    okm.reserve(length);
+    std::vector<uint8_t> input;
+    Sha256Digest previous{};
+    for (uint8_t counter = 1; okm.size() < length; ++counter) {
+        input.clear();
+        if (counter > 1) input.insert(input.end(), previous.begin(), previous.end());
+        input.insert(input.end(), info, info + infoSize);
+        input.push_back(counter);
+        previous = HmacSha256(prk.data(), prk.size(), input.data(), input.size());
+        size_t n = (std::min)(previous.size(), length - okm.size());
+        okm.insert(okm.end(), previous.begin(), previous.begin() + n);
+    }
+    return okm;
+}
+
+std::vector<uint8_t> HkdfExpandLabel(const Sha256Digest& secret, std::string_view label, size_t length) {
+    // struct { uint16 length; opaque label<7..255> = "tls13 " + label; opaque context<0..255>; }
+    std::vector<uint8_t> info;
+    info.push_back(static_cast<uint8_t>(length >> 8));
+    info.push_back(static_cast<uint8_t>(length));
+    std::string_view prefix = "tls13 ";
+    info.push_back(static_cast<uint8_t>(prefix.size() + label.size()));
+    info.insert(info.end(), prefix.begin(), prefix.end());
+    info.insert(info.end(), label.begin(), label.end());
+    info.push_back(0);
+    return HkdfExpand(secret, info.data(), info.size(), length);
+}
+
+void Aes128::SetKey(const uint8_t key[16]) {
+    for (int i = 0; i < 4; ++i) roundKeys[i] = LoadBE32(key + 4 * i);
+    uint8_t rcon = 1;
+    for (size_t i = 4; i < roundKeys.size(); ++i) {
+        uint32_t t = roundKeys[i - 1];
+        if (i % 4 == 0) {
+            t = (uint32_t(AES_SBOX[(t >> 16) & 0xFF]) << 24) | (uint32_t(AES_SBOX[(t >> 8) & 0xFF]) << 16)
+                | (uint32_t(AES_SBOX[t & 0xFF]) << 8) | AES_SBOX[t >> 24];
+            t ^= uint32_t(rcon) << 24;
+            rcon = Xtime(rcon);
+        }
+        roundKeys[i] = roundKeys[i - 4] ^ t;
+    }
+}
+
+void Aes128::EncryptBlock(const uint8_t in[16], uint8_t out[16]) const {
+    const AesTables& tables = Tables();
+    const uint32_t* k = roundKeys.data();
+    uint32_t s0 = LoadBE32(in) ^ k[0];
+    uint32_t s1 = LoadBE32(in + 4) ^ k[1];
+    uint32_t s2 = LoadBE32(in + 8) ^ k[2];
+    uint32_t s3 = LoadBE32(in + 12) ^ k[3];
+    // Столбец c после ShiftRows берёт строку r из столбца c + r
+    auto column = [&](uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t key) {
+        return tables.te[0][a >> 24] ^ tables.te[1][(b >> 16) & 0xFF]
+            ^ tables.te[2][(c >> 8) & 0xFF] ^ tables.te[3][d & 0xFF] ^ key;
+    };
+    for (int round = 1; round < 10; ++round) {
+        k += 4;
+        uint32_t t0 = column(s0, s1, s2, s3, k[0]);
+        uint32_t t1 = column(s1, s2, s3, s0, k[1]);
+        uint32_t t2 = column(s2, s3, s0, s1, k[2]);
+        uint32_t t3 = column(s3, s0, s1, s2, k[3]);
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+    // Последний раунд без MixColumns
+    k += 4;
+    auto last = [&](uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t key) {
+        return ((uint32_t(AES_SBOX[a >> 24]) << 24) | (uint32_t(AES_SBOX[(b >> 16) & 0xFF]) << 16)
+            | (uint32_t(AES_SBOX[(c >> 8) & 0xFF]) << 8) | AES_SBOX[d & 0xFF]) ^ key;
+    };
+    StoreBE32(out, last(s0, s1, s2, s3, k[0]));
+    StoreBE32(out + 4, last(s1, s2, s3, s0, k[1]));
+    StoreBE32(out + 8, last(s2, s3, s0, s1, k[2]));
+    StoreBE32(out + 12, last(s3, s0, s1, s2, k[3]));
+}
+
+void Aes128Gcm::SetKey(const uint8_t key[16]) {
+    aes.SetKey(key);
+    uint8_t zero[16] = {};
+    uint8_t h[16];
+    aes.EncryptBlock(zero, h);
+
+    // Кратные H для умножения по 4 бита (таблица Шоупа): индекс — полубайт в порядке битов GCM
+    uint64_t vHigh = LoadBE64(h), vLow = LoadBE64(h + 8);
+    hashHigh[0] = 0;
+    hashLow[0] = 0;
+    hashHigh[8] = vHigh;
+    hashLow[8] = vLow;
+    for (int i = 4; i > 0; i >>= 1) {
+        uint64_t reduce = (vLow & 1) ? 0xE100000000000000ull : 0;
+        vLow = (vLow >> 1) | (vHigh << 63);
+        vHigh = (vHigh >> 1) ^ reduce;
+        hashHigh[i] = vHigh;
+        hashLow[i] = vLow;
+    }
+    for (int i = 2; i <= 8; i *= 2) {
+        for (int j = 1; j < i; ++j) {
+            hashHigh[i + j] = hashHigh[i] ^ hashHigh[j];
+            hashLow[i + j] = hashLow[i] ^ hashLow[j];
+        }
+    }
+}
+
+void Aes128Gcm::Ghash(const uint8_t* aad, size_t aadSize, const uint8_t* data, size_t size, uint8_t tag[16]) const {
+    // Редукция четырёх выдвинутых битов по модулю многочлена GCM
+    static const uint64_t REDUCE4[16] = {
+        0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+        0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+    };
+    uint8_t y[16] = {};
+    auto multiply = [&]() {
+        uint64_t zHigh = 0, zLow = 0;
+        auto step = [&](unsigned nibble) {
+            uint64_t rem = zLow & 0x0F;
+            zLow = (zHigh << 60) | (zLow >> 4);
+            zHigh = (zHigh >> 4) ^ (REDUCE4[rem] << 48);
+            zHigh ^= hashHigh[nibble];
+            zLow ^= hashLow[nibble];
+        };
+        // Биты GCM идут от старшего к младшему, поэтому блок обходится с конца
+        zHigh = hashHigh[y[15] & 0x0F];
+        zLow = hashLow[y[15] & 0x0F];
+        step(y[15] >> 4);
+        for (int i = 14; i >= 0; --i) {
+            step(y[i] & 0x0F);
+            step(y[i] >> 4);
+        }
+        StoreBE64(y, zHigh);
+        StoreBE64(y + 8, zLow);
+    };
+    auto absorb = [&](const uint8_t* p, size_t n) {
+        while (n > 0) {
+            size_t take = n < 16 ? n : 16;
+            for (size_t i = 0; i < take; ++i) y[i] ^= p[i];
+            p += take;
+            n -= take;
+            multiply();
+        }
+    };
+    absorb(aad, aadSize);
+    absorb(data, size);
+    uint8_t lengths[16];
+    StoreBE64(lengths, static_cast<uint64_t>(aadSize) * 8);
+    StoreBE64(lengths + 8, static_cast<uint64_t>(size) * 8);
+    absorb(lengths, sizeof(lengths));
+    std::memcpy(tag, y, 16);
+}
+
+void Aes128Gcm::Ctr(const uint8_t nonce[12], const uint8_t* in, size_t size, uint8_t* out) const {
+    uint8_t counter[16];
+    std::memcpy(counter, nonce, 12);
+    uint32_t n = 2;     // счётчик 1 зарезервирован для тега
+    uint8_t stream[16];
+    for (size_t offset = 0; offset < size; offset += 16, ++n) {
+        counter[12] = static_cast<uint8_t>(n >> 24);
+        counter[13] = static_cast<uint8_t>(n >> 16);
+        counter[14] = static_cast<uint8_t>(n >> 8);
+        counter[15] = static_cast<uint8_t>(n);
+        aes.EncryptBlock(counter, stream);
+        size_t take = size - offset < 16 ? size - offset : 16;
+        for (size_t i = 0; i < take; ++i) out[offset + i] = in[offset + i] ^ stream[i];
+    }
+}
+
+void Aes128Gcm::Seal(const uint8_t nonce[12], const uint8_t* aad, size_t aadSize,
+    const uint8_t* plaintext, size_t size, std::vector<uint8_t>& out) const {
+    out.resize(size + 16);
+    Ctr(nonce, plaintext, size, out.data());
+    uint8_t tag[16];
+    Ghash(aad, aadSize, out.data(), size, tag);
+    uint8_t j0[16];
+    std::memcpy(j0, nonce, 12);
+    j0[12] = 0; j0[13] = 0; j0[14] = 0; j0[15] = 1;
+    uint8_t mask[16];
+    aes.EncryptBlock(j0, mask);
+    for (int i = 0; i < 16; ++i) out[size + i] = tag[i] ^ mask[i];
+}
+
+bool Aes128Gcm::Open(const uint8_t nonce[12], const uint8_t* aad, size_t aadSize,
+    const uint8_t* input, size_t size, std::vector<uint8_t>& out) const {
+    if (size < 16) return false;
+    size_t length = size - 16;
+    uint8_t tag[16];
+    Ghash(aad, aadSize, input, length, tag);
+    uint8_t j0[16];
+    std::memcpy(j0, nonce, 12);
+    j0[12] = 0; j0[13] = 0; j0[14] = 0; j0[15] = 1;
+    uint8_t mask[16];
+    aes.EncryptBlock(j0, mask);
+    uint8_t diff = 0;
+    for (int i = 0; i < 16; ++i) diff |= static_cast<uint8_t>((tag[i] ^ mask[i]) ^ input[length + i]);
+    if (diff != 0) return false;
+    out.resize(length);
+    Ctr(nonce, input, length, out.data());
+    return true;
+}
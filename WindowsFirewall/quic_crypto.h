@@ -0,0 +1,56 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Примитивы для снятия защиты пакетов QUIC Initial (RFC 9001, раздел 5): SHA-256, HMAC,
+// HKDF и AES-128-GCM. Ключи Initial выводятся из открытых данных пакета, поэтому реализация
+// не стремится к постоянному времени выполнения; для настоящих секретов она не годится.
+
+using Sha256Digest = std::array<uint8_t, 32>;
+
+Sha256Digest Sha256(const uint8_t* data, size_t size);
+Sha256Digest HmacSha256(const uint8_t* key, size_t keySize, const uint8_t* data, size_t size);
+
+// HKDF (RFC 5869) на SHA-256
+Sha256Digest HkdfExtract(const uint8_t* salt, size_t saltSize, const uint8_t* ikm, size_t ikmSize);
+std::vector<uint8_t> HkdfExpand(const Sha256Digest& prk, const uint8_t* info, size_t infoSize, size_t length);
+// HKDF-Expand-Label из TLS 1.3 (RFC 8446, 7.1) с пустым контекстом
+std::vector<uint8_t> HkdfExpandLabel(const Sha256Digest& secret, std::string_view label, size_t length);
+
+class Aes128 {
+public:
+    Aes128() = default;
+    explicit Aes128(const uint8_t key[16]) { SetKey(key); }
+    void SetKey(const uint8_t key[16]);
+    void EncryptBlock(const uint8_t in[16], uint8_t out[16]) const;
+
+private:
+    std::array<uint32_t, 44> roundKeys{};     // слова расписания ключа, старший байт первым
+};
+
+// AES-128-GCM с 12-байтовым nonce и 16-байтовым тегом (AEAD_AES_128_GCM)
+class Aes128Gcm {
+public:
+    Aes128Gcm() = default;
+    explicit Aes128Gcm(const uint8_t key[16]) { SetKey(key); }
+    void SetKey(const uint8_t key[16]);
+
+    // out получает ciphertext || tag
+    void Seal(const uint8_t nonce[12], const uint8_t* aad, size_t aadSize,
+        const uint8_t* plaintext, size_t size, std::vector<uint8_t>& out) const;
+    // input — ciphertext || tag; false — тег не сошёлся (out не заполняется)
+    bool Open(const uint8_t nonce[12], const uint8_t* aad, size_t aadSize,
+        const uint8_t* input, size_t size, std::vector<uint8_t>& out) const;
+
+private:
+    void Ghash(const uint8_t* aad, size_t aadSize, const uint8_t* data, size_t size, uint8_t tag[16]) const;
+    void Ctr(const uint8_t nonce[12], const uint8_t* in, size_t size, uint8_t* out) const;
+
+    Aes128 aes;
+    // Кратные H = E(K, 0^128) для умножения в GF(2^128) по полубайтам
+    std::array<uint64_t, 16> hashHigh{};
+    std::array<uint64_t, 16> hashLow{};
+};
@@ -0,0 +1,185 @@
+#include "quic_initial.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr uint32_t QUIC_VERSION_1 = 0x00000001;
+constexpr size_t MAX_CONNECTION_ID = 20;
+constexpr size_t SAMPLE_OFFSET = 4;     // образец для маски берётся как будто номер пакета 4 байта
+constexpr size_t SAMPLE_SIZE = 16;
+constexpr size_t TAG_SIZE = 16;
+
+// RFC 9001, 5.2: initial_salt для QUIC v1
+const uint8_t INITIAL_SALT_V1[20] = {
+    0x38, 0x76, 0x2c, 0xf7, 0xf5, 0x59, 0x34, 0xb3, 0x4d, 0x17,
+    0x9a, 0xe6, 0xa4, 0xc8, 0x0c, 0xad, 0xcc, 0xbb, 0x7f, 0x0a
+};
+
+// Целое переменной длины QUIC (RFC 9000, 16)
+bool ReadVarint(const uint8_t* data, size_t size, size_t& pos, uint64_t& value) {
+    if (pos >= size) return false;
+    size_t length = size_t(1) << (data[pos] >> 6);
+    if (size - pos < length) return false;
+    value = data[pos] & 0x3F;
+    for (size_t i = 1; i < length; ++i) value = (value << 8) | data[pos + i];
+    pos += length;
+    return true;
+}
+
+} // namespace
+
+void DeriveQuicInitialKeys(const uint8_t* dcid, size_t dcidLength, bool client, QuicInitialKeys& keys) {
+    Sha256Digest initialSecret = HkdfExtract(INITIAL_SALT_V1, sizeof(INITIAL_SALT_V1), dcid, dcidLength);
+    std::vector<uint8_t> secretBytes = HkdfExpandLabel(initialSecret, client ? "client in" : "server in", 32);
+    Sha256Digest secret;
+    std::memcpy(secret.data(), secretBytes.data(), secret.size());
+
+    std::vector<uint8_t> key = HkdfExpandLabel(secret, "quic key", sizeof(keys.key));
+    std::vector<uint8_t> iv = HkdfExpandLabel(secret, "quic iv", sizeof(keys.iv));
+    std::vector<uint8_t> hp = HkdfExpandLabel(secret, "quic hp", sizeof(keys.hp));
+    std::memcpy(keys.key, key.data(), sizeof(keys.key));
+    std::memcpy(keys.iv, iv.data(), sizeof(keys.iv));
+    std::memcpy(keys.hp, hp.data(), sizeof(keys.hp));
+}
+
+bool ParseQuicInitialHeader(const uint8_t* data, size_t size, QuicInitialHeader& header) {
+    // Длинный заголовок (бит формы и фиксированный бит), тип пакета 0 — Initial
+    if (size < 7 || (data[0] & 0xF0) != 0xC0) return false;
+    uint32_t version = (uint32_t(data[1]) << 24) | (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 8) | data[4];
+    if (version != QUIC_VERSION_1) return false;
+
+    size_t pos = 5;
+    size_t dcidLength = data[pos++];
+    if (dcidLength > MAX_CONNECTION_ID || size - pos < dcidLength + 1) return false;
+    header.dcid = data + pos;
+    header.dcidLength = dcidLength;
+    pos += dcidLength;
+    size_t scidLength = data[pos++];
+    if (scidLength > MAX_CONNECTION_ID || size - pos < scidLength) return false;
+    pos += scidLength;
+
+    uint64_t tokenLength = 0;
+    if (!ReadVarint(data, size, pos, tokenLength) || size - pos < tokenLength) return false;
+    pos += static_cast<size_t>(tokenLength);
+    uint64_t length = 0;
+    if (!ReadVarint(data, size, pos, length) || size - pos < length) return false;
+    // Номер пакета (до 4 байт), образец маски и тег должны уместиться в длину пакета
+    if (length < SAMPLE_OFFSET + SAMPLE_SIZE) return false;
+    header.packetNumberOffset = pos;
+    header.packetLength = pos + static_cast<size_t>(length);
+    return true;
+}
+
+QuicInitialProtection::QuicInitialProtection(const QuicInitialKeys& keys)
+    : aead(keys.key)
+    , headerProtection(keys.hp)
+{
+    std::memcpy(iv, keys.iv, sizeof(iv));
+}
+
+void QuicInitialProtection::Nonce(uint64_t packetNumber, uint8_t nonce[12]) const {
+    std::memcpy(nonce, iv, 12);
+    for (int i = 0; i < 8; ++i) nonce[11 - i] ^= static_cast<uint8_t>(packetNumber >> (8 * i));
+}
+
+bool QuicInitialProtection::Open(const uint8_t* packet, const QuicInitialHeader& header,
+    std::vector<uint8_t>& frames, uint64_t& packetNumber) const {
+    size_t pnOffset = header.packetNumberOffset;
+    uint8_t mask[16];
+    headerProtection.EncryptBlock(packet + pnOffset + SAMPLE_OFFSET, mask);
+
+    // Открытый заголовок собирается в копии: исходный буфер захвата не меняется
+    uint8_t first = static_cast<uint8_t>(packet[0] ^ (mask[0] & 0x0F));
+    size_t pnLength = (first & 0x03) + 1;
+    if (header.packetLength < pnOffset + pnLength + TAG_SIZE) return false;
+    std::vector<uint8_t> aad(packet, packet + pnOffset + pnLength);
+    aad[0] = first;
+    packetNumber = 0;
+    for (size_t i = 0; i < pnLength; ++i) {
+        aad[pnOffset + i] ^= mask[1 + i];
+        packetNumber = (packetNumber << 8) | aad[pnOffset + i];
+    }
+
+    uint8_t nonce[12];
+    Nonce(packetNumber, nonce);
+    size_t payloadOffset = pnOffset + pnLength;
+    return aead.Open(nonce, aad.data(), aad.size(), packet + payloadOffset, header.packetLength - payloadOffset, frames);
+}
+
+void QuicInitialProtection::Seal(const std::vector<uint8_t>& header, size_t packetNumberLength,
+    const uint8_t* frames, size_t size, std::vector<uint8_t>& packet) const {
+    size_t pnOffset = header.size() - packetNumberLength;
+    uint64_t packetNumber = 0;
+    for (size_t i = pnOffset; i < header.size(); ++i) packetNumber = (packetNumber << 8) | header[i];
+    uint8_t nonce[12];
+    Nonce(packetNumber, nonce);
+
+    std::vector<uint8_t> sealed;
+    aead.Seal(nonce, header.data(), header.size(), frames, size, sealed);
+    packet = header;
+    packet.insert(packet.end(), sealed.begin(), sealed.end());
+
+    uint8_t mask[16];
+    headerProtection.EncryptBlock(packet.data() + pnOffset + SAMPLE_OFFSET, mask);
+    packet[0] ^= mask[0] & 0x0F;
+    for (size_t i = 0; i < packetNumberLength; ++i) packet[pnOffset + i] ^= mask[1 + i];
+}
+
+bool QuicCryptoStream::AddFrames(const uint8_t* frames, size_t size) {
+    size_t pos = 0;
+    while (pos < size) {
+        uint64_t type = 0;
+        if (!ReadVarint(frames, size, pos, type)) return false;
+        switch (type) {
+        case 0x00:      // PADDING
+        case 0x01:      // PING
+            break;
+        case 0x02:      // ACK
+        case 0x03: {    // ACK с ECN
+            uint64_t largest = 0, delay = 0, rangeCount = 0, firstRange = 0;
+            if (!ReadVarint(frames, size, pos, largest) || !ReadVarint(frames, size, pos, delay)
+                || !ReadVarint(frames, size, pos, rangeCount) || !ReadVarint(frames, size, pos, firstRange)) {
+                return false;
+            }
+            if (rangeCount > size) return false;
+            for (uint64_t i = 0; i < rangeCount * 2 + (type == 0x03 ? 3 : 0); ++i) {
+                uint64_t unused = 0;
+                if (!ReadVarint(frames, size, pos, unused)) return false;
+            }
+            break;
+        }
+        case 0x06: {    // CRYPTO
+            uint64_t offset = 0, length = 0;
+            if (!ReadVarint(frames, size, pos, offset) || !ReadVarint(frames, size, pos, length)) return false;
+            if (size - pos < length) return false;
+            // Данные за MAX_SIZE не нужны: SNI в ClientHello встречается раньше
+            if (offset < MAX_SIZE) {
+                size_t end = static_cast<size_t>((std::min<uint64_t>)(offset + length, MAX_SIZE));
+                if (data.size() < end) {
+                    data.resize(end);
+                    received.resize(end);
+                }
+                size_t start = static_cast<size_t>(offset);
+                std::memcpy(data.data() + start, frames + pos, end - start);
+                std::memset(received.data() + start, 1, end - start);
+                while (contiguous < received.size() && received[contiguous]) ++contiguous;
+            }
+            pos += static_cast<size_t>(length);
+            break;
+        }
+        case 0x1C: {    // CONNECTION_CLOSE
+            uint64_t code = 0, frameType = 0, reasonLength = 0;
+            if (!ReadVarint(frames, size, pos, code) || !ReadVarint(frames, size, pos, frameType)
+                || !ReadVarint(frames, size, pos, reasonLength) || size - pos < reasonLength) {
+                return false;
+            }
+            pos += static_cast<size_t>(reasonLength);
+            break;
+        }
+        default:
+            return false;   // в пакетах Initial другие кадры запрещены (RFC 9000, 12.4)
+        }
+    }
+    return true;
+}
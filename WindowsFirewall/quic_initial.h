@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "quic_crypto.h"
+
+// Ключи защиты пакетов Initial одной стороны соединения (RFC 9001, 5.2)
+struct QuicInitialKeys {
+    uint8_t key[16];
+    uint8_t iv[12];
+    uint8_t hp[16];
+};
+
+// Ключи клиента (client = true) или сервера по Destination Connection ID первого пакета клиента.
+// Соль открытая, поэтому снять защиту Initial может любой наблюдатель.
+void DeriveQuicInitialKeys(const uint8_t* dcid, size_t dcidLength, bool client, QuicInitialKeys& keys);
+
+// Заголовок длинного пакета Initial QUIC v1 до снятия защиты
+struct QuicInitialHeader {
+    const uint8_t* dcid = nullptr;
+    size_t dcidLength = 0;
+    size_t packetNumberOffset = 0;
+    size_t packetLength = 0;        // пакет целиком: в датаграмме за ним могут идти другие
+};
+
+// false — не Initial версии 1 или заголовок выходит за датаграмму
+bool ParseQuicInitialHeader(const uint8_t* data, size_t size, QuicInitialHeader& header);
+
+// Защита заголовка и AEAD пакетов Initial одной стороны
+class QuicInitialProtection {
+public:
+    explicit QuicInitialProtection(const QuicInitialKeys& keys);
+
+    // Снимает защиту пакета packet (начало заголовка) и расшифровывает кадры.
+    // Номер пакета берётся как есть, без восстановления старших байт: для первых пакетов соединения
+    // он совпадает с полным.
+    bool Open(const uint8_t* packet, const QuicInitialHeader& header,
+        std::vector<uint8_t>& frames, uint64_t& packetNumber) const;
+    // Обратная операция для проверок: header — открытый заголовок, включая номер пакета
+    // длиной packetNumberLength байт в конце
+    void Seal(const std::vector<uint8_t>& header, size_t packetNumberLength,
+        const uint8_t* frames, size_t size, std::vector<uint8_t>& packet) const;
+
+private:
+    void Nonce(uint64_t packetNumber, uint8_t nonce[12]) const;
+
+    Aes128Gcm aead;
+    Aes128 headerProtection;
+    uint8_t iv[12];
+};
+
+// Данные кадров CRYPTO пакетов Initial, собранные по смещению. В QUIC ClientHello передаётся
+// без записей TLS и может быть разбит на кадры в произвольном порядке и на несколько пакетов.
+class QuicCryptoStream {
+public:
+    // false — кадры испорчены или не допустимы в пакете Initial
+    bool AddFrames(const uint8_t* frames, size_t size);
+    const uint8_t* Data() const { return data.data(); }
+    size_t ContiguousSize() const { return contiguous; }
+
+    static constexpr size_t MAX_SIZE = 4096;
+
+private:
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> received;  // 1 — байт получен
+    size_t contiguous = 0;
+};
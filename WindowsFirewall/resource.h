@@ -130,6 +130,7 @@
 #define IDC_RADIO_UDP					6103
 #define IDC_RADIO_TCP_UDP				6104
 #define IDC_RADIO_ALL					6105
+#define IDC_CHECK_WHITELIST				6106
 #define IDC_STATIC                      -1
 
 // Next default values for new objects
@@ -1,6 +1,7 @@
 #pragma once
 #include "firewall_types.h"
 #include <string>
+#include <ctime>
 
 class Rule {
 public:
@@ -12,6 +13,8 @@ public:
         , action(RuleAction::ALLOW)
         , enabled(true)
         , direction(RuleDirection::Inbound)
+        , priority(0)
+        , expiresAt(0)
     {
     }
 
@@ -27,9 +30,17 @@ public:
         , sourcePortStr(other.sourcePortStr)
         , destPortStr(other.destPortStr)     
         , appPath(other.appPath)
+        , service(other.service)
+        , icmpTypes(other.icmpTypes)
+        , tcpFlags(other.tcpFlags)
+        , connectionState(other.connectionState)
         , action(other.action)
         , enabled(other.enabled)
         , direction(other.direction)
+        , adapter(other.adapter)
+        , schedule(other.schedule)
+        , priority(other.priority)
+        , expiresAt(other.expiresAt)
         , creator(other.creator)
         , creationTime(other.creationTime)
     {
@@ -48,9 +59,17 @@ public:
             sourcePortStr = other.sourcePortStr; 
             destPortStr = other.destPortStr;     
             appPath = other.appPath;
+            service = other.service;
+            icmpTypes = other.icmpTypes;
+            tcpFlags = other.tcpFlags;
+            connectionState = other.connectionState;
             action = other.action;
             enabled = other.enabled;
             direction = other.direction;
+            adapter = other.adapter;
+            schedule = other.schedule;
+            priority = other.priority;
+            expiresAt = other.expiresAt;
             creator = other.creator;
             creationTime = other.creationTime;
         }
@@ -68,9 +87,17 @@ public:
     std::string sourcePortStr; 
     std::string destPortStr;
     std::string appPath;
+    std::string service;        // служба по содержимому или порту ("ssh", "bittorrent"); пусто — любая
+    std::string icmpTypes;      // типы ICMP/ICMPv6 "8,0,3/4" (тип или тип/код); пусто — любые
+    std::string tcpFlags;       // "SYN,!ACK": флаги, которые должны быть установлены или ('!') сброшены
+    std::string connectionState;    // "NEW", "ESTABLISHED,RELATED"; пусто — любое
     RuleAction action;
     bool enabled;
     RuleDirection direction;
+    std::string adapter;        // IPv4 адаптера ("192.168.1.10", как PacketInfo::adapterIp); пусто — любой
+    std::string schedule;       // "Mon-Fri 09:00-18:00; Sat 10:00-14:00" по местному времени; пусто — всегда
+    int priority;               // больше — проверяется раньше; при равном приоритете решает порядок в списке
+    time_t expiresAt;           // время (Unix), когда временное правило снимается; 0 — постоянное
     std::string creator;
     std::string creationTime;
 };
\ No newline at end of file
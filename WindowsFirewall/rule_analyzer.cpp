@@ -0,0 +1,524 @@
+#include "rule_analyzer.h"
+#include "ip_utils.h"
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+namespace {
+
+enum Field : unsigned {
+    FIELD_DEST_PORTS = 1,
+    FIELD_SOURCE_PORTS = 2,
+    FIELD_DEST_ADDRESS = 4,
+    FIELD_SOURCE_ADDRESS = 8
+};
+
+struct Entry {
+    const Rule* rule;
+    CompiledRule compiled;
+    bool alive = true;
+    unsigned changed = 0;   // маска Field, переписанных слиянием
+};
+
+int PrefixLength(uint32_t mask) {
+    int length = 0;
+    while (length < 32 && (mask & (0x80000000u >> length))) ++length;
+    return length;
+}
+
+std::vector<PortRange> Normalize(std::vector<PortRange> ranges) {
+    std::sort(ranges.begin(), ranges.end(), [](const PortRange& a, const PortRange& b) {
+        return a.low < b.low;
+    });
+    std::vector<PortRange> result;
+    for (const auto& r : ranges) {
+        // Пересекающиеся и смежные диапазоны (80-89, 90-99) склеиваются
+        if (!result.empty() && static_cast<uint32_t>(r.low) <= static_cast<uint32_t>(result.back().high) + 1) {
+            result.back().high = (std::max)(result.back().high, r.high);
+        }
+        else {
+            result.push_back(r);
+        }
+    }
+    return result;
+}
+
+// Диапазоны обоих аргументов нормализованы (Normalize)
+bool PortsCover(const std::vector<PortRange>& outer, const std::vector<PortRange>& inner) {
+    if (outer.empty()) return true;
+    if (inner.empty()) return false;
+    for (const auto& r : inner) {
+        bool covered = false;
+        for (const auto& o : outer) {
+            if (o.low <= r.low && r.high <= o.high) {
+                covered = true;
+                break;
+            }
+        }
+        if (!covered) return false;
+    }
+    return true;
+}
+
+bool PortsOverlap(const std::vector<PortRange>& a, const std::vector<PortRange>& b) {
+    if (a.empty() || b.empty()) return true;
+    for (const auto& x : a) {
+        for (const auto& y : b) {
+            if (x.low <= y.high && y.low <= x.high) return true;
+        }
+    }
+    return false;
+}
+
+std::vector<PortRange> UnionPorts(const std::vector<PortRange>& a, const std::vector<PortRange>& b) {
+    if (a.empty() || b.empty()) return {};
+    std::vector<PortRange> all = a;
+    all.insert(all.end(), b.begin(), b.end());
+    return Normalize(all);
+}
+
+// Пустой набор — любой пакет, в том числе не ICMP
+bool IcmpTypesCover(const std::vector<IcmpTypeMatch>& outer, const std::vector<IcmpTypeMatch>& inner) {
+    if (outer.empty()) return true;
+    if (inner.empty()) return false;
+    for (const auto& i : inner) {
+        bool covered = std::any_of(outer.begin(), outer.end(), [&](const IcmpTypeMatch& o) {
+            return o.type == i.type && (o.code < 0 || o.code == i.code);
+        });
+        if (!covered) return false;
+    }
+    return true;
+}
+
+bool IcmpTypesOverlap(const std::vector<IcmpTypeMatch>& a, const std::vector<IcmpTypeMatch>& b) {
+    if (a.empty() || b.empty()) return true;
+    for (const auto& x : a) {
+        for (const auto& y : b) {
+            if (x.type == y.type && (x.code < 0 || y.code < 0 || x.code == y.code)) return true;
+        }
+    }
+    return false;
+}
+
+// Правило с флагами или состоянием проверяется на каждом пакете соединения, без них — только
+// на первом (см. ConnectionTracker), поэтому покрывать друг друга могут лишь правила одного вида
+bool PacketConditionsCover(const CompiledRule& outer, const CompiledRule& inner) {
+    if ((outer.tcpFlagsMask == 0) != (inner.tcpFlagsMask == 0)) return false;
+    if ((outer.states == 0) != (inner.states == 0)) return false;
+    return (outer.tcpFlagsMask & inner.tcpFlagsMask) == outer.tcpFlagsMask
+        && (inner.tcpFlagsSet & outer.tcpFlagsMask) == outer.tcpFlagsSet
+        && (inner.states & ~outer.states) == 0;
+}
+
+bool PacketConditionsOverlap(const CompiledRule& a, const CompiledRule& b) {
+    return ((a.tcpFlagsSet ^ b.tcpFlagsSet) & a.tcpFlagsMask & b.tcpFlagsMask) == 0
+        && (a.states == 0 || b.states == 0 || (a.states & b.states) != 0);
+}
+
+// Правило без расписания действует всегда
+bool ScheduleCovers(const CompiledRule& outer, const CompiledRule& inner) {
+    if (!outer.schedule) return true;
+    return inner.schedule && outer.schedule->Covers(*inner.schedule);
+}
+
+bool SchedulesOverlap(const CompiledRule& a, const CompiledRule& b) {
+    return !a.schedule || !b.schedule || a.schedule->Overlaps(*b.schedule);
+}
+
+// Временное правило заменяет другое, только пока действует: покрыть можно правило, которое
+// снимется не позже
+bool LivesAsLong(const Rule& outer, const Rule& inner) {
+    return outer.expiresAt == 0 || (inner.expiresAt != 0 && outer.expiresAt >= inner.expiresAt);
+}
+
+bool AddressCovers(const AddressMatch& outer, const AddressMatch& inner) {
+    if (outer.any) return true;
+    if (inner.any || outer.never || inner.never) return false;
+    return (outer.mask & inner.mask) == outer.mask && (inner.network & outer.mask) == outer.network;
+}
+
+bool AddressOverlaps(const AddressMatch& a, const AddressMatch& b) {
+    // Домены (never) для WFP разрешаются в адреса — считаем, что пересекаются со всем
+    if (a.any || b.any || a.never || b.never) return true;
+    uint32_t mask = a.mask & b.mask;
+    return (a.network & mask) == (b.network & mask);
+}
+
+std::string AddressKey(const AddressMatch& a) {
+    if (a.any) return "*";
+    if (a.never) return "!";
+    return std::to_string(a.network) + "/" + std::to_string(PrefixLength(a.mask));
+}
+
+std::string PortsKey(const std::vector<PortRange>& ranges) {
+    return RuleAnalyzer::FormatPorts(ranges);
+}
+
+std::string IcmpTypesKey(std::vector<IcmpTypeMatch> types) {
+    std::sort(types.begin(), types.end(), [](const IcmpTypeMatch& a, const IcmpTypeMatch& b) {
+        return a.type != b.type ? a.type < b.type : a.code < b.code;
+    });
+    std::string key;
+    for (const auto& t : types) {
+        key += std::to_string(t.type) + "/" + std::to_string(t.code) + ",";
+    }
+    return key;
+}
+
+// Ключ группы: всё, кроме поля, по которому выполняется слияние
+std::string GroupKey(const CompiledRule& c, Field except) {
+    std::string key;
+    key += std::to_string(static_cast<int>(c.direction)) + "|";
+    key += std::to_string(c.adapter) + "|";
+    key += std::to_string(static_cast<int>(c.action)) + "|";
+    key += std::to_string(c.ipProtocol) + "|";
+    key += std::to_string(static_cast<int>(c.app.kind)) + ":" + std::to_string(c.app.id) + "|";
+    key += std::to_string(c.service) + "|";
+    key += IcmpTypesKey(c.icmpTypes) + "|";
+    key += std::to_string(c.tcpFlagsMask) + "/" + std::to_string(c.tcpFlagsSet) + ":" + std::to_string(c.states) + "|";
+    key += (c.schedule ? c.schedule->Text() : std::string()) + "|";
+    key += (except == FIELD_SOURCE_ADDRESS ? "#" + std::to_string(PrefixLength(c.source.mask)) : AddressKey(c.source)) + "|";
+    key += (except == FIELD_DEST_ADDRESS ? "#" + std::to_string(PrefixLength(c.dest.mask)) : AddressKey(c.dest)) + "|";
+    key += (except == FIELD_SOURCE_PORTS ? "#" : PortsKey(c.sourcePorts)) + "|";
+    key += (except == FIELD_DEST_PORTS ? "#" : PortsKey(c.destPorts));
+    return key;
+}
+
+void NormalizePorts(CompiledRule& rule) {
+    rule.sourcePorts = Normalize(rule.sourcePorts);
+    rule.destPorts = Normalize(rule.destPorts);
+}
+
+bool CoversNormalized(const CompiledRule& outer, const CompiledRule& inner) {
+    return outer.direction == inner.direction
+        && (outer.adapter == 0 || outer.adapter == inner.adapter)
+        && (outer.ipProtocol == 0 || outer.ipProtocol == inner.ipProtocol)
+        && outer.app == inner.app
+        && (outer.service == UNKNOWN_SERVICE || outer.service == inner.service)
+        && AddressCovers(outer.source, inner.source)
+        && AddressCovers(outer.dest, inner.dest)
+        && PortsCover(outer.sourcePorts, inner.sourcePorts)
+        && PortsCover(outer.destPorts, inner.destPorts)
+        && IcmpTypesCover(outer.icmpTypes, inner.icmpTypes)
+        && PacketConditionsCover(outer, inner)
+        && ScheduleCovers(outer, inner);
+}
+
+uint64_t CoverageKey(const CompiledRule& c, uint32_t network, int prefixLength) {
+    uint64_t app = (static_cast<uint64_t>(c.app.kind) << 32) | c.app.id;
+    return (app * 0x9E3779B97F4A7C15ull)
+        ^ (static_cast<uint64_t>(network) << 8)
+        ^ (static_cast<uint64_t>(prefixLength) << 1)
+        ^ static_cast<uint64_t>(c.direction == RuleDirection::Outbound);
+}
+
+// Нет ли между правилами i и j живого правила с другим действием, пересекающегося с j:
+// только тогда пакеты j можно решать на позиции i
+bool CanHoist(const std::vector<Entry>& entries, size_t i, size_t j) {
+    const CompiledRule& moved = entries[j].compiled;
+    for (size_t k = i + 1; k < j; ++k) {
+        if (!entries[k].alive) continue;
+        const CompiledRule& between = entries[k].compiled;
+        if (between.action != moved.action && RuleAnalyzer::Overlaps(between, moved)) return false;
+    }
+    return true;
+}
+
+bool TryMerge(std::vector<Entry>& entries, size_t i, size_t j, Field field) {
+    CompiledRule& target = entries[i].compiled;
+    const CompiledRule& source = entries[j].compiled;
+    switch (field) {
+    case FIELD_DEST_PORTS:
+        target.destPorts = UnionPorts(target.destPorts, source.destPorts);
+        break;
+    case FIELD_SOURCE_PORTS:
+        target.sourcePorts = UnionPorts(target.sourcePorts, source.sourcePorts);
+        break;
+    case FIELD_DEST_ADDRESS:
+    case FIELD_SOURCE_ADDRESS: {
+        AddressMatch& a = (field == FIELD_DEST_ADDRESS) ? target.dest : target.source;
+        const AddressMatch& b = (field == FIELD_DEST_ADDRESS) ? source.dest : source.source;
+        int length = PrefixLength(a.mask);
+        // Только соседние подсети одной длины: 10.0.0.0/25 + 10.0.0.128/25 = 10.0.0.0/24
+        if (a.any || a.never || b.any || b.never || length == 0 || a.mask != b.mask) return false;
+        if ((a.network ^ b.network) != (1u << (32 - length))) return false;
+        a.mask = PrefixToMask(length - 1);
+        a.network &= a.mask;
+        break;
+    }
+    }
+    entries[i].changed |= field;
+    entries[j].alive = false;
+    return true;
+}
+
+} // namespace
+
+size_t RuleAnalysis::Count(RuleFindingKind kind) const {
+    return static_cast<size_t>(std::count_if(findings.begin(), findings.end(),
+        [kind](const RuleFinding& f) { return f.kind == kind; }));
+}
+
+const char* RuleFindingKindToString(RuleFindingKind kind) {
+    switch (kind) {
+    case RuleFindingKind::Redundant: return "redundant";
+    case RuleFindingKind::Shadowed: return "shadowed";
+    case RuleFindingKind::Merged: return "merged";
+    default: return "unknown";
+    }
+}
+
+bool RuleAnalyzer::Covers(const CompiledRule& outer, const CompiledRule& inner) {
+    CompiledRule a = outer;
+    CompiledRule b = inner;
+    NormalizePorts(a);
+    NormalizePorts(b);
+    return CoversNormalized(a, b);
+}
+
+bool RuleAnalyzer::Overlaps(const CompiledRule& a, const CompiledRule& b) {
+    // Приложение не учитывается. Правила разных направлений не пересекаются, если оба без
+    // состояния (направление пакета) или оба с состоянием (направление соединения)
+    return (a.direction == b.direction || (a.states != 0) != (b.states != 0))
+        && (a.adapter == 0 || b.adapter == 0 || a.adapter == b.adapter)
+        && (a.ipProtocol == 0 || b.ipProtocol == 0 || a.ipProtocol == b.ipProtocol)
+        && (a.service == UNKNOWN_SERVICE || b.service == UNKNOWN_SERVICE || a.service == b.service)
+        && AddressOverlaps(a.source, b.source)
+        && AddressOverlaps(a.dest, b.dest)
+        && PortsOverlap(a.sourcePorts, b.sourcePorts)
+        && PortsOverlap(a.destPorts, b.destPorts)
+        && IcmpTypesOverlap(a.icmpTypes, b.icmpTypes)
+        && PacketConditionsOverlap(a, b)
+        && SchedulesOverlap(a, b);
+}
+
+std::string RuleAnalyzer::FormatAddress(const AddressMatch& address) {
+    if (address.any || address.never) return "";
+    std::string result = FormatIPv4(address.network);
+    if (address.mask != 0xFFFFFFFFu) result += "/" + std::to_string(PrefixLength(address.mask));
+    return result;
+}
+
+std::string RuleAnalyzer::FormatPorts(const std::vector<PortRange>& ranges) {
+    std::string result;
+    for (const auto& r : ranges) {
+        if (!result.empty()) result += ",";
+        result += std::to_string(r.low);
+        if (r.high != r.low) result += "-" + std::to_string(r.high);
+    }
+    return result;
+}
+
+RuleAnalysis RuleAnalyzer::Analyze(const std::vector<Rule>& rules, bool minimize) {
+    RuleAnalysis result;
+    // "Более раннее" — в порядке вычисления; minimized выходит в нём же
+    std::vector<Rule> ordered = RuleMatcher::EvaluationOrder(rules);
+    std::vector<Entry> entries;
+    entries.reserve(ordered.size());
+    for (const auto& rule : ordered) {
+        if (!rule.enabled) continue;
+        CompiledRule compiled = RuleMatcher::CompileRule(rule);
+        NormalizePorts(compiled);
+        entries.push_back({ &rule, compiled });
+    }
+    result.enabledBefore = entries.size();
+
+    // 1. Покрытие более ранним правилом. Кандидаты ищутся по префиксам адреса назначения,
+    //    покрытые правила в индекс не попадают (всё, что покрывают они, покрывает и их покрывающее)
+    std::unordered_map<uint64_t, std::vector<size_t>> index;
+    for (size_t j = 0; j < entries.size(); ++j) {
+        const CompiledRule& rule = entries[j].compiled;
+        int maxLength = (rule.dest.any || rule.dest.never) ? 0 : PrefixLength(rule.dest.mask);
+
+        size_t sameAction = SIZE_MAX;
+        size_t otherAction = SIZE_MAX;
+        for (int length = 0; length <= maxLength && sameAction == SIZE_MAX; ++length) {
+            auto it = index.find(CoverageKey(rule, rule.dest.network & PrefixToMask(length), length));
+            if (it == index.end()) continue;
+            for (size_t i : it->second) {
+                if (!CoversNormalized(entries[i].compiled, rule) || !LivesAsLong(*entries[i].rule, *entries[j].rule)) continue;
+                if (entries[i].compiled.action == rule.action) {
+                    sameAction = i;
+                    break;
+                }
+                otherAction = (std::min)(otherAction, i);
+            }
+        }
+
+        if (sameAction != SIZE_MAX) {
+            result.findings.push_back({ RuleFindingKind::Redundant, rule.id, entries[sameAction].compiled.id });
+            entries[j].alive = false;
+        }
+        else if (otherAction != SIZE_MAX) {
+            // Правило мертво и в RuleMatcher, и в WFP, но скорее это ошибка в списке: не удаляем, а сообщаем
+            result.findings.push_back({ RuleFindingKind::Shadowed, rule.id, entries[otherAction].compiled.id });
+        }
+        else if (!rule.dest.never) {
+            index[CoverageKey(rule, rule.dest.network, maxLength)].push_back(j);
+        }
+    }
+
+    // 2. Слияние правил, отличающихся одним полем, до неподвижной точки
+    //    (объединение подсетей поднимается по одному биту за проход)
+    const Field fields[] = { FIELD_DEST_PORTS, FIELD_SOURCE_PORTS, FIELD_DEST_ADDRESS, FIELD_SOURCE_ADDRESS };
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Field field : fields) {
+            std::unordered_map<std::string, std::vector<size_t>> groups;
+            for (size_t j = 0; j < entries.size(); ++j) {
+                // Временные правила не сливаются: каждое снимается в свой срок
+                if (!entries[j].alive || entries[j].rule->expiresAt != 0
+                    || entries[j].compiled.source.never || entries[j].compiled.dest.never) continue;
+                groups[GroupKey(entries[j].compiled, field)].push_back(j);
+            }
+            for (auto& kv : groups) {
+                const std::vector<size_t>& members = kv.second;
+                if (field == FIELD_DEST_PORTS || field == FIELD_SOURCE_PORTS) {
+                    // Порты объединяются с ближайшим предыдущим правилом группы
+                    size_t last = members[0];
+                    for (size_t a = 1; a < members.size(); ++a) {
+                        size_t j = members[a];
+                        if (CanHoist(entries, last, j) && TryMerge(entries, last, j, field)) {
+                            result.findings.push_back({ RuleFindingKind::Merged, entries[j].compiled.id, entries[last].compiled.id });
+                            changed = true;
+                        }
+                        else {
+                            last = j;
+                        }
+                    }
+                    continue;
+                }
+
+                // Подсети: ищем соседа той же длины по адресу
+                std::unordered_map<uint32_t, size_t> byNetwork;
+                for (size_t j : members) {
+                    const AddressMatch& address = (field == FIELD_DEST_ADDRESS) ? entries[j].compiled.dest : entries[j].compiled.source;
+                    int length = PrefixLength(address.mask);
+                    if (address.any || length == 0) continue;
+                    auto sibling = byNetwork.find(address.network ^ (1u << (32 - length)));
+                    if (sibling != byNetwork.end() && CanHoist(entries, sibling->second, j)
+                        && TryMerge(entries, sibling->second, j, field)) {
+                        result.findings.push_back({ RuleFindingKind::Merged, entries[j].compiled.id, entries[sibling->second].compiled.id });
+                        byNetwork.erase(sibling);
+                        changed = true;
+                        continue;
+                    }
+                    byNetwork[address.network] = j;
+                }
+            }
+        }
+    }
+
+    for (const auto& e : entries) {
+        if (!e.alive) continue;
+        ++result.enabledAfter;
+        if (!minimize) continue;
+
+        Rule r = *e.rule;
+        if (e.changed & FIELD_SOURCE_ADDRESS) r.sourceIp = FormatAddress(e.compiled.source);
+        if (e.changed & FIELD_DEST_ADDRESS) r.destIp = FormatAddress(e.compiled.dest);
+        if (e.changed & FIELD_SOURCE_PORTS) {
+            r.sourcePortStr = FormatPorts(e.compiled.sourcePorts);
+            r.sourcePort = e.compiled.sourcePorts.empty() ? 0 : e.compiled.sourcePorts.front().low;
+        }
+        if (e.changed & FIELD_DEST_PORTS) {
+            r.destPortStr = FormatPorts(e.compiled.destPorts);
+            r.destPort = e.compiled.destPorts.empty() ? 0 : e.compiled.destPorts.front().low;
+        }
+        result.minimized.push_back(r);
+    }
+    return result;
+}
+
+namespace {
+
+// Перестановка order (позиция -> правило) подъёмом правил к началу. Правило перепрыгивает только
+// через соседнее правило, с которым не пересекается: каждый шаг сохраняет ответ для любого пакета,
+// значит, и вся перестановка. Пересекающееся правило впереди поднимается первым, с частотой
+// поднимаемого (его проверяют все пакеты того), но не глубже MAX_DEPTH
+class HotRuleRaiser {
+public:
+    HotRuleRaiser(const std::vector<CompiledRule>& compiled, std::vector<uint64_t> weight)
+        : compiled(compiled), priority(std::move(weight)), order(compiled.size()), position(compiled.size()) {
+        for (uint32_t i = 0; i < order.size(); ++i) order[i] = position[i] = i;
+    }
+
+    // Поднимается, пока впереди правила реже priority; false — не сдвинулось
+    bool Raise(uint32_t rule, uint64_t value, int depth = 0) {
+        size_t from = position[rule];
+        size_t to = from;
+        while (to > 0) {
+            uint32_t previous = order[to - 1];
+            // Границу приоритетов правил (Rule::priority) подъём не пересекает
+            if (priority[previous] >= value || compiled[previous].priority != compiled[rule].priority) break;
+            if (RuleAnalyzer::Overlaps(compiled[previous], compiled[rule])) {
+                // Поднятое правило уходит выше, на его место сдвигаются уже пройденные не дальше to - 1
+                if (depth >= MAX_DEPTH || !Raise(previous, value, depth + 1)) break;
+                continue;
+            }
+            --to;
+        }
+        priority[rule] = (std::max)(priority[rule], value);
+        if (to == from) return false;
+        std::rotate(order.begin() + to, order.begin() + from, order.begin() + from + 1);
+        for (size_t p = to; p <= from; ++p) position[order[p]] = static_cast<uint32_t>(p);
+        return true;
+    }
+
+    const std::vector<uint32_t>& Order() const { return order; }
+    const std::vector<uint32_t>& Positions() const { return position; }
+
+private:
+    static constexpr int MAX_DEPTH = 8;
+    const std::vector<CompiledRule>& compiled;
+    std::vector<uint64_t> priority;
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> position;     // правило -> позиция
+};
+
+} // namespace
+
+RuleOrder RuleAnalyzer::ReorderByHits(const std::vector<Rule>& rules, const std::unordered_map<int, uint64_t>& hits) {
+    RuleOrder result;
+    std::vector<Rule> ordered = RuleMatcher::EvaluationOrder(rules);
+    std::vector<const Rule*> enabled;
+    std::vector<CompiledRule> compiled;
+    std::vector<uint64_t> weight;
+    for (const auto& rule : ordered) {
+        if (!rule.enabled) continue;
+        auto it = hits.find(rule.id);
+        enabled.push_back(&rule);
+        compiled.push_back(RuleMatcher::CompileRule(rule));
+        weight.push_back(it == hits.end() ? 0 : it->second);
+    }
+    std::vector<uint32_t> hot;
+    for (uint32_t i = 0; i < weight.size(); ++i) {
+        if (weight[i] > 0) hot.push_back(i);
+    }
+    std::sort(hot.begin(), hot.end(), [&weight](uint32_t a, uint32_t b) {
+        return weight[a] != weight[b] ? weight[a] > weight[b] : a < b;
+    });
+    if (hot.size() > MAX_REORDER_HOT) hot.resize(MAX_REORDER_HOT);
+
+    // Самые частые правила поднимаются первыми, следующие останавливаются перед ними
+    HotRuleRaiser raiser(compiled, weight);
+    for (uint32_t rule : hot) raiser.Raise(rule, weight[rule]);
+
+    const std::vector<uint32_t>& position = raiser.Positions();
+    double before = 0;
+    double after = 0;
+    for (uint32_t i = 0; i < weight.size(); ++i) {
+        result.packets += weight[i];
+        result.moved += position[i] < i;
+        before += static_cast<double>(weight[i]) * (i + 1);
+        after += static_cast<double>(weight[i]) * (position[i] + 1);
+    }
+    if (result.packets) {
+        result.testedBefore = before / result.packets;
+        result.testedAfter = after / result.packets;
+    }
+    result.rules.reserve(enabled.size());
+    for (uint32_t rule : raiser.Order()) result.rules.push_back(*enabled[rule]);
+    return result;
+}
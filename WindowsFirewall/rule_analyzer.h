@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "rule.h"
+#include "rule_matcher.h"
+
+enum class RuleFindingKind {
+    Redundant,  // полностью покрыто более ранним правилом с тем же действием — удаляется
+    Shadowed,   // покрыто более ранним правилом с другим действием — только отчёт
+    Merged      // объединено с более ранним правилом (порты, соседние подсети)
+};
+
+struct RuleFinding {
+    RuleFindingKind kind;
+    int ruleId;         // найденное правило
+    int otherRuleId;    // покрывающее правило / правило, в которое выполнено слияние
+};
+
+struct RuleAnalysis {
+    std::vector<RuleFinding> findings;
+    std::vector<Rule> minimized;    // эквивалентный набор включённых правил (если запрошен)
+    size_t enabledBefore = 0;
+    size_t enabledAfter = 0;
+
+    size_t Count(RuleFindingKind kind) const;
+};
+
+// Порядок проверки включённых правил по частоте срабатываний
+struct RuleOrder {
+    std::vector<Rule> rules;        // включённые правила в новом порядке
+    size_t moved = 0;               // правил, поднятых выше своего места
+    uint64_t packets = 0;           // срабатываний, по которым считались средние
+    // Среднее число правил, проверенных до подошедшего при просмотре подряд, до и после перестановки
+    double testedBefore = 0;
+    double testedAfter = 0;
+};
+
+// Поиск затенённых, избыточных и объединяемых правил в порядке вычисления
+// (RuleMatcher::EvaluationOrder). Эквивалентность сохраняется для first-match и для WFP, где
+// в том же порядке идут веса фильтров: затенённые правила с другим действием не удаляются,
+// а правило приложения покрывается только правилом того же приложения.
+class RuleAnalyzer {
+public:
+    static RuleAnalysis Analyze(const std::vector<Rule>& rules, bool minimize = true);
+
+    static bool Covers(const CompiledRule& outer, const CompiledRule& inner);
+    static bool Overlaps(const CompiledRule& a, const CompiledRule& b);
+
+    // Частые правила поднимаются выше, пока перед ними стоят более редкие правила того же
+    // приоритета, с которыми они не пересекаются (Overlaps, без учёта приложения). Пересекающиеся пары
+    // образуют граф зависимостей, и их взаимный порядок не меняется, а правила, подходящие
+    // к одному пакету, всегда пересекаются: первое подошедшее правило любого действия остаётся
+    // тем же. Поднимаются не больше MAX_REORDER_HOT самых частых правил.
+    // hits — срабатывания по id правила (RuleStats)
+    static RuleOrder ReorderByHits(const std::vector<Rule>& rules, const std::unordered_map<int, uint64_t>& hits);
+    static constexpr size_t MAX_REORDER_HOT = 1024;
+
+    static std::string FormatAddress(const AddressMatch& address);
+    static std::string FormatPorts(const std::vector<PortRange>& ranges);
+};
+
+const char* RuleFindingKindToString(RuleFindingKind kind);
@@ -0,0 +1,84 @@
+#include "rule_expiry.h"
+
+void ExpiryWheel::Start(int64_t now) {
+    Rebuild(now);
+}
+
+void ExpiryWheel::Clear() {
+    for (auto& level : slots) {
+        for (auto& slot : level) slot.clear();
+    }
+    overflow.clear();
+    due.clear();
+    deadlines.clear();
+}
+
+void ExpiryWheel::Schedule(int ruleId, int64_t expiresAt) {
+    deadlines[ruleId] = expiresAt;
+    if (started) Insert({ ruleId, expiresAt });
+}
+
+void ExpiryWheel::Cancel(int ruleId) {
+    deadlines.erase(ruleId);
+}
+
+// Уровень — старшая группа битов, в которой срок отличается от позиции: срок уровня L
+// спускается ниже, когда позиция доходит до его слота
+void ExpiryWheel::Insert(const Entry& entry) {
+    if (entry.expiresAt <= current) {
+        due.push_back(entry);
+        return;
+    }
+    uint64_t diff = static_cast<uint64_t>(entry.expiresAt) ^ static_cast<uint64_t>(current);
+    int level = 0;
+    while (level < LEVELS && (diff >> (SLOT_BITS * (level + 1))) != 0) ++level;
+    if (level == LEVELS) {
+        overflow.push_back(entry);
+        return;
+    }
+    slots[level][(entry.expiresAt >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(entry);
+}
+
+void ExpiryWheel::Rebuild(int64_t now) {
+    for (auto& level : slots) {
+        for (auto& slot : level) slot.clear();
+    }
+    overflow.clear();
+    due.clear();
+    current = now;
+    started = true;
+    for (const auto& kv : deadlines) Insert({ kv.first, kv.second });
+}
+
+void ExpiryWheel::Advance(int64_t now, std::vector<int>& expired) {
+    expired.clear();
+    if (!started) Start(now);
+    if (now - current > MAX_STEP) Rebuild(now);
+    std::vector<Entry> cascade;
+    while (current < now) {
+        ++current;
+        // Оборот уровня спускает его следующий слот ниже, начиная с верхнего: срок, спущенный
+        // в слот уровня L - 1 под позицией, разбирается на этом же тике
+        if ((current & ((int64_t(1) << (SLOT_BITS * LEVELS)) - 1)) == 0) {
+            cascade.swap(overflow);
+            for (const auto& entry : cascade) Insert(entry);
+            cascade.clear();
+        }
+        for (int level = LEVELS - 1; level > 0; --level) {
+            if ((current & ((int64_t(1) << (SLOT_BITS * level)) - 1)) != 0) continue;
+            cascade.swap(slots[level][(current >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+            for (const auto& entry : cascade) Insert(entry);
+            cascade.clear();
+        }
+        std::vector<Entry>& slot = slots[0][current & (SLOTS - 1)];
+        due.insert(due.end(), slot.begin(), slot.end());
+        slot.clear();
+    }
+    for (const auto& entry : due) {
+        auto it = deadlines.find(entry.ruleId);
+        if (it == deadlines.end() || it->second != entry.expiresAt) continue;
+        expired.push_back(entry.ruleId);
+        deadlines.erase(it);
+    }
+    due.clear();
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Сроки временных правил (Rule::expiresAt) в иерархическом колесе: LEVELS уровней по SLOTS слотов,
+// слот уровня L — SLOTS^L секунд. Постановка и снятие — O(1), срок спускается по уровням
+// не больше LEVELS раз, поэтому тысячи истечений стоят O(1) каждое, а не перебор всех правил
+// на каждом тике
+class ExpiryWheel {
+public:
+    // Время — секунды Unix (time_t), как в Rule::expiresAt. Позиция колеса — now; сроки,
+    // поставленные до Start, переносятся
+    void Start(int64_t now);
+    void Clear();
+
+    // Прежний срок правила заменяется; срок, который уже наступил, истечёт при следующем Advance
+    void Schedule(int ruleId, int64_t expiresAt);
+    void Cancel(int ruleId);
+    bool Empty() const { return deadlines.empty(); }
+    size_t Size() const { return deadlines.size(); }
+
+    // id правил со сроком не позже now. Часы, переставленные назад, колесо не двигают: сроки
+    // наступят по прежней позиции
+    void Advance(int64_t now, std::vector<int>& expired);
+
+private:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 6;
+    static constexpr uint32_t SLOTS = 1u << SLOT_BITS;
+    // Разрыв больше этого (спящий режим, перевод часов) — колесо собирается заново, а не
+    // проходит каждую секунду
+    static constexpr int64_t MAX_STEP = int64_t(1) << (2 * SLOT_BITS);
+
+    struct Entry {
+        int ruleId;
+        int64_t expiresAt;
+    };
+
+    void Insert(const Entry& entry);
+    void Rebuild(int64_t now);
+
+    std::vector<Entry> slots[LEVELS][SLOTS];
+    std::vector<Entry> overflow;            // дальше SLOTS^LEVELS секунд, разбирается на обороте верхнего уровня
+    std::vector<Entry> due;                 // срок не позже позиции колеса
+    std::unordered_map<int, int64_t> deadlines;     // действующий срок правила; записи в слотах с другим сроком устарели
+    int64_t current = 0;
+    bool started = false;
+};
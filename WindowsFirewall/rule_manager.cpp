@@ -7,11 +7,18 @@
 #include <codecvt>
 #include <locale>
 #include <fstream>
+#include <cstdio>
 #include <nlohmann/json.hpp>
 #include "rule.h"
 #include "string_utils.h" 
 #include "validator.h"
 #include "rule_wizard.h"
+#include "rule_stats.h"
+#include "ip_utils.h"
+#include "dns_resolver_feeder.h"
+#include "address_list.h"
+#include <filesystem>
+#include <chrono>
 #include <commctrl.h>
 
 #pragma comment(lib, "comctl32.lib")
@@ -22,8 +29,14 @@
 
 RuleManager::RuleManager() {
     LoadRulesFromFile();
+    LoadProfiles();
+    LoadRuleStats();
+    LoadFilterMode();
+}
+RuleManager::~RuleManager() {
+    SaveRuleStats();
+    if (compactWorker.joinable()) compactWorker.join();
 }
-RuleManager::~RuleManager() = default;
 
 using nlohmann::json;
 
@@ -34,6 +47,7 @@ static std::string ProtocolToString(Protocol proto) {
     case Protocol::TCP: return "TCP";
     case Protocol::UDP: return "UDP";
     case Protocol::ICMP: return "ICMP";
+    case Protocol::ICMPV6: return "ICMPV6";
     default: return "UNKNOWN";
     }
 }
@@ -41,6 +55,7 @@ static Protocol ProtocolFromString(const std::string& str) {
     if (str == "TCP") return Protocol::TCP;
     if (str == "UDP") return Protocol::UDP;
     if (str == "ICMP") return Protocol::ICMP;
+    if (str == "ICMPV6") return Protocol::ICMPV6;
     return Protocol::ANY;
 }
 
@@ -50,35 +65,176 @@ std::string RuleManager::GetProtocolString(Protocol proto) const {
     case Protocol::TCP: return "TCP";
     case Protocol::UDP: return "UDP";
     case Protocol::ICMP: return "ICMP";
+    case Protocol::ICMPV6: return "ICMPv6";
     case Protocol::ANY: return "ANY";
     default: return "UNKNOWN";
     }
 }
 
+static uint8_t ProtocolNameToIpNumber(const std::string& name) {
+    if (name == "TCP") return 6;
+    if (name == "UDP") return 17;
+    if (name == "ICMP") return 1;
+    if (name == "ICMPv6") return 58;
+    return 0;
+}
+
+//       ,     
+static FlowKey MakeFlowKey(const PacketInfo& pkt) {
+    FlowKey flow;
+    if (!ParseIPv4(pkt.sourceIp, flow.sourceIp) && ParseIPv6(pkt.sourceIp, flow.sourceIp6)) {
+        flow.ipv6 = ParseIPv6(pkt.destIp, flow.destIp6);
+    }
+    else {
+        ParseIPv4(pkt.destIp, flow.destIp);
+    }
+    flow.sourcePort = pkt.sourcePort;
+    flow.destPort = pkt.destPort;
+    flow.ipProtocol = ProtocolNameToIpNumber(pkt.protocol);
+    flow.icmpType = pkt.icmpType;
+    flow.icmpCode = pkt.icmpCode;
+    flow.relatedProtocol = pkt.relatedProtocol;
+    if (flow.relatedProtocol) {
+        if (flow.ipv6) {
+            ParseIPv6(pkt.relatedSourceIp, flow.relatedSourceIp6);
+            ParseIPv6(pkt.relatedDestIp, flow.relatedDestIp6);
+        }
+        else {
+            ParseIPv4(pkt.relatedSourceIp, flow.relatedSourceIp);
+            ParseIPv4(pkt.relatedDestIp, flow.relatedDestIp);
+        }
+    }
+    flow.tcpFlags = pkt.tcpFlags;
+    flow.direction = pkt.direction;
+    ParseIPv4(pkt.adapterIp, flow.adapter);
+    flow.size = static_cast<uint32_t>(pkt.size);
+    AppIdentityTable& apps = AppIdentityTable::Instance();
+    AppId appId = pkt.appId;
+    if (appId == INVALID_APP_ID && !pkt.processName.empty() && pkt.processName != "Unknown") {
+        appId = apps.Intern(pkt.processName);
+    }
+    flow.app = apps.Get(appId);
+    flow.serverName = pkt.serverName;
+    flow.serverIsSource = pkt.serverIsSource;
+    flow.service = pkt.serviceId;
+    return flow;
+}
+
+static FlowKey MakeFlowKey(const Connection& connection) {
+    FlowKey flow;
+    ParseIPv4(connection.sourceIp, flow.sourceIp);
+    ParseIPv4(connection.destIp, flow.destIp);
+    flow.sourcePort = static_cast<uint16_t>(connection.sourcePort);
+    flow.destPort = static_cast<uint16_t>(connection.destPort);
+    flow.ipProtocol = ProtocolToIpNumber(connection.protocol);
+    AppIdentityTable& apps = AppIdentityTable::Instance();
+    flow.app = connection.appPath.empty() ? nullptr : apps.Get(apps.Intern(connection.appPath));
+    flow.service = ServiceForPorts(flow.ipProtocol, flow.sourcePort, flow.destPort);
+    return flow;
+}
+
 bool RuleManager::FindBlockingRule(const PacketInfo& pkt, std::string& outRuleName) {
+    FlowKey flow = MakeFlowKey(pkt);
     std::lock_guard<std::mutex> lock(ruleMutex);
-    for (const auto& rule : rules) {
-        if (!rule.enabled) continue;
-        if (rule.action != RuleAction::BLOCK) continue;
-        if (rule.protocol != Protocol::ANY && ProtocolToString(rule.protocol) != pkt.protocol)
-            continue;
-        if (!rule.sourceIp.empty() && rule.sourceIp != pkt.sourceIp) continue;
-        if (!rule.destIp.empty() && rule.destIp != pkt.destIp) continue;
-        if (rule.sourcePort != 0 && rule.sourcePort != pkt.sourcePort) continue;
-        if (rule.destPort != 0 && rule.destPort != pkt.destPort) continue;
-        if (!rule.appPath.empty() && pkt.processName != rule.appPath) continue;
-        outRuleName = rule.name.empty() ? rule.description : rule.name;
+    ULONGLONG now = GetTickCount64();
+    RefreshScheduleIfDue(now);
+    ExpireIfDue(now);
+    const CompiledRule* rule = connections.FindBlockingRule(*matcher, flow, now);
+    ReorderIfDue(now);
+    if (rule) {
+        outRuleName = rule->name;
+        //           
+        if (rule != &matcher->DefaultDenyRule()) RuleStats::Instance().RecordHit(rule->id, pkt.size, time(nullptr));
         return true;
     }
     outRuleName.clear();
     return false;
 }
 
+void RuleManager::FindBlockingRuleBatch(std::vector<PacketInfo>& packets) {
+    std::vector<FlowKey> flows;
+    flows.reserve(packets.size());
+    for (const auto& pkt : packets) flows.push_back(MakeFlowKey(pkt));
+    std::vector<const CompiledRule*> verdicts(packets.size());
+    time_t now = time(nullptr);
+
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    ULONGLONG tick = GetTickCount64();
+    RefreshScheduleIfDue(tick);
+    ExpireIfDue(tick);
+    connections.FindBlockingRuleBatch(*matcher, flows.data(), flows.size(), verdicts.data(), tick);
+    ReorderIfDue(tick);
+    for (size_t i = 0; i < packets.size(); ++i) {
+        const CompiledRule* rule = verdicts[i];
+        packets[i].isBlocked = rule != nullptr;
+        if (!rule) {
+            packets[i].blockReason.clear();
+            continue;
+        }
+        packets[i].blockReason = rule->name;
+        if (rule != &matcher->DefaultDenyRule()) RuleStats::Instance().RecordHit(rule->id, packets[i].size, now);
+    }
+}
+
 static std::string ActionToString(RuleAction act) { return act == RuleAction::ALLOW ? "ALLOW" : "BLOCK"; }
 static RuleAction ActionFromString(const std::string& str) { return str == "ALLOW" ? RuleAction::ALLOW : RuleAction::BLOCK; }
 static std::string DirectionToString(RuleDirection dir) { return dir == RuleDirection::Inbound ? "Inbound" : "Outbound"; }
 static RuleDirection DirectionFromString(const std::string& str) { return str == "Outbound" ? RuleDirection::Outbound : RuleDirection::Inbound; }
 
+static json RuleToJson(const Rule& r) {
+    return {
+        {"id", r.id},
+        {"name", r.name},
+        {"description", r.description},
+        {"protocol", ProtocolToString(r.protocol)},
+        {"sourceIp", r.sourceIp},
+        {"destIp", r.destIp},
+        {"sourcePort", r.sourcePort},
+        {"destPort", r.destPort},
+        {"sourcePortStr", r.sourcePortStr},
+        {"destPortStr", r.destPortStr},
+        {"appPath", r.appPath},
+        {"service", r.service},
+        {"icmpTypes", r.icmpTypes},
+        {"tcpFlags", r.tcpFlags},
+        {"connectionState", r.connectionState},
+        {"action", ActionToString(r.action)},
+        {"enabled", r.enabled},
+        {"direction", DirectionToString(r.direction)},
+        {"adapter", r.adapter},
+        {"schedule", r.schedule},
+        {"priority", r.priority},
+        {"expiresAt", static_cast<int64_t>(r.expiresAt)}
+    };
+}
+
+static Rule RuleFromJson(const json& j) {
+    Rule r;
+    r.id = j.value("id", 0);
+    r.name = j.value("name", "");
+    r.description = j.value("description", "");
+    r.protocol = ProtocolFromString(j.value("protocol", "ANY"));
+    r.sourceIp = j.value("sourceIp", "");
+    r.destIp = j.value("destIp", "");
+    r.sourcePort = j.value("sourcePort", 0);
+    r.destPort = j.value("destPort", 0);
+    r.sourcePortStr = j.value("sourcePortStr", "");
+    r.destPortStr = j.value("destPortStr", "");
+    r.appPath = j.value("appPath", "");
+    r.service = j.value("service", "");
+    r.icmpTypes = j.value("icmpTypes", "");
+    r.tcpFlags = j.value("tcpFlags", "");
+    r.connectionState = j.value("connectionState", "");
+    r.action = ActionFromString(j.value("action", "ALLOW"));
+    r.enabled = j.value("enabled", true);
+    r.direction = DirectionFromString(j.value("direction", "Inbound"));
+    r.adapter = j.value("adapter", "");
+    r.schedule = j.value("schedule", "");
+    r.priority = j.value("priority", 0);
+    r.expiresAt = static_cast<time_t>(j.value("expiresAt", int64_t(0)));
+    return r;
+}
+
 std::wstring GetExecutableDir()
 {
     wchar_t buf[MAX_PATH];
@@ -91,9 +247,61 @@ std::wstring GetExecutableDir()
 }
 
 std::wstring rulesPath = GetExecutableDir() + L"\\rules.json";
+std::wstring ruleStatsPath = GetExecutableDir() + L"\\rule_stats.json";
+std::wstring addressListsPath = GetExecutableDir() + L"\\address_lists.json";
+std::wstring profilesPath = GetExecutableDir() + L"\\profiles.json";
+std::wstring addedRulesPath = GetExecutableDir() + L"\\rules_added.jsonl";
+std::wstring filterModePath = GetExecutableDir() + L"\\filter_mode.json";
+
+//      "@":
+//   [{"name": "drop", "path": "lists\\drop.txt"}, {"name": "c2", "path": "c2.csv", "column": 1}]
+// "falsePositiveRate"      (  0.01, 0   )
+//      
+static void LoadAddressListSources() {
+    std::unordered_map<std::string, AddressListSource> sources;
+    std::ifstream f(addressListsPath);
+    if (f) {
+        json arr = json::parse(f, nullptr, false);
+        if (arr.is_array()) {
+            for (const auto& j : arr) {
+                if (!j.is_object()) continue;
+                std::string name = j.value("name", "");
+                std::string path = j.value("path", "");
+                if (!AddressLists::IsReference("@" + name) || path.empty()) continue;
+                std::filesystem::path file(Utf8ToWide(path));
+                if (file.is_relative()) file = std::filesystem::path(GetExecutableDir()) / file;
+                AddressListSource source;
+                source.path = file.string();
+                source.column = j.value("column", -1);
+                source.falsePositiveRate = j.value("falsePositiveRate", source.falsePositiveRate);
+                sources[name] = source;
+            }
+        }
+    }
+    AddressLists::Instance().SetSources(sources);
+}
+
+static void LogAddressListLoads(const std::vector<AddressLists::LoadResult>& results) {
+    for (const auto& r : results) {
+        if (r.ok) {
+            FirewallLogger::Instance().LogServiceEvent(FirewallEventType::FILTER_APPLIED,
+                "Address list @" + r.name + " loaded: " + std::to_string(r.stats.entries) + " entries, "
+                + std::to_string(r.stats.skipped) + " skipped lines, "
+                + std::to_string(r.memoryBytes / 1024) + " KB, "
+                + std::to_string(static_cast<int>(r.seconds * 1000)) + " ms"
+                + (r.prefilterFalsePositiveRate > 0
+                    ? ", prefilter false positives " + std::to_string(r.prefilterFalsePositiveRate * 100) + "%" : ""));
+        }
+        else {
+            FirewallLogger::Instance().LogServiceEvent(FirewallEventType::SERVICE_ERROR,
+                "Address list @" + r.name + " not reloaded, keeping previous contents: " + r.error);
+        }
+    }
+}
 
 bool RuleManager::SaveRulesToFile(const std::wstring& path) const {
-    std::ofstream f(rulesPath, std::ios::out | std::ios::trunc);
+    //       
+    std::ofstream f(ActiveRulesPath(), std::ios::out | std::ios::trunc);
     if (!f) {
         OutputDebugStringA("   rules.json!\n");
         return false;
@@ -104,62 +312,302 @@ bool RuleManager::SaveRulesToFile(const std::wstring& path) const {
     );
     OutputDebugStringA("rules.json    .\n");
     json arr = json::array();
-    for (const auto& r : rules) {
-        arr.push_back({
-            {"id", r.id},
-            {"name", r.name},
-            {"description", r.description},
-            {"protocol", ProtocolToString(r.protocol)},
-            {"sourceIp", r.sourceIp},
-            {"destIp", r.destIp},
-            {"sourcePort", r.sourcePort},
-            {"destPort", r.destPort},
-            {"sourcePortStr", r.sourcePortStr},
-            {"destPortStr", r.destPortStr},
-            {"appPath", r.appPath},
-            {"action", ActionToString(r.action)},
-            {"enabled", r.enabled},
-            {"direction", DirectionToString(r.direction)}
-            });
-    }
+    for (const auto& r : rules) arr.push_back(RuleToJson(r));
     f << arr.dump(2);
+    f.close();
+    std::error_code error;
+    auto modified = std::filesystem::last_write_time(ActiveRulesPath(), error);
+    if (!error) ActiveRulesTime() = modified;
     return true;
 }
 
+std::wstring RuleManager::ActiveRulesPath() const {
+    return profiles.empty() ? rulesPath : profiles[activeProfile].rulesPath;
+}
+
+std::filesystem::file_time_type& RuleManager::ActiveRulesTime() const {
+    return profiles.empty() ? rulesFileTime : profiles[activeProfile].loadedTime;
+}
+
+bool RuleManager::ReadRulesFile(const std::wstring& path, std::vector<Rule>& out, int& maxId) {
+    std::ifstream f(path);
+    if (!f) return false;
+    json arr;
+    f >> arr;
+    out.clear();
+    maxId = 0;
+    time_t now = time(nullptr);
+    for (const auto& j : arr) {
+        Rule r = RuleFromJson(j);
+        maxId = (std::max)(maxId, r.id);
+        //    ,    
+        if (r.expiresAt != 0 && r.expiresAt <= now) continue;
+        out.push_back(r);
+    }
+    return true;
+}
+
+void RuleManager::SetActiveRules(std::vector<Rule> loaded, int maxId) {
+    std::vector<Rule> previous = std::move(rules);
+    rules = std::move(loaded);
+    nextRuleId = maxId + 1;
+    //     10 :         
+    if (PatchMatcherFrom(previous)) MatcherPatched();
+    else RebuildMatcher();
+    RescheduleExpiry();
+}
+
 bool RuleManager::LoadRulesFromFile(const std::wstring& path) {
     std::lock_guard<std::mutex> lock(ruleMutex);
     FirewallLogger::Instance().LogServiceEvent(
         FirewallEventType::SERVICE_STARTED,
         "Loading rules from file: " + std::string(path.begin(), path.end())
     );
-    std::ifstream f(path);
+    std::vector<Rule> loaded;
+    int maxId = 0;
+    std::error_code error;
+    auto modified = std::filesystem::last_write_time(path, error);
+    if (!ReadRulesFile(path, loaded, maxId)) return false;
+    rulesFileTime = error ? std::filesystem::file_time_type() : modified;
+    SetActiveRules(std::move(loaded), maxId);
+
+    //       ;    .
+    //    ,       .
+    LoadAddressListSources();
+    AddressLists::Instance().ReloadChangedAsync(LogAddressListLoads);
+    return true;
+}
+
+// profiles.json:
+//   {"active": "office", "profiles": [
+//     {"name": "office", "rules": "rules.office.json", "networks": ["10.20.0.0/16"]},
+//     {"name": "public", "rules": "rules.public.json"}]}
+//      .   
+//  ,       
+bool RuleManager::LoadProfiles() {
+    std::ifstream f(profilesPath);
+    if (!f) return false;
+    json doc = json::parse(f, nullptr, false);
+    if (!doc.is_object() || !doc.contains("profiles") || !doc["profiles"].is_array()) return false;
+
+    std::vector<RuleProfile> loaded;
+    for (const auto& j : doc["profiles"]) {
+        if (!j.is_object()) continue;
+        RuleProfile profile;
+        profile.name = j.value("name", "");
+        std::string path = j.value("rules", "");
+        bool duplicate = std::any_of(loaded.begin(), loaded.end(),
+            [&profile](const RuleProfile& p) { return p.name == profile.name; });
+        if (profile.name.empty() || path.empty() || duplicate) continue;
+        std::filesystem::path file(Utf8ToWide(path));
+        if (file.is_relative()) file = std::filesystem::path(GetExecutableDir()) / file;
+        profile.rulesPath = file.wstring();
+        if (j.contains("networks") && j["networks"].is_array()) {
+            for (const auto& network : j["networks"]) {
+                if (network.is_string()) profile.networks.push_back(network.get<std::string>());
+            }
+        }
+        loaded.push_back(std::move(profile));
+    }
+    if (loaded.empty()) return false;
+    std::string active = doc.value("active", "");
+
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    //          matcher
+    ParkActiveProfile();
+    std::string current = profiles.empty() ? std::string() : profiles[activeProfile].name;
+    for (auto& profile : loaded) {
+        for (auto& old : profiles) {
+            if (old.name != profile.name || old.rulesPath != profile.rulesPath || !old.matcher) continue;
+            profile.rules = std::move(old.rules);
+            profile.matcher = std::move(old.matcher);
+            profile.reordered = old.reordered;
+            profile.nextRuleId = old.nextRuleId;
+            profile.loadedTime = old.loadedTime;
+        }
+    }
+    profiles = std::move(loaded);
+
+    size_t compiled = 0;
+    for (auto& profile : profiles) {
+        std::error_code error;
+        auto modified = std::filesystem::last_write_time(profile.rulesPath, error);
+        if (profile.matcher && !error && modified == profile.loadedTime) continue;
+        int maxId = 0;
+        if (!ReadRulesFile(profile.rulesPath, profile.rules, maxId)) profile.rules.clear();
+        profile.nextRuleId = maxId + 1;
+        profile.loadedTime = error ? std::filesystem::file_time_type() : modified;
+        CompileProfile(profile);
+        ++compiled;
+    }
+
+    //    ,   ;    
+    auto find = [this](const std::string& name) {
+        for (size_t i = 0; i < profiles.size(); ++i) {
+            if (profiles[i].name == name) return i;
+        }
+        return profiles.size();
+    };
+    size_t index = find(current);
+    if (active != activeInFile || index == profiles.size()) index = find(active);
+    if (index == profiles.size()) index = 0;
+    activeInFile = active;
+    ActivateProfile(index);
+    if (compiled > 0) {
+        FirewallLogger::Instance().LogServiceEvent(FirewallEventType::FILTER_APPLIED,
+            "Rule profiles loaded: " + std::to_string(profiles.size()) + " profiles, "
+            + std::to_string(compiled) + " compiled, active " + profiles[activeProfile].name);
+    }
+
+    LoadAddressListSources();
+    AddressLists::Instance().ReloadChangedAsync(LogAddressListLoads);
+    return true;
+}
+
+void RuleManager::CompileProfile(RuleProfile& profile) const {
+    profile.matcher = std::make_unique<RuleMatcher>();
+    profile.matcher->SetFilterMode(matcher->GetFilterMode());
+    profile.matcher->Compile(minimizeRules ? RuleAnalyzer::Analyze(profile.rules).minimized : profile.rules);
+    profile.reordered = false;
+}
+
+//   matcher     
+void RuleManager::ParkActiveProfile() {
+    if (profiles.empty()) return;
+    RuleProfile& profile = profiles[activeProfile];
+    std::swap(rules, profile.rules);
+    std::swap(matcher, profile.matcher);
+    profile.reordered = matcherReordered;
+    profile.nextRuleId = nextRuleId;
+}
+
+void RuleManager::ActivateProfile(size_t index) {
+    RuleProfile& profile = profiles[index];
+    std::swap(rules, profile.rules);
+    std::swap(matcher, profile.matcher);
+    matcherReordered = profile.reordered;
+    nextRuleId = profile.nextRuleId;
+    //     ,       (  rules.json   )
+    profile.rules.clear();
+    profile.matcher->Clear();
+    //     ,    
+    matcher->RefreshSchedule();
+    RescheduleExpiry();
+    activeProfile = index;
+    ++rulesVersion;
+    ruleOrder = RuleOrder();
+    nextReorderTick = 0;
+}
+
+bool RuleManager::SwitchProfile(const std::string& name) {
+    double switchUs = 0;
+    {
+        std::lock_guard<std::mutex> lock(ruleMutex);
+        auto it = std::find_if(profiles.begin(), profiles.end(), [&name](const RuleProfile& p) { return p.name == name; });
+        if (it == profiles.end()) return false;
+        size_t index = static_cast<size_t>(it - profiles.begin());
+        if (index == activeProfile) return true;
+        auto start = std::chrono::steady_clock::now();
+        ParkActiveProfile();
+        ActivateProfile(index);
+        switchUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        //  matcher    :   SetReorderRules
+        if (matcherReordered && !reorderRules) RebuildMatcher();
+        UpdateResolverNames();
+        activeInFile = name;
+    }
+    char latency[32];
+    snprintf(latency, sizeof(latency), "%.1f us", switchUs);
+    FirewallLogger::Instance().LogServiceEvent(FirewallEventType::FILTER_APPLIED,
+        "Rule profile switched to " + name + " in " + latency);
+
+    std::ifstream in(profilesPath);
+    json doc = in ? json::parse(in, nullptr, false) : json();
+    in.close();
+    if (!doc.is_object()) return true;
+    doc["active"] = name;
+    std::ofstream out(profilesPath, std::ios::out | std::ios::trunc);
+    if (out) out << doc.dump(2);
+    return true;
+}
+
+std::string RuleManager::GetActiveProfile() const {
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    return profiles.empty() ? std::string() : profiles[activeProfile].name;
+}
+
+std::vector<std::string> RuleManager::GetProfileNames() const {
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    std::vector<std::string> names;
+    for (const auto& profile : profiles) names.push_back(profile.name);
+    return names;
+}
+
+std::string RuleManager::ProfileForAddresses(const std::vector<uint32_t>& addresses) const {
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    for (const auto& profile : profiles) {
+        for (const auto& network : profile.networks) {
+            uint32_t prefix = 0;
+            uint32_t mask = 0;
+            if (!ParseIPv4Prefix(network, prefix, mask)) continue;
+            for (uint32_t address : addresses) {
+                if ((address & mask) == (prefix & mask)) return profile.name;
+            }
+        }
+    }
+    return std::string();
+}
+
+//      ,    rules.json
+bool RuleManager::SaveRuleStats() const {
+    RuleStats& stats = RuleStats::Instance();
+    //    :   ,  GUI
+    if (!stats.HasLocalChanges()) return true;
+
+    std::ofstream f(ruleStatsPath, std::ios::out | std::ios::trunc);
+    if (!f) {
+        OutputDebugStringA("   rule_stats.json!\n");
+        return false;
+    }
+    json arr = json::array();
+    for (const auto& kv : stats.Snapshot()) {
+        arr.push_back({
+            {"id", kv.first},
+            {"packets", kv.second.packets},
+            {"bytes", kv.second.bytes},
+            {"lastHit", static_cast<int64_t>(kv.second.lastHit)}
+            });
+    }
+    f << arr.dump(2);
+    return true;
+}
+
+bool RuleManager::LoadRuleStats() {
+    std::ifstream f(ruleStatsPath);
     if (!f) return false;
     json arr;
-    f >> arr;
-    rules.clear();
-    nextRuleId = 1;
+    try {
+        f >> arr;
+    }
+    catch (const json::exception&) {
+        return false;
+    }
+    std::unordered_map<int, RuleHitStats> loaded;
     for (const auto& j : arr) {
-        Rule r;
-        r.id = j.value("id", 0);
-        r.name = j.value("name", "");
-        r.description = j.value("description", "");
-        r.protocol = ProtocolFromString(j.value("protocol", "ANY"));
-        r.sourceIp = j.value("sourceIp", "");
-        r.destIp = j.value("destIp", "");
-        r.sourcePort = j.value("sourcePort", 0);
-        r.destPort = j.value("destPort", 0);
-        r.sourcePortStr = j.value("sourcePortStr", "");
-        r.destPortStr = j.value("destPortStr", "");
-        r.appPath = j.value("appPath", "");
-        r.action = ActionFromString(j.value("action", "ALLOW"));
-        r.enabled = j.value("enabled", true);
-        r.direction = DirectionFromString(j.value("direction", "Inbound"));
-        rules.push_back(r);
-        if (r.id >= nextRuleId) nextRuleId = r.id + 1;
+        RuleHitStats s;
+        s.packets = j.value("packets", uint64_t(0));
+        s.bytes = j.value("bytes", uint64_t(0));
+        s.lastHit = static_cast<time_t>(j.value("lastHit", int64_t(0)));
+        loaded[j.value("id", 0)] = s;
     }
+    RuleStats::Instance().SetBaseline(loaded);
     return true;
 }
 
+std::unordered_map<int, RuleHitStats> RuleManager::GetRuleStats() const {
+    return RuleStats::Instance().Snapshot();
+}
+
 RuleManager& RuleManager::Instance() {
     static RuleManager instance;
     return instance;
@@ -177,7 +625,11 @@ RuleDirection RuleManager::GetCurrentDirection() const {
 
 bool RuleManager::AddRule(const Rule& rule) {
     std::lock_guard<std::mutex> lock(ruleMutex);
+    InsertRule(rule);
+    return true;
+}
 
+const Rule& RuleManager::InsertRule(const Rule& rule) {
     //    
     FirewallEvent event;
     event.type = FirewallEventType::RULE_ADDED;
@@ -192,6 +644,10 @@ bool RuleManager::AddRule(const Rule& rule) {
         << "Source Port: " << (rule.sourcePort == 0 ? "Any" : std::to_string(rule.sourcePort)) << "\n"
         << "Destination Port: " << (rule.destPort == 0 ? "Any" : std::to_string(rule.destPort)) << "\n"
         << "Application Path: " << (rule.appPath.empty() ? "Any" : rule.appPath) << "\n"
+        << "Service: " << (rule.service.empty() ? "Any" : rule.service) << "\n"
+        << "ICMP Types: " << (rule.icmpTypes.empty() ? "Any" : rule.icmpTypes) << "\n"
+        << "TCP Flags: " << (rule.tcpFlags.empty() ? "Any" : rule.tcpFlags) << "\n"
+        << "Connection State: " << (rule.connectionState.empty() ? "Any" : rule.connectionState) << "\n"
         << "Action: " << (rule.action == RuleAction::ALLOW ? "Allow" : "Block") << "\n"
         << "Direction: " << (rule.direction == RuleDirection::Inbound ? "Inbound" : "Outbound") << "\n"
         << "Enabled: " << (rule.enabled ? "Yes" : "No") << "\n"
@@ -202,35 +658,108 @@ bool RuleManager::AddRule(const Rule& rule) {
 
     Rule newRule = rule;
     newRule.id = nextRuleId++;
+    // id     ( ResetRuleIdCounter  ): 
+    //     
+    RuleStats::Instance().Forget(newRule.id);
     rules.push_back(newRule);
+    if (minimizeRules || !matcher->AppendRule(newRule)) RebuildMatcher();
+    else MatcherPatched();
+    if (newRule.expiresAt != 0) expiry.Schedule(newRule.id, newRule.expiresAt);
     SaveRulesToFile();
     FirewallLogger::Instance().LogRuleEvent(event);
+    return rules.back();
+}
+
+//  ,   ,    rules_added.jsonl:  
+//  GUI    ,     
+bool RuleManager::AddTemporaryRule(const Rule& rule, uint32_t ttlSeconds) {
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    Rule temporary = rule;
+    temporary.expiresAt = time(nullptr) + ttlSeconds;
+    json line = RuleToJson(InsertRule(temporary));
+    line["profile"] = profiles.empty() ? std::string() : profiles[activeProfile].name;
+    //     : ,    ,     
+    std::error_code error;
+    auto mode = std::filesystem::file_size(addedRulesPath, error) > ADDED_RULES_MAX_BYTES ? std::ios::trunc : std::ios::app;
+    std::ofstream f(addedRulesPath, std::ios::out | mode);
+    if (f) f << line.dump() << "\n";
     return true;
 }
+
+//    id   nextRuleId  ,      : 
+//      . ,  ,   
+size_t RuleManager::LoadAddedRules() {
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    std::ifstream f(addedRulesPath, std::ios::binary);
+    if (!f) return 0;
+    f.seekg(0, std::ios::end);
+    std::streamoff size = f.tellg();
+    if (size < addedRulesOffset) addedRulesOffset = 0;
+    f.seekg(addedRulesOffset);
+    std::string profile = profiles.empty() ? std::string() : profiles[activeProfile].name;
+    time_t now = time(nullptr);
+    bool patched = !minimizeRules;
+    size_t added = 0;
+    std::string text;
+    while (std::getline(f, text)) {
+        // ,  GUI  ,    
+        if (f.eof()) break;
+        addedRulesOffset = f.tellg();
+        json j = json::parse(text, nullptr, false);
+        if (!j.is_object() || j.value("profile", "") != profile) continue;
+        Rule r = RuleFromJson(j);
+        if (r.id < nextRuleId || (r.expiresAt != 0 && r.expiresAt <= now)) continue;
+        rules.push_back(r);
+        nextRuleId = r.id + 1;
+        if (patched && !matcher->AppendRule(r)) patched = false;
+        if (r.expiresAt != 0) expiry.Schedule(r.id, r.expiresAt);
+        ++added;
+    }
+    if (added == 0) return 0;
+    if (patched) MatcherPatched();
+    else RebuildMatcher();
+    return added;
+}
+
+FirewallEvent RuleManager::RuleDeletedEvent(const Rule& rule) const {
+    FirewallEvent event;
+    event.type = FirewallEventType::RULE_DELETED;
+    event.ruleName = rule.name;
+    event.description = rule.description;
+    event.username = FirewallLogger::Instance().GetCurrentUsername();
+    std::stringstream details;
+    details << "Rule ID: " << rule.id << "\n"
+        << "Protocol: " << GetProtocolString(rule.protocol) << "\n"
+        << "Source IP: " << (rule.sourceIp.empty() ? "Any" : rule.sourceIp) << "\n"
+        << "Destination IP: " << (rule.destIp.empty() ? "Any" : rule.destIp) << "\n"
+        << "Source Port: " << (rule.sourcePort == 0 ? "Any" : std::to_string(rule.sourcePort)) << "\n"
+        << "Destination Port: " << (rule.destPort == 0 ? "Any" : std::to_string(rule.destPort)) << "\n"
+        << "Application Path: " << (rule.appPath.empty() ? "Any" : rule.appPath) << "\n"
+        << "Service: " << (rule.service.empty() ? "Any" : rule.service) << "\n"
+        << "ICMP Types: " << (rule.icmpTypes.empty() ? "Any" : rule.icmpTypes) << "\n"
+        << "TCP Flags: " << (rule.tcpFlags.empty() ? "Any" : rule.tcpFlags) << "\n"
+        << "Connection State: " << (rule.connectionState.empty() ? "Any" : rule.connectionState) << "\n"
+        << "Action: " << (rule.action == RuleAction::ALLOW ? "Allow" : "Block") << "\n"
+        << "Direction: " << (rule.direction == RuleDirection::Inbound ? "Inbound" : "Outbound") << "\n"
+        << "Creator: " << rule.creator << "\n"
+        << "Creation Time: " << rule.creationTime;
+    event.previousValue = details.str();
+    return event;
+}
+
 bool RuleManager::RemoveRule(int ruleId) {
     std::lock_guard<std::mutex> lock(ruleMutex);
     auto it = std::find_if(rules.begin(), rules.end(), [ruleId](const Rule& r) { return r.id == ruleId; });
     if (it != rules.end()) {
-        FirewallEvent event;
-        event.type = FirewallEventType::RULE_DELETED;
-        event.ruleName = it->name;
-        event.description = it->description;
-        event.username = FirewallLogger::Instance().GetCurrentUsername();
-        std::stringstream details;
-        details << "Rule ID: " << it->id << "\n"
-            << "Protocol: " << GetProtocolString(it->protocol) << "\n"
-            << "Source IP: " << (it->sourceIp.empty() ? "Any" : it->sourceIp) << "\n"
-            << "Destination IP: " << (it->destIp.empty() ? "Any" : it->destIp) << "\n"
-            << "Source Port: " << (it->sourcePort == 0 ? "Any" : std::to_string(it->sourcePort)) << "\n"
-            << "Destination Port: " << (it->destPort == 0 ? "Any" : std::to_string(it->destPort)) << "\n"
-            << "Application Path: " << (it->appPath.empty() ? "Any" : it->appPath) << "\n"
-            << "Action: " << (it->action == RuleAction::ALLOW ? "Allow" : "Block") << "\n"
-            << "Direction: " << (it->direction == RuleDirection::Inbound ? "Inbound" : "Outbound") << "\n"
-            << "Creator: " << it->creator << "\n"
-            << "Creation Time: " << it->creationTime;
-
-        event.previousValue = details.str();
+        FirewallEvent event = RuleDeletedEvent(*it);
+        RuleStats::Instance().Forget(it->id);
+        expiry.Cancel(it->id);
         rules.erase(it);
+        if (minimizeRules) RebuildMatcher();
+        else {
+            matcher->RemoveRule(ruleId);
+            MatcherPatched();
+        }
         SaveRulesToFile();
         FirewallLogger::Instance().LogRuleEvent(event);
         return true;
@@ -251,6 +780,10 @@ bool RuleManager::UpdateRule(const Rule& newRule) {
             << "Source Port: " << (it->sourcePort == 0 ? "Any" : std::to_string(it->sourcePort)) << "\n"
             << "Destination Port: " << (it->destPort == 0 ? "Any" : std::to_string(it->destPort)) << "\n"
             << "Application Path: " << (it->appPath.empty() ? "Any" : it->appPath) << "\n"
+            << "Service: " << (it->service.empty() ? "Any" : it->service) << "\n"
+            << "ICMP Types: " << (it->icmpTypes.empty() ? "Any" : it->icmpTypes) << "\n"
+            << "TCP Flags: " << (it->tcpFlags.empty() ? "Any" : it->tcpFlags) << "\n"
+            << "Connection State: " << (it->connectionState.empty() ? "Any" : it->connectionState) << "\n"
             << "Action: " << (it->action == RuleAction::ALLOW ? "Allow" : "Block") << "\n"
             << "Direction: " << (it->direction == RuleDirection::Inbound ? "Inbound" : "Outbound") << "\n"
             << "Enabled: " << (it->enabled ? "Yes" : "No") << "\n"
@@ -259,6 +792,10 @@ bool RuleManager::UpdateRule(const Rule& newRule) {
 
         //  
         *it = newRule;
+        if (ReplaceInMatcher(newRule)) MatcherPatched();
+        else RebuildMatcher();
+        if (newRule.expiresAt != 0) expiry.Schedule(newRule.id, newRule.expiresAt);
+        else expiry.Cancel(newRule.id);
 
         //    
         FirewallEvent event;
@@ -276,6 +813,10 @@ bool RuleManager::UpdateRule(const Rule& newRule) {
             << "Source Port: " << (newRule.sourcePort == 0 ? "Any" : std::to_string(newRule.sourcePort)) << "\n"
             << "Destination Port: " << (newRule.destPort == 0 ? "Any" : std::to_string(newRule.destPort)) << "\n"
             << "Application Path: " << (newRule.appPath.empty() ? "Any" : newRule.appPath) << "\n"
+            << "Service: " << (newRule.service.empty() ? "Any" : newRule.service) << "\n"
+            << "ICMP Types: " << (newRule.icmpTypes.empty() ? "Any" : newRule.icmpTypes) << "\n"
+            << "TCP Flags: " << (newRule.tcpFlags.empty() ? "Any" : newRule.tcpFlags) << "\n"
+            << "Connection State: " << (newRule.connectionState.empty() ? "Any" : newRule.connectionState) << "\n"
             << "Action: " << (newRule.action == RuleAction::ALLOW ? "Allow" : "Block") << "\n"
             << "Direction: " << (newRule.direction == RuleDirection::Inbound ? "Inbound" : "Outbound") << "\n"
             << "Enabled: " << (newRule.enabled ? "Yes" : "No") << "\n"
@@ -305,29 +846,318 @@ std::optional<Rule> RuleManager::GetRuleById(int ruleId) const {
     return std::nullopt;
 }
 
+//    :  ,       
+// .  ,   ,    
 bool RuleManager::IsAllowed(const Connection& connection, int& matchedRuleId) {
+    FlowKey flow = MakeFlowKey(connection);
     std::lock_guard<std::mutex> lock(ruleMutex);
-    matchedRuleId = -1;
-    for (const auto& rule : rules) {
-        if (!rule.enabled) continue;
+    if (connection.directionKnown) {
+        flow.direction = connection.direction;
+        return matcher->IsAllowed(flow, matchedRuleId);
+    }
+    return matcher->IsAllowedEitherDirection(flow, matchedRuleId);
+}
 
-        bool sourceMatch = (rule.sourceIp.empty() || rule.sourceIp == connection.sourceIp);
-        bool destMatch = (rule.destIp.empty() || rule.destIp == connection.destIp);
-        bool protocolMatch = (rule.protocol == Protocol::ANY || rule.protocol == connection.protocol);
-        bool sourcePortMatch = (rule.sourcePort == 0 || rule.sourcePort == connection.sourcePort);
-        bool destPortMatch = (rule.destPort == 0 || rule.destPort == connection.destPort);
+void RuleManager::RebuildMatcher() {
+    if (minimizeRules) {
+        matcher->Compile(RuleAnalyzer::Analyze(rules).minimized);
+    }
+    else {
+        matcher->Compile(rules);
+    }
+    matcherReordered = false;
+    ++rulesVersion;
+    UpdateResolverNames();
+}
+
+void RuleManager::UpdateResolverNames() {
+    //        IpDomainTable 
+    std::vector<std::string> names = matcher->Domains().ExactNames();
+    if (!names.empty() && !resolverFeeder) {
+        resolverFeeder = static_cast<ResolverDomainFeeder*>(
+            IpDomainTable::Instance().AddFeeder(std::make_unique<ResolverDomainFeeder>()));
+    }
+    if (resolverFeeder) resolverFeeder->SetNames(names);
+}
+
+void RuleManager::MatcherPatched() {
+    ++rulesVersion;
+    UpdateResolverNames();
+    if (matcher->Fragmented()) CompactMatcherAsync();
+}
 
-        if (sourceMatch && destMatch && protocolMatch && sourcePortMatch && destPortMatch) {
-            matchedRuleId = rule.id;
-            return rule.action == RuleAction::ALLOW;
+//      matcher  ;   
+void RuleManager::CompactMatcherAsync() {
+    RecompileAsync(matcherReordered);
+}
+
+void RuleManager::ReorderIfDue(ULONGLONG now) {
+    if (!reorderRules) return;
+    //       ,   
+    if (nextReorderTick == 0) nextReorderTick = now + REORDER_INTERVAL_MS;
+    if (now < nextReorderTick) return;
+    nextReorderTick = now + REORDER_INTERVAL_MS;
+    RecompileAsync(true);
+}
+
+void RuleManager::RefreshScheduleIfDue(ULONGLONG now) {
+    if (now < nextScheduleTick) return;
+    nextScheduleTick = now + SCHEDULE_CHECK_MS;
+    ScheduleClock::Instance().Refresh();
+    matcher->RefreshSchedule();
+}
+
+void RuleManager::RescheduleExpiry() {
+    expiry.Clear();
+    for (const auto& r : rules) {
+        if (r.expiresAt != 0) expiry.Schedule(r.id, r.expiresAt);
+    }
+}
+
+size_t RuleManager::RemoveExpired() {
+    if (expiry.Empty()) return 0;
+    std::vector<int> expired;
+    expiry.Advance(time(nullptr), expired);
+    if (expired.empty()) return 0;
+    bool patched = !minimizeRules;
+    size_t removed = 0;
+    for (int id : expired) {
+        auto it = std::find_if(rules.begin(), rules.end(), [id](const Rule& r) { return r.id == id; });
+        if (it == rules.end()) continue;
+        expiredEvents.push_back(RuleDeletedEvent(*it));
+        expiredIds.push_back(id);
+        rules.erase(it);
+        if (patched) matcher->RemoveRule(id);
+        ++removed;
+    }
+    if (removed == 0) return 0;
+    if (patched) MatcherPatched();
+    else RebuildMatcher();
+    return removed;
+}
+
+void RuleManager::ExpireIfDue(ULONGLONG now) {
+    if (now < nextExpiryTick) return;
+    nextExpiryTick = now + EXPIRY_CHECK_MS;
+    RemoveExpired();
+}
+
+size_t RuleManager::ExpireRules() {
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    RemoveExpired();
+    if (expiredEvents.empty()) return 0;
+    std::vector<FirewallEvent> events = std::move(expiredEvents);
+    expiredEvents.clear();
+    for (int id : expiredIds) RuleStats::Instance().Forget(id);
+    expiredIds.clear();
+    FirewallLogger::Instance().LogServiceEvent(FirewallEventType::FILTER_APPLIED,
+        "Temporary rules expired: " + std::to_string(events.size()));
+
+    //    GUI     .    
+    //    ,     :   
+    // ,    ,  .  , 
+    //  ,   
+    std::error_code error;
+    auto modified = std::filesystem::last_write_time(ActiveRulesPath(), error);
+    if (error || modified != ActiveRulesTime()) return events.size();
+    SaveRulesToFile();
+    for (const auto& event : events) FirewallLogger::Instance().LogRuleEvent(event);
+    return events.size();
+}
+
+//       ,    matcher,  
+//      
+void RuleManager::RecompileAsync(bool reorder) {
+    //       ruleMutex (ReorderIfDue, MatcherPatched):  
+    //  .     ,    ruleMutex,  
+    // ruleMutex     matcher  
+    if (compacting.exchange(true)) return;
+    if (compactWorker.joinable()) compactWorker.join();
+    compactWorker = std::thread([this, reorder]() {
+        std::vector<Rule> snapshot;
+        uint64_t version = 0;
+        FilterMode mode = FilterMode::BLACKLIST;
+        bool minimize = false;
+        bool reordered = false;
+        {
+            std::lock_guard<std::mutex> lock(ruleMutex);
+            snapshot = rules;
+            version = rulesVersion;
+            mode = matcher->GetFilterMode();
+            minimize = minimizeRules;
+            reordered = matcherReordered;
+        }
+        std::vector<Rule> effective = minimize ? RuleAnalyzer::Analyze(snapshot).minimized : std::move(snapshot);
+        RuleOrder order;
+        if (reorder) {
+            std::unordered_map<int, uint64_t> hits;
+            for (const auto& kv : RuleStats::Instance().Snapshot()) hits[kv.first] = kv.second.packets;
+            order = RuleAnalyzer::ReorderByHits(effective, hits);
+        }
+        //     matcher  :  
+        if (reorder && order.moved == 0 && !reordered) {
+            std::lock_guard<std::mutex> lock(ruleMutex);
+            if (version == rulesVersion) ruleOrder = std::move(order);
+            compacting = false;
+            return;
+        }
+        RuleMatcher fresh;
+        fresh.SetFilterMode(mode);
+        fresh.Compile(reorder ? order.rules : effective);
+        size_t moved = order.moved;
+        char averages[64];
+        snprintf(averages, sizeof(averages), "%.1f -> %.1f", order.testedBefore, order.testedAfter);
+        bool swapped = false;
+        {
+            std::lock_guard<std::mutex> lock(ruleMutex);
+            if (version == rulesVersion) {
+                *matcher = std::move(fresh);
+                matcherReordered = reorder && moved > 0;
+                if (reorder) ruleOrder = std::move(order);
+                swapped = true;
+            }
+        }
+        if (swapped && reorder && moved > 0) {
+            FirewallLogger::Instance().LogServiceEvent(FirewallEventType::FILTER_APPLIED,
+                "Rules reordered by hits: " + std::to_string(moved) + " moved, average rules tested per matched packet "
+                + averages);
         }
+        compacting = false;
+    });
+}
+
+// ,     
+static bool SameMatch(const Rule& a, const Rule& b) {
+    return a.name == b.name && a.description == b.description && a.protocol == b.protocol
+        && a.sourceIp == b.sourceIp && a.destIp == b.destIp
+        && a.sourcePort == b.sourcePort && a.destPort == b.destPort
+        && a.sourcePortStr == b.sourcePortStr && a.destPortStr == b.destPortStr
+        && a.appPath == b.appPath && a.service == b.service && a.icmpTypes == b.icmpTypes
+        && a.tcpFlags == b.tcpFlags && a.connectionState == b.connectionState
+        && a.action == b.action && a.enabled == b.enabled && a.direction == b.direction
+        && a.adapter == b.adapter && a.schedule == b.schedule && a.priority == b.priority;
+}
+
+bool RuleManager::ReplaceInMatcher(const Rule& rule) {
+    if (minimizeRules || matcherReordered) return false;
+    if (matcher->ReplaceRule(rule)) return true;
+    //      matcher,      
+    auto it = std::find_if(rules.begin(), rules.end(), [&rule](const Rule& r) { return r.id == rule.id; });
+    if (it == rules.end() || std::any_of(it + 1, rules.end(), [](const Rule& r) { return r.enabled; })) return false;
+    return matcher->AppendRule(rule);
+}
+
+//  ,   rules,      ,     
+bool RuleManager::PatchMatcherFrom(const std::vector<Rule>& previous) {
+    if (minimizeRules || matcher->Size() == 0) return false;
+    std::unordered_map<int, const Rule*> before;
+    for (const auto& r : previous) before[r.id] = &r;
+    std::unordered_map<int, size_t> position;
+    for (size_t i = 0; i < rules.size(); ++i) position[rules[i].id] = i;
+    if (position.size() != rules.size() || before.size() != previous.size()) return false;
+
+    size_t last = 0;
+    bool kept = false;
+    for (const auto& r : previous) {
+        auto it = position.find(r.id);
+        if (it == position.end()) continue;
+        if (kept && it->second < last) return false;
+        last = it->second;
+        kept = true;
+    }
+    for (size_t i = 0; kept && i <= last; ++i) {
+        if (!before.count(rules[i].id)) return false;
+    }
+
+    for (const auto& r : previous) {
+        if (!position.count(r.id)) matcher->RemoveRule(r.id);
+    }
+    for (const auto& r : rules) {
+        auto it = before.find(r.id);
+        if (it == before.end()) {
+            if (!matcher->AppendRule(r)) return false;
+        }
+        else if (!SameMatch(r, *it->second) && (matcherReordered || !matcher->ReplaceRule(r))) return false;
+    }
+    return true;
+}
+
+RuleAnalysis RuleManager::AnalyzeRules() const {
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    return RuleAnalyzer::Analyze(rules);
+}
+
+void RuleManager::SetMinimizeRules(bool enabled) {
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    minimizeRules = enabled;
+    RebuildMatcher();
+    for (size_t i = 0; i < profiles.size(); ++i) {
+        if (i != activeProfile) CompileProfile(profiles[i]);
+    }
+}
+
+void RuleManager::SetFilterMode(FilterMode mode) {
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    matcher->SetFilterMode(mode);
+    for (auto& profile : profiles) {
+        if (profile.matcher) profile.matcher->SetFilterMode(mode);
     }
-    return true; //   ,     
+    ++rulesVersion;
+}
+
+FilterMode RuleManager::GetFilterMode() const {
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    return matcher->GetFilterMode();
+}
+
+// filter_mode.json: {"filterMode": "WHITELIST"}  ,   GUI
+bool RuleManager::SaveFilterMode() const {
+    std::ofstream f(filterModePath, std::ios::out | std::ios::trunc);
+    if (!f) return false;
+    json doc = { {"filterMode", GetFilterMode() == FilterMode::WHITELIST ? "WHITELIST" : "BLACKLIST"} };
+    f << doc.dump(2);
+    return true;
+}
+
+//    ,       
+bool RuleManager::LoadFilterMode() {
+    std::error_code error;
+    auto modified = std::filesystem::last_write_time(filterModePath, error);
+    if (error || modified == filterModeTime) return false;
+    filterModeTime = modified;
+    std::ifstream f(filterModePath);
+    json doc = f ? json::parse(f, nullptr, false) : json();
+    if (!doc.is_object()) return false;
+    FilterMode mode = doc.value("filterMode", "") == "WHITELIST" ? FilterMode::WHITELIST : FilterMode::BLACKLIST;
+    if (mode == GetFilterMode()) return false;
+    SetFilterMode(mode);
+    return true;
+}
+
+std::vector<Rule> RuleManager::GetEffectiveRules() const {
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    return minimizeRules ? RuleAnalyzer::Analyze(rules).minimized : rules;
+}
+
+void RuleManager::SetReorderRules(bool enabled) {
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    reorderRules = enabled;
+    nextReorderTick = 0;
+    if (!enabled && matcherReordered) RebuildMatcher();
+}
+
+RuleOrder RuleManager::GetRuleOrder() const {
+    std::lock_guard<std::mutex> lock(ruleMutex);
+    return ruleOrder;
 }
 
 void RuleManager::Clear() {
     std::lock_guard<std::mutex> lock(ruleMutex);
     rules.clear();
+    matcher->Clear();
+    expiry.Clear();
+    matcherReordered = false;
+    ++rulesVersion;
     nextRuleId = 1;
 }
 
@@ -347,6 +1177,31 @@ void RuleManager::ShowRulesDialog(HWND hParent) {
     );
 }
 
+static std::wstring FormatBytes(uint64_t bytes) {
+    const wchar_t* units[] = { L"", L"", L"", L"", L"" };
+    double value = static_cast<double>(bytes);
+    int unit = 0;
+    while (value >= 1024.0 && unit < 4) {
+        value /= 1024.0;
+        unit++;
+    }
+    wchar_t buf[32];
+    if (unit == 0)
+        swprintf_s(buf, L"%llu %s", static_cast<unsigned long long>(bytes), units[unit]);
+    else
+        swprintf_s(buf, L"%.1f %s", value, units[unit]);
+    return buf;
+}
+
+static std::wstring FormatHitTime(time_t t) {
+    if (t == 0) return L"";
+    struct tm timeinfo;
+    if (localtime_s(&timeinfo, &t) != 0) return L"";
+    wchar_t buf[64];
+    wcsftime(buf, _countof(buf), L"%Y-%m-%d %H:%M:%S", &timeinfo);
+    return buf;
+}
+
 void FillRulesList(HWND hList) {
     ListView_DeleteAllItems(hList);
 
@@ -369,7 +1224,10 @@ void FillRulesList(HWND hList) {
         { L" ", 120 },
         { L"", 70 },
         { L" ", 100 },
-        { L" ", 100 }
+        { L" ", 100 },
+        { L"", 90 },
+        { L"", 80 },
+        { L" ", 130 }
     };
 
     for (int i = 0; i < _countof(columns); i++) {
@@ -381,6 +1239,7 @@ void FillRulesList(HWND hList) {
 
     auto rules = RuleManager::Instance().GetRules();
     auto currentDirection = RuleManager::Instance().GetCurrentDirection();
+    auto ruleStats = RuleManager::Instance().GetRuleStats();
 
     // 
     std::vector<Rule> filteredRules;
@@ -396,7 +1255,7 @@ void FillRulesList(HWND hList) {
 
     int itemIndex = 0;
     for (const auto& rule : filteredRules) {
-        std::wstring values[9];
+        std::wstring values[12];
         values[0] = Utf8ToWide(rule.name);
         values[1] = rule.enabled ? L"" : L"";
         values[2] = rule.action == RuleAction::ALLOW ? L"" : L"";
@@ -421,6 +1280,20 @@ void FillRulesList(HWND hList) {
             values[8] = rule.destPort == 0 ? L"" : std::to_wstring(rule.destPort);
         }
 
+        //  
+        auto statIt = ruleStats.find(rule.id);
+        if (statIt != ruleStats.end()) {
+            const RuleHitStats& st = statIt->second;
+            values[9] = std::to_wstring(st.packets);
+            values[10] = FormatBytes(st.bytes);
+            values[11] = FormatHitTime(st.lastHit);
+        }
+        else {
+            values[9] = L"0";
+            values[10] = L"0 ";
+            values[11] = L"";
+        }
+
         LVITEM lvi = { 0 };
         lvi.mask = LVIF_TEXT | LVIF_PARAM;
         lvi.iItem = itemIndex;
@@ -429,7 +1302,7 @@ void FillRulesList(HWND hList) {
         lvi.lParam = rule.id;
         ListView_InsertItem(hList, &lvi);
 
-        for (int i = 1; i < 9; ++i) {
+        for (int i = 1; i < 12; ++i) {
             LVITEM subLvi = { 0 };
             subLvi.mask = LVIF_TEXT;
             subLvi.iItem = itemIndex;
@@ -1,30 +1,124 @@
 #pragma once
 #include <vector>
 #include <mutex>
+#include <atomic>
+#include <thread>
 #include <optional>
 #include <string>
+#include <ios>
+#include <unordered_map>
+#include <memory>
+#include <filesystem>
 #include "rule.h"
+#include "rule_stats.h"
+#include "rule_matcher.h"
+#include "connection_tracker.h"
+#include "rule_analyzer.h"
+#include "rule_expiry.h"
 #include "types.h"
 #include <Windows.h>
 #include "connection.h"
 #include "firewall_logger.h"
 
+class ResolverDomainFeeder;
+
 class RuleManager {
 private:
     RuleManager();
     ~RuleManager();
 
     std::vector<Rule> rules;
+    std::unique_ptr<RuleMatcher> matcher = std::make_unique<RuleMatcher>();
+    ConnectionTracker connections;      // под ruleMutex, как и matcher
+    bool minimizeRules = false;
+    ResolverDomainFeeder* resolverFeeder = nullptr;    // принадлежит IpDomainTable
     mutable std::mutex ruleMutex;
     int nextRuleId = 1;
     RuleDirection currentDirection = RuleDirection::Inbound;
     std::string GetProtocolString(Protocol proto) const;
+    void RebuildMatcher();
+    void UpdateResolverNames();
+    static bool ReadRulesFile(const std::wstring& path, std::vector<Rule>& out, int& maxId);
+    const Rule& InsertRule(const Rule& rule);
+    FirewallEvent RuleDeletedEvent(const Rule& rule) const;
+    void SetActiveRules(std::vector<Rule> loaded, int maxId);
+
+    // Профили (profiles.json): у каждого свой файл правил и заранее скомпилированный matcher.
+    // Правила и matcher активного профиля живут в rules и matcher, остальных — в самом профиле;
+    // переключение обменивает указатели и ничего не компилирует
+    struct RuleProfile {
+        std::string name;
+        std::wstring rulesPath;
+        std::vector<std::string> networks;  // подсети адаптера ("10.20.0.0/16"), в которых профиль включается сам
+        std::vector<Rule> rules;
+        std::unique_ptr<RuleMatcher> matcher;
+        bool reordered = false;
+        int nextRuleId = 1;
+        mutable std::filesystem::file_time_type loadedTime{};  // время изменения файла правил при загрузке или записи
+    };
+    std::vector<RuleProfile> profiles;
+    size_t activeProfile = 0;
+    std::string activeInFile;           // "active" из profiles.json при последней загрузке
+    void CompileProfile(RuleProfile& profile) const;
+    void ParkActiveProfile();
+    void ActivateProfile(size_t index);
+    // Файл правил активного набора и время его изменения при последнем чтении или записи
+    mutable std::filesystem::file_time_type rulesFileTime{};
+    std::wstring ActiveRulesPath() const;
+    std::filesystem::file_time_type& ActiveRulesTime() const;
+
+    // Изменения правил правят matcher по одному правилу (RuleMatcher::AppendRule и др.);
+    // RebuildMatcher — только при минимизации набора и перестановках. rulesVersion растёт
+    // с каждым изменением, чтобы фоновая перекомпиляция не подменила более новый matcher
+    bool ReplaceInMatcher(const Rule& rule);
+    bool PatchMatcherFrom(const std::vector<Rule>& previous);
+    void MatcherPatched();
+    void CompactMatcherAsync();
+    void RecompileAsync(bool reorder);
+    uint64_t rulesVersion = 0;
+    std::thread compactWorker;
+    std::atomic<bool> compacting{ false };
+
+    // Раз в REORDER_INTERVAL_MS matcher перекомпилируется в фоне с частыми правилами впереди
+    // (RuleAnalyzer::ReorderByHits). Правка правила на своём месте в переставленном matcher
+    // невозможна: она перекомпилирует его в исходном порядке до следующей перестановки
+    void ReorderIfDue(ULONGLONG now);
+    static constexpr ULONGLONG REORDER_INTERVAL_MS = 60000;
+    bool reorderRules = true;
+    bool matcherReordered = false;
+    ULONGLONG nextReorderTick = 0;
+    RuleOrder ruleOrder;
+
+    // Раз в SCHEDULE_CHECK_MS минута ScheduleClock уходит в matcher: правила с расписанием
+    // включаются и выключаются на границе минуты с опозданием не больше интервала
+    void RefreshScheduleIfDue(ULONGLONG now);
+    static constexpr ULONGLONG SCHEDULE_CHECK_MS = 1000;
+    ULONGLONG nextScheduleTick = 0;
+
+    // Сроки временных правил активного набора; истёкшие снимаются из rules и matcher по одному,
+    // как RemoveRule, не чаще раза в EXPIRY_CHECK_MS. На пути пакета — только это: запись файла,
+    // журнал и счётчики ждут ExpireRules по таймеру в expiredEvents и expiredIds
+    ExpiryWheel expiry;
+    void RescheduleExpiry();
+    size_t RemoveExpired();
+    std::vector<FirewallEvent> expiredEvents;
+    std::vector<int> expiredIds;
+    void ExpireIfDue(ULONGLONG now);
+    static constexpr ULONGLONG EXPIRY_CHECK_MS = 1000;
+    ULONGLONG nextExpiryTick = 0;
+
+    // Прочитанная часть rules_added.jsonl; журнал длиннее ADDED_RULES_MAX_BYTES GUI начинает заново
+    std::streamoff addedRulesOffset = 0;
+    std::filesystem::file_time_type filterModeTime{};   // filter_mode.json при последнем чтении
+    static constexpr uintmax_t ADDED_RULES_MAX_BYTES = 64 * 1024;
 
 public:
     RuleManager(const RuleManager&) = delete;
     RuleManager& operator=(const RuleManager&) = delete;
 
     bool FindBlockingRule(const PacketInfo& pkt, std::string& outRuleName);
+    // Пачка пакетов под одним захватом ruleMutex: заполняет isBlocked и blockReason
+    void FindBlockingRuleBatch(std::vector<PacketInfo>& packets);
 
     void ApplyAllRules();
 
@@ -35,10 +129,21 @@ public:
 
     bool ShowAddRuleWizard(HWND hParent);
     bool AddRule(const Rule& rule);
+    // Временное правило: снимается через ttlSeconds (Rule::expiresAt), и после перезапуска тоже
+    bool AddTemporaryRule(const Rule& rule, uint32_t ttlSeconds);
+    // Временные правила, которые GUI добавил после прочитанной части журнала, дописываются
+    // в matcher без чтения файла правил; возвращает их число
+    size_t LoadAddedRules();
+    // Снимает истёкшие временные правила, как RemoveRule, вместе с уже снятыми на пути пакета;
+    // вызывается по таймеру. Файл правил переписывается, только если с последнего чтения или
+    // записи его не менял другой процесс. Возвращает число снятых правил
+    size_t ExpireRules();
     bool RemoveRule(int ruleId);
     bool UpdateRule(const Rule& rule);
     std::vector<Rule> GetRules() const;
     std::optional<Rule> GetRuleById(int ruleId) const;
+    // В направлении соединения, а если оно неизвестно — RuleMatcher::IsAllowedEitherDirection;
+    // matchedRuleId — запретившее правило или подошедшее разрешающее
     bool IsAllowed(const Connection& connection, int& matchedRuleId);
     void Clear();
     void ResetRuleIdCounter(int newNextId = 1);
@@ -46,6 +151,38 @@ public:
 
     bool SaveRulesToFile(const std::wstring& path = L"rules.json") const;
     bool LoadRulesFromFile(const std::wstring& path = L"rules.json");
+
+    // Перечитывает profiles.json и изменившиеся файлы правил профилей, компилируя все профили;
+    // false — файла профилей нет, действует один rules.json
+    bool LoadProfiles();
+    // Мгновенное переключение на заранее скомпилированный профиль; выбор записывается
+    // в profiles.json, чтобы за ним последовал второй процесс (GUI или демон)
+    bool SwitchProfile(const std::string& name);
+    std::string GetActiveProfile() const;
+    std::vector<std::string> GetProfileNames() const;
+    // Первый профиль, в подсетях которого есть один из адресов адаптеров; пусто — нет такого
+    std::string ProfileForAddresses(const std::vector<uint32_t>& addresses) const;
+
+    bool SaveRuleStats() const;
+    bool LoadRuleStats();
+    std::unordered_map<int, RuleHitStats> GetRuleStats() const;
+
+    // Затенённые/избыточные/объединяемые правила; при включённой минимизации
+    // сопоставитель компилируется из минимизированного набора
+    RuleAnalysis AnalyzeRules() const;
+    void SetMinimizeRules(bool enabled);
+    // WHITELIST: пакет, не подошедший ни к одному разрешающему правилу, блокируется
+    void SetFilterMode(FilterMode mode);
+    FilterMode GetFilterMode() const;
+    // Режим переживает перезапуск GUI и доходит до демона через filter_mode.json;
+    // LoadFilterMode — true, если режим из файла сменил текущий
+    bool SaveFilterMode() const;
+    bool LoadFilterMode();
+    std::vector<Rule> GetEffectiveRules() const;
+    // Перестановка правил по частоте срабатываний; порядок rules и WFP не меняется
+    void SetReorderRules(bool enabled);
+    // Последняя перестановка: порядок проверки и среднее число проверенных правил до и после
+    RuleOrder GetRuleOrder() const;
 private:
     static INT_PTR CALLBACK RulesDialogProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM lParam);
 };
\ No newline at end of file
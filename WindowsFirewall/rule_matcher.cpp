@@ -0,0 +1,820 @@
+#include "rule_matcher.h"
+#include "ip_utils.h"
+#include "icmp_decoder.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+
+static std::string Trim(const std::string& s) {
+    size_t first = s.find_first_not_of(" \t");
+    if (first == std::string::npos) return "";
+    size_t last = s.find_last_not_of(" \t");
+    return s.substr(first, last - first + 1);
+}
+
+static bool IsAnyAddress(const std::string& s) {
+    if (s.empty() || s == "0.0.0.0" || s == "0.0.0.0/0" || s == "*") return true;
+    std::string lower = s;
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+        [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return lower == "any";
+}
+
+AddressMatch RuleMatcher::ParseAddress(const std::string& str) {
+    AddressMatch m;
+    std::string s = Trim(str);
+    if (IsAnyAddress(s)) return m;
+
+    m.any = false;
+    if (AddressLists::IsReference(s)) {
+        m.never = true;
+        m.list = AddressLists::Instance().Get(AddressLists::ReferenceName(s));
+        return m;
+    }
+    if (!ParseIPv4Prefix(s, m.network, m.mask)) {
+        // Домен или некорректная строка: адрес пакета с ней никогда не совпадёт
+        m.never = true;
+    }
+    return m;
+}
+
+static bool ParsePortNumber(const std::string& s, uint16_t& out) {
+    std::string t = Trim(s);
+    if (t.empty() || t.size() > 5) return false;
+    int value = 0;
+    for (char c : t) {
+        if (c < '0' || c > '9') return false;
+        value = value * 10 + (c - '0');
+    }
+    if (value <= 0 || value > 65535) return false;
+    out = static_cast<uint16_t>(value);
+    return true;
+}
+
+// Строка вида "80,443,1000-2000" (как её сохраняет мастер правил); иначе одиночный порт
+std::vector<PortRange> RuleMatcher::ParsePorts(const std::string& portStr, int port) {
+    std::vector<PortRange> ranges;
+    size_t start = 0;
+    while (!portStr.empty()) {
+        size_t comma = portStr.find(',', start);
+        std::string part = portStr.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        size_t dash = part.find('-');
+        PortRange r;
+        if (dash != std::string::npos) {
+            if (ParsePortNumber(part.substr(0, dash), r.low) &&
+                ParsePortNumber(part.substr(dash + 1), r.high) && r.low <= r.high) {
+                ranges.push_back(r);
+            }
+        }
+        else if (ParsePortNumber(part, r.low)) {
+            r.high = r.low;
+            ranges.push_back(r);
+        }
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+
+    if (ranges.empty() && port > 0 && port <= 65535) {
+        ranges.push_back({ static_cast<uint16_t>(port), static_cast<uint16_t>(port) });
+    }
+    return ranges;
+}
+
+static bool ParseIcmpNumber(const std::string& s, int& out) {
+    std::string t = Trim(s);
+    if (t.empty() || t.size() > 3) return false;
+    int value = 0;
+    for (char c : t) {
+        if (c < '0' || c > '9') return false;
+        value = value * 10 + (c - '0');
+    }
+    if (value > 255) return false;
+    out = value;
+    return true;
+}
+
+// "8,0,3/4": тип или тип/код через запятую; некорректные элементы пропускаются
+std::vector<IcmpTypeMatch> RuleMatcher::ParseIcmpTypes(const std::string& str) {
+    std::vector<IcmpTypeMatch> types;
+    size_t start = 0;
+    while (!str.empty()) {
+        size_t comma = str.find(',', start);
+        std::string part = str.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        size_t slash = part.find('/');
+        int type = 0;
+        int code = -1;
+        bool ok = slash == std::string::npos
+            ? ParseIcmpNumber(part, type)
+            : ParseIcmpNumber(part.substr(0, slash), type) && ParseIcmpNumber(part.substr(slash + 1), code);
+        if (ok) {
+            IcmpTypeMatch m;
+            m.type = static_cast<uint8_t>(type);
+            m.code = static_cast<int16_t>(code);
+            types.push_back(m);
+        }
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return types;
+}
+
+static const struct {
+    const char* name;
+    uint8_t flag;
+} kTcpFlagNames[] = {
+    { "FIN", TCP_FLAG_FIN }, { "SYN", TCP_FLAG_SYN }, { "RST", TCP_FLAG_RST }, { "PSH", TCP_FLAG_PSH },
+    { "ACK", TCP_FLAG_ACK }, { "URG", TCP_FLAG_URG }, { "ECE", TCP_FLAG_ECE }, { "CWR", TCP_FLAG_CWR }
+};
+
+static std::string Upper(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(),
+        [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+    return s;
+}
+
+// Элементы списка через запятую без пробелов по краям, в верхнем регистре
+template <typename Fn>
+static void ForEachListItem(const std::string& str, Fn fn) {
+    size_t start = 0;
+    while (start < str.size()) {
+        size_t comma = str.find(',', start);
+        std::string item = Upper(Trim(str.substr(start, comma == std::string::npos ? std::string::npos : comma - start)));
+        if (!item.empty()) fn(item);
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+}
+
+bool RuleMatcher::ParseTcpFlags(const std::string& str, uint8_t& mask, uint8_t& set) {
+    mask = 0;
+    set = 0;
+    bool ok = true;
+    ForEachListItem(str, [&](const std::string& item) {
+        bool clear = item[0] == '!';
+        std::string name = Trim(clear ? item.substr(1) : item);
+        for (const auto& known : kTcpFlagNames) {
+            if (name == known.name) {
+                mask |= known.flag;
+                if (clear) set &= static_cast<uint8_t>(~known.flag);
+                else set |= known.flag;
+                return;
+            }
+        }
+        ok = false;
+    });
+    return ok;
+}
+
+uint8_t RuleMatcher::ParseConnectionStates(const std::string& str) {
+    uint8_t states = 0;
+    ForEachListItem(str, [&](const std::string& item) {
+        if (item == "NEW") states |= static_cast<uint8_t>(ConnectionState::New);
+        else if (item == "ESTABLISHED") states |= static_cast<uint8_t>(ConnectionState::Established);
+        else if (item == "RELATED") states |= static_cast<uint8_t>(ConnectionState::Related);
+    });
+    return states;
+}
+
+// Правило с ошибкой в условии не должно превращаться в "любой пакет": оно не совпадёт ни с чем
+static void MatchNothing(CompiledRule& c) {
+    c.tcpFlagsMask = 0xFF;
+    c.tcpFlagsSet = 0xFF;
+    c.ipProtocol = 0xFF;
+}
+
+CompiledRule RuleMatcher::CompileRule(const Rule& rule) {
+    CompiledRule c;
+    c.id = rule.id;
+    c.priority = rule.priority;
+    c.action = rule.action;
+    c.direction = rule.direction;
+    c.ipProtocol = ProtocolToIpNumber(rule.protocol);
+    c.source = ParseAddress(rule.sourceIp);
+    c.dest = ParseAddress(rule.destIp);
+    c.sourcePorts = ParsePorts(rule.sourcePortStr, rule.sourcePort);
+    c.destPorts = ParsePorts(rule.destPortStr, rule.destPort);
+    c.icmpTypes = ParseIcmpTypes(rule.icmpTypes);
+    if (!ParseTcpFlags(rule.tcpFlags, c.tcpFlagsMask, c.tcpFlagsSet)) MatchNothing(c);
+    std::string adapter = Trim(rule.adapter);
+    if (!adapter.empty() && !ParseIPv4(adapter, c.adapter)) MatchNothing(c);
+    c.states = ParseConnectionStates(rule.connectionState);
+    c.appPath = rule.appPath;
+    c.app = AppIdentityTable::Instance().ParseMatch(rule.appPath);
+    c.service = ServiceNames::Instance().Intern(rule.service);
+    c.name = rule.name.empty() ? rule.description : rule.name;
+    if (!WeekSchedule::Parse(rule.schedule, c.schedule)) MatchNothing(c);
+    return c;
+}
+
+static std::atomic<uint64_t> nextGeneration{ 0 };
+
+static size_t StateIndex(ConnectionState state) {
+    switch (state) {
+    case ConnectionState::Established: return 1;
+    case ConnectionState::Related: return 2;
+    default: return 0;
+    }
+}
+
+// Домен в адресе получает id шаблона в DomainTrie этого сопоставителя
+CompiledRule RuleMatcher::CompileWithDomains(const Rule& rule) {
+    CompiledRule c = CompileRule(rule);
+    if (c.source.never && !c.source.list) c.source.domain = domains.Add(rule.sourceIp);
+    if (c.dest.never && !c.dest.list) c.dest.domain = domains.Add(rule.destIp);
+    return c;
+}
+
+static bool HigherPriority(const Rule* a, const Rule* b) {
+    return a->priority > b->priority;
+}
+
+void RuleMatcher::Compile(const std::vector<Rule>& rules) {
+    Clear();
+    scheduleMinute = scheduleClock->Minute();
+    std::vector<const Rule*> ordered;
+    ordered.reserve(rules.size());
+    for (const auto& rule : rules) {
+        if (rule.enabled) ordered.push_back(&rule);
+    }
+    std::stable_sort(ordered.begin(), ordered.end(), HigherPriority);
+    compiled.reserve(ordered.size());
+    for (const Rule* rule : ordered) compiled.push_back(CompileWithDomains(*rule));
+    for (const auto& c : compiled) {
+        if (c.adapter != 0 && !adapterSets.count(c.adapter)) AddAdapterSets(c.adapter, false);
+    }
+    for (size_t i = 0; i < compiled.size(); ++i) IndexRule(static_cast<uint32_t>(i));
+    BuildBlockEngine();
+}
+
+std::vector<Rule> RuleMatcher::EvaluationOrder(const std::vector<Rule>& rules) {
+    std::vector<const Rule*> ordered;
+    ordered.reserve(rules.size());
+    for (const auto& rule : rules) ordered.push_back(&rule);
+    std::stable_sort(ordered.begin(), ordered.end(), HigherPriority);
+    std::vector<Rule> result;
+    result.reserve(ordered.size());
+    for (const Rule* rule : ordered) result.push_back(*rule);
+    return result;
+}
+
+void RuleMatcher::IndexRule(uint32_t index) {
+    const CompiledRule& c = compiled[index];
+    slots[c.id] = index;
+    if (c.schedule) InsertSortedIndex(scheduled, index);
+    if (ActiveNow(c)) IndexInSets(index);
+}
+
+void RuleMatcher::IndexInSets(uint32_t index) {
+    const CompiledRule& c = compiled[index];
+    for (size_t s = 0; s < sets.size(); ++s) {
+        if (InSet(c, s)) IndexInSet(c, index, sets[s]);
+    }
+}
+
+void RuleMatcher::IndexInSet(const CompiledRule& c, uint32_t index, RuleSet& set) {
+    if (c.action == RuleAction::ALLOW) {
+        std::vector<uint64_t> keys;
+        AllowKeys(c, keys);
+        for (uint64_t key : keys) InsertSortedIndex(set.allowIndex[key], index);
+        return;
+    }
+    InsertSortedIndex(FieldMaskIndex::Supports(c) ? set.blockSpecialised : set.blockGeneric, index);
+    for (size_t state = 0; state < 3; ++state) {
+        bool perPacket = c.states ? (c.states & (1u << state)) != 0 : c.tcpFlagsMask != 0;
+        if (perPacket) InsertSortedIndex(set.packetRules[state], index);
+    }
+}
+
+void RuleMatcher::AddAdapterSets(uint32_t adapter, bool indexExisting) {
+    size_t base = sets.size();
+    adapterSets[adapter] = base;
+    setAdapters.push_back(adapter);
+    sets.resize(base + 2);
+    if (!indexExisting) return;
+    // Живые правила по порядку: пустые слоты в slots не числятся
+    for (uint32_t index = 0; index < compiled.size(); ++index) {
+        const CompiledRule& c = compiled[index];
+        auto slot = slots.find(c.id);
+        if (slot == slots.end() || slot->second != index || !ActiveNow(c)) continue;
+        for (size_t s = base; s < sets.size(); ++s) {
+            if (InSet(c, s)) IndexInSet(c, index, sets[s]);
+        }
+    }
+    for (size_t s = base; s < sets.size(); ++s) BuildSetEngine(sets[s]);
+}
+
+void RuleMatcher::UnindexRule(uint32_t index) {
+    const CompiledRule& c = compiled[index];
+    slots.erase(c.id);
+    if (c.schedule) EraseSortedIndex(scheduled, index);
+    if (ActiveNow(c)) UnindexFromSets(index);
+}
+
+void RuleMatcher::UnindexFromSets(uint32_t index) {
+    const CompiledRule& c = compiled[index];
+    for (size_t s = 0; s < sets.size(); ++s) {
+        if (!InSet(c, s)) continue;
+        RuleSet& set = sets[s];
+        if (c.action == RuleAction::ALLOW) {
+            std::vector<uint64_t> keys;
+            AllowKeys(c, keys);
+            for (uint64_t key : keys) {
+                auto it = set.allowIndex.find(key);
+                if (it == set.allowIndex.end()) continue;
+                EraseSortedIndex(it->second, index);
+                if (it->second.empty()) set.allowIndex.erase(it);
+            }
+            continue;
+        }
+        EraseSortedIndex(set.blockGeneric, index);
+        EraseSortedIndex(set.blockSpecialised, index);
+        for (auto& list : set.packetRules) EraseSortedIndex(list, index);
+    }
+}
+
+// Auto: Simd, пока ни в одном наборе нет больше SIMD_MAX_RULES специализированных правил
+RuleMatcher::BlockEngine RuleMatcher::WantedEngine() const {
+    if (blockEngine != BlockEngine::Auto) return blockEngine;
+    size_t largest = 0;
+    for (const auto& set : sets) largest = (std::max)(largest, set.blockSpecialised.size());
+    return largest <= SIMD_MAX_RULES ? BlockEngine::Simd : BlockEngine::FieldMask;
+}
+
+// После изменения одного правила blockSpecialised: корзина индекса правится на месте, таблица
+// (при Auto не больше SIMD_MAX_RULES строк) строится заново, Auto за порогом меняет движок
+void RuleMatcher::PatchBlockEngine(uint32_t index, bool inserted) {
+    if (WantedEngine() != activeEngine) {
+        BuildBlockEngine();
+        return;
+    }
+    const CompiledRule& c = compiled[index];
+    for (size_t s = 0; s < sets.size(); ++s) {
+        if (!InSet(c, s)) continue;
+        RuleSet& set = sets[s];
+        if (activeEngine == BlockEngine::FieldMask) {
+            if (inserted) set.blockIndex.Insert(c, index);
+            else set.blockIndex.Remove(c, index);
+        }
+        else if (activeEngine == BlockEngine::Simd) set.blockTable.Build(compiled, set.blockSpecialised);
+    }
+}
+
+bool RuleMatcher::FitsAt(uint32_t index, int priority) const {
+    return (index == 0 || compiled[index - 1].priority >= priority)
+        && (index + 1 >= compiled.size() || compiled[index + 1].priority <= priority);
+}
+
+// Пустой слот удалённого правила: разрешающее (линейный поиск блокирующих его пропускает)
+// и с адресами never, которые не совпадают ни с одним пакетом
+static CompiledRule Hole() {
+    CompiledRule c;
+    c.id = 0;
+    c.source.any = false;
+    c.source.never = true;
+    c.dest = c.source;
+    return c;
+}
+
+bool RuleMatcher::AppendRule(const Rule& rule) {
+    if (!rule.enabled) return true;
+    if (!compiled.empty() && compiled.back().priority < rule.priority) return false;
+    compiled.push_back(CompileWithDomains(rule));
+    uint32_t index = static_cast<uint32_t>(compiled.size() - 1);
+    if (compiled[index].adapter != 0 && !adapterSets.count(compiled[index].adapter)) {
+        AddAdapterSets(compiled[index].adapter, true);
+    }
+    IndexRule(index);
+    const CompiledRule& c = compiled[index];
+    if (InBlockEngine(c)) PatchBlockEngine(index, true);
+    generation = ++nextGeneration;
+    return true;
+}
+
+bool RuleMatcher::RemoveRule(int id) {
+    auto it = slots.find(id);
+    if (it == slots.end()) return false;
+    uint32_t index = it->second;
+    const CompiledRule& c = compiled[index];
+    bool specialised = InBlockEngine(c);
+    UnindexRule(index);
+    // Корзине индекса нужно правило в прежнем виде, поэтому слот пустеет последним
+    if (specialised) PatchBlockEngine(index, false);
+    // Слот сохраняет приоритет: по нему AppendRule и ReplaceRule проверяют порядок
+    int priority = c.priority;
+    compiled[index] = Hole();
+    compiled[index].priority = priority;
+    ++holes;
+    generation = ++nextGeneration;
+    return true;
+}
+
+bool RuleMatcher::ReplaceRule(const Rule& rule) {
+    auto it = slots.find(rule.id);
+    if (it == slots.end()) return !rule.enabled;
+    if (!rule.enabled) return RemoveRule(rule.id);
+    uint32_t index = it->second;
+    if (!FitsAt(index, rule.priority)) return false;
+    const CompiledRule& old = compiled[index];
+    bool wasSpecialised = InBlockEngine(old);
+    UnindexRule(index);
+    if (wasSpecialised) PatchBlockEngine(index, false);
+    compiled[index] = CompileWithDomains(rule);
+    if (compiled[index].adapter != 0 && !adapterSets.count(compiled[index].adapter)) {
+        AddAdapterSets(compiled[index].adapter, true);
+    }
+    IndexRule(index);
+    const CompiledRule& c = compiled[index];
+    if (InBlockEngine(c)) PatchBlockEngine(index, true);
+    generation = ++nextGeneration;
+    return true;
+}
+
+void RuleMatcher::SetBlockEngine(BlockEngine engine) {
+    blockEngine = engine;
+    BuildBlockEngine();
+}
+
+void RuleMatcher::BuildBlockEngine() {
+    activeEngine = WantedEngine();
+    for (auto& set : sets) BuildSetEngine(set);
+}
+
+void RuleMatcher::BuildSetEngine(RuleSet& set) {
+    set.blockIndex.Clear();
+    set.blockTable.Clear();
+    // Новые наборы — с тем же ядром, что выбрано для остальных (SetSimdKernel)
+    set.blockTable.SetKernel(simdKernel);
+    if (activeEngine == BlockEngine::FieldMask) set.blockIndex.Build(compiled, set.blockSpecialised);
+    else if (activeEngine == BlockEngine::Simd) set.blockTable.Build(compiled, set.blockSpecialised);
+}
+
+bool RuleMatcher::SetSimdKernel(SimdRuleTable::Kernel kernel) {
+    if (static_cast<int>(kernel) > static_cast<int>(SimdRuleTable::BestKernel())) return false;
+    simdKernel = kernel;
+    bool ok = true;
+    for (auto& set : sets) ok = set.blockTable.SetKernel(kernel) && ok;
+    return ok;
+}
+
+// Префикс IPv4 не короче /16 (не список и не домен) — блок /16 для индекса
+static bool IndexableAddress(const AddressMatch& a) {
+    return !a.any && !a.never && !a.list && (a.mask & 0xFFFF0000u) == 0xFFFF0000u;
+}
+
+void RuleMatcher::AllowKeys(const CompiledRule& c, std::vector<uint64_t>& keys) {
+    keys.clear();
+    if (IndexableAddress(c.dest)) {
+        keys.push_back(AllowKey(ALLOW_BY_DEST, c.dest.network >> 16));
+        return;
+    }
+    if (IndexableAddress(c.source)) {
+        keys.push_back(AllowKey(ALLOW_BY_SOURCE, c.source.network >> 16));
+        return;
+    }
+    size_t ports = 0;
+    for (const auto& range : c.destPorts) ports += range.high - range.low + 1u;
+    if (c.destPorts.empty() || ports > MAX_INDEXED_PORTS) {
+        keys.push_back(AllowKey(ALLOW_ANY_PORT, c.ipProtocol));
+        return;
+    }
+    for (const auto& range : c.destPorts) {
+        for (uint32_t port = range.low; port <= range.high; ++port) {
+            uint64_t key = AllowKey(ALLOW_BY_PORT, (uint32_t(c.ipProtocol) << 16) | port);
+            // Пересекающиеся диапазоны одного правила не должны повторять ключ
+            if (std::find(keys.begin(), keys.end(), key) == keys.end()) keys.push_back(key);
+        }
+    }
+}
+
+void RuleMatcher::SetFilterMode(FilterMode mode) {
+    filterMode = mode;
+    defaultDeny.action = RuleAction::BLOCK;
+    defaultDeny.name = "Whitelist: no matching allow rule";
+    generation = ++nextGeneration;
+}
+
+void RuleMatcher::SetScheduleClock(const ScheduleClock* clock) {
+    scheduleClock = clock;
+    RefreshSchedule();
+}
+
+// Раз в минуту: перебираются только правила с расписанием, в наборах правятся те, что
+// перешли границу
+bool RuleMatcher::RefreshSchedule() {
+    uint32_t minute = scheduleClock->Minute();
+    if (minute == scheduleMinute) return false;
+    std::vector<uint32_t> leaving;
+    std::vector<uint32_t> entering;
+    for (uint32_t index : scheduled) {
+        const WeekSchedule& schedule = *compiled[index].schedule;
+        bool was = schedule.Active(scheduleMinute);
+        if (schedule.Active(minute) != was) (was ? leaving : entering).push_back(index);
+    }
+    // Уходящие правила убираются при прежней минуте: корзине индекса нужно правило в наборах
+    for (uint32_t index : leaving) {
+        bool specialised = InBlockEngine(compiled[index]);
+        UnindexFromSets(index);
+        if (specialised) PatchBlockEngine(index, false);
+    }
+    scheduleMinute = minute;
+    for (uint32_t index : entering) {
+        IndexInSets(index);
+        if (InBlockEngine(compiled[index])) PatchBlockEngine(index, true);
+    }
+    if (leaving.empty() && entering.empty()) return false;
+    generation = ++nextGeneration;
+    return true;
+}
+
+void RuleMatcher::Clear() {
+    compiled.clear();
+    slots.clear();
+    scheduled.clear();
+    holes = 0;
+    for (auto& set : sets) {
+        for (auto& list : set.packetRules) list.clear();
+        set.blockGeneric.clear();
+        set.blockSpecialised.clear();
+        set.blockIndex.Clear();
+        set.blockTable.Clear();
+        set.allowIndex.clear();
+    }
+    sets.resize(2);
+    setAdapters.resize(1);
+    adapterSets.clear();
+    domains.Clear();
+    generation = ++nextGeneration;
+}
+
+static bool PortMatches(const std::vector<PortRange>& ranges, uint16_t port) {
+    if (ranges.empty()) return true;
+    for (const auto& r : ranges) {
+        if (port >= r.low && port <= r.high) return true;
+    }
+    return false;
+}
+
+static bool IcmpMatches(const std::vector<IcmpTypeMatch>& types, const FlowKey& flow) {
+    if (types.empty()) return true;
+    if (flow.ipProtocol != IP_PROTOCOL_ICMP && flow.ipProtocol != IP_PROTOCOL_ICMPV6) return false;
+    for (const auto& t : types) {
+        if (t.type == flow.icmpType && (t.code < 0 || t.code == flow.icmpCode)) return true;
+    }
+    return false;
+}
+
+// Правило с состоянием относится к соединениям своего направления: "NEW" во входящем
+// правиле не трогает ответы на исходящие соединения
+static bool PacketMatches(const CompiledRule& rule, const FlowKey& flow) {
+    if (rule.tcpFlagsMask && (flow.ipProtocol != 6 || (flow.tcpFlags & rule.tcpFlagsMask) != rule.tcpFlagsSet)) {
+        return false;
+    }
+    if (rule.states == 0) return true;
+    if (!(rule.states & static_cast<uint8_t>(flow.state))) return false;
+    return (rule.direction == RuleDirection::Inbound) == (flow.ConnectionDirection() == PacketDirection::Incoming);
+}
+
+bool RuleMatcher::MatchesTuple(const CompiledRule& rule, const FlowKey& flow) {
+    return (rule.ipProtocol == 0 || rule.ipProtocol == flow.ipProtocol)
+        && (rule.service == UNKNOWN_SERVICE || rule.service == flow.service)
+        && (flow.ipv6 ? rule.source.MatchesIPv6(flow.sourceIp6) : rule.source.Matches(flow.sourceIp))
+        && (flow.ipv6 ? rule.dest.MatchesIPv6(flow.destIp6) : rule.dest.Matches(flow.destIp))
+        && PortMatches(rule.sourcePorts, flow.sourcePort)
+        && PortMatches(rule.destPorts, flow.destPort)
+        && IcmpMatches(rule.icmpTypes, flow)
+        && PacketMatches(rule, flow);
+}
+
+bool RuleMatcher::DomainMatches(uint32_t pattern, uint32_t ip, std::string_view serverName,
+    bool& resolved, std::vector<uint32_t>& hits) const {
+    if (!resolved) {
+        resolved = true;
+        // Имя из самого потока точнее обратного соответствия: на адресе CDN живут сотни сайтов
+        if (!serverName.empty()) {
+            domains.Match(serverName, hits);
+        }
+        else if (domainTable && ip != 0) {
+            domainTable->ForEachName(ip, [&](std::string_view name) { domains.Match(name, hits); });
+        }
+    }
+    return std::find(hits.begin(), hits.end(), pattern) != hits.end();
+}
+
+bool RuleMatcher::MatchesWithDomains(const CompiledRule& rule, const FlowKey& flow, FlowDomains& flowDomains) const {
+    if ((rule.ipProtocol != 0 && rule.ipProtocol != flow.ipProtocol)
+        || (rule.service != UNKNOWN_SERVICE && rule.service != flow.service)
+        || !PortMatches(rule.sourcePorts, flow.sourcePort)
+        || !PortMatches(rule.destPorts, flow.destPort)
+        || !IcmpMatches(rule.icmpTypes, flow)
+        || !PacketMatches(rule, flow)) {
+        return false;
+    }
+    std::string_view sourceName = flow.serverIsSource ? flow.serverName : std::string_view();
+    std::string_view destName = flow.serverIsSource ? std::string_view() : flow.serverName;
+    // Таблица адрес -> имя знает только IPv4: для IPv6 остаётся имя из самого потока
+    bool sourceOk = rule.source.domain
+        ? DomainMatches(rule.source.domain, flow.ipv6 ? 0 : flow.sourceIp, sourceName, flowDomains.sourceResolved, flowDomains.source)
+        : (flow.ipv6 ? rule.source.MatchesIPv6(flow.sourceIp6) : rule.source.Matches(flow.sourceIp));
+    if (!sourceOk) return false;
+    return rule.dest.domain
+        ? DomainMatches(rule.dest.domain, flow.ipv6 ? 0 : flow.destIp, destName, flowDomains.destResolved, flowDomains.dest)
+        : (flow.ipv6 ? rule.dest.MatchesIPv6(flow.destIp6) : rule.dest.Matches(flow.destIp));
+}
+
+RuleVerdict RuleMatcher::Evaluate(const FlowKey& flow, size_t* evaluated) const {
+    const RuleSet& set = SetFor(flow);
+    RuleVerdict verdict;
+    verdict.direction = flow.direction;
+    size_t tested = 0;
+    const CompiledRule* allow = FindAllowIn(set, flow, &tested);
+    const CompiledRule* rule = nullptr;
+    if (filterMode == FilterMode::WHITELIST && !allow) {
+        rule = &defaultDeny;
+    }
+    else {
+        const CompiledRule* block = FindBlockBefore(set, flow, IndexOf(allow), tested);
+        rule = block ? block : allow;
+    }
+    if (evaluated) *evaluated += tested;
+    if (!rule) return verdict;
+    verdict.rule = rule;
+    verdict.action = rule->action;
+    if (rule != &defaultDeny) verdict.ruleId = rule->id;
+    return verdict;
+}
+
+const CompiledRule* RuleMatcher::FindBlockingRule(const FlowKey& flow, size_t* evaluated) const {
+    RuleVerdict verdict = Evaluate(flow, evaluated);
+    return verdict.Blocked() ? verdict.rule : nullptr;
+}
+
+bool RuleMatcher::IsAllowed(const FlowKey& flow, int& matchedRuleId) const {
+    RuleVerdict verdict = Evaluate(flow);
+    matchedRuleId = verdict.ruleId;
+    return !verdict.Blocked();
+}
+
+bool RuleMatcher::IsAllowedEitherDirection(FlowKey flow, int& matchedRuleId) const {
+    flow.direction = PacketDirection::Outgoing;
+    RuleVerdict outgoing = Evaluate(flow);
+    flow.direction = PacketDirection::Incoming;
+    RuleVerdict incoming = Evaluate(flow);
+    for (bool blocked : { false, true }) {
+        for (const RuleVerdict* verdict : { &outgoing, &incoming }) {
+            if (verdict->ruleId == -1 || verdict->Blocked() != blocked) continue;
+            matchedRuleId = verdict->ruleId;
+            return !blocked;
+        }
+    }
+    matchedRuleId = -1;
+    return filterMode == FilterMode::BLACKLIST;
+}
+
+const CompiledRule* RuleMatcher::FindBlockBefore(const RuleSet& set, const FlowKey& flow, uint32_t limit,
+    size_t& tested) const {
+    if (activeEngine != BlockEngine::Linear) {
+        // Правила общей проверки — по порядку до первого совпадения, затем индекс или таблица
+        // ищут правило раньше него
+        const CompiledRule* generic = FindBlockingIn(set.blockGeneric, flow, limit, &tested);
+        uint32_t before = generic ? IndexOf(generic) : limit;
+        uint32_t best = activeEngine == BlockEngine::Simd
+            ? set.blockTable.Find(compiled.data(), flow, true, before, tested)
+            : set.blockIndex.Find(compiled.data(), flow, true, before, tested);
+        return best == before ? generic : &compiled[best];
+    }
+    // Эталон: все блокирующие правила набора подряд
+    FlowDomains flowDomains;
+    size_t setIndex = static_cast<size_t>(&set - sets.data());
+    uint32_t end = static_cast<uint32_t>((std::min)(static_cast<size_t>(limit), compiled.size()));
+    for (uint32_t index = 0; index < end; ++index) {
+        const CompiledRule& rule = compiled[index];
+        if (rule.action != RuleAction::BLOCK || !InSet(rule, setIndex) || !ActiveNow(rule)) continue;
+        ++tested;
+        if (!Matches(rule, flow, flowDomains)) continue;
+        if (!rule.app.Matches(flow.app)) continue;
+        return &rule;
+    }
+    return nullptr;
+}
+
+void RuleMatcher::FindBlockingRuleBatch(const FlowKey* flows, size_t count, const CompiledRule** verdicts,
+    size_t* evaluated) const {
+    if (activeEngine != BlockEngine::FieldMask) {
+        for (size_t i = 0; i < count; ++i) verdicts[i] = FindBlockingRule(flows[i], evaluated);
+        return;
+    }
+    size_t tested = 0;
+    std::vector<FlowKey> part;
+    part.reserve((std::min)(MAX_BATCH, count));
+    uint32_t at[MAX_BATCH];
+    uint32_t limits[MAX_BATCH];
+    size_t setOf[MAX_BATCH];
+    for (size_t start = 0; start < count; start += MAX_BATCH) {
+        size_t n = (std::min)(MAX_BATCH, count - start);
+        const FlowKey* chunk = flows + start;
+        const CompiledRule** out = verdicts + start;
+        size_t used = 0;            // наборы, в которые попали пакеты, — биты для первых 64
+        for (size_t i = 0; i < n; ++i) {
+            setOf[i] = SetIndex(chunk[i]);
+            used |= setOf[i] < 64 ? size_t(1) << setOf[i] : 0;
+        }
+        for (size_t s = 0; s < sets.size(); ++s) {
+            if (s < 64 && !(used & (size_t(1) << s))) continue;
+            const RuleSet& set = sets[s];
+            part.clear();
+            for (size_t i = 0; i < n; ++i) {
+                if (setOf[i] != s) continue;
+                size_t k = part.size();
+                part.push_back(chunk[i]);
+                at[k] = static_cast<uint32_t>(i);
+                const CompiledRule* allow = FindAllowIn(set, chunk[i], &tested);
+                if (filterMode == FilterMode::WHITELIST && !allow) {
+                    out[i] = &defaultDeny;
+                    limits[k] = 0;          // корзины пропускают пакет
+                    continue;
+                }
+                const CompiledRule* generic = FindBlockingIn(set.blockGeneric, chunk[i], IndexOf(allow), &tested);
+                out[i] = nullptr;
+                limits[k] = generic ? IndexOf(generic) : IndexOf(allow);
+            }
+            set.blockIndex.FindBatch(compiled.data(), part.data(), part.size(), true, limits, tested);
+            for (size_t k = 0; k < part.size(); ++k) {
+                const CompiledRule*& verdict = out[at[k]];
+                if (verdict == &defaultDeny || limits[k] == UINT32_MAX) continue;
+                const CompiledRule& rule = compiled[limits[k]];
+                if (rule.action == RuleAction::BLOCK) verdict = &rule;
+            }
+        }
+    }
+    if (evaluated) *evaluated += tested;
+}
+
+const CompiledRule* RuleMatcher::FindAllowingRule(const FlowKey& flow, size_t* evaluated) const {
+    return FindAllowIn(SetFor(flow), flow, evaluated);
+}
+
+// Кандидаты — до шести списков индекса: блоки /16 адресов пакета, порт назначения с его
+// протоколом и с любым, "любой порт" обоих. Из каждого берётся первое подошедшее правило,
+// ответ — самое раннее
+const CompiledRule* RuleMatcher::FindAllowIn(const RuleSet& set, const FlowKey& flow, size_t* evaluated) const {
+    if (set.allowIndex.empty()) return nullptr;
+    uint64_t keys[6];
+    size_t keyCount = 0;
+    if (!flow.ipv6) {
+        keys[keyCount++] = AllowKey(ALLOW_BY_DEST, flow.destIp >> 16);
+        keys[keyCount++] = AllowKey(ALLOW_BY_SOURCE, flow.sourceIp >> 16);
+    }
+    keys[keyCount++] = AllowKey(ALLOW_BY_PORT, (uint32_t(flow.ipProtocol) << 16) | flow.destPort);
+    keys[keyCount++] = AllowKey(ALLOW_ANY_PORT, flow.ipProtocol);
+    if (flow.ipProtocol != 0) {
+        keys[keyCount++] = AllowKey(ALLOW_BY_PORT, flow.destPort);
+        keys[keyCount++] = AllowKey(ALLOW_ANY_PORT, 0);
+    }
+    FlowDomains flowDomains;
+    size_t tested = 0;
+    uint32_t best = UINT32_MAX;
+    for (size_t k = 0; k < keyCount; ++k) {
+        auto it = set.allowIndex.find(keys[k]);
+        if (it == set.allowIndex.end()) continue;
+        for (uint32_t index : it->second) {
+            if (index >= best) break;
+            const CompiledRule& rule = compiled[index];
+            ++tested;
+            if (!Matches(rule, flow, flowDomains)) continue;
+            if (!rule.app.Matches(flow.app)) continue;
+            best = index;
+            break;
+        }
+    }
+    if (evaluated) *evaluated += tested;
+    return best == UINT32_MAX ? nullptr : &compiled[best];
+}
+
+const CompiledRule* RuleMatcher::FindBlockingPacketRule(const FlowKey& flow, size_t* evaluated) const {
+    const RuleSet& set = SetFor(flow);
+    const std::vector<uint32_t>& rules = set.packetRules[StateIndex(flow.state)];
+    if (rules.empty()) return nullptr;
+    // Разрешающее правило раньше блокирующего решает и за пакет внутри соединения
+    size_t tested = 0;
+    const CompiledRule* found = FindBlockingIn(rules, flow, IndexOf(FindAllowIn(set, flow, &tested)), &tested);
+    if (evaluated) *evaluated += tested;
+    return found;
+}
+
+const CompiledRule* RuleMatcher::FindBlockingIn(const std::vector<uint32_t>& indices, const FlowKey& flow,
+    uint32_t limit, size_t* evaluated) const {
+    FlowDomains flowDomains;
+    size_t tested = 0;
+    const CompiledRule* found = nullptr;
+    for (uint32_t index : indices) {
+        if (index >= limit) break;
+        const CompiledRule& rule = compiled[index];
+        ++tested;
+        if (!Matches(rule, flow, flowDomains)) continue;
+        if (!rule.app.Matches(flow.app)) continue;
+        found = &rule;
+        break;
+    }
+    if (evaluated) *evaluated += tested;
+    return found;
+}
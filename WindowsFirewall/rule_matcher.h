@@ -0,0 +1,299 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "rule.h"
+#include "flow_key.h"
+#include "domain_table.h"
+#include "address_list.h"
+#include "field_mask_index.h"
+#include "simd_rule_table.h"
+#include "rule_schedule.h"
+
+struct PortRange {
+    uint16_t low = 0;
+    uint16_t high = 0;
+};
+
+// Тип ICMP с кодом или без: "3/4" — только frag-needed, "3" — любая недостижимость
+struct IcmpTypeMatch {
+    uint8_t type = 0;
+    int16_t code = -1;          // -1 — любой код
+
+    bool operator==(const IcmpTypeMatch& other) const { return type == other.type && code == other.code; }
+};
+
+// Условие на адрес: any, префикс IPv4 (точный адрес = /32), список ("@имя") или never
+// (домен, мусор). Пакеты IPv6 совпадают только с any и списками. Домен сам по себе с адресом не совпадает: его проверяет RuleMatcher
+// по имени сервера потока (SNI, Host) или по IpDomainTable. Список тоже помечен never,
+// чтобы анализатор и WFP не принимали его за префикс.
+struct AddressMatch {
+    bool any = true;
+    bool never = false;
+    uint32_t domain = 0;        // id шаблона в DomainTrie сопоставителя; 0 — не домен
+    const AddressList* list = nullptr;      // из AddressLists, живёт до конца процесса
+    uint32_t network = 0;
+    uint32_t mask = 0;
+
+    bool Matches(uint32_t addr) const {
+        if (any) return true;
+        if (list) return list->ContainsIPv4(addr);
+        return !never && (addr & mask) == network;
+    }
+    bool MatchesIPv6(const uint8_t* addr) const {
+        if (any) return true;
+        return list && list->ContainsIPv6(addr);
+    }
+};
+
+// Правило, разобранное один раз при загрузке: без строковых сравнений в пути пакета
+struct CompiledRule {
+    int id = 0;
+    int priority = 0;
+    RuleAction action = RuleAction::ALLOW;
+    RuleDirection direction = RuleDirection::Inbound;
+    uint32_t adapter = 0;                   // IPv4 адаптера, порядок байтов хоста; 0 = любой
+    uint8_t ipProtocol = 0;                 // 0 = любой
+    AddressMatch source;
+    AddressMatch dest;
+    std::vector<PortRange> sourcePorts;     // пусто = любой
+    std::vector<PortRange> destPorts;
+    std::vector<IcmpTypeMatch> icmpTypes;   // пусто = любой пакет; иначе только ICMP/ICMPv6 этих типов
+    uint8_t tcpFlagsMask = 0;               // проверяемые флаги TCP; 0 = любой пакет
+    uint8_t tcpFlagsSet = 0;                // какие из проверяемых должны быть установлены
+    uint8_t states = 0;                     // биты ConnectionState; 0 = любое. Правило без состояния
+                                            // проверяет направление пакета, с состоянием — соединения
+    std::string appPath;                    // исходная строка (для анализа и WFP)
+    AppMatch app;                           // Kind::None = любое приложение
+    ServiceId service = UNKNOWN_SERVICE;    // UNKNOWN_SERVICE = любая служба
+    std::string name;                       // имя (или описание) для отображения причины блокировки
+    std::shared_ptr<const WeekSchedule> schedule;   // nullptr = всегда; иначе только в минуты расписания
+};
+
+// Ответ Evaluate: первое подошедшее правило любого действия
+struct RuleVerdict {
+    int ruleId = -1;                        // -1 — не подошло ни одно правило, ответ режима
+    RuleAction action = RuleAction::ALLOW;
+    PacketDirection direction = PacketDirection::Incoming;     // направление пакета
+    const CompiledRule* rule = nullptr;     // DefaultDenyRule() при запрете по умолчанию WHITELIST
+
+    bool Blocked() const { return action == RuleAction::BLOCK; }
+};
+
+class RuleMatcher {
+public:
+    // Включённые правила в порядке вычисления (first-match): по убыванию priority, при равном
+    // приоритете — в порядке следования
+    void Compile(const std::vector<Rule>& rules);
+    // Тот же порядок для всего списка (и выключенных правил): по нему WFP раздаёт веса фильтров
+    static std::vector<Rule> EvaluationOrder(const std::vector<Rule>& rules);
+    void Clear();
+    size_t Size() const { return compiled.size(); }
+    const std::vector<CompiledRule>& Rules() const { return compiled; }
+
+    // Изменение одного правила без перекомпиляции остальных: правятся только списки, корзина
+    // FieldMaskIndex или таблица правила. Индексы правил не сдвигаются: новое правило встаёт
+    // в конец (как в RuleManager::AddRule), удалённое оставляет пустой слот, который не совпадает
+    // ни с чем, до следующей Compile. Каждое изменение меняет Generation().
+    // Выключенное правило AppendRule пропускает; false — приоритет правила выше, чем у последнего,
+    // в конце ему не место: нужна Compile
+    bool AppendRule(const Rule& rule);
+    // false — среди включённых правил такого id нет
+    bool RemoveRule(int id);
+    // Правило на своём месте; выключенное удаляется. false — правило включается, а его места
+    // среди включённых нет, или новый приоритет не помещается между соседями: нужна Compile
+    // (или AppendRule, если оно последнее)
+    bool ReplaceRule(const Rule& rule);
+    // Пустые слоты от RemoveRule; Fragmented — их столько, что пора перекомпилировать
+    size_t Holes() const { return holes; }
+    bool Fragmented() const { return holes >= MIN_COMPACT_HOLES && holes * 4 >= compiled.size(); }
+    static constexpr size_t MIN_COMPACT_HOLES = 64;
+
+    // BLACKLIST: разрешено всё, что не запрещено. WHITELIST: пакет проходит, только если подошло
+    // разрешающее правило. В обоих режимах решает первое подошедшее правило любого действия
+    void SetFilterMode(FilterMode mode);
+    FilterMode GetFilterMode() const { return filterMode; }
+    // Ответ в режиме WHITELIST, если ни одно разрешающее правило не подошло
+    const CompiledRule& DefaultDenyRule() const { return defaultDeny; }
+
+    // Единственная проверка пакета, остальные Find* и IsAllowed — её обёртки: первое в порядке
+    // вычисления правило любого действия, подходящее к пакету (с учётом приложения и направления);
+    // evaluated += число проверенных правил. Разрешающее правило ищется по индексу, блокирующие —
+    // только раньше него. WHITELIST: разрешающее не нашлось — DefaultDenyRule() без просмотра
+    // блокирующих правил
+    RuleVerdict Evaluate(const FlowKey& flow, size_t* evaluated = nullptr) const;
+    // Правило Evaluate, если оно блокирующее, иначе nullptr
+    const CompiledRule* FindBlockingRule(const FlowKey& flow, size_t* evaluated = nullptr) const;
+    // Как проверяются блокирующие правила без доменов, списков, ICMP, флагов и состояний:
+    // Linear — все блокирующие правила подряд общей проверкой (эталон), FieldMask — корзины
+    // FieldMaskIndex, Simd — подряд по столбцам SimdRuleTable. Auto — Simd, пока таких правил
+    // не больше SIMD_MAX_RULES, иначе FieldMask
+    enum class BlockEngine { Auto, Linear, FieldMask, Simd };
+    static constexpr size_t SIMD_MAX_RULES = 256;
+    void SetBlockEngine(BlockEngine engine);
+    BlockEngine GetBlockEngine() const { return activeEngine; }     // выбранный для текущих правил
+    // Ядро SimdRuleTable; по умолчанию лучшее, что есть у процессора
+    bool SetSimdKernel(SimdRuleTable::Kernel kernel);
+    // Наборы правил без привязки к адаптеру
+    const FieldMaskIndex& BlockIndex(PacketDirection direction = PacketDirection::Incoming) const {
+        return sets[DirectionIndex(direction)].blockIndex;
+    }
+    const SimdRuleTable& BlockTable(PacketDirection direction = PacketDirection::Incoming) const {
+        return sets[DirectionIndex(direction)].blockTable;
+    }
+    // Адаптеров, у которых есть свои правила (у каждого два набора, по направлениям)
+    size_t AdapterCount() const { return adapterSets.size(); }
+    // FindBlockingRule для пачки: verdicts[i] — ответ для flows[i]. Пакеты пачки делятся по
+    // направлению, каждая часть проходит корзины FieldMaskIndex вместе, по MAX_BATCH пакетов
+    void FindBlockingRuleBatch(const FlowKey* flows, size_t count, const CompiledRule** verdicts,
+        size_t* evaluated = nullptr) const;
+    static constexpr size_t MAX_BATCH = 256;
+    // Первое подходящее разрешающее правило (с учётом приложения) по индексу или nullptr
+    const CompiledRule* FindAllowingRule(const FlowKey& flow, size_t* evaluated = nullptr) const;
+    // Блокирующее правило Evaluate только среди правил, которые решают по самому пакету внутри
+    // разрешённого соединения: с условием на состояние flow.state и с флагами TCP. Остальные
+    // правила ConnectionTracker применяет к первому пакету соединения.
+    const CompiledRule* FindBlockingPacketRule(const FlowKey& flow, size_t* evaluated = nullptr) const;
+    // Evaluate: matchedRuleId — id правила или -1
+    bool IsAllowed(const FlowKey& flow, int& matchedRuleId) const;
+    // IsAllowed для соединения, направление которого неизвестно: разрешающее правило в любом
+    // направлении пропускает, затем блокирующее в любом запрещает, иначе ответ режима
+    bool IsAllowedEitherDirection(FlowKey flow, int& matchedRuleId) const;
+
+    // Индекс разрешающих правил: правило попадает в один список по самому избирательному
+    // условию — блок /16 адреса назначения, затем источника (префикс не короче /16), затем
+    // порт назначения (не больше MAX_INDEXED_PORTS портов), иначе "любой порт" своего протокола
+    static constexpr uint32_t MAX_INDEXED_PORTS = 64;
+
+    static CompiledRule CompileRule(const Rule& rule);
+    static AddressMatch ParseAddress(const std::string& str);
+    static std::vector<PortRange> ParsePorts(const std::string& portStr, int port);
+    static std::vector<IcmpTypeMatch> ParseIcmpTypes(const std::string& str);
+    // "SYN,!ACK"; false — неизвестное имя флага
+    static bool ParseTcpFlags(const std::string& str, uint8_t& mask, uint8_t& set);
+    // "NEW,ESTABLISHED" -> биты ConnectionState; неизвестные имена пропускаются
+    static uint8_t ParseConnectionStates(const std::string& str);
+
+    static bool MatchesTuple(const CompiledRule& rule, const FlowKey& flow);
+
+    // Источник соответствий адрес -> имя для доменных правил (по умолчанию общий)
+    void SetDomainTable(const IpDomainTable* table) { domainTable = table; }
+    const DomainTrie& Domains() const { return domains; }
+
+    // Правило с расписанием лежит в наборах только в свои минуты (по минуте часов, запомненной
+    // при Compile и RefreshSchedule), и пакет расписаний не проверяет. По умолчанию часы общие
+    void SetScheduleClock(const ScheduleClock* clock);
+    // Минута часов в сопоставитель: правила, которые от неё включились или выключились, вносятся
+    // в наборы и убираются из них, как при AppendRule и RemoveRule. true — такие нашлись,
+    // и Generation() сменилось: соединения перепроверятся
+    bool RefreshSchedule();
+    uint32_t ScheduleMinute() const { return scheduleMinute; }
+
+    // Меняется при каждой перекомпиляции, у разных сопоставителей не совпадает
+    uint64_t Generation() const { return generation; }
+
+private:
+    // Шаблоны доменов, которым соответствуют адреса пакета; заполняется лениво,
+    // только если пакет дошёл до доменного правила
+    struct FlowDomains {
+        bool sourceResolved = false;
+        bool destResolved = false;
+        std::vector<uint32_t> source;
+        std::vector<uint32_t> dest;
+    };
+
+    bool Matches(const CompiledRule& rule, const FlowKey& flow, FlowDomains& flowDomains) const {
+        if ((rule.source.domain | rule.dest.domain) == 0) return MatchesTuple(rule, flow);
+        return MatchesWithDomains(rule, flow, flowDomains);
+    }
+    bool MatchesWithDomains(const CompiledRule& rule, const FlowKey& flow, FlowDomains& flowDomains) const;
+    bool DomainMatches(uint32_t pattern, uint32_t ip, std::string_view serverName,
+        bool& resolved, std::vector<uint32_t>& hits) const;
+
+    // Правила одного адаптера и направления пакета: свои списки, индекс разрешающих правил
+    // и блокирующий движок; пакет смотрит только в свой набор. Правило без состояния лежит
+    // в наборах своего направления, с состоянием — обоих (направление соединения проверяет
+    // PacketMatches); правило без адаптера — в наборах всех адаптеров и в общих наборах
+    // для пакетов остальных адаптеров, правило адаптера — только в его наборах
+    struct RuleSet {
+        std::vector<uint32_t> blockGeneric;     // блокирующие правила общей проверки
+        std::vector<uint32_t> blockSpecialised; // остальные блокирующие: blockIndex или blockTable
+        FieldMaskIndex blockIndex;
+        SimdRuleTable blockTable;
+        std::vector<uint32_t> packetRules[3];   // по состоянию (бит ConnectionState): блокирующие правила пакета
+        std::unordered_map<uint64_t, std::vector<uint32_t>> allowIndex;     // индексы в compiled по возрастанию
+    };
+    static size_t DirectionIndex(PacketDirection direction) { return direction == PacketDirection::Incoming ? 0 : 1; }
+    // Наборы адаптера идут парой: sets[base] — входящие пакеты, sets[base + 1] — исходящие
+    size_t SetIndex(const FlowKey& flow) const {
+        size_t base = 0;
+        if (!adapterSets.empty() && flow.adapter != 0) {
+            auto it = adapterSets.find(flow.adapter);
+            if (it != adapterSets.end()) base = it->second;
+        }
+        return base + DirectionIndex(flow.direction);
+    }
+    const RuleSet& SetFor(const FlowKey& flow) const { return sets[SetIndex(flow)]; }
+    bool InSet(const CompiledRule& rule, size_t set) const {
+        return (rule.states != 0 || (rule.direction == RuleDirection::Inbound) == (set % 2 == 0))
+            && (rule.adapter == 0 || rule.adapter == setAdapters[set / 2]);
+    }
+    // Пара наборов для нового адаптера с уже действующими правилами без адаптера
+    void AddAdapterSets(uint32_t adapter, bool indexExisting);
+    // Правило без расписания или в минуту своего расписания
+    bool ActiveNow(const CompiledRule& rule) const {
+        return !rule.schedule || rule.schedule->Active(scheduleMinute);
+    }
+    // Правило лежит в blockSpecialised наборов, и его правит PatchBlockEngine
+    bool InBlockEngine(const CompiledRule& rule) const {
+        return rule.action == RuleAction::BLOCK && FieldMaskIndex::Supports(rule) && ActiveNow(rule);
+    }
+
+    // Первое блокирующее правило с индексом меньше limit или nullptr
+    const CompiledRule* FindBlockingIn(const std::vector<uint32_t>& indices, const FlowKey& flow, uint32_t limit,
+        size_t* evaluated) const;
+    const CompiledRule* FindBlockBefore(const RuleSet& set, const FlowKey& flow, uint32_t limit, size_t& tested) const;
+    const CompiledRule* FindAllowIn(const RuleSet& set, const FlowKey& flow, size_t* evaluated) const;
+    uint32_t IndexOf(const CompiledRule* rule) const {
+        return rule ? static_cast<uint32_t>(rule - compiled.data()) : UINT32_MAX;
+    }
+
+    enum AllowKeyKind : uint64_t { ALLOW_BY_DEST = 1, ALLOW_BY_SOURCE, ALLOW_BY_PORT, ALLOW_ANY_PORT };
+    static uint64_t AllowKey(AllowKeyKind kind, uint32_t value) { return (uint64_t(kind) << 32) | value; }
+    static void AllowKeys(const CompiledRule& rule, std::vector<uint64_t>& keys);
+
+    CompiledRule CompileWithDomains(const Rule& rule);
+    // Правило compiled[index] в списки и обратно (в наборы — если ActiveNow); блокирующий
+    // движок — только при Patch
+    void IndexRule(uint32_t index);
+    void IndexInSets(uint32_t index);
+    void IndexInSet(const CompiledRule& c, uint32_t index, RuleSet& set);
+    void UnindexRule(uint32_t index);
+    void UnindexFromSets(uint32_t index);
+    void PatchBlockEngine(uint32_t index, bool inserted);
+    BlockEngine WantedEngine() const;
+    // Приоритет правила на месте index не нарушает порядок вычисления
+    bool FitsAt(uint32_t index, int priority) const;
+
+    std::vector<CompiledRule> compiled;
+    std::unordered_map<int, uint32_t> slots;    // id включённого правила -> индекс в compiled
+    size_t holes = 0;
+    void BuildBlockEngine();
+    void BuildSetEngine(RuleSet& set);
+
+    std::vector<RuleSet> sets = std::vector<RuleSet>(2);     // по SetIndex; первая пара — без адаптера
+    std::vector<uint32_t> setAdapters = { 0 };              // адаптер пары наборов
+    std::unordered_map<uint32_t, size_t> adapterSets;       // адаптер -> первый из его наборов
+    BlockEngine blockEngine = BlockEngine::Auto;
+    BlockEngine activeEngine = BlockEngine::Linear;     // общий для обоих наборов
+    SimdRuleTable::Kernel simdKernel = SimdRuleTable::BestKernel();    // для всех наборов, и новых тоже
+    FilterMode filterMode = FilterMode::BLACKLIST;
+    CompiledRule defaultDeny;
+    uint64_t generation = 0;
+    DomainTrie domains;
+    const IpDomainTable* domainTable = &IpDomainTable::Instance();
+    const ScheduleClock* scheduleClock = &ScheduleClock::Instance();
+    uint32_t scheduleMinute = 0;
+    std::vector<uint32_t> scheduled;        // индексы правил с расписанием, и вне его минут
+};
@@ -0,0 +1,202 @@
+#include "rule_schedule.h"
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+
+static std::string Trim(const std::string& s) {
+    size_t first = s.find_first_not_of(" \t");
+    if (first == std::string::npos) return "";
+    size_t last = s.find_last_not_of(" \t");
+    return s.substr(first, last - first + 1);
+}
+
+static std::vector<std::string> Split(const std::string& s, char separator) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (true) {
+        size_t end = s.find(separator, start);
+        parts.push_back(Trim(s.substr(start, end == std::string::npos ? std::string::npos : end - start)));
+        if (end == std::string::npos) break;
+        start = end + 1;
+    }
+    return parts;
+}
+
+// "mon", "Monday" -> 0 (понедельник); -1 — не день недели
+static int ParseDay(const std::string& s) {
+    static const char* const kDays[] = { "mon", "tue", "wed", "thu", "fri", "sat", "sun" };
+    if (s.size() < 3) return -1;
+    std::string lower = s;
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+        [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    for (int day = 0; day < 7; ++day) {
+        if (lower.compare(0, 3, kDays[day]) == 0) return day;
+    }
+    return -1;
+}
+
+// "Mon-Fri,Sun" -> биты дней
+static bool ParseDays(const std::string& s, uint8_t& days) {
+    for (const std::string& item : Split(s, ',')) {
+        size_t dash = item.find('-');
+        int first = ParseDay(Trim(item.substr(0, dash)));
+        int last = dash == std::string::npos ? first : ParseDay(Trim(item.substr(dash + 1)));
+        if (first < 0 || last < 0) return false;
+        // "Sat-Mon" — через конец недели
+        for (int day = first;; day = (day + 1) % 7) {
+            days |= static_cast<uint8_t>(1u << day);
+            if (day == last) break;
+        }
+    }
+    return true;
+}
+
+// "09:30" -> минута суток; "24:00" допустимо как конец суток
+static bool ParseTime(const std::string& s, uint32_t& minute) {
+    size_t colon = s.find(':');
+    if (colon == std::string::npos || colon == 0 || colon > 2 || s.size() != colon + 3) return false;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (i != colon && !std::isdigit(static_cast<unsigned char>(s[i]))) return false;
+    }
+    uint32_t hours = static_cast<uint32_t>(std::stoul(s.substr(0, colon)));
+    uint32_t minutes = static_cast<uint32_t>(std::stoul(s.substr(colon + 1)));
+    if (minutes >= 60 || hours > 24 || (hours == 24 && minutes != 0)) return false;
+    minute = hours * 60 + minutes;
+    return true;
+}
+
+bool WeekSchedule::Parse(const std::string& text, std::shared_ptr<const WeekSchedule>& out) {
+    out.reset();
+    std::string trimmed = Trim(text);
+    if (trimmed.empty()) return true;
+    auto schedule = std::make_shared<WeekSchedule>();
+    schedule->text = trimmed;
+    for (const std::string& part : Split(trimmed, ';')) {
+        if (part.empty()) continue;
+        // Дни — до первой цифры: "Mon-Fri 09:00-18:00", "Sat", "08:00-12:00,13:00-17:00"
+        size_t digit = 0;
+        while (digit < part.size() && !std::isdigit(static_cast<unsigned char>(part[digit]))) ++digit;
+        std::string daysText = Trim(part.substr(0, digit));
+        std::string timesText = Trim(part.substr(digit));
+        uint8_t days = 0x7F;
+        if (!daysText.empty()) {
+            days = 0;
+            if (!ParseDays(daysText, days)) return false;
+        }
+        std::vector<std::pair<uint32_t, uint32_t>> intervals;     // начало, длина
+        if (timesText.empty()) intervals.emplace_back(0, MINUTES_PER_DAY);
+        else {
+            for (const std::string& range : Split(timesText, ',')) {
+                size_t dash = range.find('-');
+                uint32_t from = 0;
+                uint32_t to = 0;
+                if (dash == std::string::npos || !ParseTime(Trim(range.substr(0, dash)), from)
+                    || !ParseTime(Trim(range.substr(dash + 1)), to) || from == to || from == MINUTES_PER_DAY) {
+                    return false;
+                }
+                intervals.emplace_back(from, to > from ? to - from : MINUTES_PER_DAY - from + to);
+            }
+        }
+        for (uint32_t day = 0; day < 7; ++day) {
+            if (!(days & (1u << day))) continue;
+            for (const auto& interval : intervals) schedule->SetRange(day * MINUTES_PER_DAY + interval.first, interval.second);
+        }
+    }
+    out = std::move(schedule);
+    return true;
+}
+
+void WeekSchedule::SetRange(uint32_t from, uint32_t length) {
+    for (uint32_t i = 0; i < length; ++i) {
+        uint32_t minute = (from + i) % MINUTES_PER_WEEK;
+        bits[minute >> 6] |= 1ull << (minute & 63);
+    }
+}
+
+std::vector<uint32_t> WeekSchedule::Changes() const {
+    std::vector<uint32_t> changes;
+    bool previous = Active(MINUTES_PER_WEEK - 1);
+    for (uint32_t minute = 0; minute < MINUTES_PER_WEEK; ++minute) {
+        bool active = Active(minute);
+        if (active != previous) changes.push_back(minute);
+        previous = active;
+    }
+    return changes;
+}
+
+bool WeekSchedule::Covers(const WeekSchedule& other) const {
+    for (size_t word = 0; word < WORDS; ++word) {
+        if (other.bits[word] & ~bits[word]) return false;
+    }
+    return true;
+}
+
+bool WeekSchedule::Overlaps(const WeekSchedule& other) const {
+    for (size_t word = 0; word < WORDS; ++word) {
+        if (other.bits[word] & bits[word]) return true;
+    }
+    return false;
+}
+
+ScheduleClock& ScheduleClock::Instance() {
+    static ScheduleClock instance;
+    return instance;
+}
+
+uint32_t ScheduleClock::MinuteOfWeek(Clock::time_point time) {
+    std::time_t t = Clock::to_time_t(time);
+    std::tm local = {};
+#if defined(_WIN32)
+    localtime_s(&local, &t);
+#else
+    localtime_r(&t, &local);
+#endif
+    uint32_t day = static_cast<uint32_t>((local.tm_wday + 6) % 7);     // tm_wday: 0 — воскресенье
+    return day * WeekSchedule::MINUTES_PER_DAY + static_cast<uint32_t>(local.tm_hour * 60 + local.tm_min);
+}
+
+bool ScheduleClock::Refresh() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Clock::time_point now = clock ? clock() : Clock::now();
+    if (now >= minuteStart && now < minuteEnd) return false;
+    // Смещения часовых поясов кратны минуте: граница минуты местного времени совпадает с UTC
+    minuteStart = std::chrono::time_point_cast<std::chrono::minutes>(now);
+    if (minuteStart > now) minuteStart -= std::chrono::minutes(1);
+    minuteEnd = minuteStart + std::chrono::minutes(1);
+    uint32_t current = MinuteOfWeek(now);
+    return minute.exchange(current, std::memory_order_relaxed) != current;
+}
+
+void ScheduleClock::SetClock(std::function<Clock::time_point()> replacement) {
+    std::lock_guard<std::mutex> lock(mutex);
+    clock = std::move(replacement);
+    minuteStart = Clock::time_point();
+    minuteEnd = Clock::time_point();
+}
+
+void ScheduleWheel::Clear() {
+    for (auto& slot : slots) slot.clear();
+    rules = 0;
+}
+
+void ScheduleWheel::Add(int ruleId, const WeekSchedule& schedule) {
+    if (slots.empty()) slots.resize(WeekSchedule::MINUTES_PER_WEEK);
+    for (uint32_t minute : schedule.Changes()) slots[minute].push_back(ruleId);
+    ++rules;
+}
+
+void ScheduleWheel::Start(uint32_t minute) {
+    position = minute;
+}
+
+void ScheduleWheel::Advance(uint32_t minute, std::vector<int>& due) {
+    due.clear();
+    if (slots.empty()) {
+        position = minute;
+        return;
+    }
+    while (position != minute) {
+        position = (position + 1) % WeekSchedule::MINUTES_PER_WEEK;
+        due.insert(due.end(), slots[position].begin(), slots[position].end());
+    }
+}
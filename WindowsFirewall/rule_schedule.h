@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Недельное расписание правила: бит на каждую минуту недели, минута 0 — понедельник 00:00
+// местного времени. Календарь разбирается один раз при компиляции правила, пакет проверяет
+// только бит текущей минуты
+class WeekSchedule {
+public:
+    static constexpr uint32_t MINUTES_PER_DAY = 24 * 60;
+    static constexpr uint32_t MINUTES_PER_WEEK = 7 * MINUTES_PER_DAY;
+
+    // "Mon-Fri 09:00-18:00; Sat,Sun 10:00-14:00": части через ';', в части — дни (диапазон
+    // через '-', список через ',') и интервалы времени через ','. Дни без времени — сутки
+    // целиком, время без дней — каждый день; конец раньше начала — интервал через полночь
+    // ("Fri 22:00-02:00" захватывает ночь на субботу). Пустая строка — out = nullptr (всегда);
+    // false — ошибка разбора
+    static bool Parse(const std::string& text, std::shared_ptr<const WeekSchedule>& out);
+
+    bool Active(uint32_t minute) const { return (bits[minute >> 6] >> (minute & 63)) & 1; }
+    // Минуты, в которые Active отличается от предыдущей минуты (по кругу недели), по возрастанию
+    std::vector<uint32_t> Changes() const;
+    // Все минуты other входят в это расписание
+    bool Covers(const WeekSchedule& other) const;
+    bool Overlaps(const WeekSchedule& other) const;
+    // Строка расписания без пробелов по краям
+    const std::string& Text() const { return text; }
+
+private:
+    static constexpr size_t WORDS = (MINUTES_PER_WEEK + 63) / 64;
+    // Минуты [from, from + length) по кругу недели
+    void SetRange(uint32_t from, uint32_t length);
+
+    uint64_t bits[WORDS] = {};
+    std::string text;
+};
+
+// Минута недели для расписаний. Календарь (местное время) пересчитывается, только когда часы
+// ушли за пределы текущей минуты; между этим Minute() — готовое значение
+class ScheduleClock {
+public:
+    using Clock = std::chrono::system_clock;
+
+    // Минута вычисляется сразу, по системным часам
+    ScheduleClock() { Refresh(); }
+    ScheduleClock(const ScheduleClock&) = delete;
+    ScheduleClock& operator=(const ScheduleClock&) = delete;
+
+    static ScheduleClock& Instance();
+
+    // true — наступила другая минута (или часы переставили)
+    bool Refresh();
+    uint32_t Minute() const { return minute.load(std::memory_order_relaxed); }
+
+    // Подмена часов для проверок расписаний без ожидания; пустая функция — системные часы
+    void SetClock(std::function<Clock::time_point()> clock);
+
+    // Минута недели момента по местному времени
+    static uint32_t MinuteOfWeek(Clock::time_point time);
+
+private:
+    std::mutex mutex;
+    std::function<Clock::time_point()> clock;
+    Clock::time_point minuteStart;
+    Clock::time_point minuteEnd;            // [minuteStart, minuteEnd) — минута Minute()
+    std::atomic<uint32_t> minute{ 0 };
+};
+
+// Колесо границ расписаний на неделю: слот минуты — id правил, которые в эту минуту
+// включаются или выключаются. Демон продвигает его раз в минуту и трогает WFP, только
+// если пройденные слоты не пусты
+class ScheduleWheel {
+public:
+    void Clear();
+    void Add(int ruleId, const WeekSchedule& schedule);
+    bool Empty() const { return rules == 0; }
+    // Позиция колеса — текущая минута; её границы считаются пройденными
+    void Start(uint32_t minute);
+    // id правил с границами в минутах после прошлой позиции до minute включительно (по кругу
+    // недели; часы, переставленные назад, проходят круг до minute)
+    void Advance(uint32_t minute, std::vector<int>& due);
+
+private:
+    std::vector<std::vector<int>> slots;    // MINUTES_PER_WEEK слотов после первого Add
+    uint32_t position = 0;
+    size_t rules = 0;
+};
@@ -0,0 +1,149 @@
+#include "rule_stats.h"
+#include <algorithm>
+
+RuleStats& RuleStats::Instance() {
+    static RuleStats instance;
+    return instance;
+}
+
+RuleStats::Shard::~Shard() {
+    for (auto& chunk : chunks) {
+        delete chunk.load(std::memory_order_relaxed);
+    }
+}
+
+RuleStats::ShardHolder::~ShardHolder() {
+    if (shard) {
+        RuleStats::Instance().RetireShard(shard);
+    }
+}
+
+RuleStats::Shard* RuleStats::LocalShard() {
+    thread_local ShardHolder holder;
+    if (!holder.shard) {
+        holder.shard = new Shard();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        liveShards.push_back(holder.shard);
+    }
+    return holder.shard;
+}
+
+void RuleStats::RetireShard(Shard* shard) {
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        Accumulate(*shard, retired);
+        liveShards.erase(std::remove(liveShards.begin(), liveShards.end(), shard), liveShards.end());
+    }
+    delete shard;
+}
+
+void RuleStats::RecordHit(int ruleId, size_t bytes, time_t now) {
+    if (ruleId < 0 || ruleId >= MAX_TRACKED_RULE_ID) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        RuleHitStats& s = overflow[ruleId];
+        s.packets++;
+        s.bytes += bytes;
+        s.lastHit = (std::max)(s.lastHit, now);
+        return;
+    }
+
+    Shard* shard = LocalShard();
+    std::atomic<Chunk*>& slot = shard->chunks[ruleId >> CHUNK_BITS];
+    Chunk* chunk = slot.load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new Chunk();
+        slot.store(chunk, std::memory_order_release);
+    }
+
+    // Единственный писатель — текущий поток, поэтому RMW-операции не нужны
+    Counter& c = chunk->counters[ruleId & (CHUNK_SIZE - 1)];
+    c.packets.store(c.packets.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    c.bytes.store(c.bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+    c.lastHit.store(static_cast<int64_t>(now), std::memory_order_relaxed);
+}
+
+void RuleStats::Merge(RuleHitStats& dst, const RuleHitStats& src) {
+    dst.packets += src.packets;
+    dst.bytes += src.bytes;
+    dst.lastHit = (std::max)(dst.lastHit, src.lastHit);
+}
+
+void RuleStats::Accumulate(const Shard& shard, std::unordered_map<int, RuleHitStats>& out) {
+    for (int ci = 0; ci < CHUNK_COUNT; ++ci) {
+        const Chunk* chunk = shard.chunks[ci].load(std::memory_order_acquire);
+        if (!chunk) continue;
+        for (int i = 0; i < CHUNK_SIZE; ++i) {
+            const Counter& c = chunk->counters[i];
+            uint64_t packets = c.packets.load(std::memory_order_relaxed);
+            if (packets == 0) continue;
+            RuleHitStats s;
+            s.packets = packets;
+            s.bytes = c.bytes.load(std::memory_order_relaxed);
+            s.lastHit = static_cast<time_t>(c.lastHit.load(std::memory_order_relaxed));
+            Merge(out[(ci << CHUNK_BITS) | i], s);
+        }
+    }
+}
+
+std::unordered_map<int, RuleHitStats> RuleStats::LocalLocked() const {
+    std::unordered_map<int, RuleHitStats> result = retired;
+    for (const auto& kv : overflow) Merge(result[kv.first], kv.second);
+    for (const Shard* shard : liveShards) Accumulate(*shard, result);
+    return result;
+}
+
+std::unordered_map<int, RuleHitStats> RuleStats::SnapshotLocked() const {
+    std::unordered_map<int, RuleHitStats> result = LocalLocked();
+    for (const auto& kv : offsets) {
+        auto it = result.find(kv.first);
+        if (it == result.end()) continue;
+        RuleHitStats& s = it->second;
+        s.packets -= (std::min)(s.packets, kv.second.packets);
+        s.bytes -= (std::min)(s.bytes, kv.second.bytes);
+        if (s.packets == 0) {
+            result.erase(it);
+        }
+    }
+    for (const auto& kv : baseline) Merge(result[kv.first], kv.second);
+    return result;
+}
+
+std::unordered_map<int, RuleHitStats> RuleStats::Snapshot() const {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return SnapshotLocked();
+}
+
+RuleHitStats RuleStats::Get(int ruleId) const {
+    auto all = Snapshot();
+    auto it = all.find(ruleId);
+    return it != all.end() ? it->second : RuleHitStats();
+}
+
+void RuleStats::SetBaseline(const std::unordered_map<int, RuleHitStats>& stats) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    // Смещения относятся только к счётчикам этого процесса, новая база их не касается
+    baseline = stats;
+}
+
+void RuleStats::Forget(int ruleId) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    baseline.erase(ruleId);
+    // Счётчики потоков не трогаем (их пишет только владелец) — смещение равно всему,
+    // что записано к этому моменту, и прежнее смещение id им заменяется
+    auto local = LocalLocked();
+    auto it = local.find(ruleId);
+    if (it != local.end()) offsets[ruleId] = it->second;
+    else offsets.erase(ruleId);
+}
+
+void RuleStats::Reset() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    baseline.clear();
+    offsets = LocalLocked();
+}
+
+bool RuleStats::HasLocalChanges() const {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    // Смещения Forget не в счёт: демон снимает истёкшие правила, но пакетов не видит
+    return !liveShards.empty() || !retired.empty() || !overflow.empty();
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Накопленная статистика срабатываний одного правила
+struct RuleHitStats {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    time_t lastHit = 0;
+};
+
+// Счётчики срабатываний правил.
+// Каждый поток пишет только в свой шард (без общих атомарных операций),
+// суммирование по всем потокам выполняется по запросу в Snapshot().
+class RuleStats {
+public:
+    static RuleStats& Instance();
+
+    RuleStats(const RuleStats&) = delete;
+    RuleStats& operator=(const RuleStats&) = delete;
+
+    // Вызывается из пути сопоставления пакета с правилом
+    void RecordHit(int ruleId, size_t bytes, time_t now);
+
+    // Суммарная статистика: сохранённая база + все живые и завершённые потоки
+    std::unordered_map<int, RuleHitStats> Snapshot() const;
+    RuleHitStats Get(int ruleId) const;
+
+    // База, загруженная из файла (предыдущие запуски)
+    void SetBaseline(const std::unordered_map<int, RuleHitStats>& stats);
+    // Счётчики id с нуля: при удалении правила и когда id занимает новое правило
+    void Forget(int ruleId);
+    void Reset();
+
+    // Записаны ли в этом процессе срабатывания, которых нет в сохранённой базе
+    bool HasLocalChanges() const;
+
+    static const int MAX_TRACKED_RULE_ID = 1 << 20;
+
+private:
+    RuleStats() = default;
+
+    static const int CHUNK_BITS = 8;
+    static const int CHUNK_SIZE = 1 << CHUNK_BITS;
+    static const int CHUNK_COUNT = MAX_TRACKED_RULE_ID / CHUNK_SIZE;
+
+    // Счётчик пишет только поток-владелец (relaxed load + store, без lock-префикса),
+    // атомарность нужна лишь для корректного чтения при агрегации
+    struct Counter {
+        std::atomic<uint64_t> packets{ 0 };
+        std::atomic<uint64_t> bytes{ 0 };
+        std::atomic<int64_t> lastHit{ 0 };
+    };
+
+    struct Chunk {
+        Counter counters[CHUNK_SIZE];
+    };
+
+    struct Shard {
+        std::atomic<Chunk*> chunks[CHUNK_COUNT] = {};
+        ~Shard();
+    };
+
+    struct ShardHolder {
+        Shard* shard = nullptr;
+        ~ShardHolder();
+    };
+
+    Shard* LocalShard();
+    void RetireShard(Shard* shard);
+    std::unordered_map<int, RuleHitStats> SnapshotLocked() const;
+    // Записанное в этом процессе: завершённые и живые потоки, id вне таблицы
+    std::unordered_map<int, RuleHitStats> LocalLocked() const;
+    static void Accumulate(const Shard& shard, std::unordered_map<int, RuleHitStats>& out);
+    static void Merge(RuleHitStats& dst, const RuleHitStats& src);
+
+    mutable std::mutex registryMutex;
+    std::vector<Shard*> liveShards;
+    std::unordered_map<int, RuleHitStats> retired;   // потоки, которые уже завершились
+    std::unordered_map<int, RuleHitStats> baseline;  // загружено из файла
+    std::unordered_map<int, RuleHitStats> overflow;  // id вне диапазона таблицы
+    std::unordered_map<int, RuleHitStats> offsets;   // LocalLocked() на момент Forget/Reset, без базы
+};
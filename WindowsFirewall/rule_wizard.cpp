@@ -719,6 +719,7 @@ INT_PTR CALLBACK RuleWizard::PageDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPA
             ComboBox_AddString(protoCombo, L"TCP");
             ComboBox_AddString(protoCombo, L"UDP");
             ComboBox_AddString(protoCombo, L"ICMP");
+            ComboBox_AddString(protoCombo, L"ICMPv6");
             ComboBox_SetCurSel(protoCombo, static_cast<int>(self->m_ruleDraft.protocol));
         }
         HWND comboProto = GetDlgItem(hwnd, IDC_COMBO_PROTOCOL);
@@ -728,6 +729,7 @@ INT_PTR CALLBACK RuleWizard::PageDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPA
             ComboBox_AddString(comboProto, L"TCP");
             ComboBox_AddString(comboProto, L"UDP");
             ComboBox_AddString(comboProto, L"ICMP");
+            ComboBox_AddString(comboProto, L"ICMPv6");
             ComboBox_SetCurSel(comboProto, static_cast<int>(self->m_ruleDraft.protocol));
         }
         HWND advProtoCombo = GetDlgItem(hwnd, IDC_ADV_PROTO_COMBO);
@@ -737,6 +739,7 @@ INT_PTR CALLBACK RuleWizard::PageDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPA
             ComboBox_AddString(advProtoCombo, L"TCP");
             ComboBox_AddString(advProtoCombo, L"UDP");
             ComboBox_AddString(advProtoCombo, L"ICMP");
+            ComboBox_AddString(advProtoCombo, L"ICMPv6");
             ComboBox_SetCurSel(advProtoCombo, static_cast<int>(self->m_ruleDraft.protocol));
         }
 
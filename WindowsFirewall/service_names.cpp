@@ -0,0 +1,118 @@
+#include "service_names.h"
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <vector>
+
+ServiceNames& ServiceNames::Instance() {
+    static ServiceNames instance;
+    return instance;
+}
+
+static std::string Lower(std::string_view name) {
+    std::string s(name);
+    for (char& c : s) {
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+    }
+    return s;
+}
+
+ServiceId ServiceNames::Intern(std::string_view name) {
+    if (name.empty()) return UNKNOWN_SERVICE;
+    std::string key = Lower(name);
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = ids.find(key);
+        if (it != ids.end()) return it->second;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto it = ids.find(key);
+    if (it != ids.end()) return it->second;
+    if (names.size() >= MAX_SERVICES) return UNKNOWN_SERVICE;
+    names.push_back(key);
+    ServiceId id = static_cast<ServiceId>(names.size());
+    ids.emplace(std::move(key), id);
+    return id;
+}
+
+ServiceId ServiceNames::Find(std::string_view name) const {
+    if (name.empty()) return UNKNOWN_SERVICE;
+    std::string key = Lower(name);
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = ids.find(key);
+    return it != ids.end() ? it->second : UNKNOWN_SERVICE;
+}
+
+const std::string& ServiceNames::Name(ServiceId id) const {
+    static const std::string empty;
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return id != UNKNOWN_SERVICE && id <= names.size() ? names[id - 1] : empty;
+}
+
+size_t ServiceNames::Size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return names.size();
+}
+
+namespace {
+
+struct PortEntry {
+    uint16_t port;
+    uint8_t ipProtocol;
+    const char* name;
+};
+
+// Порты IANA для самых распространённых служб; при первом обращении имена интернируются
+// и таблица сортируется по (порт, протокол) для двоичного поиска
+const PortEntry PORT_SERVICES[] = {
+    { 20, 6, "ftp-data" }, { 21, 6, "ftp" }, { 22, 6, "ssh" }, { 23, 6, "telnet" },
+    { 25, 6, "smtp" }, { 53, 6, "dns" }, { 53, 17, "dns" }, { 67, 17, "dhcp" }, { 68, 17, "dhcp" },
+    { 69, 17, "tftp" }, { 80, 6, "http" }, { 88, 6, "kerberos" }, { 88, 17, "kerberos" },
+    { 110, 6, "pop3" }, { 123, 17, "ntp" }, { 135, 6, "msrpc" }, { 137, 17, "netbios-ns" },
+    { 138, 17, "netbios-dgm" }, { 139, 6, "netbios-ssn" }, { 143, 6, "imap" }, { 161, 17, "snmp" },
+    { 162, 17, "snmp" }, { 389, 6, "ldap" }, { 389, 17, "ldap" }, { 443, 6, "tls" }, { 443, 17, "quic" },
+    { 445, 6, "smb" }, { 465, 6, "smtp" }, { 500, 17, "ipsec" }, { 514, 17, "syslog" },
+    { 554, 6, "rtsp" }, { 587, 6, "smtp" }, { 636, 6, "ldap" }, { 853, 6, "dns" }, { 993, 6, "imap" },
+    { 995, 6, "pop3" }, { 1194, 6, "openvpn" }, { 1194, 17, "openvpn" }, { 1433, 6, "mssql" },
+    { 1701, 17, "l2tp" }, { 1723, 6, "pptp" }, { 1883, 6, "mqtt" }, { 1900, 17, "ssdp" },
+    { 3268, 6, "ldap" }, { 3306, 6, "mysql" }, { 3389, 6, "rdp" }, { 3389, 17, "rdp" },
+    { 3478, 17, "stun" }, { 4500, 17, "ipsec" }, { 5060, 6, "sip" }, { 5060, 17, "sip" },
+    { 5222, 6, "xmpp" }, { 5353, 17, "mdns" }, { 5355, 17, "llmnr" }, { 5432, 6, "postgresql" },
+    { 5900, 6, "vnc" }, { 6379, 6, "redis" }, { 6881, 6, "bittorrent" }, { 6881, 17, "bittorrent" },
+    { 8080, 6, "http" }, { 8443, 6, "tls" }, { 27017, 6, "mongodb" }, { 51820, 17, "wireguard" }
+};
+
+struct ResolvedPort {
+    uint32_t key;           // (порт << 8) | протокол
+    ServiceId service;
+};
+
+const std::vector<ResolvedPort>& PortTable() {
+    static const std::vector<ResolvedPort> table = [] {
+        std::vector<ResolvedPort> t;
+        t.reserve(std::size(PORT_SERVICES));
+        for (const auto& e : PORT_SERVICES) {
+            t.push_back({ (uint32_t(e.port) << 8) | e.ipProtocol, ServiceNames::Instance().Intern(e.name) });
+        }
+        std::sort(t.begin(), t.end(), [](const ResolvedPort& a, const ResolvedPort& b) { return a.key < b.key; });
+        return t;
+    }();
+    return table;
+}
+
+} // namespace
+
+ServiceId ServiceForPort(uint8_t ipProtocol, uint16_t port) {
+    const auto& table = PortTable();
+    uint32_t key = (uint32_t(port) << 8) | ipProtocol;
+    auto it = std::lower_bound(table.begin(), table.end(), key,
+        [](const ResolvedPort& e, uint32_t k) { return e.key < k; });
+    return it != table.end() && it->key == key ? it->service : UNKNOWN_SERVICE;
+}
+
+ServiceId ServiceForPorts(uint8_t ipProtocol, uint16_t sourcePort, uint16_t destPort) {
+    uint16_t first = (std::min)(sourcePort, destPort);
+    uint16_t second = (std::max)(sourcePort, destPort);
+    ServiceId service = ServiceForPort(ipProtocol, first);
+    return service != UNKNOWN_SERVICE ? service : ServiceForPort(ipProtocol, second);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+using ServiceId = uint16_t;
+constexpr ServiceId UNKNOWN_SERVICE = 0;
+
+// Интернированные имена служб ("ssh", "tls", "bittorrent"): общие для сигнатур содержимого,
+// таблицы портов и правил, поэтому условие правила на службу — сравнение двух чисел
+class ServiceNames {
+public:
+    static ServiceNames& Instance();
+
+    // Имя приводится к нижнему регистру; пустое имя — UNKNOWN_SERVICE
+    ServiceId Intern(std::string_view name);
+    ServiceId Find(std::string_view name) const;
+    // Пустая строка для UNKNOWN_SERVICE и неизвестных id
+    const std::string& Name(ServiceId id) const;
+    size_t Size() const;
+
+    static constexpr size_t MAX_SERVICES = 0xFFFF;
+
+private:
+    ServiceNames() = default;
+
+    mutable std::shared_mutex mutex;
+    std::deque<std::string> names;      // индекс = id - 1; deque не перемещает строки
+    std::unordered_map<std::string, ServiceId> ids;
+};
+
+// Служба по известному порту (IANA) — запасной вариант, пока содержимое потока не опознано.
+// ipProtocol: 6 = TCP, 17 = UDP.
+ServiceId ServiceForPort(uint8_t ipProtocol, uint16_t port);
+// Служба пакета по паре портов: порт сервера обычно меньше, поэтому при совпадении
+// обоих предпочтение отдаётся меньшему
+ServiceId ServiceForPorts(uint8_t ipProtocol, uint16_t sourcePort, uint16_t destPort);
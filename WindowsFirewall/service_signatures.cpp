@@ -0,0 +1,428 @@
+#include "service_signatures.h"
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <queue>
+#include <sstream>
+
+namespace {
+
+uint16_t ReadBE16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t ReadBE32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+int HexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Шаблон после трёх первых полей: строка в кавычках или байты в hex
+bool ParsePattern(const std::string& text, std::string& pattern) {
+    size_t pos = text.find_first_not_of(" \t");
+    if (pos == std::string::npos) return false;
+    pattern.clear();
+    if (text[pos] == '"') {
+        for (++pos; pos < text.size() && text[pos] != '"'; ++pos) {
+            char c = text[pos];
+            if (c != '\\') {
+                pattern += c;
+                continue;
+            }
+            if (++pos >= text.size()) return false;
+            switch (text[pos]) {
+            case 'r': pattern += '\r'; break;
+            case 'n': pattern += '\n'; break;
+            case 't': pattern += '\t'; break;
+            case '\\': pattern += '\\'; break;
+            case '"': pattern += '"'; break;
+            case 'x': {
+                if (pos + 2 >= text.size()) return false;
+                int high = HexDigit(text[pos + 1]), low = HexDigit(text[pos + 2]);
+                if (high < 0 || low < 0) return false;
+                pattern += static_cast<char>(high * 16 + low);
+                pos += 2;
+                break;
+            }
+            default: return false;
+            }
+        }
+        if (pos >= text.size()) return false;      // нет закрывающей кавычки
+        size_t rest = text.find_first_not_of(" \t\r", pos + 1);
+        return rest == std::string::npos && !pattern.empty();
+    }
+    std::istringstream bytes(text.substr(pos));
+    std::string token;
+    while (bytes >> token) {
+        if (token.size() != 2 || HexDigit(token[0]) < 0 || HexDigit(token[1]) < 0) return false;
+        pattern += static_cast<char>(HexDigit(token[0]) * 16 + HexDigit(token[1]));
+    }
+    return !pattern.empty();
+}
+
+} // namespace
+
+bool SignatureSet::Parse(std::istream& in, std::string& error) {
+    std::vector<ServiceSignature> parsed;
+    std::string line;
+    for (size_t number = 1; std::getline(in, line); ++number) {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') continue;
+
+        std::istringstream fields(line);
+        std::string service, offset, side;
+        fields >> service >> offset >> side;
+        std::string rest;
+        std::getline(fields, rest);
+
+        ServiceSignature signature;
+        signature.service = ServiceNames::Instance().Intern(service);
+        if (offset == "*") {
+            signature.offset = -1;
+        }
+        else {
+            char* end = nullptr;
+            long value = std::strtol(offset.c_str(), &end, 10);
+            if (offset.empty() || *end != '\0' || value < 0 || value > 65535) {
+                error = "line " + std::to_string(number) + ": bad offset '" + offset + "'";
+                return false;
+            }
+            signature.offset = static_cast<int>(value);
+        }
+        if (side == "any") signature.side = ServiceSignature::Side::Any;
+        else if (side == "client") signature.side = ServiceSignature::Side::Client;
+        else if (side == "server") signature.side = ServiceSignature::Side::Server;
+        else {
+            error = "line " + std::to_string(number) + ": bad side '" + side + "'";
+            return false;
+        }
+        if (signature.service == UNKNOWN_SERVICE || !ParsePattern(rest, signature.pattern)) {
+            error = "line " + std::to_string(number) + ": bad pattern";
+            return false;
+        }
+        parsed.push_back(std::move(signature));
+    }
+    for (auto& signature : parsed) signatures.push_back(std::move(signature));
+    return true;
+}
+
+bool SignatureSet::LoadFile(const std::string& path, std::string& error) {
+    std::ifstream file(path);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    return Parse(file, error);
+}
+
+void SignatureSet::Add(const ServiceSignature& signature) {
+    if (signature.service != UNKNOWN_SERVICE && !signature.pattern.empty()) signatures.push_back(signature);
+}
+
+void SignatureSet::Build() {
+    // Классы байтов: у каждого байта из шаблонов свой класс, остальные — класс 0
+    byteClass.fill(0);
+    classCount = 1;
+    maxPatternEnd = 0;
+    for (const auto& signature : signatures) {
+        for (char c : signature.pattern) {
+            uint8_t byte = static_cast<uint8_t>(c);
+            if (byteClass[byte] == 0 && classCount < 256) byteClass[byte] = static_cast<uint8_t>(classCount++);
+        }
+        maxPatternEnd = signature.offset < 0
+            ? (std::numeric_limits<size_t>::max)()
+            : (std::max)(maxPatternEnd, static_cast<size_t>(signature.offset) + signature.pattern.size());
+    }
+    // Если в шаблонах встречаются все 256 байтов, последнему достаётся класс 0: прочих байтов нет
+    const State NONE = (std::numeric_limits<State>::max)();
+
+    // Бор в виде плотной таблицы; недостающие переходы достраиваются по суффиксным ссылкам
+    next.assign(classCount, NONE);
+    std::vector<std::vector<uint32_t>> own(1);
+    for (uint32_t index = 0; index < signatures.size(); ++index) {
+        State state = START;
+        for (char c : signatures[index].pattern) {
+            size_t slot = static_cast<size_t>(state) * classCount + byteClass[static_cast<uint8_t>(c)];
+            if (next[slot] == NONE) {
+                State created = static_cast<State>(own.size());
+                next[slot] = created;
+                next.resize(next.size() + classCount, NONE);
+                own.emplace_back();
+            }
+            state = next[slot];
+        }
+        own[state].push_back(index);
+    }
+
+    size_t stateCount = own.size();
+    std::vector<State> fail(stateCount, START);
+    std::vector<std::vector<uint32_t>> all(stateCount);
+    std::queue<State> queue;
+    for (size_t c = 0; c < classCount; ++c) {
+        State child = next[c];
+        if (child == NONE) {
+            next[c] = START;
+        }
+        else {
+            fail[child] = START;
+            queue.push(child);
+        }
+    }
+    all[START] = own[START];
+    while (!queue.empty()) {
+        State state = queue.front();
+        queue.pop();
+        all[state] = own[state];
+        all[state].insert(all[state].end(), all[fail[state]].begin(), all[fail[state]].end());
+        for (size_t c = 0; c < classCount; ++c) {
+            size_t slot = static_cast<size_t>(state) * classCount + c;
+            State target = next[static_cast<size_t>(fail[state]) * classCount + c];
+            if (next[slot] == NONE) {
+                next[slot] = target;
+            }
+            else {
+                fail[next[slot]] = target;
+                queue.push(next[slot]);
+            }
+        }
+    }
+
+    outputStart.assign(stateCount + 1, 0);
+    outputs.clear();
+    for (size_t state = 0; state < stateCount; ++state) {
+        auto& list = all[state];
+        std::stable_sort(list.begin(), list.end(), [this](uint32_t a, uint32_t b) {
+            return signatures[a].pattern.size() > signatures[b].pattern.size();
+        });
+        outputStart[state] = static_cast<uint32_t>(outputs.size());
+        outputs.insert(outputs.end(), list.begin(), list.end());
+    }
+    outputStart[stateCount] = static_cast<uint32_t>(outputs.size());
+}
+
+ServiceClassifier::ServiceClassifier(std::shared_ptr<const SignatureSet> signatures)
+    : signatures(std::move(signatures))
+{
+}
+
+void ServiceClassifier::SetSignatures(std::shared_ptr<const SignatureSet> set) {
+    std::lock_guard<std::mutex> lock(mutex);
+    signatures = std::move(set);
+    // Состояния автомата старого набора к новому не подходят: недоопознанные потоки начинаются заново
+    for (auto it = flows.begin(); it != flows.end();) {
+        if (it->second.pending) it = flows.erase(it);
+        else ++it;
+    }
+}
+
+ServiceId ServiceClassifier::OnIPv4Packet(const uint8_t* packet, size_t size) {
+    if (size < 20 || (packet[0] >> 4) != 4) return UNKNOWN_SERVICE;
+    uint8_t protocol = packet[9];
+    if (protocol != 6 && protocol != 17) return UNKNOWN_SERVICE;
+    size_t ihl = (packet[0] & 0x0F) * 4u;
+    size_t total = ReadBE16(packet + 2);
+    if (ihl < 20 || total < ihl) return UNKNOWN_SERVICE;
+    if (ReadBE16(packet + 6) & 0x1FFF) return UNKNOWN_SERVICE;     // не первый фрагмент
+    size_t available = (std::min)(total, size);
+    if (available < ihl + 8) return UNKNOWN_SERVICE;
+
+    const uint8_t* l4 = packet + ihl;
+    size_t l4size = available - ihl;
+    uint16_t sourcePort = ReadBE16(l4);
+    uint16_t destPort = ReadBE16(l4 + 2);
+    bool tcp = protocol == 6;
+    bool syn = false;
+    bool ack = false;
+    bool finished = false;
+    uint32_t seq = 0;
+    const uint8_t* payload = l4 + 8;
+    size_t payloadSize = l4size - 8;
+    if (tcp) {
+        if (l4size < 20) return UNKNOWN_SERVICE;
+        size_t dataOffset = (l4[12] >> 4) * 4u;
+        if (dataOffset < 20 || dataOffset > l4size) return UNKNOWN_SERVICE;
+        uint8_t flags = l4[13];
+        syn = (flags & 0x02) != 0;
+        ack = (flags & 0x10) != 0;
+        finished = (flags & 0x05) != 0;     // FIN или RST
+        seq = ReadBE32(l4 + 4);
+        payload = l4 + dataOffset;
+        payloadSize = l4size - dataOffset;
+    }
+
+    uint32_t sourceIp = ReadBE32(packet + 12);
+    uint32_t destIp = ReadBE32(packet + 16);
+    bool fromLow = sourceIp < destIp || (sourceIp == destIp && sourcePort <= destPort);
+    FlowTuple tuple;
+    tuple.lowIp = fromLow ? sourceIp : destIp;
+    tuple.highIp = fromLow ? destIp : sourceIp;
+    tuple.lowPort = fromLow ? sourcePort : destPort;
+    tuple.highPort = fromLow ? destPort : sourcePort;
+    tuple.ipProtocol = protocol;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = flows.find(tuple);
+    if (it == flows.end()) {
+        // Без сигнатур потоки не заводятся; поток берётся с SYN или с первых данных
+        if (!signatures || signatures->Size() == 0) return UNKNOWN_SERVICE;
+        if (finished || (payloadSize == 0 && !syn)) return UNKNOWN_SERVICE;
+        if (flows.size() >= MAX_FLOWS) EvictLocked();
+        it = flows.emplace(tuple, FlowState()).first;
+        it->second.order = nextOrder++;
+        insertionOrder.push_back({ it->second.order, tuple });
+        if (insertionOrder.size() > 2 * flows.size() + 1024) CompactOrderLocked();
+        ++stats.flows;
+    }
+
+    FlowState& flow = it->second;
+    if (flow.pending) {
+        SideState& side = flow.sides[fromLow ? 0 : 1];
+        if (syn) {
+            // Первый байт данных идёт за SYN; клиент — отправитель SYN без ACK
+            side.seqKnown = true;
+            side.nextSeq = seq + 1;
+            if (!ack) {
+                flow.clientKnown = true;
+                flow.clientIsLow = fromLow;
+            }
+        }
+        else if (payloadSize > 0) {
+            if (!flow.clientKnown) {
+                flow.clientKnown = true;
+                flow.clientIsLow = fromLow;
+            }
+            Inspect(flow, fromLow, tcp, seq, payload, payloadSize);
+        }
+    }
+
+    ServiceId service = flow.service;
+    if (finished) flows.erase(it);
+    return service;
+}
+
+void ServiceClassifier::Inspect(FlowState& flow, bool fromLow, bool tcp, uint32_t seq,
+    const uint8_t* payload, size_t size) {
+    SideState& side = flow.sides[fromLow ? 0 : 1];
+    if (tcp && !side.done) {
+        if (!side.seqKnown) {
+            side.seqKnown = true;
+            side.nextSeq = seq;
+        }
+        int32_t behind = static_cast<int32_t>(side.nextSeq - seq);
+        if (behind < 0) {
+            side.done = true;               // потерян сегмент: смещения дальше неизвестны
+        }
+        else if (static_cast<size_t>(behind) < size) {
+            payload += behind;              // повтор с новым хвостом
+            size -= behind;
+            side.nextSeq += static_cast<uint32_t>(size);
+        }
+        else {
+            size = 0;                       // повтор
+        }
+    }
+
+    const SignatureSet& set = *signatures;
+    size_t window = (std::min)(INSPECT_BYTES, set.MaxPatternEnd());
+    if (!side.done && size > 0 && side.scanned < window) {
+        // В TCP смещение считается от начала потока стороны, в UDP — от начала датаграммы
+        size_t base = tcp ? side.scanned : 0;
+        SignatureSet::State state = tcp ? side.state : SignatureSet::START;
+        size_t take = (std::min)(size, window - side.scanned);
+        bool isClient = flow.clientIsLow == fromLow;
+        const ServiceSignature* best = nullptr;
+        for (size_t i = 0; i < take; ++i) {
+            state = set.Step(state, payload[i]);
+            auto range = set.Matches(state);
+            for (const uint32_t* m = range.first; m != range.second; ++m) {
+                const ServiceSignature& candidate = set.Signature(*m);
+                if (candidate.side != ServiceSignature::Side::Any
+                    && (candidate.side == ServiceSignature::Side::Client) != isClient) {
+                    continue;
+                }
+                size_t end = base + i + 1;
+                if (candidate.offset >= 0 && end != static_cast<size_t>(candidate.offset) + candidate.pattern.size()) {
+                    continue;
+                }
+                // Из совпадений одного пакета выбирается самое длинное: "GET /announce" точнее "GET "
+                if (!best || candidate.pattern.size() > best->pattern.size()) best = &candidate;
+                break;  // в состоянии сигнатуры упорядочены по длине
+            }
+        }
+        side.state = state;
+        side.scanned += static_cast<uint32_t>(take);
+        stats.inspectedBytes += take;
+        if (best) {
+            FinishLocked(flow, best->service);
+            return;
+        }
+        if (side.scanned >= window) side.done = true;
+    }
+    if ((flow.sides[0].done && flow.sides[1].done) || ++flow.packets >= MAX_PACKETS) {
+        FinishLocked(flow, UNKNOWN_SERVICE);
+    }
+}
+
+void ServiceClassifier::FinishLocked(FlowState& flow, ServiceId service) {
+    flow.pending = false;
+    flow.service = service;
+    if (service == UNKNOWN_SERVICE) {
+        ++stats.unlabelled;
+    }
+    else {
+        ++stats.labelled;
+        ++serviceCounts[service];
+    }
+}
+
+// Таблица полна: вытесняется самый старый поток; записи, удалённые по FIN/RST, пропускаются
+void ServiceClassifier::EvictLocked() {
+    while (!insertionOrder.empty()) {
+        std::pair<uint64_t, FlowTuple> oldest = insertionOrder.front();
+        insertionOrder.pop_front();
+        auto it = flows.find(oldest.second);
+        if (it != flows.end() && it->second.order == oldest.first) {
+            flows.erase(it);
+            return;
+        }
+    }
+}
+
+void ServiceClassifier::CompactOrderLocked() {
+    std::deque<std::pair<uint64_t, FlowTuple>> live;
+    for (const auto& item : insertionOrder) {
+        auto it = flows.find(item.second);
+        if (it != flows.end() && it->second.order == item.first) live.push_back(item);
+    }
+    insertionOrder.swap(live);
+}
+
+size_t ServiceClassifier::Size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return flows.size();
+}
+
+ServiceClassifier::Stats ServiceClassifier::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+std::vector<std::pair<ServiceId, uint64_t>> ServiceClassifier::ServiceCounts() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::pair<ServiceId, uint64_t>> counts(serviceCounts.begin(), serviceCounts.end());
+    std::sort(counts.begin(), counts.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+    return counts;
+}
+
+void ServiceClassifier::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    flows.clear();
+    insertionOrder.clear();
+    stats = Stats();
+    serviceCounts.clear();
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "service_names.h"
+
+// Сигнатура содержимого: байтовая строка в начале потока одной из сторон
+struct ServiceSignature {
+    enum class Side : uint8_t { Any, Client, Server };
+
+    ServiceId service = UNKNOWN_SERVICE;
+    std::string pattern;
+    int offset = -1;            // смещение начала в потоке стороны; -1 — любое в пределах окна
+    Side side = Side::Any;
+};
+
+// Набор сигнатур, собранный в автомат Ахо-Корасик: за один проход по байтам находятся
+// все сигнатуры сразу, стоимость не зависит от их числа. Автомат — полная таблица переходов
+// по классам байтов (байты, не встречающиеся в шаблонах, делят один класс).
+//
+// Формат файла: строка на сигнатуру, '#' — комментарий
+//   служба  смещение|*  any|client|server  шаблон
+// Шаблон — строка в кавычках (\xHH, \r, \n, \t, \\, \") или байты в hex через пробел:
+//   ssh        0  any     "SSH-"
+//   smb        4  client  ff 53 4d 42
+class SignatureSet {
+public:
+    using State = uint32_t;
+    static constexpr State START = 0;
+
+    // Разбор текста; при ошибке error получает "строка N: причина" и набор не меняется
+    bool Parse(std::istream& in, std::string& error);
+    bool LoadFile(const std::string& path, std::string& error);
+    void Add(const ServiceSignature& signature);
+    // Строит автомат; вызывается после Add/Parse и до Step
+    void Build();
+
+    State Step(State state, uint8_t byte) const {
+        return next[static_cast<size_t>(state) * classCount + byteClass[byte]];
+    }
+    // Сигнатуры, оканчивающиеся в состоянии (включая найденные по суффиксным ссылкам)
+    std::pair<const uint32_t*, const uint32_t*> Matches(State state) const {
+        return { outputs.data() + outputStart[state], outputs.data() + outputStart[state + 1] };
+    }
+    const ServiceSignature& Signature(uint32_t index) const { return signatures[index]; }
+
+    size_t Size() const { return signatures.size(); }
+    size_t StateCount() const { return outputStart.empty() ? 0 : outputStart.size() - 1; }
+    size_t MaxPatternEnd() const { return maxPatternEnd; }
+
+private:
+    std::vector<ServiceSignature> signatures;
+    std::array<uint8_t, 256> byteClass{};
+    size_t classCount = 1;
+    std::vector<State> next;                // StateCount() * classCount
+    std::vector<uint32_t> outputStart;      // StateCount() + 1
+    std::vector<uint32_t> outputs;          // индексы сигнатур; внутри состояния — длинные раньше
+    size_t maxPatternEnd = 0;               // дальше этого смещения привязанные сигнатуры не найти
+};
+
+// Служба потока по первым байтам содержимого обеих сторон. Каждый поток просматривается
+// до первой сигнатуры или до INSPECT_BYTES на сторону; после этого пакеты потока стоят
+// одного поиска в таблице. Сегменты TCP берутся по порядку seq: повторы пропускаются,
+// разрыв прекращает просмотр стороны.
+class ServiceClassifier {
+public:
+    struct Stats {
+        uint64_t flows = 0;
+        uint64_t labelled = 0;          // опознаны по содержимому
+        uint64_t unlabelled = 0;        // окно исчерпано без совпадения
+        uint64_t inspectedBytes = 0;
+    };
+
+    explicit ServiceClassifier(std::shared_ptr<const SignatureSet> signatures = nullptr);
+
+    // Набор заменяется целиком; уже опознанные потоки сохраняют службу
+    void SetSignatures(std::shared_ptr<const SignatureSet> signatures);
+
+    // Служба потока пакета IPv4 (TCP или UDP); UNKNOWN_SERVICE — содержимое ещё не опознано
+    ServiceId OnIPv4Packet(const uint8_t* packet, size_t size);
+
+    size_t Size() const;
+    Stats GetStats() const;
+    // Число опознанных потоков по службам
+    std::vector<std::pair<ServiceId, uint64_t>> ServiceCounts() const;
+    void Clear();
+
+    static constexpr size_t MAX_FLOWS = 16384;
+    static constexpr size_t INSPECT_BYTES = 512;
+    static constexpr uint8_t MAX_PACKETS = 8;     // пакетов с данными на поток
+
+private:
+    struct FlowTuple {
+        uint32_t lowIp = 0;
+        uint32_t highIp = 0;
+        uint16_t lowPort = 0;
+        uint16_t highPort = 0;
+        uint8_t ipProtocol = 0;
+
+        bool operator==(const FlowTuple& other) const {
+            return lowIp == other.lowIp && highIp == other.highIp && lowPort == other.lowPort
+                && highPort == other.highPort && ipProtocol == other.ipProtocol;
+        }
+    };
+    struct FlowTupleHash {
+        size_t operator()(const FlowTuple& t) const {
+            uint64_t a = (uint64_t(t.lowIp) << 32) | t.highIp;
+            uint64_t b = (uint64_t(t.lowPort) << 24) | (uint64_t(t.highPort) << 8) | t.ipProtocol;
+            return std::hash<uint64_t>()(a * 0x9E3779B97F4A7C15ull ^ b);
+        }
+    };
+    // Просмотр одной стороны потока
+    struct SideState {
+        SignatureSet::State state = SignatureSet::START;
+        uint32_t scanned = 0;           // байт просмотрено
+        uint32_t nextSeq = 0;
+        bool seqKnown = false;
+        bool done = false;
+    };
+    struct FlowState {
+        ServiceId service = UNKNOWN_SERVICE;
+        bool pending = true;
+        bool clientKnown = false;
+        bool clientIsLow = false;
+        uint8_t packets = 0;
+        SideState sides[2];             // [0] — сторона с меньшим адресом
+        uint64_t order = 0;
+    };
+
+    void Inspect(FlowState& flow, bool fromLow, bool tcp, uint32_t seq, const uint8_t* payload, size_t size);
+    void FinishLocked(FlowState& flow, ServiceId service);
+    void EvictLocked();
+    void CompactOrderLocked();
+
+    mutable std::mutex mutex;
+    std::shared_ptr<const SignatureSet> signatures;
+    std::unordered_map<FlowTuple, FlowState, FlowTupleHash> flows;
+    std::deque<std::pair<uint64_t, FlowTuple>> insertionOrder;
+    uint64_t nextOrder = 0;
+    Stats stats;
+    std::unordered_map<ServiceId, uint64_t> serviceCounts;
+};
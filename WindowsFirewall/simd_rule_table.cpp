@@ -0,0 +1,195 @@
+#include "simd_rule_table.h"
+#include "rule_matcher.h"
+#include "cpu_features.h"
+
+static uint32_t LowestBit(uint32_t bits) {
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward(&index, bits);
+    return index;
+#else
+    return static_cast<uint32_t>(__builtin_ctz(bits));
+#endif
+}
+
+static uint32_t MatchBlockScalar(const SimdRuleTable::Columns& c, size_t row, const SimdRuleTable::FlowLanes& f) {
+    uint32_t bits = 0;
+    for (size_t lane = 0; lane < SimdRuleTable::LANES; ++lane) {
+        size_t r = row + lane;
+        bool match = (f.protocol & c.protocolMask[r]) == c.protocol[r]
+            && (f.service & c.serviceMask[r]) == c.service[r]
+            && (f.source & c.sourceMask[r]) == c.sourceNet[r]
+            && (f.dest & c.destMask[r]) == c.destNet[r]
+            && f.sourcePort >= c.sourcePortLow[r] && f.sourcePort <= c.sourcePortHigh[r]
+            && f.destPort >= c.destPortLow[r] && f.destPort <= c.destPortHigh[r]
+            && (f.ipv6 & c.ipv4Only[r]) == 0;
+        bits |= static_cast<uint32_t>(match) << lane;
+    }
+    return bits;
+}
+
+#ifdef FIREWALL_X86
+// Порты меньше 65536 и в знаковом сравнении 32-битных полос ведут себя как беззнаковые
+static uint32_t MatchBlockSse2(const SimdRuleTable::Columns& c, size_t row, const SimdRuleTable::FlowLanes& f) {
+    const __m128i protocol = _mm_set1_epi32(static_cast<int>(f.protocol));
+    const __m128i service = _mm_set1_epi32(static_cast<int>(f.service));
+    const __m128i source = _mm_set1_epi32(static_cast<int>(f.source));
+    const __m128i dest = _mm_set1_epi32(static_cast<int>(f.dest));
+    const __m128i sourcePort = _mm_set1_epi32(static_cast<int>(f.sourcePort));
+    const __m128i destPort = _mm_set1_epi32(static_cast<int>(f.destPort));
+    const __m128i ipv6 = _mm_set1_epi32(static_cast<int>(f.ipv6));
+    uint32_t bits = 0;
+    for (size_t half = 0; half < SimdRuleTable::LANES; half += 4) {
+        size_t r = row + half;
+#define SIMD_RULES_LOAD(column) _mm_loadu_si128(reinterpret_cast<const __m128i*>(c.column.data() + r))
+        __m128i m = _mm_cmpeq_epi32(_mm_and_si128(protocol, SIMD_RULES_LOAD(protocolMask)), SIMD_RULES_LOAD(protocol));
+        m = _mm_and_si128(m, _mm_cmpeq_epi32(_mm_and_si128(service, SIMD_RULES_LOAD(serviceMask)), SIMD_RULES_LOAD(service)));
+        m = _mm_and_si128(m, _mm_cmpeq_epi32(_mm_and_si128(source, SIMD_RULES_LOAD(sourceMask)), SIMD_RULES_LOAD(sourceNet)));
+        m = _mm_and_si128(m, _mm_cmpeq_epi32(_mm_and_si128(dest, SIMD_RULES_LOAD(destMask)), SIMD_RULES_LOAD(destNet)));
+        m = _mm_andnot_si128(_mm_cmpgt_epi32(SIMD_RULES_LOAD(sourcePortLow), sourcePort), m);
+        m = _mm_andnot_si128(_mm_cmpgt_epi32(sourcePort, SIMD_RULES_LOAD(sourcePortHigh)), m);
+        m = _mm_andnot_si128(_mm_cmpgt_epi32(SIMD_RULES_LOAD(destPortLow), destPort), m);
+        m = _mm_andnot_si128(_mm_cmpgt_epi32(destPort, SIMD_RULES_LOAD(destPortHigh)), m);
+        m = _mm_andnot_si128(_mm_and_si128(ipv6, SIMD_RULES_LOAD(ipv4Only)), m);
+#undef SIMD_RULES_LOAD
+        bits |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(m))) << half;
+    }
+    return bits;
+}
+
+TARGET_AVX2 static uint32_t MatchBlockAvx2(const SimdRuleTable::Columns& c, size_t row, const SimdRuleTable::FlowLanes& f) {
+#define SIMD_RULES_LOAD(column) _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.column.data() + row))
+    __m256i m = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(f.protocol)), SIMD_RULES_LOAD(protocolMask)),
+        SIMD_RULES_LOAD(protocol));
+    m = _mm256_and_si256(m, _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(f.service)),
+        SIMD_RULES_LOAD(serviceMask)), SIMD_RULES_LOAD(service)));
+    m = _mm256_and_si256(m, _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(f.source)),
+        SIMD_RULES_LOAD(sourceMask)), SIMD_RULES_LOAD(sourceNet)));
+    m = _mm256_and_si256(m, _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(f.dest)),
+        SIMD_RULES_LOAD(destMask)), SIMD_RULES_LOAD(destNet)));
+    const __m256i sourcePort = _mm256_set1_epi32(static_cast<int>(f.sourcePort));
+    const __m256i destPort = _mm256_set1_epi32(static_cast<int>(f.destPort));
+    m = _mm256_andnot_si256(_mm256_cmpgt_epi32(SIMD_RULES_LOAD(sourcePortLow), sourcePort), m);
+    m = _mm256_andnot_si256(_mm256_cmpgt_epi32(sourcePort, SIMD_RULES_LOAD(sourcePortHigh)), m);
+    m = _mm256_andnot_si256(_mm256_cmpgt_epi32(SIMD_RULES_LOAD(destPortLow), destPort), m);
+    m = _mm256_andnot_si256(_mm256_cmpgt_epi32(destPort, SIMD_RULES_LOAD(destPortHigh)), m);
+    m = _mm256_andnot_si256(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(f.ipv6)), SIMD_RULES_LOAD(ipv4Only)), m);
+#undef SIMD_RULES_LOAD
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+}
+#endif
+
+SimdRuleTable::Kernel SimdRuleTable::BestKernel() {
+#ifdef FIREWALL_X86
+    static const Kernel best = CpuHasAvx2() ? Kernel::Avx2 : Kernel::Sse2;
+    return best;
+#else
+    return Kernel::Scalar;
+#endif
+}
+
+const char* SimdRuleTable::KernelName(Kernel kernel) {
+    switch (kernel) {
+    case Kernel::Avx2: return "AVX2";
+    case Kernel::Sse2: return "SSE2";
+    default: return "scalar";
+    }
+}
+
+bool SimdRuleTable::SetKernel(Kernel wanted) {
+    if (static_cast<int>(wanted) > static_cast<int>(BestKernel())) return false;
+    kernel = wanted;
+    switch (kernel) {
+#ifdef FIREWALL_X86
+    case Kernel::Avx2: block = &MatchBlockAvx2; break;
+    case Kernel::Sse2: block = &MatchBlockSse2; break;
+#endif
+    default: block = &MatchBlockScalar; break;
+    }
+    return true;
+}
+
+static void Hull(const std::vector<PortRange>& ranges, uint32_t& low, uint32_t& high) {
+    low = 0;
+    high = 65535;
+    if (ranges.empty()) return;
+    low = ranges.front().low;
+    high = ranges.front().high;
+    for (const auto& r : ranges) {
+        if (r.low < low) low = r.low;
+        if (r.high > high) high = r.high;
+    }
+}
+
+void SimdRuleTable::Append(const CompiledRule& rule, uint32_t index) {
+    Columns& c = columns;
+    c.protocol.push_back(rule.ipProtocol);
+    c.protocolMask.push_back(rule.ipProtocol ? 0xFFFFFFFFu : 0);
+    c.service.push_back(rule.service);
+    c.serviceMask.push_back(rule.service != UNKNOWN_SERVICE ? 0xFFFFFFFFu : 0);
+    c.sourceNet.push_back(rule.source.any ? 0 : rule.source.network);
+    c.sourceMask.push_back(rule.source.any ? 0 : rule.source.mask);
+    c.destNet.push_back(rule.dest.any ? 0 : rule.dest.network);
+    c.destMask.push_back(rule.dest.any ? 0 : rule.dest.mask);
+    uint32_t low = 0;
+    uint32_t high = 0;
+    Hull(rule.sourcePorts, low, high);
+    c.sourcePortLow.push_back(low);
+    c.sourcePortHigh.push_back(high);
+    Hull(rule.destPorts, low, high);
+    c.destPortLow.push_back(low);
+    c.destPortHigh.push_back(high);
+    c.ipv4Only.push_back(rule.source.any && rule.dest.any ? 0 : 0xFFFFFFFFu);
+    rows.push_back(index);
+    verify.push_back(rule.sourcePorts.size() > 1 || rule.destPorts.size() > 1);
+}
+
+void SimdRuleTable::Build(const std::vector<CompiledRule>& rules, const std::vector<uint32_t>& indices) {
+    Clear();
+    for (uint32_t index : indices) Append(rules[index], index);
+    rowCount = rows.size();
+    // Дополнение: протокол 0x100 не совпадает ни с одним пакетом
+    CompiledRule never;
+    while (rows.size() % LANES != 0) {
+        Append(never, UINT32_MAX);
+        columns.protocol.back() = 0x100;
+        columns.protocolMask.back() = 0xFFFFFFFFu;
+    }
+    // Перестройка после правки правила не сбрасывает выбранное ядро
+    SetKernel(static_cast<int>(kernel) > static_cast<int>(BestKernel()) ? BestKernel() : kernel);
+}
+
+void SimdRuleTable::Clear() {
+    columns = Columns();
+    rows.clear();
+    verify.clear();
+    rowCount = 0;
+}
+
+uint32_t SimdRuleTable::Find(const CompiledRule* rules, const FlowKey& flow, bool checkApp, uint32_t limit,
+    size_t& tested) const {
+    FlowLanes lanes;
+    lanes.protocol = flow.ipProtocol;
+    lanes.service = flow.service;
+    lanes.source = flow.ipv6 ? 0 : flow.sourceIp;
+    lanes.dest = flow.ipv6 ? 0 : flow.destIp;
+    lanes.sourcePort = flow.sourcePort;
+    lanes.destPort = flow.destPort;
+    lanes.ipv6 = flow.ipv6 ? 0xFFFFFFFFu : 0;
+    for (size_t row = 0; row < rows.size(); row += LANES) {
+        if (rows[row] >= limit) break;
+        tested += LANES;
+        uint32_t bits = block(columns, row, lanes);
+        while (bits) {
+            size_t r = row + LowestBit(bits);
+            bits &= bits - 1;
+            uint32_t index = rows[r];
+            if (index >= limit) return limit;
+            const CompiledRule& rule = rules[index];
+            if (verify[r] && !RuleMatcher::MatchesTuple(rule, flow)) continue;
+            if (checkApp && !rule.app.Matches(flow.app)) continue;
+            return index;
+        }
+    }
+    return limit;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct CompiledRule;
+struct FlowKey;
+
+// Правила по столбцам (протокол, служба, адреса с масками, границы портов) для просмотра
+// подряд по 8 правил за раз: AVX2 — одним сравнением на столбец, SSE2 — двумя, без векторных
+// инструкций — по одному. Совпавшие строки дают битовую маску, первое правило — младший бит.
+// Правило с несколькими диапазонами портов хранится охватывающим диапазоном и после маски
+// проверяется целиком. Поддерживаются те же правила, что и FieldMaskIndex::Supports.
+class SimdRuleTable {
+public:
+    enum class Kernel { Scalar, Sse2, Avx2 };
+    // Лучшее ядро, которое есть у процессора (определяется один раз)
+    static Kernel BestKernel();
+    static const char* KernelName(Kernel kernel);
+
+    // indices — по возрастанию; ядро остаётся выбранным в SetKernel (по умолчанию BestKernel())
+    void Build(const std::vector<CompiledRule>& rules, const std::vector<uint32_t>& indices);
+    void Clear();
+    // Ядро не лучше BestKernel(); false — процессор его не поддерживает
+    bool SetKernel(Kernel kernel);
+    Kernel GetKernel() const { return kernel; }
+    size_t Size() const { return rowCount; }
+
+    // Самый ранний индекс подходящего правила меньше limit, иначе limit; tested += просмотрено строк
+    uint32_t Find(const CompiledRule* rules, const FlowKey& flow, bool checkApp, uint32_t limit, size_t& tested) const;
+
+    static constexpr size_t LANES = 8;
+
+    // Значения пакета, размноженные по полосам
+    struct FlowLanes {
+        uint32_t protocol;
+        uint32_t service;
+        uint32_t source;
+        uint32_t dest;
+        uint32_t sourcePort;
+        uint32_t destPort;
+        uint32_t ipv6;      // 0xFFFFFFFF для IPv6
+    };
+    // Столбцы, дополненные до кратного LANES никогда не совпадающими строками
+    struct Columns {
+        std::vector<uint32_t> protocol, protocolMask;
+        std::vector<uint32_t> service, serviceMask;
+        std::vector<uint32_t> sourceNet, sourceMask, destNet, destMask;
+        std::vector<uint32_t> sourcePortLow, sourcePortHigh, destPortLow, destPortHigh;
+        std::vector<uint32_t> ipv4Only;     // 0xFFFFFFFF — у правила есть подсеть IPv4
+    };
+    // Биты совпавших строк блока [row, row + LANES)
+    using BlockFn = uint32_t (*)(const Columns& columns, size_t row, const FlowLanes& flow);
+
+private:
+    void Append(const CompiledRule& rule, uint32_t index);
+
+    Columns columns;
+    std::vector<uint32_t> rows;         // индекс в compiled; у дополнения — UINT32_MAX
+    std::vector<uint8_t> verify;        // 1 — строка совпала по охвату, нужна полная проверка
+    size_t rowCount = 0;
+    Kernel kernel = BestKernel();
+    BlockFn block = nullptr;
+};
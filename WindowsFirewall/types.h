@@ -20,11 +20,6 @@ enum class ProtocolFilter
     UDP
 };
 
-enum class FilterMode {
-    BLACKLIST,  //   
-    WHITELIST   //    
-};
-
 struct AppSettings
 {
     ProtocolFilter protocolFilter = ProtocolFilter::All;
@@ -150,6 +145,8 @@ struct PacketInfo {
     std::string time;
     std::string sourceDomain;
     std::string destDomain;
+    std::string serverName;     // SNI  Host  TCP;   
+    bool serverIsSource;        //     (  )
     std::string adapterIp;
     bool isBlocked;      
     std::string blockReason; 
@@ -158,9 +155,28 @@ struct PacketInfo {
     uint32_t  processId;
     uint16_t destPort;
     PacketDirection direction;
+    uint32_t appId;      // AppIdentityTable, 0 = 
+    std::string service;        //      ;   
+    uint16_t serviceId;         // ServiceNames, 0 = 
+    // ICMP/ICMPv6:      ,      
+    uint8_t icmpType;
+    uint8_t icmpCode;
+    uint8_t relatedProtocol;    //  ICMP:   ; 0   
+    std::string relatedSourceIp;    //  ICMP:   
+    std::string relatedDestIp;
+    uint8_t tcpFlags;           // TCP_FLAG_*  flow_key.h
+    bool badChecksum;           //   IPv4   ;    
 
     PacketInfo() :
+        serverIsSource(false),
+        icmpType(0),
+        icmpCode(0),
+        relatedProtocol(0),
+        tcpFlags(0),
+        badChecksum(false),
         processId(0),
+        appId(0),
+        serviceId(0),
         size(0),
         sourcePort(0),
         destPort(0),
@@ -179,6 +195,8 @@ struct GroupedPacketInfo {
     std::string time;
     std::string sourceDomain;
     std::string destDomain;
+    std::string serverName;
+    std::string service;
     uint32_t processId;
     uint16_t sourcePort;
     uint16_t destPort;
@@ -2,6 +2,7 @@
 #include "string_utils.h"
 #include <sstream>
 #include "resource.h"
+#include "domain_table.h"
 
 bool RuleValidator::ValidatePortInput(const std::wstring& input, std::vector<std::pair<int, int>>& portRanges) {
     std::wstring port = input;
@@ -52,6 +53,13 @@ bool RuleValidator::ValidateIpInput(const std::wstring& input, std::vector<std::
     parts.push_back(ip);
 
     for (const auto& part : parts) {
+        //     "*.example.com" (  :    '-')
+        std::string name = WideToUtf8(part.c_str());
+        if (DomainTrie::IsDomainPattern(name)) {
+            ipRanges.push_back({ name, name });
+            continue;
+        }
+
         //   CIDR 
         if (part.find(L'/') != std::wstring::npos) {
             // TODO:   CIDR
@@ -37,6 +37,7 @@ UINT8 WfpFilterManager::ProtocolToNumber(Protocol proto) {
     case Protocol::TCP: return 6;
     case Protocol::UDP: return 17;
     case Protocol::ICMP: return 1;
+    case Protocol::ICMPV6: return 58;
     default: return 0; // ANY
     }
 }